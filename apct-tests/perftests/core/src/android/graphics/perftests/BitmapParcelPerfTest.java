@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package android.graphics.perftests;
+
+import android.graphics.Bitmap;
+import android.graphics.Canvas;
+import android.graphics.Color;
+import android.graphics.Paint;
+import android.os.Parcel;
+import android.perftests.utils.BenchmarkState;
+import android.perftests.utils.PerfStatusReporter;
+import android.support.test.filters.LargeTest;
+
+import org.junit.Rule;
+import org.junit.Test;
+
+@LargeTest
+public class BitmapParcelPerfTest {
+    @Rule
+    public PerfStatusReporter mPerfStatusReporter = new PerfStatusReporter();
+
+    // An icon, a notification's large image, and a full screen.
+    @Test
+    public void testWriteRead_192x192_fds() {
+        writeRead(192, 192, false, true);
+    }
+
+    @Test
+    public void testWriteRead_512x512_fds() {
+        writeRead(512, 512, false, true);
+    }
+
+    @Test
+    public void testWriteRead_1080x1920_fds() {
+        writeRead(1080, 1920, false, true);
+    }
+
+    @Test
+    public void testWriteRead_1080x1920_mutable_fds() {
+        writeRead(1080, 1920, true, true);
+    }
+
+    @Test
+    public void testWriteRead_192x192_noFds() {
+        writeRead(192, 192, false, false);
+    }
+
+    @Test
+    public void testWriteRead_512x512_noFds() {
+        writeRead(512, 512, false, false);
+    }
+
+    @Test
+    public void testWriteRead_1080x1920_noFds() {
+        writeRead(1080, 1920, false, false);
+    }
+
+    private void writeRead(int width, int height, boolean mutable, boolean allowFds) {
+        Bitmap bitmap = makeBitmap(width, height, mutable);
+        Parcel parcel = Parcel.obtain();
+        BenchmarkState state = mPerfStatusReporter.getBenchmarkState();
+        while (state.keepRunning()) {
+            parcel.setDataPosition(0);
+            parcel.setDataSize(0);
+            boolean restoreFds = parcel.pushAllowFds(allowFds);
+            bitmap.writeToParcel(parcel, 0);
+            parcel.restoreAllowFds(restoreFds);
+            parcel.setDataPosition(0);
+            Bitmap.CREATOR.createFromParcel(parcel).recycle();
+        }
+        parcel.recycle();
+        bitmap.recycle();
+    }
+
+    // Flat areas and gradients, as in typical UI content.
+    private static Bitmap makeBitmap(int width, int height, boolean mutable) {
+        Bitmap bitmap = Bitmap.createBitmap(width, height, Bitmap.Config.ARGB_8888);
+        Canvas canvas = new Canvas(bitmap);
+        canvas.drawColor(Color.WHITE);
+        Paint paint = new Paint(Paint.ANTI_ALIAS_FLAG);
+        for (int i = 0; i < 8; i++) {
+            paint.setColor(Color.HSVToColor(new float[] { i * 45, 0.6f, 0.9f }));
+            canvas.drawCircle(width * (i + 1) / 9f, height / 2f, Math.min(width, height) / 6f,
+                    paint);
+        }
+        return mutable ? bitmap : bitmap.copy(Bitmap.Config.ARGB_8888, false);
+    }
+}
@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package android.graphics.perftests;
+
+import android.graphics.ImageFormat;
+import android.graphics.Rect;
+import android.graphics.YuvImage;
+import android.perftests.utils.BenchmarkState;
+import android.perftests.utils.PerfStatusReporter;
+import android.support.test.filters.LargeTest;
+
+import org.junit.Rule;
+import org.junit.Test;
+
+import java.io.ByteArrayOutputStream;
+
+@LargeTest
+public class YuvImagePerfTest {
+    @Rule
+    public PerfStatusReporter mPerfStatusReporter = new PerfStatusReporter();
+
+    // A 12 MP 4:3 camera frame, and a 4K UHD video frame.
+    private static final int WIDTH_12MP = 4000;
+    private static final int HEIGHT_12MP = 3000;
+    private static final int WIDTH_4K = 3840;
+    private static final int HEIGHT_4K = 2160;
+
+    private static final int QUALITY = 95;
+    private static final int PARALLEL_THREADS = 4;
+
+    @Test
+    public void testCompressNv21_12mp() {
+        compressToJpeg(ImageFormat.NV21, WIDTH_12MP, HEIGHT_12MP, 1);
+    }
+
+    @Test
+    public void testCompressNv21_12mp_parallel() {
+        compressToJpeg(ImageFormat.NV21, WIDTH_12MP, HEIGHT_12MP, PARALLEL_THREADS);
+    }
+
+    @Test
+    public void testCompressNv21_4k() {
+        compressToJpeg(ImageFormat.NV21, WIDTH_4K, HEIGHT_4K, 1);
+    }
+
+    @Test
+    public void testCompressYuy2_12mp() {
+        compressToJpeg(ImageFormat.YUY2, WIDTH_12MP, HEIGHT_12MP, 1);
+    }
+
+    @Test
+    public void testCompressYuy2_12mp_parallel() {
+        compressToJpeg(ImageFormat.YUY2, WIDTH_12MP, HEIGHT_12MP, PARALLEL_THREADS);
+    }
+
+    @Test
+    public void testCompressYuy2_4k() {
+        compressToJpeg(ImageFormat.YUY2, WIDTH_4K, HEIGHT_4K, 1);
+    }
+
+    private void compressToJpeg(int format, int width, int height, int maxThreads) {
+        YuvImage image = new YuvImage(makeFrame(format, width, height), format, width, height,
+                null);
+        Rect rect = new Rect(0, 0, width, height);
+        ByteArrayOutputStream out = new ByteArrayOutputStream(width * height);
+
+        BenchmarkState state = mPerfStatusReporter.getBenchmarkState();
+        while (state.keepRunning()) {
+            out.reset();
+            image.compressToJpeg(rect, QUALITY, out, maxThreads);
+        }
+    }
+
+    // Smooth gradients with some noise, so that the entropy coder does a realistic amount
+    // of work.
+    private static byte[] makeFrame(int format, int width, int height) {
+        int size = format == ImageFormat.NV21 ? width * height * 3 / 2 : width * height * 2;
+        byte[] frame = new byte[size];
+        int seed = 1;
+        for (int i = 0; i < size; i++) {
+            seed = seed * 1103515245 + 12345;
+            frame[i] = (byte) ((i % width) / 16 + ((seed >>> 16) & 15));
+        }
+        return frame;
+    }
+}
@@ -0,0 +1,182 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package android.hardware.camera2;
+
+import android.graphics.Bitmap;
+import android.graphics.Rect;
+import android.hardware.camera2.impl.CameraMetadataNative;
+import android.hardware.camera2.params.BlackLevelPattern;
+import android.hardware.camera2.params.ColorSpaceTransform;
+import android.perftests.utils.BenchmarkState;
+import android.perftests.utils.PerfStatusReporter;
+import android.support.test.InstrumentationRegistry;
+import android.support.test.filters.LargeTest;
+import android.support.test.runner.AndroidJUnit4;
+import android.util.Rational;
+import android.util.Size;
+
+import org.junit.After;
+import org.junit.Before;
+import org.junit.Rule;
+import org.junit.Test;
+import org.junit.runner.RunWith;
+
+import java.io.BufferedOutputStream;
+import java.io.File;
+import java.io.FileOutputStream;
+import java.io.IOException;
+import java.io.OutputStream;
+import java.nio.ByteBuffer;
+
+/**
+ * Measures writing RAW16 DNG files at common sensor sizes.  Each iteration is one file, so
+ * the reported time per iteration is the inverse of the DNG writes per second.
+ */
+@RunWith(AndroidJUnit4.class)
+@LargeTest
+public class DngCreatorPerfTest {
+    @Rule
+    public PerfStatusReporter mPerfStatusReporter = new PerfStatusReporter();
+
+    private static final Size SIZE_8MP = new Size(3264, 2448);
+    private static final Size SIZE_12MP = new Size(4032, 3024);
+    private static final Size SIZE_16MP = new Size(4608, 3456);
+
+    private File mFile;
+
+    @Before
+    public void setUp() {
+        mFile = new File(InstrumentationRegistry.getTargetContext().getCacheDir(),
+                "DngCreatorPerfTest.dng");
+    }
+
+    @After
+    public void tearDown() {
+        mFile.delete();
+    }
+
+    @Test
+    public void testWriteFile_8mp() throws IOException {
+        writeDng(SIZE_8MP, false, false);
+    }
+
+    @Test
+    public void testWriteFile_12mp() throws IOException {
+        writeDng(SIZE_12MP, false, false);
+    }
+
+    @Test
+    public void testWriteFile_16mp() throws IOException {
+        writeDng(SIZE_16MP, false, false);
+    }
+
+    @Test
+    public void testWriteFileWithThumbnail_12mp() throws IOException {
+        writeDng(SIZE_12MP, true, false);
+    }
+
+    @Test
+    public void testWriteStream_12mp() throws IOException {
+        writeDng(SIZE_12MP, false, true);
+    }
+
+    @Test
+    public void testWriteStreamWithThumbnail_12mp() throws IOException {
+        writeDng(SIZE_12MP, true, true);
+    }
+
+    /**
+     * @param throughStream write through a wrapping stream instead of straight to the
+     *        FileOutputStream, so that the file descriptor cannot be used directly.
+     */
+    private void writeDng(Size size, boolean withThumbnail, boolean throughStream)
+            throws IOException {
+        CameraCharacteristics characteristics = makeCharacteristics(size);
+        CaptureResult result = makeResult();
+        ByteBuffer pixels = makePixels(size);
+        Bitmap thumbnail = withThumbnail ? makeThumbnail() : null;
+
+        BenchmarkState state = mPerfStatusReporter.getBenchmarkState();
+        while (state.keepRunning()) {
+            try (DngCreator creator = new DngCreator(characteristics, result);
+                    FileOutputStream file = new FileOutputStream(mFile)) {
+                if (thumbnail != null) {
+                    creator.setThumbnail(thumbnail);
+                }
+                OutputStream out = throughStream ? new BufferedOutputStream(file) : file;
+                creator.writeByteBuffer(out, size, pixels, 0);
+                out.flush();
+            }
+        }
+    }
+
+    private static CameraCharacteristics makeCharacteristics(Size size) {
+        CameraMetadataNative metadata = new CameraMetadataNative();
+        metadata.set(CameraCharacteristics.SENSOR_INFO_TIMESTAMP_SOURCE,
+                CameraCharacteristics.SENSOR_INFO_TIMESTAMP_SOURCE_REALTIME);
+        metadata.set(CameraCharacteristics.SENSOR_INFO_PIXEL_ARRAY_SIZE, size);
+        metadata.set(CameraCharacteristics.SENSOR_INFO_PRE_CORRECTION_ACTIVE_ARRAY_SIZE,
+                new Rect(0, 0, size.getWidth(), size.getHeight()));
+        metadata.set(CameraCharacteristics.SENSOR_INFO_COLOR_FILTER_ARRANGEMENT,
+                CameraCharacteristics.SENSOR_INFO_COLOR_FILTER_ARRANGEMENT_RGGB);
+        metadata.set(CameraCharacteristics.SENSOR_INFO_WHITE_LEVEL, 1023);
+        metadata.set(CameraCharacteristics.SENSOR_BLACK_LEVEL_PATTERN,
+                new BlackLevelPattern(new int[] { 64, 64, 64, 64 }));
+        metadata.set(CameraCharacteristics.SENSOR_REFERENCE_ILLUMINANT1,
+                CameraCharacteristics.SENSOR_REFERENCE_ILLUMINANT1_D65);
+        ColorSpaceTransform identity = new ColorSpaceTransform(new int[] {
+                1, 1, 0, 1, 0, 1,
+                0, 1, 1, 1, 0, 1,
+                0, 1, 0, 1, 1, 1 });
+        metadata.set(CameraCharacteristics.SENSOR_COLOR_TRANSFORM1, identity);
+        metadata.set(CameraCharacteristics.SENSOR_CALIBRATION_TRANSFORM1, identity);
+        metadata.set(CameraCharacteristics.SENSOR_FORWARD_MATRIX1, identity);
+        return new CameraCharacteristics(metadata);
+    }
+
+    private static CaptureResult makeResult() {
+        CameraMetadataNative metadata = new CameraMetadataNative();
+        metadata.set(CaptureResult.SENSOR_EXPOSURE_TIME, 10000000L);
+        metadata.set(CaptureResult.SENSOR_SENSITIVITY, 100);
+        metadata.set(CaptureResult.CONTROL_POST_RAW_SENSITIVITY_BOOST, 100);
+        metadata.set(CaptureResult.LENS_FOCAL_LENGTH, 4.0f);
+        metadata.set(CaptureResult.LENS_APERTURE, 1.8f);
+        metadata.set(CaptureResult.SENSOR_NEUTRAL_COLOR_POINT, new Rational[] {
+                new Rational(1, 2), new Rational(1, 1), new Rational(2, 3) });
+        return new CaptureResult(metadata, /*sequenceId*/0);
+    }
+
+    // A direct buffer, as RAW_SENSOR images from an ImageReader are.
+    private static ByteBuffer makePixels(Size size) {
+        int count = size.getWidth() * size.getHeight();
+        ByteBuffer pixels = ByteBuffer.allocateDirect(count * 2);
+        int seed = 1;
+        for (int i = 0; i < count; i++) {
+            seed = seed * 1103515245 + 12345;
+            pixels.putShort((short) ((seed >>> 16) & 1023));
+        }
+        pixels.rewind();
+        return pixels;
+    }
+
+    private static Bitmap makeThumbnail() {
+        Bitmap thumbnail = Bitmap.createBitmap(DngCreator.MAX_THUMBNAIL_DIMENSION,
+                DngCreator.MAX_THUMBNAIL_DIMENSION * 3 / 4, Bitmap.Config.ARGB_8888);
+        thumbnail.eraseColor(0xFF406080);
+        return thumbnail;
+    }
+}
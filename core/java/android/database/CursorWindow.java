@@ -73,6 +73,12 @@ public class CursorWindow extends SQLiteClosable implements Parcelable {
     private static native String nativeGetString(long windowPtr, int row, int column);
     private static native long nativeGetLong(long windowPtr, int row, int column);
     private static native double nativeGetDouble(long windowPtr, int row, int column);
+    private static native void nativeGetLongs(long windowPtr, int startRow, int numRows,
+            int column, long[] values);
+    private static native void nativeGetDoubles(long windowPtr, int startRow, int numRows,
+            int column, double[] values);
+    private static native char[] nativeGetStrings(long windowPtr, int startRow, int numRows,
+            int column, int[] lengths);
     private static native void nativeCopyStringToBuffer(long windowPtr, int row, int column,
             CharArrayBuffer buffer);
 
@@ -546,6 +552,90 @@ public class CursorWindow extends SQLiteClosable implements Parcelable {
         }
     }
 
+    /**
+     * Gets the values of a column for a range of rows as <code>long</code>s, converting
+     * each field as {@link #getLong} does. This crosses into native code once for the
+     * whole range instead of once per row.
+     *
+     * @param startRow The zero-based index of the first row.
+     * @param numRows The number of rows to read.
+     * @param column The zero-based column index.
+     * @param values The array that receives the values, at least <code>numRows</code> long.
+     * @hide
+     */
+    public void getLongs(int startRow, int numRows, int column, long[] values) {
+        checkRowRange(numRows, values.length);
+        acquireReference();
+        try {
+            nativeGetLongs(mWindowPtr, startRow - mStartPos, numRows, column, values);
+        } finally {
+            releaseReference();
+        }
+    }
+
+    /**
+     * Gets the values of a column for a range of rows as <code>double</code>s, converting
+     * each field as {@link #getDouble} does. This crosses into native code once for the
+     * whole range instead of once per row.
+     *
+     * @param startRow The zero-based index of the first row.
+     * @param numRows The number of rows to read.
+     * @param column The zero-based column index.
+     * @param values The array that receives the values, at least <code>numRows</code> long.
+     * @hide
+     */
+    public void getDoubles(int startRow, int numRows, int column, double[] values) {
+        checkRowRange(numRows, values.length);
+        acquireReference();
+        try {
+            nativeGetDoubles(mWindowPtr, startRow - mStartPos, numRows, column, values);
+        } finally {
+            releaseReference();
+        }
+    }
+
+    /**
+     * Gets the values of a column for a range of rows as strings, converting each field
+     * as {@link #getString} does. The strings cross from native code packed into a single
+     * buffer instead of one call per row.
+     *
+     * @param startRow The zero-based index of the first row.
+     * @param numRows The number of rows to read.
+     * @param column The zero-based column index.
+     * @return The values, with <code>null</code> for null fields.
+     * @hide
+     */
+    public String[] getStrings(int startRow, int numRows, int column) {
+        if (numRows < 0) {
+            throw new IllegalArgumentException("Invalid row count " + numRows);
+        }
+        final int[] lengths = new int[numRows];
+        final char[] chars;
+        acquireReference();
+        try {
+            chars = nativeGetStrings(mWindowPtr, startRow - mStartPos, numRows, column, lengths);
+        } finally {
+            releaseReference();
+        }
+
+        final String[] values = new String[numRows];
+        int offset = 0;
+        for (int i = 0; i < numRows; i++) {
+            if (lengths[i] >= 0) {
+                values[i] = new String(chars, offset, lengths[i]);
+                offset += lengths[i];
+            }
+        }
+        return values;
+    }
+
+    private static void checkRowRange(int numRows, int capacity) {
+        if (numRows < 0 || numRows > capacity) {
+            throw new IllegalArgumentException("Invalid row count " + numRows
+                    + " for a capacity of " + capacity);
+        }
+    }
+
     /**
      * Gets the value of the field at the specified row and column index as a
      * <code>short</code>.
@@ -20,7 +20,6 @@ import android.annotation.IntRange;
 import android.annotation.NonNull;
 import android.annotation.Nullable;
 import android.graphics.Bitmap;
-import android.graphics.Color;
 import android.graphics.ImageFormat;
 import android.hardware.camera2.impl.CameraMetadataNative;
 import android.location.Location;
@@ -30,6 +29,8 @@ import android.os.SystemClock;
 import android.util.Log;
 import android.util.Size;
 
+import java.io.FileDescriptor;
+import java.io.FileOutputStream;
 import java.io.IOException;
 import java.io.InputStream;
 import java.io.OutputStream;
@@ -198,8 +199,9 @@ public final class DngCreator implements AutoCloseable {
                     MAX_THUMBNAIL_DIMENSION);
         }
 
-        ByteBuffer rgbBuffer = convertToRGB(pixels);
-        nativeSetThumbnail(rgbBuffer, width, height);
+        int[] colors = new int[width * height];
+        pixels.getPixels(colors, /*offset*/0, /*stride*/width, /*x*/0, /*y*/0, width, height);
+        nativeSetThumbnailColors(colors, width, height);
 
         return this;
     }
@@ -239,8 +241,16 @@ public final class DngCreator implements AutoCloseable {
                     MAX_THUMBNAIL_DIMENSION);
         }
 
-        ByteBuffer rgbBuffer = convertToRGB(pixels);
-        nativeSetThumbnail(rgbBuffer, width, height);
+        Image.Plane[] planes = pixels.getPlanes();
+        ByteBuffer[] planeBuffers = new ByteBuffer[planes.length];
+        int[] rowStrides = new int[planes.length];
+        int[] pixelStrides = new int[planes.length];
+        for (int i = 0; i < planes.length; i++) {
+            planeBuffers[i] = planes[i].getBuffer();
+            rowStrides[i] = planes[i].getRowStride();
+            pixelStrides[i] = planes[i].getPixelStride();
+        }
+        nativeSetThumbnailYuv(planeBuffers, rowStrides, pixelStrides, width, height);
 
         return this;
     }
@@ -350,7 +360,8 @@ public final class DngCreator implements AutoCloseable {
             throw new IllegalArgumentException("Size with invalid width, height: (" + width + "," +
                     height + ") passed to writeInputStream");
         }
-        nativeWriteInputStream(dngOutput, pixels, width, height, offset);
+        nativeWriteInputStream(dngOutput, getFileDescriptor(dngOutput), pixels, width, height,
+                offset);
     }
 
     /**
@@ -481,7 +492,6 @@ public final class DngCreator implements AutoCloseable {
     }
 
     private static final int DEFAULT_PIXEL_STRIDE = 2; // bytes per sample
-    private static final int BYTES_PER_RGB_PIX = 3; // byts per pixel
 
     // TIFF tag values needed to map between public API and TIFF spec
     private static final int TAG_ORIENTATION_UNKNOWN = 9;
@@ -507,123 +517,21 @@ public final class DngCreator implements AutoCloseable {
                     minRowStride + " is too large, expecting " + rowStride);
         }
         pixels.clear(); // Reset mark and limit
-        nativeWriteImage(dngOutput, width, height, pixels, rowStride, pixelStride, offset,
-                pixels.isDirect());
+        nativeWriteImage(dngOutput, getFileDescriptor(dngOutput), width, height, pixels,
+                rowStride, pixelStride, offset, pixels.isDirect());
         pixels.clear();
     }
 
     /**
-     * Convert a single YUV pixel to RGB.
-     */
-    private static void yuvToRgb(byte[] yuvData, int outOffset, /*out*/byte[] rgbOut) {
-        final int COLOR_MAX = 255;
-
-        float y = yuvData[0] & 0xFF;  // Y channel
-        float cb = yuvData[1] & 0xFF; // U channel
-        float cr = yuvData[2] & 0xFF; // V channel
-
-        // convert YUV -> RGB (from JFIF's "Conversion to and from RGB" section)
-        float r = y + 1.402f * (cr - 128);
-        float g = y - 0.34414f * (cb - 128) - 0.71414f * (cr - 128);
-        float b = y + 1.772f * (cb - 128);
-
-        // clamp to [0,255]
-        rgbOut[outOffset] = (byte) Math.max(0, Math.min(COLOR_MAX, r));
-        rgbOut[outOffset + 1] = (byte) Math.max(0, Math.min(COLOR_MAX, g));
-        rgbOut[outOffset + 2] = (byte) Math.max(0, Math.min(COLOR_MAX, b));
-    }
-
-    /**
-     * Convert a single {@link Color} pixel to RGB.
-     */
-    private static void colorToRgb(int color, int outOffset, /*out*/byte[] rgbOut) {
-        rgbOut[outOffset] = (byte) Color.red(color);
-        rgbOut[outOffset + 1] = (byte) Color.green(color);
-        rgbOut[outOffset + 2] = (byte) Color.blue(color);
-        // Discards Alpha
-    }
-
-    /**
-     * Generate a direct RGB {@link ByteBuffer} from a YUV420_888 {@link Image}.
+     * Returns the file descriptor to write the DNG to directly, without going through
+     * {@code dngOutput}, or null if it has to be written through the stream.  Only a plain
+     * {@link FileOutputStream} is bypassed, as subclasses may change what is written.
      */
-    private static ByteBuffer convertToRGB(Image yuvImage) {
-        // TODO: Optimize this with renderscript intrinsic.
-        int width = yuvImage.getWidth();
-        int height = yuvImage.getHeight();
-        ByteBuffer buf = ByteBuffer.allocateDirect(BYTES_PER_RGB_PIX * width * height);
-
-        Image.Plane yPlane = yuvImage.getPlanes()[0];
-        Image.Plane uPlane = yuvImage.getPlanes()[1];
-        Image.Plane vPlane = yuvImage.getPlanes()[2];
-
-        ByteBuffer yBuf = yPlane.getBuffer();
-        ByteBuffer uBuf = uPlane.getBuffer();
-        ByteBuffer vBuf = vPlane.getBuffer();
-
-        yBuf.rewind();
-        uBuf.rewind();
-        vBuf.rewind();
-
-        int yRowStride = yPlane.getRowStride();
-        int vRowStride = vPlane.getRowStride();
-        int uRowStride = uPlane.getRowStride();
-
-        int yPixStride = yPlane.getPixelStride();
-        int vPixStride = vPlane.getPixelStride();
-        int uPixStride = uPlane.getPixelStride();
-
-        byte[] yuvPixel = { 0, 0, 0 };
-        byte[] yFullRow = new byte[yPixStride * (width - 1) + 1];
-        byte[] uFullRow = new byte[uPixStride * (width / 2 - 1) + 1];
-        byte[] vFullRow = new byte[vPixStride * (width / 2 - 1) + 1];
-        byte[] finalRow = new byte[BYTES_PER_RGB_PIX * width];
-        for (int i = 0; i < height; i++) {
-            int halfH = i / 2;
-            yBuf.position(yRowStride * i);
-            yBuf.get(yFullRow);
-            uBuf.position(uRowStride * halfH);
-            uBuf.get(uFullRow);
-            vBuf.position(vRowStride * halfH);
-            vBuf.get(vFullRow);
-            for (int j = 0; j < width; j++) {
-                int halfW = j / 2;
-                yuvPixel[0] = yFullRow[yPixStride * j];
-                yuvPixel[1] = uFullRow[uPixStride * halfW];
-                yuvPixel[2] = vFullRow[vPixStride * halfW];
-                yuvToRgb(yuvPixel, j * BYTES_PER_RGB_PIX, /*out*/finalRow);
-            }
-            buf.put(finalRow);
+    private static FileDescriptor getFileDescriptor(OutputStream dngOutput) throws IOException {
+        if (dngOutput.getClass() != FileOutputStream.class) {
+            return null;
         }
-
-        yBuf.rewind();
-        uBuf.rewind();
-        vBuf.rewind();
-        buf.rewind();
-        return buf;
-    }
-
-    /**
-     * Generate a direct RGB {@link ByteBuffer} from a {@link Bitmap}.
-     */
-    private static ByteBuffer convertToRGB(Bitmap argbBitmap) {
-        // TODO: Optimize this.
-        int width = argbBitmap.getWidth();
-        int height = argbBitmap.getHeight();
-        ByteBuffer buf = ByteBuffer.allocateDirect(BYTES_PER_RGB_PIX * width * height);
-
-        int[] pixelRow = new int[width];
-        byte[] finalRow = new byte[BYTES_PER_RGB_PIX * width];
-        for (int i = 0; i < height; i++) {
-            argbBitmap.getPixels(pixelRow, /*offset*/0, /*stride*/width, /*x*/0, /*y*/i,
-                    /*width*/width, /*height*/1);
-            for (int j = 0; j < width; j++) {
-                colorToRgb(pixelRow[j], j * BYTES_PER_RGB_PIX, /*out*/finalRow);
-            }
-            buf.put(finalRow);
-        }
-
-        buf.rewind();
-        return buf;
+        return ((FileOutputStream) dngOutput).getFD();
     }
 
     /**
@@ -661,14 +569,22 @@ public final class DngCreator implements AutoCloseable {
                                                       String longRef, String dateTag,
                                                       int[] timeTag);
 
-    private synchronized native void nativeSetThumbnail(ByteBuffer buffer, int width, int height);
+    private synchronized native void nativeSetThumbnailColors(int[] colors, int width,
+                                                              int height);
+
+    private synchronized native void nativeSetThumbnailYuv(ByteBuffer[] planes, int[] rowStrides,
+                                                           int[] pixelStrides, int width,
+                                                           int height);
 
-    private synchronized native void nativeWriteImage(OutputStream out, int width, int height,
+    private synchronized native void nativeWriteImage(OutputStream out, FileDescriptor outFd,
+                                                      int width, int height,
                                                       ByteBuffer rawBuffer, int rowStride,
                                                       int pixStride, long offset, boolean isDirect)
                                                       throws IOException;
 
-    private synchronized native void nativeWriteInputStream(OutputStream out, InputStream rawStream,
+    private synchronized native void nativeWriteInputStream(OutputStream out,
+                                                            FileDescriptor outFd,
+                                                            InputStream rawStream,
                                                             int width, int height, long offset)
                                                             throws IOException;
 
@@ -1899,6 +1899,30 @@ public final class Debug
      */
     public static final native int getBinderDeathObjectCount();
 
+    /** @hide Index of the number of BinderProxy lookups for a remote IBinder. */
+    public static final int BINDER_PROXY_STATS_LOOKUPS = 0;
+    /** @hide Index of the number of lookups that found a live BinderProxy. */
+    public static final int BINDER_PROXY_STATS_HITS = 1;
+    /** @hide Index of the number of BinderProxies created. */
+    public static final int BINDER_PROXY_STATS_CREATED = 2;
+    /** @hide Index of the number of BinderProxies dropped because another thread created one
+     * for the same IBinder at the same time. */
+    public static final int BINDER_PROXY_STATS_CREATION_RACES = 3;
+    /** @hide Index of the number of times a lookup waited for another thread's lookup. */
+    public static final int BINDER_PROXY_STATS_CONTENTION = 4;
+    /** @hide Index of the total time spent in lookups, in nanoseconds. */
+    public static final int BINDER_PROXY_STATS_TOTAL_NANOS = 5;
+    /** @hide Index of the longest lookup, in nanoseconds. */
+    public static final int BINDER_PROXY_STATS_MAX_NANOS = 6;
+
+    /**
+     * Returns counters for the lookups that map remote IBinders to their BinderProxy objects
+     * in this process, indexed by the BINDER_PROXY_STATS_* constants.
+     *
+     * @hide
+     */
+    public static final native long[] getBinderProxyLookupStats();
+
     /**
      * Primes the register map cache.
      *
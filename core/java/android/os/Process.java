@@ -953,6 +953,35 @@ public class Process {
     public static final native boolean parseProcLine(byte[] buffer, int startIndex, 
             int endIndex, int[] format, String[] outStrings, long[] outLongs, float[] outFloats);
 
+    /**
+     * Creates a reader that collects the same fields from /proc/[pid]/stat,
+     * /proc/[pid]/statm and /proc/[pid]/status for many processes in one call.
+     * The stat and statm formats are as for {@link #readProcFile}, but may only
+     * use {@link #PROC_OUT_LONG}; statusFields are line labels as for
+     * {@link #readProcLines}.  Any of them may be null to skip that file.
+     * Files are kept open between reads, so the reader must be released with
+     * {@link #closeProcSnapshot}.
+     *
+     * @return a handle for {@link #readProcSnapshot}
+     * @hide
+     */
+    public static final native long openProcSnapshot(int[] statFormat, int[] statmFormat,
+            String[] statusFields);
+
+    /**
+     * Reads the fields configured by {@link #openProcSnapshot} for each of pids.
+     * Processes no longer in the list have their files closed.
+     *
+     * @return one packed array holding, for each pid in order, a flag that is 1
+     * when all of its files were read and 0 otherwise, then the stat fields, the
+     * statm fields and the status fields.
+     * @hide
+     */
+    public static final native long[] readProcSnapshot(long snapshot, int[] pids);
+
+    /** @hide */
+    public static final native void closeProcSnapshot(long snapshot);
+
     /** @hide */
     public static final native int[] getPidsForCommands(String[] cmds);
 
@@ -62,6 +62,10 @@ public class NetworkStatsFactory {
     /** Path to {@code /proc/net/xt_qtaguid/stats}. */
     private final File mStatsXtUid;
 
+    /** Native state of {@link #readNetworkStatsDetailChanges}, created on first use. */
+    @GuardedBy("this")
+    private long mDeltaState;
+
     // TODO: to improve testability and avoid global state, do not use a static variable.
     @GuardedBy("sStackedIfaces")
     private static final ArrayMap<String, String> sStackedIfaces = new ArrayMap<>();
@@ -241,6 +245,48 @@ public class NetworkStatsFactory {
         return stats;
     }
 
+    /**
+     * Parse and return {@link NetworkStats} with the UID-level detail rows that changed since
+     * the last call on this factory, or all rows on the first call. Values are totals since
+     * device boot as in {@link #readNetworkStatsDetail()}, but are not adjusted for 464xlat
+     * traffic, since that needs the unchanged rows of stacked interfaces too.
+     */
+    public synchronized NetworkStats readNetworkStatsDetailChanges(int limitUid,
+            String[] limitIfaces, int limitTag, NetworkStats lastStats) throws IOException {
+        final StrictMode.ThreadPolicy savedPolicy = StrictMode.allowThreadDiskReads();
+        try {
+            final NetworkStats stats;
+            if (lastStats != null) {
+                stats = lastStats;
+                stats.setElapsedRealtime(SystemClock.elapsedRealtime());
+            } else {
+                stats = new NetworkStats(SystemClock.elapsedRealtime(), -1);
+            }
+            if (mDeltaState == 0) {
+                mDeltaState = nativeCreateDeltaState();
+            }
+            if (nativeReadNetworkStatsDetailChanges(mDeltaState, stats,
+                    mStatsXtUid.getAbsolutePath(), limitUid, limitIfaces, limitTag) != 0) {
+                throw new IOException("Failed to parse network stats");
+            }
+            return stats;
+        } finally {
+            StrictMode.setThreadPolicy(savedPolicy);
+        }
+    }
+
+    @Override
+    protected void finalize() throws Throwable {
+        try {
+            if (mDeltaState != 0) {
+                nativeDestroyDeltaState(mDeltaState);
+                mDeltaState = 0;
+            }
+        } finally {
+            super.finalize();
+        }
+    }
+
     private NetworkStats readNetworkStatsDetailInternal(int limitUid, String[] limitIfaces,
             int limitTag, NetworkStats lastStats) throws IOException {
         if (USE_NATIVE_PARSING) {
@@ -348,4 +394,15 @@ public class NetworkStatsFactory {
     @VisibleForTesting
     public static native int nativeReadNetworkStatsDetail(
             NetworkStats stats, String path, int limitUid, String[] limitIfaces, int limitTag);
+
+    /**
+     * Like {@link #nativeReadNetworkStatsDetail}, but only fills in the rows that changed
+     * since the last call with the same {@code deltaState}.
+     */
+    private static native int nativeReadNetworkStatsDetailChanges(long deltaState,
+            NetworkStats stats, String path, int limitUid, String[] limitIfaces, int limitTag);
+
+    private static native long nativeCreateDeltaState();
+
+    private static native void nativeDestroyDeltaState(long deltaState);
 }
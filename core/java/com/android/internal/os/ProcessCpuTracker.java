@@ -37,6 +37,7 @@ import java.io.PrintWriter;
 import java.io.StringWriter;
 import java.text.SimpleDateFormat;
 import java.util.ArrayList;
+import java.util.Arrays;
 import java.util.Collections;
 import java.util.Comparator;
 import java.util.Date;
@@ -74,6 +75,11 @@ public class ProcessCpuTracker {
     /** Stores user time and system time in jiffies. */
     private final long[] mProcessStatsData = new long[4];
 
+    /** Native reader for PROCESS_STATS_FORMAT of every process at once, created on first
+     * use.  It keeps the stat files open between updates, until {@link #close}.  Guarded
+     * by this. */
+    private long mProcessStatsSnapshot;
+
     /** Stores user time and system time in jiffies.  Used for
      * public API to retrieve CPU use for a process.  Must lock while in use. */
     private final long[] mSinglePidStatsData = new long[4];
@@ -299,6 +305,29 @@ public class ProcessCpuTracker {
         mJiffyMillis = 1000/jiffyHz;
     }
 
+    /**
+     * Closes the stat files kept open between updates.  The tracker stays usable; the next
+     * update opens them again.
+     */
+    public void close() {
+        synchronized (this) {
+            if (mProcessStatsSnapshot != 0) {
+                Process.closeProcSnapshot(mProcessStatsSnapshot);
+                mProcessStatsSnapshot = 0;
+            }
+        }
+    }
+
+    private long[] readProcessStatsSnapshot(int[] pids) {
+        synchronized (this) {
+            if (mProcessStatsSnapshot == 0) {
+                mProcessStatsSnapshot = Process.openProcSnapshot(PROCESS_STATS_FORMAT,
+                        null, null);
+            }
+            return Process.readProcSnapshot(mProcessStatsSnapshot, pids);
+        }
+    }
+
     public void onLoadChanged(float load1, float load5, float load15) {
     }
 
@@ -418,6 +447,19 @@ public class ProcessCpuTracker {
         int NP = (pids == null) ? 0 : pids.length;
         int NS = allProcs.size();
         int curStatsIndex = 0;
+
+        // Read the stats of all processes in one go rather than opening each stat file
+        // in turn.  Threads are few enough per process that they still read individually.
+        long[] snapshot = null;
+        final int snapshotStride = 1 + mProcessStatsData.length;
+        if (parentPid < 0 && NP > 0) {
+            int count = 0;
+            while (count < NP && pids[count] >= 0) {
+                count++;
+            }
+            snapshot = readProcessStatsSnapshot(
+                    count == NP ? pids : Arrays.copyOf(pids, count));
+        }
         for (int i=0; i<NP; i++) {
             int pid = pids[i];
             if (pid < 0) {
@@ -439,7 +481,13 @@ public class ProcessCpuTracker {
                     final long uptime = SystemClock.uptimeMillis();
 
                     final long[] procStats = mProcessStatsData;
-                    if (!Process.readProcFile(st.statFile.toString(),
+                    if (snapshot != null) {
+                        final int base = i * snapshotStride;
+                        if (snapshot[base] == 0) {
+                            continue;
+                        }
+                        System.arraycopy(snapshot, base + 1, procStats, 0, procStats.length);
+                    } else if (!Process.readProcFile(st.statFile.toString(),
                             PROCESS_STATS_FORMAT, null, procStats, null)) {
                         continue;
                     }
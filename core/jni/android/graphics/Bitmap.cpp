@@ -27,16 +27,22 @@
 #include <hwui/Paint.h>
 #include <hwui/Bitmap.h>
 #include <renderthread/RenderProxy.h>
+#include "utils/PixelConversion.h"
 
 #include "core_jni_helpers.h"
 
 #include <jni.h>
+#include <lz4.h>
 #include <string.h>
 #include <memory>
 #include <string>
 
 #define DEBUG_PARCEL 0
 #define ASHMEM_BITMAP_MIN_SIZE (128 * (1 << 10))
+// Pixels this large are LZ4 compressed when they have to be copied into the parcel itself.
+#define COMPRESSED_PARCEL_MIN_SIZE (64 * (1 << 10))
+// Pixels compressed first to find out whether compressing the rest is worthwhile.
+#define COMPRESSION_SAMPLE_SIZE (16 * (1 << 10))
 
 static jclass   gBitmap_class;
 static jfieldID gBitmap_nativePtr;
@@ -306,6 +312,7 @@ bool unlockPixels(JNIEnv* env, jobject bitmap) {
 
 using namespace android;
 using namespace android::bitmap;
+using android::uirenderer::PixelConversion;
 
 ///////////////////////////////////////////////////////////////////////////////
 // Conversions to/from SkColor, for get/setPixels, and the create method, which
@@ -316,54 +323,22 @@ typedef void (*FromColorProc)(void* dst, const SkColor src[], int width,
 
 static void FromColor_F16(void* dst, const SkColor src[], int width,
                           int, int) {
-    uint64_t* d = (uint64_t*)dst;
-
-    for (int i = 0; i < width; i++) {
-        *d++ = SkColor4f::FromColor(*src++).premul().toF16();
-    }
+    PixelConversion::colorsToF16((uint64_t*)dst, src, width, kPremul_SkAlphaType);
 }
 
 static void FromColor_F16_Raw(void* dst, const SkColor src[], int width,
                           int, int) {
-    uint64_t* d = (uint64_t*)dst;
-
-    for (int i = 0; i < width; i++) {
-        const SkColor4f color = SkColor4f::FromColor(*src++);
-        uint16_t* scratch = reinterpret_cast<uint16_t*>(d++);
-        scratch[0] = SkFloatToHalf(color.fR);
-        scratch[1] = SkFloatToHalf(color.fG);
-        scratch[2] = SkFloatToHalf(color.fB);
-        scratch[3] = SkFloatToHalf(color.fA);
-    }
+    PixelConversion::colorsToF16((uint64_t*)dst, src, width, kUnpremul_SkAlphaType);
 }
 
 static void FromColor_D32(void* dst, const SkColor src[], int width,
                           int, int) {
-    SkPMColor* d = (SkPMColor*)dst;
-
-    for (int i = 0; i < width; i++) {
-        *d++ = SkPreMultiplyColor(*src++);
-    }
+    PixelConversion::colorsToN32((uint32_t*)dst, src, width, kPremul_SkAlphaType);
 }
 
 static void FromColor_D32_Raw(void* dst, const SkColor src[], int width,
                           int, int) {
-    // Needed to thwart the unreachable code detection from clang.
-    static const bool sk_color_ne_zero = SK_COLOR_MATCHES_PMCOLOR_BYTE_ORDER;
-
-    // SkColor's ordering may be different from SkPMColor
-    if (sk_color_ne_zero) {
-        memcpy(dst, src, width * sizeof(SkColor));
-        return;
-    }
-
-    // order isn't same, repack each pixel manually
-    SkPMColor* d = (SkPMColor*)dst;
-    for (int i = 0; i < width; i++) {
-        SkColor c = *src++;
-        *d++ = SkPackARGB32NoCheck(SkColorGetA(c), SkColorGetR(c),
-                                   SkColorGetG(c), SkColorGetB(c));
-    }
+    PixelConversion::colorsToN32((uint32_t*)dst, src, width, kUnpremul_SkAlphaType);
 }
 
 static void FromColor_D565(void* dst, const SkColor src[], int width,
@@ -407,11 +382,7 @@ static void FromColor_D4444_Raw(void* dst, const SkColor src[], int width,
 }
 
 static void FromColor_DA8(void* dst, const SkColor src[], int width, int x, int y) {
-    uint8_t* d = (uint8_t*)dst;
-
-    for (int stop = x + width; x < stop; x++) {
-        *d++ = SkColorGetA(*src++);
-    }
+    PixelConversion::colorsToAlpha8((uint8_t*)dst, src, width);
 }
 
 // can return NULL
@@ -491,135 +462,81 @@ typedef void (*ToColorProc)(SkColor dst[], const void* src, int width,
 static void ToColor_F16_Alpha(SkColor dst[], const void* src, int width,
                               SkColorTable*) {
     SkASSERT(width > 0);
-    uint64_t* s = (uint64_t*)src;
-    do {
-        *dst++ = SkPM4f::FromF16((const uint16_t*) s++).unpremul().toSkColor();
-    } while (--width != 0);
+    PixelConversion::f16ToColors(dst, (const uint64_t*)src, width, kPremul_SkAlphaType);
 }
 
 static void ToColor_F16_Raw(SkColor dst[], const void* src, int width,
                             SkColorTable*) {
     SkASSERT(width > 0);
-    uint64_t* s = (uint64_t*)src;
-    do {
-        *dst++ = Sk4f_toS32(swizzle_rb(SkHalfToFloat_finite_ftz(*s++)));
-    } while (--width != 0);
+    PixelConversion::f16ToColors(dst, (const uint64_t*)src, width, kUnpremul_SkAlphaType);
 }
 
 static void ToColor_S32_Alpha(SkColor dst[], const void* src, int width,
                               SkColorTable*) {
     SkASSERT(width > 0);
-    const SkPMColor* s = (const SkPMColor*)src;
-    do {
-        *dst++ = SkUnPreMultiply::PMColorToColor(*s++);
-    } while (--width != 0);
+    PixelConversion::n32ToColors(dst, (const uint32_t*)src, width, kPremul_SkAlphaType);
 }
 
 static void ToColor_S32_Raw(SkColor dst[], const void* src, int width,
                               SkColorTable*) {
     SkASSERT(width > 0);
-    const SkPMColor* s = (const SkPMColor*)src;
-    do {
-        SkPMColor c = *s++;
-        *dst++ = SkColorSetARGB(SkGetPackedA32(c), SkGetPackedR32(c),
-                                SkGetPackedG32(c), SkGetPackedB32(c));
-    } while (--width != 0);
+    PixelConversion::n32ToColors(dst, (const uint32_t*)src, width, kUnpremul_SkAlphaType);
 }
 
 static void ToColor_S32_Opaque(SkColor dst[], const void* src, int width,
                                SkColorTable*) {
     SkASSERT(width > 0);
-    const SkPMColor* s = (const SkPMColor*)src;
-    do {
-        SkPMColor c = *s++;
-        *dst++ = SkColorSetRGB(SkGetPackedR32(c), SkGetPackedG32(c),
-                               SkGetPackedB32(c));
-    } while (--width != 0);
+    PixelConversion::n32ToColors(dst, (const uint32_t*)src, width, kOpaque_SkAlphaType);
 }
 
 static void ToColor_S4444_Alpha(SkColor dst[], const void* src, int width,
                                 SkColorTable*) {
     SkASSERT(width > 0);
-    const SkPMColor16* s = (const SkPMColor16*)src;
-    do {
-        *dst++ = SkUnPreMultiply::PMColorToColor(SkPixel4444ToPixel32(*s++));
-    } while (--width != 0);
+    PixelConversion::argb4444ToColors(dst, (const uint16_t*)src, width, kPremul_SkAlphaType);
 }
 
 static void ToColor_S4444_Raw(SkColor dst[], const void* src, int width,
                                 SkColorTable*) {
     SkASSERT(width > 0);
-    const SkPMColor16* s = (const SkPMColor16*)src;
-    do {
-        SkPMColor c = SkPixel4444ToPixel32(*s++);
-        *dst++ = SkColorSetARGB(SkGetPackedA32(c), SkGetPackedR32(c),
-                                SkGetPackedG32(c), SkGetPackedB32(c));
-    } while (--width != 0);
+    PixelConversion::argb4444ToColors(dst, (const uint16_t*)src, width, kUnpremul_SkAlphaType);
 }
 
 static void ToColor_S4444_Opaque(SkColor dst[], const void* src, int width,
                                  SkColorTable*) {
     SkASSERT(width > 0);
-    const SkPMColor16* s = (const SkPMColor16*)src;
-    do {
-        SkPMColor c = SkPixel4444ToPixel32(*s++);
-        *dst++ = SkColorSetRGB(SkGetPackedR32(c), SkGetPackedG32(c),
-                               SkGetPackedB32(c));
-    } while (--width != 0);
+    PixelConversion::argb4444ToColors(dst, (const uint16_t*)src, width, kOpaque_SkAlphaType);
 }
 
 static void ToColor_S565(SkColor dst[], const void* src, int width,
                          SkColorTable*) {
     SkASSERT(width > 0);
-    const uint16_t* s = (const uint16_t*)src;
-    do {
-        uint16_t c = *s++;
-        *dst++ =  SkColorSetRGB(SkPacked16ToR32(c), SkPacked16ToG32(c),
-                                SkPacked16ToB32(c));
-    } while (--width != 0);
+    PixelConversion::rgb565ToColors(dst, (const uint16_t*)src, width);
 }
 
 static void ToColor_SI8_Alpha(SkColor dst[], const void* src, int width,
                               SkColorTable* ctable) {
     SkASSERT(width > 0);
-    const uint8_t* s = (const uint8_t*)src;
-    const SkPMColor* colors = ctable->readColors();
-    do {
-        *dst++ = SkUnPreMultiply::PMColorToColor(colors[*s++]);
-    } while (--width != 0);
+    PixelConversion::index8ToColors(dst, (const uint8_t*)src, width, ctable->readColors(),
+            kPremul_SkAlphaType);
 }
 
 static void ToColor_SI8_Raw(SkColor dst[], const void* src, int width,
                               SkColorTable* ctable) {
     SkASSERT(width > 0);
-    const uint8_t* s = (const uint8_t*)src;
-    const SkPMColor* colors = ctable->readColors();
-    do {
-        SkPMColor c = colors[*s++];
-        *dst++ = SkColorSetARGB(SkGetPackedA32(c), SkGetPackedR32(c),
-                                SkGetPackedG32(c), SkGetPackedB32(c));
-    } while (--width != 0);
+    PixelConversion::index8ToColors(dst, (const uint8_t*)src, width, ctable->readColors(),
+            kUnpremul_SkAlphaType);
 }
 
 static void ToColor_SI8_Opaque(SkColor dst[], const void* src, int width,
                                SkColorTable* ctable) {
     SkASSERT(width > 0);
-    const uint8_t* s = (const uint8_t*)src;
-    const SkPMColor* colors = ctable->readColors();
-    do {
-        SkPMColor c = colors[*s++];
-        *dst++ = SkColorSetRGB(SkGetPackedR32(c), SkGetPackedG32(c),
-                               SkGetPackedB32(c));
-    } while (--width != 0);
+    PixelConversion::index8ToColors(dst, (const uint8_t*)src, width, ctable->readColors(),
+            kOpaque_SkAlphaType);
 }
 
 static void ToColor_SA8(SkColor dst[], const void* src, int width, SkColorTable*) {
     SkASSERT(width > 0);
-    const uint8_t* s = (const uint8_t*)src;
-    do {
-        uint8_t c = *s++;
-        *dst++ = SkColorSetARGB(c, 0, 0, 0);
-    } while (--width != 0);
+    PixelConversion::alpha8ToColors(dst, (const uint8_t*)src, width);
 }
 
 // can return NULL
@@ -684,18 +601,7 @@ static ToColorProc ChooseToColorProc(const SkBitmap& src) {
 
 static void ToF16_SA8(void* dst, const void* src, int width) {
     SkASSERT(width > 0);
-    uint64_t* d = (uint64_t*)dst;
-    const uint8_t* s = (const uint8_t*)src;
-
-    for (int i = 0; i < width; i++) {
-        uint8_t c = *s++;
-        SkPM4f a;
-        a.fVec[SkPM4f::R] = 0.0f;
-        a.fVec[SkPM4f::G] = 0.0f;
-        a.fVec[SkPM4f::B] = 0.0f;
-        a.fVec[SkPM4f::A] = c / 255.0f;
-        *d++ = a.toF16();
-    }
+    PixelConversion::alpha8ToF16((uint64_t*)dst, (const uint8_t*)src, width);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -1063,6 +969,45 @@ static void Bitmap_setHasMipMap(JNIEnv* env, jobject, jlong bitmapHandle,
 // framework, we may need to update this maximum size.
 static constexpr uint32_t kMaxColorSpaceSerializedBytes = 80;
 
+// How the pixels follow the bitmap's header in a parcel.
+enum {
+    // A blob: an ashmem fd if the parcel allows fds and the pixels are large, or else the
+    // pixels themselves.
+    kParcelTransferBlob = 0,
+    // The pixels compressed with LZ4, written into the parcel.
+    kParcelTransferLz4 = 1,
+};
+
+// Whether LZ4 made size bytes small enough to be worth decompressing at the other end.
+static bool isWorthCompressing(size_t size, int compressedSize) {
+    return compressedSize > 0 && (size_t) compressedSize <= size - size / 8;
+}
+
+// Compresses the pixels into *compressed if that is worth it, returning the compressed
+// size, or 0 if they should be sent as they are.
+static int compressPixels(const void* pixels, size_t size, std::unique_ptr<char[]>* compressed) {
+    if (pixels == NULL || size < COMPRESSED_PARCEL_MIN_SIZE
+            || size > (size_t) LZ4_MAX_INPUT_SIZE) {
+        return 0;
+    }
+    // Photos barely compress. Try a sample from the middle of the pixels first, so that
+    // for those only the sample is compressed and they are sent as they are.
+    const char* src = static_cast<const char*>(pixels);
+    const int sampleBound = LZ4_compressBound(COMPRESSION_SAMPLE_SIZE);
+    std::unique_ptr<char[]> sample(new char[sampleBound]);
+    if (!isWorthCompressing(COMPRESSION_SAMPLE_SIZE, LZ4_compress_default(
+            src + (size - COMPRESSION_SAMPLE_SIZE) / 2, sample.get(),
+            COMPRESSION_SAMPLE_SIZE, sampleBound))) {
+        return 0;
+    }
+    sample.reset();
+
+    const int bound = LZ4_compressBound(size);
+    compressed->reset(new char[bound]);
+    const int compressedSize = LZ4_compress_default(src, compressed->get(), size, bound);
+    return isWorthCompressing(size, compressedSize) ? compressedSize : 0;
+}
+
 static jobject Bitmap_createFromParcel(JNIEnv* env, jobject, jobject parcel) {
     if (parcel == NULL) {
         SkDebugf("-------- unparcel parcel is NULL\n");
@@ -1130,8 +1075,34 @@ static jobject Bitmap_createFromParcel(JNIEnv* env, jobject, jobject parcel) {
         }
     }
 
-    // Read the bitmap blob.
     size_t size = bitmap->getSize();
+    const int32_t transferMode = p->readInt32();
+    if (transferMode == kParcelTransferLz4) {
+        const int32_t compressedSize = p->readInt32();
+        const void* compressed = compressedSize > 0 ? p->readInplace(compressedSize) : NULL;
+        if (compressed == NULL) {
+            doThrowRE(env, "Could not read compressed bitmap data.");
+            return NULL;
+        }
+        // Decompress straight into the new bitmap's pixels.
+        sk_sp<Bitmap> nativeBitmap = Bitmap::allocateHeapBitmap(bitmap.get(), ctable);
+        if (!nativeBitmap) {
+            doThrowRE(env, "Could not allocate java pixel ref.");
+            return NULL;
+        }
+        if (LZ4_decompress_safe(static_cast<const char*>(compressed),
+                static_cast<char*>(bitmap->getPixels()), compressedSize, size) != (int) size) {
+            doThrowRE(env, "Could not decompress bitmap data.");
+            return NULL;
+        }
+        return createBitmap(env, nativeBitmap.release(),
+                getPremulBitmapCreateFlags(isMutable), NULL, NULL, density);
+    } else if (transferMode != kParcelTransferBlob) {
+        doThrowRE(env, "Unknown bitmap transfer mode.");
+        return NULL;
+    }
+
+    // Read the bitmap blob.
     android::Parcel::ReadableBlob blob;
     android::status_t status = p->readBlob(size, &blob);
     if (status) {
@@ -1254,6 +1225,28 @@ static jboolean Bitmap_writeToParcel(JNIEnv* env, jobject,
         }
     }
 
+    size_t size = bitmap.getSize();
+    const void* pSrc =  bitmap.getPixels();
+
+    // Without fds the pixels go into the parcel itself, where they count against the
+    // binder transaction limit; compress them if that makes them much smaller.
+    std::unique_ptr<char[]> compressed;
+    const int compressedSize = p->allowFds() ? 0 : compressPixels(pSrc, size, &compressed);
+    if (compressedSize > 0) {
+#if DEBUG_PARCEL
+        ALOGD("Bitmap.writeToParcel: compressed %zu bytes of pixels to %d",
+                size, compressedSize);
+#endif
+        p->writeInt32(kParcelTransferLz4);
+        p->writeInt32(compressedSize);
+        if (p->write(compressed.get(), compressedSize)) {
+            doThrowRE(env, "Could not write compressed bitmap data.");
+            return JNI_FALSE;
+        }
+        return JNI_TRUE;
+    }
+    p->writeInt32(kParcelTransferBlob);
+
     // Transfer the underlying ashmem region if we have one and it's immutable.
     android::status_t status;
     int fd = bitmapWrapper->bitmap().getAshmemFd();
@@ -1281,7 +1274,6 @@ static jboolean Bitmap_writeToParcel(JNIEnv* env, jobject,
             p->allowFds() ? "allowed" : "forbidden");
 #endif
 
-    size_t size = bitmap.getSize();
     android::Parcel::WritableBlob blob;
     status = p->writeBlob(size, mutableCopy, &blob);
     if (status) {
@@ -1289,7 +1281,6 @@ static jboolean Bitmap_writeToParcel(JNIEnv* env, jobject,
         return JNI_FALSE;
     }
 
-    const void* pSrc =  bitmap.getPixels();
     if (pSrc == NULL) {
         memset(blob.data(), 0, size);
     } else {
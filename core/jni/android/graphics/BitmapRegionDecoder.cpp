@@ -19,6 +19,7 @@
 #include "BitmapFactory.h"
 #include "CreateJavaOutputStreamAdaptor.h"
 #include "GraphicsJNI.h"
+#include "TiledRegionDecoder.h"
 #include "Utils.h"
 
 #include "SkBitmap.h"
@@ -43,10 +44,8 @@
 
 using namespace android;
 
-static jobject createBitmapRegionDecoder(JNIEnv* env, std::unique_ptr<SkStreamRewindable> stream) {
-  std::unique_ptr<SkBitmapRegionDecoder> brd(
-            SkBitmapRegionDecoder::Create(stream.release(),
-                                          SkBitmapRegionDecoder::kAndroidCodec_Strategy));
+static jobject createBitmapRegionDecoder(JNIEnv* env, sk_sp<SkData> data) {
+    std::unique_ptr<TiledRegionDecoder> brd(TiledRegionDecoder::Create(std::move(data)));
     if (!brd) {
         doThrowIOE(env, "Image format not supported");
         return nullObjectReturn("CreateBitmapRegionDecoder returned null");
@@ -62,10 +61,10 @@ static jobject nativeNewInstanceFromByteArray(JNIEnv* env, jobject, jbyteArray b
         For now we just always copy the array's data if isShareable.
      */
     AutoJavaByteArray ar(env, byteArray);
-    std::unique_ptr<SkMemoryStream> stream(new SkMemoryStream(ar.ptr() + offset, length, true));
+    sk_sp<SkData> data(SkData::MakeWithCopy(ar.ptr() + offset, length));
 
-    // the decoder owns the stream.
-    jobject brd = createBitmapRegionDecoder(env, std::move(stream));
+    // the decoder owns the data.
+    jobject brd = createBitmapRegionDecoder(env, std::move(data));
     return brd;
 }
 
@@ -82,10 +81,9 @@ static jobject nativeNewInstanceFromFileDescriptor(JNIEnv* env, jobject clazz,
     }
 
     sk_sp<SkData> data(SkData::MakeFromFD(descriptor));
-    std::unique_ptr<SkMemoryStream> stream(new SkMemoryStream(std::move(data)));
 
-    // the decoder owns the stream.
-    jobject brd = createBitmapRegionDecoder(env, std::move(stream));
+    // the decoder owns the data.
+    jobject brd = createBitmapRegionDecoder(env, std::move(data));
     return brd;
 }
 
@@ -95,11 +93,11 @@ static jobject nativeNewInstanceFromStream(JNIEnv* env, jobject clazz,
                                   jboolean isShareable) {
     jobject brd = NULL;
     // for now we don't allow shareable with java inputstreams
-    std::unique_ptr<SkStreamRewindable> stream(CopyJavaInputStream(env, is, storage));
+    std::unique_ptr<SkMemoryStream> stream(CopyJavaInputStream(env, is, storage));
 
     if (stream) {
-        // the decoder owns the stream.
-        brd = createBitmapRegionDecoder(env, std::move(stream));
+        // the decoder owns the data.
+        brd = createBitmapRegionDecoder(env, stream->asData());
     }
     return brd;
 }
@@ -113,8 +111,8 @@ static jobject nativeNewInstanceFromAsset(JNIEnv* env, jobject clazz,
         return NULL;
     }
 
-    // the decoder owns the stream.
-    jobject brd = createBitmapRegionDecoder(env, std::move(stream));
+    // the decoder owns the data.
+    jobject brd = createBitmapRegionDecoder(env, stream->asData());
     return brd;
 }
 
@@ -155,7 +153,7 @@ static jobject nativeDecodeRegion(JNIEnv* env, jobject, jlong brdHandle, jint in
         env->SetObjectField(options, gOptions_outColorSpaceFieldID, 0);
     }
 
-    SkBitmapRegionDecoder* brd = reinterpret_cast<SkBitmapRegionDecoder*>(brdHandle);
+    TiledRegionDecoder* brd = reinterpret_cast<TiledRegionDecoder*>(brdHandle);
 
     SkColorType decodeColorType = brd->computeOutputColorType(colorType);
     sk_sp<SkColorSpace> decodeColorSpace = brd->computeOutputColorSpace(
@@ -198,7 +196,7 @@ static jobject nativeDecodeRegion(JNIEnv* env, jobject, jlong brdHandle, jint in
         env->SetIntField(options, gOptions_heightFieldID, bitmap.height());
 
         env->SetObjectField(options, gOptions_mimeFieldID,
-                encodedFormatToString(env, (SkEncodedImageFormat)brd->getEncodedFormat()));
+                encodedFormatToString(env, brd->getEncodedFormat()));
         if (env->ExceptionCheck()) {
             return nullObjectReturn("OOM in encodedFormatToString()");
         }
@@ -234,20 +232,20 @@ static jobject nativeDecodeRegion(JNIEnv* env, jobject, jlong brdHandle, jint in
 }
 
 static jint nativeGetHeight(JNIEnv* env, jobject, jlong brdHandle) {
-    SkBitmapRegionDecoder* brd =
-            reinterpret_cast<SkBitmapRegionDecoder*>(brdHandle);
+    TiledRegionDecoder* brd =
+            reinterpret_cast<TiledRegionDecoder*>(brdHandle);
     return static_cast<jint>(brd->height());
 }
 
 static jint nativeGetWidth(JNIEnv* env, jobject, jlong brdHandle) {
-    SkBitmapRegionDecoder* brd =
-            reinterpret_cast<SkBitmapRegionDecoder*>(brdHandle);
+    TiledRegionDecoder* brd =
+            reinterpret_cast<TiledRegionDecoder*>(brdHandle);
     return static_cast<jint>(brd->width());
 }
 
 static void nativeClean(JNIEnv* env, jobject, jlong brdHandle) {
-    SkBitmapRegionDecoder* brd =
-            reinterpret_cast<SkBitmapRegionDecoder*>(brdHandle);
+    TiledRegionDecoder* brd =
+            reinterpret_cast<TiledRegionDecoder*>(brdHandle);
     delete brd;
 }
 
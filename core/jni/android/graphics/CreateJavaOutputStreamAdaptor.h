@@ -30,10 +30,10 @@ SkStream* CreateJavaInputStreamAdaptor(JNIEnv* env, jobject stream,
  *  @param stream Pointer to Java InputStream.
  *  @param storage Java byte array for retrieving data from the
  *      Java InputStream.
- *  @return SkStreamRewindable The data in stream will be copied
- *      to a new SkStreamRewindable.
+ *  @return SkMemoryStream The data in stream will be copied
+ *      to a new SkMemoryStream.
  */
-SkStreamRewindable* CopyJavaInputStream(JNIEnv* env, jobject stream,
+SkMemoryStream* CopyJavaInputStream(JNIEnv* env, jobject stream,
                                         jbyteArray storage);
 
 SkWStream* CreateJavaOutputStreamAdaptor(JNIEnv* env, jobject stream,
@@ -15,11 +15,11 @@
 #include <hwui/Canvas.h>
 #include <hwui/Bitmap.h>
 
-class SkBitmapRegionDecoder;
 class SkCanvas;
 
 namespace android {
 class Paint;
+class TiledRegionDecoder;
 struct Typeface;
 }
 
@@ -88,7 +88,8 @@ public:
 
     static jobject createRegion(JNIEnv* env, SkRegion* region);
 
-    static jobject createBitmapRegionDecoder(JNIEnv* env, SkBitmapRegionDecoder* bitmap);
+    static jobject createBitmapRegionDecoder(JNIEnv* env,
+            android::TiledRegionDecoder* bitmap);
 
     static android::Bitmap* mapAshmemBitmap(JNIEnv* env, SkBitmap* bitmap,
             SkColorTable* ctable, int fd, void* addr, size_t size, bool readOnly);
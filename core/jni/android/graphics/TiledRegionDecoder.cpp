@@ -0,0 +1,447 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "TiledRegionDecoder"
+
+#include "TiledRegionDecoder.h"
+
+#include "SkCodec.h"
+#include "SkStream.h"
+
+#include <utils/JenkinsHash.h>
+#include <utils/Log.h>
+#include <utils/LruCache.h>
+
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+namespace android {
+
+// 32 ARGB_8888 tiles: enough for the overlap between the regions a viewer asks for as it
+// pans, without holding on to much more than one region's worth of pixels.  Regions whose
+// tiles would not fit are decoded directly.
+static const size_t TILE_CACHE_MAX_BYTES = 8 * 1024 * 1024;
+
+// From android.content.ComponentCallbacks2.
+#define TRIM_MEMORY_RUNNING_MODERATE 5
+#define TRIM_MEMORY_UI_HIDDEN 20
+
+// Output size of a sampled dimension, as SkBitmapRegionDecoder computes it.
+static int scaledDimension(int srcDimension, int sampleSize) {
+    if (sampleSize > srcDimension) {
+        return 1;
+    }
+    return srcDimension / sampleSize;
+}
+
+struct TileKey {
+    uint64_t sourceId;
+    int sampleSize;
+    int tileX;
+    int tileY;
+    SkColorType colorType;
+    bool requireUnpremul;
+    sk_sp<SkColorSpace> colorSpace;
+
+    TileKey() : sourceId(0), sampleSize(0), tileX(0), tileY(0),
+            colorType(kUnknown_SkColorType), requireUnpremul(false) {}
+
+    bool operator==(const TileKey& other) const {
+        return sourceId == other.sourceId && sampleSize == other.sampleSize
+                && tileX == other.tileX && tileY == other.tileY
+                && colorType == other.colorType && requireUnpremul == other.requireUnpremul
+                && SkColorSpace::Equals(colorSpace.get(), other.colorSpace.get());
+    }
+};
+
+// The color space is left out; keys that differ only by it are rare.
+inline hash_t hash_type(const TileKey& key) {
+    uint32_t hash = JenkinsHashMix(0, hash_type(key.sourceId));
+    hash = JenkinsHashMix(hash, hash_type(key.sampleSize));
+    hash = JenkinsHashMix(hash, hash_type(key.tileX));
+    hash = JenkinsHashMix(hash, hash_type(key.tileY));
+    hash = JenkinsHashMix(hash, hash_type(static_cast<int32_t>(key.colorType)));
+    hash = JenkinsHashMix(hash, hash_type(key.requireUnpremul));
+    return JenkinsHashWhiten(hash);
+}
+
+/**
+ * Decoded tiles of every region decoder in the process, evicted least recently used first
+ * once their pixels exceed TILE_CACHE_MAX_BYTES.  Tiles are immutable once cached, so a
+ * lookup hands out a reference to the pixels and copies nothing.
+ */
+class TileCache : public OnEntryRemoved<TileKey, SkBitmap> {
+public:
+    static TileCache& get() {
+        static TileCache* cache = new TileCache();
+        return *cache;
+    }
+
+    bool find(const TileKey& key, SkBitmap* tile) {
+        AutoMutex _l(mLock);
+        const SkBitmap& cached = mCache.get(key);
+        if (cached.isNull()) {
+            return false;
+        }
+        *tile = cached;
+        return true;
+    }
+
+    void add(const TileKey& key, const SkBitmap& tile) {
+        const size_t size = tile.getSize();
+        if (size > TILE_CACHE_MAX_BYTES) {
+            return;
+        }
+        AutoMutex _l(mLock);
+        mCache.remove(key);
+        while (mSize + size > TILE_CACHE_MAX_BYTES) {
+            LOG_ALWAYS_FATAL_IF(!mCache.removeOldest(),
+                    "Failed to remove oldest tile. mSize = %zu, mCache.size() = %zu",
+                    mSize, mCache.size());
+        }
+        mCache.put(key, tile);
+        mSize += size;
+    }
+
+    // Evicts the least recently used tiles until at most maxBytes are left.
+    void trim(size_t maxBytes) {
+        AutoMutex _l(mLock);
+        while (mSize > maxBytes && mCache.removeOldest()) {
+        }
+    }
+
+    void removeSource(uint64_t sourceId) {
+        AutoMutex _l(mLock);
+        std::vector<TileKey> keys;
+        LruCache<TileKey, SkBitmap>::Iterator it(mCache);
+        while (it.next()) {
+            if (it.key().sourceId == sourceId) {
+                keys.push_back(it.key());
+            }
+        }
+        for (const TileKey& key : keys) {
+            mCache.remove(key);
+        }
+    }
+
+    void operator()(TileKey&, SkBitmap& tile) override {
+        mSize -= tile.getSize();
+    }
+
+private:
+    TileCache()
+            : mCache(LruCache<TileKey, SkBitmap>::kUnlimitedCapacity)
+            , mSize(0) {
+        mCache.setOnEntryRemovedListener(this);
+    }
+
+    Mutex mLock;
+    LruCache<TileKey, SkBitmap> mCache;
+    size_t mSize;
+};
+
+// Tiles live on in the cache after the decode that made them, so they are malloced rather
+// than taken from the caller's allocator.
+class TileAllocator : public SkBRDAllocator {
+public:
+    bool allocPixelRef(SkBitmap* bitmap, SkColorTable* ctable) override {
+        return mHeapAllocator.allocPixelRef(bitmap, ctable);
+    }
+
+    SkCodec::ZeroInitialized zeroInit() const override { return SkCodec::kNo_ZeroInitialized; }
+
+private:
+    SkBitmap::HeapAllocator mHeapAllocator;
+};
+
+struct TileJob {
+    TileKey key;
+    // The tile's pixels in the image, and the size they decode to.
+    SkIRect srcRect;
+    int outputWidth;
+    int outputHeight;
+    SkBitmap tile;
+};
+
+static std::atomic<uint64_t> sNextSourceId(1);
+
+TiledRegionDecoder* TiledRegionDecoder::Create(sk_sp<SkData> data) {
+    std::unique_ptr<SkBitmapRegionDecoder> decoder(SkBitmapRegionDecoder::Create(
+            data, SkBitmapRegionDecoder::kAndroidCodec_Strategy));
+    if (!decoder) {
+        return nullptr;
+    }
+    return new TiledRegionDecoder(std::move(data), std::move(decoder));
+}
+
+TiledRegionDecoder::TiledRegionDecoder(sk_sp<SkData> data,
+        std::unique_ptr<SkBitmapRegionDecoder> decoder)
+        : mData(std::move(data))
+        , mSourceId(sNextSourceId++)
+        , mWidth(decoder->width())
+        , mHeight(decoder->height())
+        , mEncodedFormat(static_cast<SkEncodedImageFormat>(decoder->getEncodedFormat()))
+        , mDecoderCount(1) {
+    mDecoders.push_back(std::move(decoder));
+}
+
+TiledRegionDecoder::~TiledRegionDecoder() {
+    TileCache::get().removeSource(mSourceId);
+}
+
+void TiledRegionDecoder::trimMemory(int level) {
+    if (level >= TRIM_MEMORY_UI_HIDDEN) {
+        TileCache::get().trim(0);
+    } else if (level >= TRIM_MEMORY_RUNNING_MODERATE) {
+        TileCache::get().trim(TILE_CACHE_MAX_BYTES / 2);
+    }
+}
+
+std::unique_ptr<SkBitmapRegionDecoder> TiledRegionDecoder::tryAcquireDecoder() {
+    {
+        AutoMutex _l(mDecodersLock);
+        if (!mDecoders.empty()) {
+            std::unique_ptr<SkBitmapRegionDecoder> decoder = std::move(mDecoders.back());
+            mDecoders.pop_back();
+            return decoder;
+        }
+        if (mDecoderCount >= kMaxWorkers) {
+            return nullptr;
+        }
+        mDecoderCount++;
+    }
+    std::unique_ptr<SkBitmapRegionDecoder> decoder(SkBitmapRegionDecoder::Create(
+            mData, SkBitmapRegionDecoder::kAndroidCodec_Strategy));
+    if (!decoder) {
+        AutoMutex _l(mDecodersLock);
+        mDecoderCount--;
+    }
+    return decoder;
+}
+
+std::unique_ptr<SkBitmapRegionDecoder> TiledRegionDecoder::acquireDecoder() {
+    std::unique_ptr<SkBitmapRegionDecoder> decoder = tryAcquireDecoder();
+    if (decoder) {
+        return decoder;
+    }
+    // The decoder made by Create() is never freed, so one is always coming back.
+    AutoMutex _l(mDecodersLock);
+    while (mDecoders.empty()) {
+        mDecoderReleased.wait(mDecodersLock);
+    }
+    decoder = std::move(mDecoders.back());
+    mDecoders.pop_back();
+    return decoder;
+}
+
+void TiledRegionDecoder::releaseDecoder(std::unique_ptr<SkBitmapRegionDecoder> decoder) {
+    AutoMutex _l(mDecodersLock);
+    mDecoders.push_back(std::move(decoder));
+    mDecoderReleased.signal();
+}
+
+SkColorType TiledRegionDecoder::computeOutputColorType(SkColorType requestedColorType) {
+    std::unique_ptr<SkBitmapRegionDecoder> decoder = acquireDecoder();
+    SkColorType colorType = decoder->computeOutputColorType(requestedColorType);
+    releaseDecoder(std::move(decoder));
+    return colorType;
+}
+
+sk_sp<SkColorSpace> TiledRegionDecoder::computeOutputColorSpace(SkColorType outputColorType,
+        sk_sp<SkColorSpace> prefColorSpace) {
+    std::unique_ptr<SkBitmapRegionDecoder> decoder = acquireDecoder();
+    sk_sp<SkColorSpace> colorSpace = decoder->computeOutputColorSpace(outputColorType,
+            std::move(prefColorSpace));
+    releaseDecoder(std::move(decoder));
+    return colorSpace;
+}
+
+// A region can be put together from tiles if it lies inside the image and starts and ends
+// on sample boundaries, so that every output pixel is sampled from the same source pixel
+// the tile it falls in samples it from.  The image's right and bottom edges count as
+// boundaries.
+//
+// Only JPEG is tiled: its decoder skips to a subset's scanlines and MCU columns, so a tile
+// costs about its share of the image.  The others decode every row above a subset each
+// time, which splitting a region into tiles would only multiply.  The tiles covering the
+// region must also fit in the cache, or they would just evict each other.
+bool TiledRegionDecoder::canTile(const SkIRect& subset, int sampleSize,
+        SkColorType colorType) const {
+    if (mEncodedFormat != SkEncodedImageFormat::kJPEG) {
+        return false;
+    }
+    if (sampleSize < 1 || colorType == kIndex_8_SkColorType) {
+        return false;
+    }
+    if (subset.fLeft < 0 || subset.fTop < 0 || subset.fRight > mWidth
+            || subset.fBottom > mHeight) {
+        return false;
+    }
+    if (subset.width() < sampleSize || subset.height() < sampleSize) {
+        return false;
+    }
+    if (subset.fLeft % sampleSize != 0 || subset.fTop % sampleSize != 0
+            || (subset.fRight % sampleSize != 0 && subset.fRight != mWidth)
+            || (subset.fBottom % sampleSize != 0 && subset.fBottom != mHeight)) {
+        return false;
+    }
+
+    const int64_t tileSrcSize = kTileSize * sampleSize;
+    const int64_t tilesAcross = (subset.fRight - 1) / tileSrcSize - subset.fLeft / tileSrcSize + 1;
+    const int64_t tilesDown = (subset.fBottom - 1) / tileSrcSize - subset.fTop / tileSrcSize + 1;
+    // Count at least N32's size: an unknown color type lets the codec pick.
+    const int64_t bytesPerPixel = std::max(SkColorTypeBytesPerPixel(colorType),
+            SkColorTypeBytesPerPixel(kN32_SkColorType));
+    return tilesAcross * tilesDown * kTileSize * kTileSize * bytesPerPixel
+            <= (int64_t) TILE_CACHE_MAX_BYTES;
+}
+
+bool TiledRegionDecoder::decodeRegion(SkBitmap* bitmap, SkBRDAllocator* allocator,
+        const SkIRect& desiredSubset, int sampleSize, SkColorType colorType,
+        bool requireUnpremul, sk_sp<SkColorSpace> prefColorSpace) {
+    if (!canTile(desiredSubset, sampleSize, colorType)) {
+        std::unique_ptr<SkBitmapRegionDecoder> decoder = acquireDecoder();
+        bool success = decoder->decodeRegion(bitmap, allocator, desiredSubset, sampleSize,
+                colorType, requireUnpremul, std::move(prefColorSpace));
+        releaseDecoder(std::move(decoder));
+        return success;
+    }
+
+    // The region, in output pixels.
+    const int outLeft = desiredSubset.fLeft / sampleSize;
+    const int outTop = desiredSubset.fTop / sampleSize;
+    const int outWidth = scaledDimension(desiredSubset.width(), sampleSize);
+    const int outHeight = scaledDimension(desiredSubset.height(), sampleSize);
+    const int tileSrcSize = kTileSize * sampleSize;
+
+    const int firstTileX = outLeft / kTileSize;
+    const int firstTileY = outTop / kTileSize;
+    const int lastTileX = (outLeft + outWidth - 1) / kTileSize;
+    const int lastTileY = (outTop + outHeight - 1) / kTileSize;
+    const int tilesAcross = lastTileX - firstTileX + 1;
+
+    std::vector<SkBitmap> tiles(tilesAcross * (lastTileY - firstTileY + 1));
+    std::vector<TileJob> jobs;
+    TileCache& cache = TileCache::get();
+    for (int ty = firstTileY; ty <= lastTileY; ty++) {
+        for (int tx = firstTileX; tx <= lastTileX; tx++) {
+            TileKey key;
+            key.sourceId = mSourceId;
+            key.sampleSize = sampleSize;
+            key.tileX = tx;
+            key.tileY = ty;
+            key.colorType = colorType;
+            key.requireUnpremul = requireUnpremul;
+            key.colorSpace = prefColorSpace;
+
+            SkBitmap& tile = tiles[(ty - firstTileY) * tilesAcross + (tx - firstTileX)];
+            if (cache.find(key, &tile)) {
+                continue;
+            }
+            TileJob job;
+            job.key = key;
+            job.srcRect = SkIRect::MakeLTRB(tx * tileSrcSize, ty * tileSrcSize,
+                    std::min((tx + 1) * tileSrcSize, mWidth),
+                    std::min((ty + 1) * tileSrcSize, mHeight));
+            job.outputWidth = scaledDimension(job.srcRect.width(), sampleSize);
+            job.outputHeight = scaledDimension(job.srcRect.height(), sampleSize);
+            jobs.push_back(job);
+        }
+    }
+
+    if (!jobs.empty()) {
+        std::atomic<size_t> nextJob(0);
+        std::atomic<bool> failed(false);
+        auto work = [&]() {
+            std::unique_ptr<SkBitmapRegionDecoder> decoder = tryAcquireDecoder();
+            if (!decoder) {
+                // Another caller holds every decoder; the ones that do have a decoder
+                // get through the jobs without this one.
+                return;
+            }
+            TileAllocator tileAllocator;
+            size_t i;
+            while (!failed && (i = nextJob++) < jobs.size()) {
+                TileJob& job = jobs[i];
+                if (!decoder->decodeRegion(&job.tile, &tileAllocator, job.srcRect, sampleSize,
+                        colorType, requireUnpremul, prefColorSpace)
+                        || job.tile.width() != job.outputWidth
+                        || job.tile.height() != job.outputHeight) {
+                    failed = true;
+                }
+            }
+            releaseDecoder(std::move(decoder));
+        };
+
+        const int workerCount = std::min<int>(kMaxWorkers, jobs.size());
+        std::vector<std::thread> workers;
+        for (int i = 1; i < workerCount; i++) {
+            workers.emplace_back(work);
+        }
+        work();
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+
+        if (failed || nextJob < jobs.size()) {
+            ALOGW("Tiled decode of %d tiles failed, decoding the region directly",
+                    (int) jobs.size());
+            std::unique_ptr<SkBitmapRegionDecoder> decoder = acquireDecoder();
+            bool success = decoder->decodeRegion(bitmap, allocator, desiredSubset, sampleSize,
+                    colorType, requireUnpremul, std::move(prefColorSpace));
+            releaseDecoder(std::move(decoder));
+            return success;
+        }
+
+        for (TileJob& job : jobs) {
+            job.tile.setImmutable();
+            cache.add(job.key, job.tile);
+            tiles[(job.key.tileY - firstTileY) * tilesAcross + (job.key.tileX - firstTileX)]
+                    = job.tile;
+        }
+    }
+
+    // Every tile comes from the same codec, so any of them has the output's color and
+    // alpha types and color space.
+    bitmap->setInfo(tiles[0].info().makeWH(outWidth, outHeight));
+    if (!allocator->allocPixelRef(bitmap, nullptr)) {
+        ALOGE("Could not allocate pixels for region.");
+        return false;
+    }
+
+    const size_t bytesPerPixel = bitmap->bytesPerPixel();
+    for (int ty = firstTileY; ty <= lastTileY; ty++) {
+        for (int tx = firstTileX; tx <= lastTileX; tx++) {
+            const SkBitmap& tile = tiles[(ty - firstTileY) * tilesAcross + (tx - firstTileX)];
+            // The part of the tile inside the region, in output pixels.
+            const int left = std::max(tx * kTileSize, outLeft);
+            const int top = std::max(ty * kTileSize, outTop);
+            const int right = std::min(tx * kTileSize + tile.width(), outLeft + outWidth);
+            const int bottom = std::min(ty * kTileSize + tile.height(), outTop + outHeight);
+            const size_t rowBytes = (right - left) * bytesPerPixel;
+            for (int y = top; y < bottom; y++) {
+                memcpy(bitmap->getAddr(left - outLeft, y - outTop),
+                        tile.getAddr(left - tx * kTileSize, y - ty * kTileSize), rowBytes);
+            }
+        }
+    }
+    return true;
+}
+
+}  // namespace android
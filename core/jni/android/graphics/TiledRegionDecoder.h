@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _ANDROID_GRAPHICS_TILED_REGION_DECODER_H_
+#define _ANDROID_GRAPHICS_TILED_REGION_DECODER_H_
+
+#include "SkBitmap.h"
+#include "SkBitmapRegionDecoder.h"
+#include "SkBRDAllocator.h"
+#include "SkColorSpace.h"
+#include "SkData.h"
+#include "SkRect.h"
+
+#include <utils/Condition.h>
+#include <utils/Mutex.h>
+
+#include <memory>
+#include <vector>
+
+namespace android {
+
+/**
+ * Region decoder behind android.graphics.BitmapRegionDecoder.
+ *
+ * A region is decoded as the tiles of a fixed grid over the sampled image that it covers.
+ * Missing tiles are decoded in parallel, each worker using its own SkBitmapRegionDecoder
+ * over the shared encoded data, and kept in a process-wide cache bounded by bytes, so that
+ * the overlapping regions a panning or zooming viewer asks for are mostly copied rather
+ * than decoded again.
+ *
+ * Only JPEG images are tiled.  Regions that do not line up with the sampled grid, that
+ * reach outside the image, or whose tiles would not fit in the cache are decoded directly
+ * as before.
+ */
+class TiledRegionDecoder {
+public:
+    // Size of a tile, in pixels of the decoded output.
+    static const int kTileSize = 256;
+    // Upper bound on the decoders, and so on the threads, used for one region.
+    static const int kMaxWorkers = 4;
+
+    /**
+     * Returns a decoder for the encoded image in data, or nullptr if its format is not
+     * supported.
+     */
+    static TiledRegionDecoder* Create(sk_sp<SkData> data);
+
+    ~TiledRegionDecoder();
+
+    /**
+     * Drops cached tiles in response to ComponentCallbacks2.onTrimMemory(level).
+     */
+    static void trimMemory(int level);
+
+    int width() const { return mWidth; }
+    int height() const { return mHeight; }
+    SkEncodedImageFormat getEncodedFormat() const { return mEncodedFormat; }
+
+    SkColorType computeOutputColorType(SkColorType requestedColorType);
+    sk_sp<SkColorSpace> computeOutputColorSpace(SkColorType outputColorType,
+            sk_sp<SkColorSpace> prefColorSpace);
+
+    /**
+     * Same contract as SkBitmapRegionDecoder::decodeRegion().
+     */
+    bool decodeRegion(SkBitmap* bitmap, SkBRDAllocator* allocator, const SkIRect& desiredSubset,
+            int sampleSize, SkColorType colorType, bool requireUnpremul,
+            sk_sp<SkColorSpace> prefColorSpace);
+
+private:
+    TiledRegionDecoder(sk_sp<SkData> data, std::unique_ptr<SkBitmapRegionDecoder> decoder);
+
+    bool canTile(const SkIRect& subset, int sampleSize, SkColorType colorType) const;
+
+    // Takes a decoder from the pool, creating one if there is none free. Returns nullptr if
+    // kMaxWorkers decoders are in use or a new one could not be created.
+    std::unique_ptr<SkBitmapRegionDecoder> tryAcquireDecoder();
+    // Same, but waits for a decoder to be released rather than return nullptr.
+    std::unique_ptr<SkBitmapRegionDecoder> acquireDecoder();
+    void releaseDecoder(std::unique_ptr<SkBitmapRegionDecoder> decoder);
+
+    const sk_sp<SkData> mData;
+    // Identifies this image in the tile cache; never reused within the process.
+    const uint64_t mSourceId;
+    const int mWidth;
+    const int mHeight;
+    const SkEncodedImageFormat mEncodedFormat;
+
+    Mutex mDecodersLock;
+    Condition mDecoderReleased;
+    std::vector<std::unique_ptr<SkBitmapRegionDecoder>> mDecoders;
+    int mDecoderCount;
+};
+
+}  // namespace android
+
+#endif  // _ANDROID_GRAPHICS_TILED_REGION_DECODER_H_
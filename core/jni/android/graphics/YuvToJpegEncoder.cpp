@@ -1,4 +1,5 @@
 #include "CreateJavaOutputStreamAdaptor.h"
+#include "SkData.h"
 #include "SkJPEGWriteUtility.h"
 #include "YuvToJpegEncoder.h"
 #include <ui/PixelFormat.h>
@@ -7,6 +8,67 @@
 #include "core_jni_helpers.h"
 
 #include <jni.h>
+#include <string.h>
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+// Sixteen bytes, as a NEON or SSE register.  The shuffles below compile to
+// vuzp/vld2-style unzips on ARM and to byte shuffles on x86.
+typedef uint8_t U8x16 __attribute__((vector_size(16)));
+typedef uint8_t U8x8 __attribute__((vector_size(8)));
+
+static inline U8x16 load16(const uint8_t* src) {
+    U8x16 v;
+    memcpy(&v, src, sizeof(v));
+    return v;
+}
+
+static inline void store16(uint8_t* dst, U8x16 v) {
+    memcpy(dst, &v, sizeof(v));
+}
+
+static inline void store8(uint8_t* dst, U8x8 v) {
+    memcpy(dst, &v, sizeof(v));
+}
+
+// Splits count interleaved VU pairs, as in NV21, into U and V rows.
+static void deinterleaveVu(const uint8_t* vu, uint8_t* u, uint8_t* v, int count) {
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        U8x16 a = load16(vu + 2 * i);
+        U8x16 b = load16(vu + 2 * i + 16);
+        store16(u + i, __builtin_shufflevector(a, b,
+                1, 3, 5, 7, 9, 11, 13, 15, 17, 19, 21, 23, 25, 27, 29, 31));
+        store16(v + i, __builtin_shufflevector(a, b,
+                0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30));
+    }
+    for (; i < count; i++) {
+        u[i] = vu[2 * i + 1];
+        v[i] = vu[2 * i];
+    }
+}
+
+// Splits count YUYV macropixels, two pixels each, into Y, U and V rows.
+static void deinterleaveYuyv(const uint8_t* yuyv, uint8_t* y, uint8_t* u, uint8_t* v,
+        int count) {
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        U8x16 a = load16(yuyv + 4 * i);
+        U8x16 b = load16(yuyv + 4 * i + 16);
+        store16(y + 2 * i, __builtin_shufflevector(a, b,
+                0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30));
+        store8(u + i, __builtin_shufflevector(a, b, 1, 5, 9, 13, 17, 21, 25, 29));
+        store8(v + i, __builtin_shufflevector(a, b, 3, 7, 11, 15, 19, 23, 27, 31));
+    }
+    for (; i < count; i++) {
+        y[2 * i] = yuyv[4 * i];
+        y[2 * i + 1] = yuyv[4 * i + 2];
+        u[i] = yuyv[4 * i + 1];
+        v[i] = yuyv[4 * i + 3];
+    }
+}
 
 YuvToJpegEncoder* YuvToJpegEncoder::create(int format, int* strides) {
     // Only ImageFormat.NV21 and ImageFormat.YUY2 are supported
@@ -20,11 +82,26 @@ YuvToJpegEncoder* YuvToJpegEncoder::create(int format, int* strides) {
     }
 }
 
-YuvToJpegEncoder::YuvToJpegEncoder(int* strides) : fStrides(strides) {
+YuvToJpegEncoder::YuvToJpegEncoder(int* strides) : fStrides(strides), fMaxThreads(1) {
+}
+
+void YuvToJpegEncoder::setMaxThreads(int maxThreads) {
+    int cores = std::max(1u, std::thread::hardware_concurrency());
+    fMaxThreads = std::max(1, std::min(maxThreads, cores));
 }
 
 bool YuvToJpegEncoder::encode(SkWStream* stream, void* inYuv, int width,
         int height, int* offsets, int jpegQuality) {
+    int stripCount = std::min(fMaxThreads, height / kStripRowAlignment);
+    if (stripCount > 1 && width * height >= kMinParallelPixels) {
+        return encodeStrips(stream, (uint8_t*) inYuv, width, height, offsets, jpegQuality,
+                stripCount);
+    }
+    return encodeStrip(stream, (uint8_t*) inYuv, width, height, offsets, jpegQuality, false);
+}
+
+bool YuvToJpegEncoder::encodeStrip(SkWStream* stream, uint8_t* yuv, int width,
+        int height, int* offsets, int jpegQuality, bool restartEachRow) {
     jpeg_compress_struct    cinfo;
     skjpeg_error_mgr        sk_err;
     skjpeg_destination_mgr  sk_wstream(stream);
@@ -32,6 +109,7 @@ bool YuvToJpegEncoder::encode(SkWStream* stream, void* inYuv, int width,
     cinfo.err = jpeg_std_error(&sk_err);
     sk_err.error_exit = skjpeg_error_exit;
     if (setjmp(sk_err.fJmpBuf)) {
+        jpeg_destroy_compress(&cinfo);
         return false;
     }
     jpeg_create_compress(&cinfo);
@@ -39,16 +117,108 @@ bool YuvToJpegEncoder::encode(SkWStream* stream, void* inYuv, int width,
     cinfo.dest = &sk_wstream;
 
     setJpegCompressStruct(&cinfo, width, height, jpegQuality);
+    if (restartEachRow) {
+        cinfo.restart_in_rows = 1;
+    }
 
     jpeg_start_compress(&cinfo, TRUE);
 
-    compress(&cinfo, (uint8_t*) inYuv, offsets);
+    compress(&cinfo, yuv, offsets);
 
     jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
 
     return true;
 }
 
+// Finds where the entropy coded data of a jpeg written by libjpeg starts,
+// and the start of its SOF0 segment.
+static bool findScanData(const uint8_t* jpeg, size_t size, size_t* sofOffset,
+        size_t* scanOffset) {
+    size_t p = 2;
+    *sofOffset = 0;
+    while (p + 4 <= size && jpeg[p] == 0xFF) {
+        uint8_t marker = jpeg[p + 1];
+        size_t length = (jpeg[p + 2] << 8) | jpeg[p + 3];
+        if (marker == 0xC0) {
+            *sofOffset = p;
+        } else if (marker == 0xDA) {
+            *scanOffset = p + 2 + length;
+            return *sofOffset != 0 && *scanOffset + 2 <= size;
+        }
+        p += 2 + length;
+    }
+    return false;
+}
+
+/*
+ * Each strip is compressed as a jpeg of its own, with a restart interval of
+ * one MCU row. Strips share the quantization and Huffman tables, and restart
+ * markers reset the DC predictors, so the scan of the whole image is the scans
+ * of the strips joined by the restart markers that would have come between
+ * them. The result is what a single encode with the same restart interval
+ * writes, byte for byte.
+ */
+bool YuvToJpegEncoder::encodeStrips(SkWStream* stream, uint8_t* yuv, int width,
+        int height, int* offsets, int jpegQuality, int stripCount) {
+    int stripHeight = (height + stripCount - 1) / stripCount;
+    stripHeight = (stripHeight + kStripRowAlignment - 1) / kStripRowAlignment
+            * kStripRowAlignment;
+    stripCount = (height + stripHeight - 1) / stripHeight;
+
+    std::vector<sk_sp<SkData>> strips(stripCount);
+    auto encodeOne = [&](int i) {
+        int top = i * stripHeight;
+        int rowOffsets[2];
+        offsetsAtRow(offsets, top, rowOffsets);
+        SkDynamicMemoryWStream out;
+        if (encodeStrip(&out, yuv, width, std::min(stripHeight, height - top), rowOffsets,
+                jpegQuality, true)) {
+            strips[i] = out.detachAsData();
+        }
+    };
+    std::vector<std::thread> threads;
+    for (int i = 1; i < stripCount; i++) {
+        threads.emplace_back(encodeOne, i);
+    }
+    encodeOne(0);
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    // The last MCU row of every strip but the last is followed by a restart
+    // marker. Strips are a multiple of eight MCU rows, so it is always RST7.
+    static const uint8_t kRst7[] = { 0xFF, 0xD7 };
+    static const uint8_t kEoi[] = { 0xFF, 0xD9 };
+    for (int i = 0; i < stripCount; i++) {
+        if (!strips[i]) {
+            return false;
+        }
+        const uint8_t* jpeg = strips[i]->bytes();
+        size_t size = strips[i]->size();
+        size_t sofOffset, scanOffset;
+        if (!findScanData(jpeg, size, &sofOffset, &scanOffset)) {
+            SkDebugf("YuvToJpegEncoder: strip %d is not a jpeg", i);
+            return false;
+        }
+        bool written;
+        if (i == 0) {
+            // The headers, with the image height in place of the strip's.
+            std::vector<uint8_t> headers(jpeg, jpeg + scanOffset);
+            headers[sofOffset + 5] = height >> 8;
+            headers[sofOffset + 6] = height & 0xFF;
+            written = stream->write(headers.data(), headers.size());
+        } else {
+            written = stream->write(kRst7, sizeof(kRst7));
+        }
+        // Everything after the headers, up to the EOI marker.
+        if (!written || !stream->write(jpeg + scanOffset, size - scanOffset - 2)) {
+            return false;
+        }
+    }
+    return stream->write(kEoi, sizeof(kEoi));
+}
+
 void YuvToJpegEncoder::setJpegCompressStruct(jpeg_compress_struct* cinfo,
         int width, int height, int quality) {
     cinfo->image_width = width;
@@ -120,16 +290,16 @@ void Yuv420SpToJpegEncoder::deinterleave(uint8_t* vuPlanar, uint8_t* uRows,
     if (numRows > 8) numRows = 8;
     for (int row = 0; row < numRows; ++row) {
         int offset = ((rowIndex >> 1) + row) * fStrides[1];
-        uint8_t* vu = vuPlanar + offset;
-        for (int i = 0; i < (width >> 1); ++i) {
-            int index = row * (width >> 1) + i;
-            uRows[index] = vu[1];
-            vRows[index] = vu[0];
-            vu += 2;
-        }
+        int index = row * (width >> 1);
+        deinterleaveVu(vuPlanar + offset, uRows + index, vRows + index, width >> 1);
     }
 }
 
+void Yuv420SpToJpegEncoder::offsetsAtRow(int* offsets, int row, int* rowOffsets) {
+    rowOffsets[0] = offsets[0] + row * fStrides[0];
+    rowOffsets[1] = offsets[1] + (row >> 1) * fStrides[1];
+}
+
 void Yuv420SpToJpegEncoder::configSamplingFactors(jpeg_compress_struct* cinfo) {
     // cb and cr are horizontally downsampled and vertically downsampled as well.
     cinfo->comp_info[0].h_samp_factor = 2;
@@ -195,18 +365,15 @@ void Yuv422IToJpegEncoder::deinterleave(uint8_t* yuv, uint8_t* yRows, uint8_t* u
     if (numRows > 16) numRows = 16;
     for (int row = 0; row < numRows; ++row) {
         uint8_t* yuvSeg = yuv + (rowIndex + row) * fStrides[0];
-        for (int i = 0; i < (width >> 1); ++i) {
-            int indexY = row * width + (i << 1);
-            int indexU = row * (width >> 1) + i;
-            yRows[indexY] = yuvSeg[0];
-            yRows[indexY + 1] = yuvSeg[2];
-            uRows[indexU] = yuvSeg[1];
-            vRows[indexU] = yuvSeg[3];
-            yuvSeg += 4;
-        }
+        deinterleaveYuyv(yuvSeg, yRows + row * width, uRows + row * (width >> 1),
+                vRows + row * (width >> 1), width >> 1);
     }
 }
 
+void Yuv422IToJpegEncoder::offsetsAtRow(int* offsets, int row, int* rowOffsets) {
+    rowOffsets[0] = offsets[0] + row * fStrides[0];
+}
+
 void Yuv422IToJpegEncoder::configSamplingFactors(jpeg_compress_struct* cinfo) {
     // cb and cr are horizontally downsampled and vertically downsampled as well.
     cinfo->comp_info[0].h_samp_factor = 2;
@@ -221,7 +388,7 @@ void Yuv422IToJpegEncoder::configSamplingFactors(jpeg_compress_struct* cinfo) {
 static jboolean YuvImage_compressToJpeg(JNIEnv* env, jobject, jbyteArray inYuv,
         jint format, jint width, jint height, jintArray offsets,
         jintArray strides, jint jpegQuality, jobject jstream,
-        jbyteArray jstorage) {
+        jbyteArray jstorage, jint maxThreads) {
     jbyte* yuv = env->GetByteArrayElements(inYuv, NULL);
     SkWStream* strm = CreateJavaOutputStreamAdaptor(env, jstream, jstorage);
 
@@ -230,6 +397,7 @@ static jboolean YuvImage_compressToJpeg(JNIEnv* env, jobject, jbyteArray inYuv,
     YuvToJpegEncoder* encoder = YuvToJpegEncoder::create(format, imgStrides);
     jboolean result = JNI_FALSE;
     if (encoder != NULL) {
+        encoder->setMaxThreads(maxThreads);
         encoder->encode(strm, yuv, width, height, imgOffsets, jpegQuality);
         delete encoder;
         result = JNI_TRUE;
@@ -244,7 +412,7 @@ static jboolean YuvImage_compressToJpeg(JNIEnv* env, jobject, jbyteArray inYuv,
 ///////////////////////////////////////////////////////////////////////////////
 
 static const JNINativeMethod gYuvImageMethods[] = {
-    {   "nativeCompressToJpeg",  "([BIII[I[IILjava/io/OutputStream;[B)Z",
+    {   "nativeCompressToJpeg",  "([BIII[I[IILjava/io/OutputStream;[BI)Z",
         (void*)YuvImage_compressToJpeg }
 };
 
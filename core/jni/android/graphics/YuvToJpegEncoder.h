@@ -33,16 +33,38 @@ public:
     bool encode(SkWStream* stream,  void* inYuv, int width,
            int height, int* offsets, int jpegQuality);
 
+    /** Set how many threads encode() may use, at most one per core.
+     *
+     *  Large images are cut into horizontal strips that are compressed
+     *  concurrently, with a restart marker after every row of MCUs, and
+     *  joined into a single baseline jpeg. The default, 1, compresses on
+     *  the calling thread only, without restart markers.
+     */
+    void setMaxThreads(int maxThreads);
+
     virtual ~YuvToJpegEncoder() {}
 
+    // Images below this many pixels are always compressed on one thread.
+    static const int kMinParallelPixels = 2 * 1024 * 1024;
+    // Strips are a whole number of this many rows, so that every strip
+    // starts on an MCU row whose restart marker number is 0.
+    static const int kStripRowAlignment = 16 * 8;
+
 protected:
     int fNumPlanes;
     int* fStrides;
+    int fMaxThreads;
     void setJpegCompressStruct(jpeg_compress_struct* cinfo, int width,
             int height, int quality);
+    bool encodeStrip(SkWStream* stream, uint8_t* yuv, int width, int height,
+            int* offsets, int jpegQuality, bool restartEachRow);
+    bool encodeStrips(SkWStream* stream, uint8_t* yuv, int width, int height,
+            int* offsets, int jpegQuality, int stripCount);
     virtual void configSamplingFactors(jpeg_compress_struct* cinfo) = 0;
     virtual void compress(jpeg_compress_struct* cinfo,
             uint8_t* yuv, int* offsets) = 0;
+    /** Compute the plane offsets at which the image starting at row begins. */
+    virtual void offsetsAtRow(int* offsets, int row, int* rowOffsets) = 0;
 };
 
 class Yuv420SpToJpegEncoder : public YuvToJpegEncoder {
@@ -57,6 +79,7 @@ private:
     void deinterleave(uint8_t* vuPlanar, uint8_t* uRows, uint8_t* vRows,
             int rowIndex, int width, int height);
     void compress(jpeg_compress_struct* cinfo, uint8_t* yuv, int* offsets);
+    void offsetsAtRow(int* offsets, int row, int* rowOffsets);
 };
 
 class Yuv422IToJpegEncoder : public YuvToJpegEncoder {
@@ -69,6 +92,7 @@ private:
     void compress(jpeg_compress_struct* cinfo, uint8_t* yuv, int* offsets);
     void deinterleave(uint8_t* yuv, uint8_t* yRows, uint8_t* uRows,
             uint8_t* vRows, int rowIndex, int width, int height);
+    void offsetsAtRow(int* offsets, int row, int* rowOffsets);
 };
 
 #endif  // _ANDROID_GRAPHICS_YUV_TO_JPEG_ENCODER_H_
@@ -34,6 +34,9 @@
 #include <sys/types.h>
 #include <dirent.h>
 
+#include <memory>
+#include <vector>
+
 #undef LOG_NDEBUG
 #define LOG_NDEBUG 1
 
@@ -364,66 +367,192 @@ static void nativeCopyStringToBuffer(JNIEnv* env, jclass clazz, jlong windowPtr,
     }
 }
 
-static jlong nativeGetLong(JNIEnv* env, jclass clazz, jlong windowPtr,
-        jint row, jint column) {
-    CursorWindow* window = reinterpret_cast<CursorWindow*>(windowPtr);
-    LOG_WINDOW("Getting long for %d,%d from %p", row, column, window);
-
-    CursorWindow::FieldSlot* fieldSlot = window->getFieldSlot(row, column);
-    if (!fieldSlot) {
-        throwExceptionWithRowCol(env, row, column);
-        return 0;
-    }
-
+// Converts a field to a long the way getLong() documents. Returns false with an
+// exception pending if the field cannot be converted.
+static bool fieldSlotToLong(JNIEnv* env, CursorWindow* window,
+        CursorWindow::FieldSlot* fieldSlot, jlong* outValue) {
     int32_t type = window->getFieldSlotType(fieldSlot);
     if (type == CursorWindow::FIELD_TYPE_INTEGER) {
-        return window->getFieldSlotValueLong(fieldSlot);
+        *outValue = window->getFieldSlotValueLong(fieldSlot);
     } else if (type == CursorWindow::FIELD_TYPE_STRING) {
         size_t sizeIncludingNull;
         const char* value = window->getFieldSlotValueString(fieldSlot, &sizeIncludingNull);
-        return sizeIncludingNull > 1 ? strtoll(value, NULL, 0) : 0L;
+        *outValue = sizeIncludingNull > 1 ? strtoll(value, NULL, 0) : 0L;
     } else if (type == CursorWindow::FIELD_TYPE_FLOAT) {
-        return jlong(window->getFieldSlotValueDouble(fieldSlot));
+        *outValue = jlong(window->getFieldSlotValueDouble(fieldSlot));
     } else if (type == CursorWindow::FIELD_TYPE_NULL) {
-        return 0;
+        *outValue = 0;
     } else if (type == CursorWindow::FIELD_TYPE_BLOB) {
         throw_sqlite3_exception(env, "Unable to convert BLOB to long");
-        return 0;
+        return false;
     } else {
         throwUnknownTypeException(env, type);
-        return 0;
+        return false;
     }
+    return true;
 }
 
-static jdouble nativeGetDouble(JNIEnv* env, jclass clazz, jlong windowPtr,
+static jlong nativeGetLong(JNIEnv* env, jclass clazz, jlong windowPtr,
         jint row, jint column) {
     CursorWindow* window = reinterpret_cast<CursorWindow*>(windowPtr);
-    LOG_WINDOW("Getting double for %d,%d from %p", row, column, window);
+    LOG_WINDOW("Getting long for %d,%d from %p", row, column, window);
 
     CursorWindow::FieldSlot* fieldSlot = window->getFieldSlot(row, column);
     if (!fieldSlot) {
         throwExceptionWithRowCol(env, row, column);
-        return 0.0;
+        return 0;
     }
 
+    jlong value;
+    return fieldSlotToLong(env, window, fieldSlot, &value) ? value : 0;
+}
+
+// Converts a field to a double the way getDouble() documents. Returns false with an
+// exception pending if the field cannot be converted.
+static bool fieldSlotToDouble(JNIEnv* env, CursorWindow* window,
+        CursorWindow::FieldSlot* fieldSlot, jdouble* outValue) {
     int32_t type = window->getFieldSlotType(fieldSlot);
     if (type == CursorWindow::FIELD_TYPE_FLOAT) {
-        return window->getFieldSlotValueDouble(fieldSlot);
+        *outValue = window->getFieldSlotValueDouble(fieldSlot);
     } else if (type == CursorWindow::FIELD_TYPE_STRING) {
         size_t sizeIncludingNull;
         const char* value = window->getFieldSlotValueString(fieldSlot, &sizeIncludingNull);
-        return sizeIncludingNull > 1 ? strtod(value, NULL) : 0.0;
+        *outValue = sizeIncludingNull > 1 ? strtod(value, NULL) : 0.0;
     } else if (type == CursorWindow::FIELD_TYPE_INTEGER) {
-        return jdouble(window->getFieldSlotValueLong(fieldSlot));
+        *outValue = jdouble(window->getFieldSlotValueLong(fieldSlot));
     } else if (type == CursorWindow::FIELD_TYPE_NULL) {
-        return 0.0;
+        *outValue = 0.0;
     } else if (type == CursorWindow::FIELD_TYPE_BLOB) {
         throw_sqlite3_exception(env, "Unable to convert BLOB to double");
-        return 0.0;
+        return false;
     } else {
         throwUnknownTypeException(env, type);
+        return false;
+    }
+    return true;
+}
+
+static jdouble nativeGetDouble(JNIEnv* env, jclass clazz, jlong windowPtr,
+        jint row, jint column) {
+    CursorWindow* window = reinterpret_cast<CursorWindow*>(windowPtr);
+    LOG_WINDOW("Getting double for %d,%d from %p", row, column, window);
+
+    CursorWindow::FieldSlot* fieldSlot = window->getFieldSlot(row, column);
+    if (!fieldSlot) {
+        throwExceptionWithRowCol(env, row, column);
         return 0.0;
     }
+
+    jdouble value;
+    return fieldSlotToDouble(env, window, fieldSlot, &value) ? value : 0.0;
+}
+
+static void nativeGetLongs(JNIEnv* env, jclass clazz, jlong windowPtr,
+        jint startRow, jint numRows, jint column, jlongArray valuesObj) {
+    CursorWindow* window = reinterpret_cast<CursorWindow*>(windowPtr);
+    LOG_WINDOW("Getting %d longs from %d,%d from %p", numRows, startRow, column, window);
+
+    std::unique_ptr<jlong[]> values(new jlong[numRows]);
+    for (jint i = 0; i < numRows; i++) {
+        CursorWindow::FieldSlot* fieldSlot = window->getFieldSlot(startRow + i, column);
+        if (!fieldSlot) {
+            throwExceptionWithRowCol(env, startRow + i, column);
+            return;
+        }
+        if (!fieldSlotToLong(env, window, fieldSlot, &values[i])) {
+            return;
+        }
+    }
+    env->SetLongArrayRegion(valuesObj, 0, numRows, values.get());
+}
+
+static void nativeGetDoubles(JNIEnv* env, jclass clazz, jlong windowPtr,
+        jint startRow, jint numRows, jint column, jdoubleArray valuesObj) {
+    CursorWindow* window = reinterpret_cast<CursorWindow*>(windowPtr);
+    LOG_WINDOW("Getting %d doubles from %d,%d from %p", numRows, startRow, column, window);
+
+    std::unique_ptr<jdouble[]> values(new jdouble[numRows]);
+    for (jint i = 0; i < numRows; i++) {
+        CursorWindow::FieldSlot* fieldSlot = window->getFieldSlot(startRow + i, column);
+        if (!fieldSlot) {
+            throwExceptionWithRowCol(env, startRow + i, column);
+            return;
+        }
+        if (!fieldSlotToDouble(env, window, fieldSlot, &values[i])) {
+            return;
+        }
+    }
+    env->SetDoubleArrayRegion(valuesObj, 0, numRows, values.get());
+}
+
+// Appends the UTF-16 form of a UTF-8 string to chars and returns its length in chars.
+// Invalid UTF-8 is treated as an empty string, as it is by getString().
+static jint appendUtf16(std::vector<char16_t>* chars, const char* str, size_t len) {
+    ssize_t size = utf8_to_utf16_length(reinterpret_cast<const uint8_t*>(str), len);
+    if (size <= 0) {
+        return 0;
+    }
+    size_t start = chars->size();
+    chars->resize(start + size);
+    utf8_to_utf16_no_null_terminator(reinterpret_cast<const uint8_t*>(str), len,
+            chars->data() + start, size);
+    return jint(size);
+}
+
+// Returns the values of a column for a range of rows as a single char[] holding each
+// string back to back, converting fields the way getString() does. lengthsObj receives
+// the length of each string, or -1 for a null field.
+static jcharArray nativeGetStrings(JNIEnv* env, jclass clazz, jlong windowPtr,
+        jint startRow, jint numRows, jint column, jintArray lengthsObj) {
+    CursorWindow* window = reinterpret_cast<CursorWindow*>(windowPtr);
+    LOG_WINDOW("Getting %d strings from %d,%d from %p", numRows, startRow, column, window);
+
+    std::vector<char16_t> chars;
+    std::unique_ptr<jint[]> lengths(new jint[numRows]);
+    for (jint i = 0; i < numRows; i++) {
+        CursorWindow::FieldSlot* fieldSlot = window->getFieldSlot(startRow + i, column);
+        if (!fieldSlot) {
+            throwExceptionWithRowCol(env, startRow + i, column);
+            return NULL;
+        }
+
+        int32_t type = window->getFieldSlotType(fieldSlot);
+        if (type == CursorWindow::FIELD_TYPE_STRING) {
+            size_t sizeIncludingNull;
+            const char* value = window->getFieldSlotValueString(fieldSlot, &sizeIncludingNull);
+            if (!value) {
+                throw_sqlite3_exception(env, "Native could not read string slot");
+                return NULL;
+            }
+            lengths[i] = sizeIncludingNull > 1
+                    ? appendUtf16(&chars, value, sizeIncludingNull - 1) : 0;
+        } else if (type == CursorWindow::FIELD_TYPE_INTEGER) {
+            char buf[32];
+            snprintf(buf, sizeof(buf), "%" PRId64, window->getFieldSlotValueLong(fieldSlot));
+            lengths[i] = appendUtf16(&chars, buf, strlen(buf));
+        } else if (type == CursorWindow::FIELD_TYPE_FLOAT) {
+            char buf[32];
+            snprintf(buf, sizeof(buf), "%g", window->getFieldSlotValueDouble(fieldSlot));
+            lengths[i] = appendUtf16(&chars, buf, strlen(buf));
+        } else if (type == CursorWindow::FIELD_TYPE_NULL) {
+            lengths[i] = -1;
+        } else if (type == CursorWindow::FIELD_TYPE_BLOB) {
+            throw_sqlite3_exception(env, "Unable to convert BLOB to string");
+            return NULL;
+        } else {
+            throwUnknownTypeException(env, type);
+            return NULL;
+        }
+    }
+
+    jcharArray charsObj = env->NewCharArray(chars.size());
+    if (!charsObj) {
+        return NULL;
+    }
+    env->SetCharArrayRegion(charsObj, 0, chars.size(),
+            reinterpret_cast<const jchar*>(chars.data()));
+    env->SetIntArrayRegion(lengthsObj, 0, numRows, lengths.get());
+    return charsObj;
 }
 
 static jboolean nativePutBlob(JNIEnv* env, jclass clazz, jlong windowPtr,
@@ -541,6 +670,12 @@ static const JNINativeMethod sMethods[] =
             (void*)nativeGetLong },
     { "nativeGetDouble", "(JII)D",
             (void*)nativeGetDouble },
+    { "nativeGetLongs", "(JIII[J)V",
+            (void*)nativeGetLongs },
+    { "nativeGetDoubles", "(JIII[D)V",
+            (void*)nativeGetDoubles },
+    { "nativeGetStrings", "(JIII[I)[C",
+            (void*)nativeGetStrings },
     { "nativeCopyStringToBuffer", "(JIILandroid/database/CharArrayBuffer;)V",
             (void*)nativeCopyStringToBuffer },
     { "nativePutBlob", "(J[BII)Z",
@@ -16,10 +16,13 @@
 
 //#define LOG_NDEBUG 0
 #define LOG_TAG "DngCreator_JNI"
+#include <errno.h>
 #include <inttypes.h>
 #include <string.h>
+#include <unistd.h>
 #include <algorithm>
 #include <memory>
+#include <thread>
 #include <vector>
 #include <cmath>
 
@@ -144,6 +147,97 @@ public:
 
 // ----------------------------------------------------------------------------
 
+/**
+ * A copy of the pixels passed to setThumbnail, kept in the format they were given in until
+ * they are converted to the thumbnail's RGB strip.
+ */
+class ThumbnailSource {
+public:
+    enum {
+        YUV_PLANE_COUNT = 3,
+    };
+
+    // Packed ARGB colors, as returned by Bitmap#getPixels.
+    ThumbnailSource(const jint* colors, uint32_t width, uint32_t height);
+    // A YUV_420_888 image; plane data is copied.
+    ThumbnailSource(const uint8_t* const planes[YUV_PLANE_COUNT],
+            const size_t planeSizes[YUV_PLANE_COUNT], const uint32_t rowStrides[YUV_PLANE_COUNT],
+            const uint32_t pixelStrides[YUV_PLANE_COUNT], uint32_t width, uint32_t height);
+
+    uint32_t getWidth() const { return mWidth; }
+    uint32_t getHeight() const { return mHeight; }
+
+    /**
+     * Writes getWidth() * getHeight() RGB pixels to rgbOut.
+     */
+    void convertToRgb(uint8_t* rgbOut) const;
+
+private:
+    void yuvToRgb(uint8_t* rgbOut) const;
+
+    bool mIsYuv;
+    uint32_t mWidth;
+    uint32_t mHeight;
+    std::vector<uint32_t> mColors;
+    std::vector<uint8_t> mPlanes[YUV_PLANE_COUNT];
+    uint32_t mRowStrides[YUV_PLANE_COUNT];
+    uint32_t mPixelStrides[YUV_PLANE_COUNT];
+};
+
+ThumbnailSource::ThumbnailSource(const jint* colors, uint32_t width, uint32_t height) :
+        mIsYuv(false), mWidth(width), mHeight(height), mColors(colors, colors + width * height) {}
+
+ThumbnailSource::ThumbnailSource(const uint8_t* const planes[YUV_PLANE_COUNT],
+        const size_t planeSizes[YUV_PLANE_COUNT], const uint32_t rowStrides[YUV_PLANE_COUNT],
+        const uint32_t pixelStrides[YUV_PLANE_COUNT], uint32_t width, uint32_t height) :
+        mIsYuv(true), mWidth(width), mHeight(height) {
+    for (int i = 0; i < YUV_PLANE_COUNT; ++i) {
+        mPlanes[i].assign(planes[i], planes[i] + planeSizes[i]);
+        mRowStrides[i] = rowStrides[i];
+        mPixelStrides[i] = pixelStrides[i];
+    }
+}
+
+void ThumbnailSource::convertToRgb(uint8_t* rgbOut) const {
+    if (mIsYuv) {
+        yuvToRgb(rgbOut);
+        return;
+    }
+    // Discards alpha
+    for (uint32_t color : mColors) {
+        *rgbOut++ = static_cast<uint8_t>(color >> 16);
+        *rgbOut++ = static_cast<uint8_t>(color >> 8);
+        *rgbOut++ = static_cast<uint8_t>(color);
+    }
+}
+
+void ThumbnailSource::yuvToRgb(uint8_t* rgbOut) const {
+    const float COLOR_MAX = 255;
+    for (uint32_t i = 0; i < mHeight; ++i) {
+        const uint8_t* yRow = mPlanes[0].data() + mRowStrides[0] * i;
+        const uint8_t* uRow = mPlanes[1].data() + mRowStrides[1] * (i / 2);
+        const uint8_t* vRow = mPlanes[2].data() + mRowStrides[2] * (i / 2);
+        for (uint32_t j = 0; j < mWidth; ++j) {
+            float y = yRow[mPixelStrides[0] * j];
+            float cb = uRow[mPixelStrides[1] * (j / 2)];
+            float cr = vRow[mPixelStrides[2] * (j / 2)];
+
+            // convert YUV -> RGB (from JFIF's "Conversion to and from RGB" section)
+            float r = y + 1.402f * (cr - 128);
+            float g = y - 0.34414f * (cb - 128) - 0.71414f * (cr - 128);
+            float b = y + 1.772f * (cb - 128);
+
+            // clamp to [0,255]
+            *rgbOut++ = static_cast<uint8_t>(std::max(0.f, std::min(COLOR_MAX, r)));
+            *rgbOut++ = static_cast<uint8_t>(std::max(0.f, std::min(COLOR_MAX, g)));
+            *rgbOut++ = static_cast<uint8_t>(std::max(0.f, std::min(COLOR_MAX, b)));
+        }
+    }
+}
+
+// End of ThumbnailSource
+// ----------------------------------------------------------------------------
+
 /**
  * Container class for the persistent native context.
  */
@@ -167,7 +261,13 @@ public:
     const uint8_t* getThumbnail() const;
     bool hasThumbnail() const;
 
-    bool setThumbnail(const uint8_t* buffer, uint32_t width, uint32_t height);
+    /**
+     * Sets the thumbnail, converting it to RGB on a worker thread so that the conversion
+     * overlaps with setting up and writing the rest of the DNG. waitForThumbnail() must be
+     * called before the pixels returned by getThumbnail() are read.
+     */
+    bool setThumbnail(std::unique_ptr<ThumbnailSource> source);
+    void waitForThumbnail();
 
     void setOrientation(uint16_t orientation);
     uint16_t getOrientation() const;
@@ -186,6 +286,7 @@ public:
 
 private:
     Vector<uint8_t> mCurrentThumbnail;
+    std::thread mThumbnailThread;
     TiffWriter mWriter;
     std::shared_ptr<CameraMetadata> mCharacteristics;
     std::shared_ptr<CameraMetadata> mResult;
@@ -207,7 +308,9 @@ NativeContext::NativeContext(const CameraMetadata& characteristics, const Camera
         mThumbnailHeight(0), mOrientation(TAG_ORIENTATION_UNKNOWN), mThumbnailSet(false),
         mGpsSet(false), mDescriptionSet(false), mCaptureTimeSet(false) {}
 
-NativeContext::~NativeContext() {}
+NativeContext::~NativeContext() {
+    waitForThumbnail();
+}
 
 TiffWriter* NativeContext::getWriter() {
     return &mWriter;
@@ -237,22 +340,34 @@ bool NativeContext::hasThumbnail() const {
     return mThumbnailSet;
 }
 
-bool NativeContext::setThumbnail(const uint8_t* buffer, uint32_t width, uint32_t height) {
-    mThumbnailWidth = width;
-    mThumbnailHeight = height;
+bool NativeContext::setThumbnail(std::unique_ptr<ThumbnailSource> source) {
+    // A conversion still running for an earlier thumbnail writes into the same buffer.
+    waitForThumbnail();
 
+    uint32_t width = source->getWidth();
+    uint32_t height = source->getHeight();
     size_t size = BYTES_PER_RGB_PIXEL * width * height;
     if (mCurrentThumbnail.resize(size) < 0) {
         ALOGE("%s: Could not resize thumbnail buffer.", __FUNCTION__);
         return false;
     }
+    mThumbnailWidth = width;
+    mThumbnailHeight = height;
 
     uint8_t* thumb = mCurrentThumbnail.editArray();
-    memcpy(thumb, buffer, size);
+    mThumbnailThread = std::thread([thumb](std::unique_ptr<ThumbnailSource> source) {
+        source->convertToRgb(thumb);
+    }, std::move(source));
     mThumbnailSet = true;
     return true;
 }
 
+void NativeContext::waitForThumbnail() {
+    if (mThumbnailThread.joinable()) {
+        mThumbnailThread.join();
+    }
+}
+
 void NativeContext::setOrientation(uint16_t orientation) {
     mOrientation = orientation;
 }
@@ -303,12 +418,25 @@ bool NativeContext::hasCaptureTime() const {
 // End of NativeContext
 // ----------------------------------------------------------------------------
 
+/**
+ * Output that collects small writes, such as the TIFF header and tag entries, into larger
+ * ones. flush() must be called once the file has been written.
+ *
+ * This class is not intended to be used across JNI calls.
+ */
+class BufferedOutput : public Output, public LightRefBase<BufferedOutput> {
+public:
+    virtual ~BufferedOutput() {}
+
+    virtual status_t flush() = 0;
+};
+
 /**
  * Wrapper class for a Java OutputStream.
  *
  * This class is not intended to be used across JNI calls.
  */
-class JniOutputStream : public Output, public LightRefBase<JniOutputStream> {
+class JniOutputStream : public BufferedOutput {
 public:
     JniOutputStream(JNIEnv* env, jobject outStream);
 
@@ -319,17 +447,21 @@ public:
     status_t write(const uint8_t* buf, size_t offset, size_t count);
 
     status_t close();
+
+    status_t flush();
 private:
     enum {
-        BYTE_ARRAY_LENGTH = 4096
+        BYTE_ARRAY_LENGTH = 64 * 1024
     };
     jobject mOutputStream;
     JNIEnv* mEnv;
     jbyteArray mByteArray;
+    // Bytes at the start of mByteArray not yet passed to the stream.
+    size_t mBuffered;
 };
 
 JniOutputStream::JniOutputStream(JNIEnv* env, jobject outStream) : mOutputStream(outStream),
-        mEnv(env) {
+        mEnv(env), mBuffered(0) {
     mByteArray = env->NewByteArray(BYTE_ARRAY_LENGTH);
     if (mByteArray == nullptr) {
         jniThrowException(env, "java/lang/OutOfMemoryError", "Could not allocate byte array.");
@@ -347,23 +479,22 @@ status_t JniOutputStream::open() {
 
 status_t JniOutputStream::write(const uint8_t* buf, size_t offset, size_t count) {
     while(count > 0) {
-        size_t len = BYTE_ARRAY_LENGTH;
+        size_t len = BYTE_ARRAY_LENGTH - mBuffered;
         len = (count > len) ? len : count;
-        mEnv->SetByteArrayRegion(mByteArray, 0, len, reinterpret_cast<const jbyte*>(buf + offset));
+        mEnv->SetByteArrayRegion(mByteArray, mBuffered, len,
+                reinterpret_cast<const jbyte*>(buf + offset));
 
         if (mEnv->ExceptionCheck()) {
             return BAD_VALUE;
         }
 
-        mEnv->CallVoidMethod(mOutputStream, gOutputStreamClassInfo.mWriteMethod, mByteArray,
-                0, len);
+        mBuffered += len;
+        count -= len;
+        offset += len;
 
-        if (mEnv->ExceptionCheck()) {
+        if (mBuffered == BYTE_ARRAY_LENGTH && flush() != OK) {
             return BAD_VALUE;
         }
-
-        count -= len;
-        offset += len;
     }
     return OK;
 }
@@ -373,9 +504,127 @@ status_t JniOutputStream::close() {
     return OK;
 }
 
+status_t JniOutputStream::flush() {
+    if (mBuffered == 0) {
+        return OK;
+    }
+
+    mEnv->CallVoidMethod(mOutputStream, gOutputStreamClassInfo.mWriteMethod, mByteArray,
+            0, mBuffered);
+    mBuffered = 0;
+
+    if (mEnv->ExceptionCheck()) {
+        return BAD_VALUE;
+    }
+    return OK;
+}
+
 // End of JniOutputStream
 // ----------------------------------------------------------------------------
 
+/**
+ * Output writing directly to the file descriptor behind a FileOutputStream, without calling
+ * back into Java.
+ *
+ * Writes at least as large as the buffer, such as whole strips from a direct buffer, go
+ * straight from the caller's memory. Regular files are written with pwrite at offsets
+ * starting from the descriptor's current position, which is moved past the written data
+ * on flush(); other descriptors fall back to write.
+ *
+ * This class is not intended to be used across JNI calls.
+ */
+class FdOutput : public BufferedOutput {
+public:
+    FdOutput(JNIEnv* env, int fd);
+
+    virtual ~FdOutput();
+
+    status_t open();
+
+    status_t write(const uint8_t* buf, size_t offset, size_t count);
+
+    status_t close();
+
+    status_t flush();
+private:
+    enum {
+        BUFFER_SIZE = 256 * 1024
+    };
+
+    status_t writeFully(const uint8_t* buf, size_t count);
+
+    JNIEnv* mEnv;
+    int mFd;
+    // File offset of the next write, or -1 if the descriptor is not seekable.
+    off64_t mPosition;
+    std::unique_ptr<uint8_t[]> mBuffer;
+    size_t mBuffered;
+};
+
+FdOutput::FdOutput(JNIEnv* env, int fd) : mEnv(env), mFd(fd),
+        mPosition(lseek64(fd, 0, SEEK_CUR)), mBuffer(new uint8_t[BUFFER_SIZE]), mBuffered(0) {}
+
+FdOutput::~FdOutput() {}
+
+status_t FdOutput::open() {
+    // Do nothing
+    return OK;
+}
+
+status_t FdOutput::write(const uint8_t* buf, size_t offset, size_t count) {
+    buf += offset;
+    if (mBuffered + count > BUFFER_SIZE && flush() != OK) {
+        return BAD_VALUE;
+    }
+    if (count >= BUFFER_SIZE) {
+        return writeFully(buf, count);
+    }
+    memcpy(mBuffer.get() + mBuffered, buf, count);
+    mBuffered += count;
+    return OK;
+}
+
+status_t FdOutput::close() {
+    // Do nothing
+    return OK;
+}
+
+status_t FdOutput::flush() {
+    status_t res = writeFully(mBuffer.get(), mBuffered);
+    mBuffered = 0;
+    if (res != OK) {
+        return res;
+    }
+    if (mPosition >= 0 && lseek64(mFd, mPosition, SEEK_SET) < 0) {
+        jniThrowIOException(mEnv, errno);
+        return BAD_VALUE;
+    }
+    return OK;
+}
+
+status_t FdOutput::writeFully(const uint8_t* buf, size_t count) {
+    while (count > 0) {
+        ssize_t written = (mPosition >= 0)
+                ? TEMP_FAILURE_RETRY(pwrite64(mFd, buf, count, mPosition))
+                : TEMP_FAILURE_RETRY(::write(mFd, buf, count));
+        if (written <= 0) {
+            ALOGE("%s: Failed to write %zu bytes: %s", __FUNCTION__, count,
+                    written < 0 ? strerror(errno) : "no progress");
+            jniThrowIOException(mEnv, written < 0 ? errno : EIO);
+            return BAD_VALUE;
+        }
+        buf += written;
+        count -= written;
+        if (mPosition >= 0) {
+            mPosition += written;
+        }
+    }
+    return OK;
+}
+
+// End of FdOutput
+// ----------------------------------------------------------------------------
+
 /**
  * Wrapper class for a Java InputStream.
  *
@@ -763,6 +1012,37 @@ uint32_t DirectStripSource::getIfd() const {
 // End of DirectStripSource
 // ----------------------------------------------------------------------------
 
+/**
+ * StripSource for the thumbnail, which waits for the thumbnail's conversion to finish before
+ * writing it.
+ *
+ * This class is not intended to be used across JNI calls.
+ */
+class ThumbnailStripSource : public DirectStripSource {
+public:
+    ThumbnailStripSource(JNIEnv* env, NativeContext* context);
+
+    virtual status_t writeToStream(Output& stream, uint32_t count);
+private:
+    NativeContext* mContext;
+};
+
+ThumbnailStripSource::ThumbnailStripSource(JNIEnv* env, NativeContext* context) :
+        DirectStripSource(env, context->getThumbnail(), TIFF_IFD_0,
+                context->getThumbnailWidth(), context->getThumbnailHeight(),
+                SAMPLES_PER_RGB_PIXEL * BYTES_PER_RGB_SAMPLE,
+                SAMPLES_PER_RGB_PIXEL * BYTES_PER_RGB_SAMPLE * context->getThumbnailWidth(),
+                /*offset*/0, BYTES_PER_RGB_SAMPLE, SAMPLES_PER_RGB_PIXEL),
+        mContext(context) {}
+
+status_t ThumbnailStripSource::writeToStream(Output& stream, uint32_t count) {
+    mContext->waitForThumbnail();
+    return DirectStripSource::writeToStream(stream, count);
+}
+
+// End of ThumbnailStripSource
+// ----------------------------------------------------------------------------
+
 /**
  * Calculate the default crop relative to the "active area" of the image sensor (this active area
  * will always be the pre-correction active area rectangle), and set this.
@@ -2094,8 +2374,8 @@ static void DngCreator_nativeSetGpsTags(JNIEnv* env, jobject thiz, jintArray lat
     context->setGpsData(data);
 }
 
-static void DngCreator_nativeSetThumbnail(JNIEnv* env, jobject thiz, jobject buffer, jint width,
-        jint height) {
+static void DngCreator_nativeSetThumbnailColors(JNIEnv* env, jobject thiz, jintArray colors,
+        jint width, jint height) {
     ALOGV("%s:", __FUNCTION__);
 
     NativeContext* context = DngCreator_getNativeContext(env, thiz);
@@ -2106,33 +2386,136 @@ static void DngCreator_nativeSetThumbnail(JNIEnv* env, jobject thiz, jobject buf
         return;
     }
 
-    size_t fullSize = width * height * BYTES_PER_RGB_PIXEL;
-    jlong capacity = env->GetDirectBufferCapacity(buffer);
-    if (static_cast<uint64_t>(capacity) != static_cast<uint64_t>(fullSize)) {
+    size_t fullSize = width * height;
+    jsize length = env->GetArrayLength(colors);
+    if (static_cast<uint64_t>(length) != static_cast<uint64_t>(fullSize)) {
         jniThrowExceptionFmt(env, "java/lang/AssertionError",
                 "Invalid size %d for thumbnail, expected size was %d",
-                capacity, fullSize);
+                length, fullSize);
+        return;
+    }
+
+    jint* colorArray = env->GetIntArrayElements(colors, nullptr);
+    if (colorArray == nullptr) {
+        ALOGE("%s: Could not get thumbnail colors", __FUNCTION__);
+        return;
+    }
+    std::unique_ptr<ThumbnailSource> source(new ThumbnailSource(colorArray, width, height));
+    env->ReleaseIntArrayElements(colors, colorArray, JNI_ABORT);
+
+    if (!context->setThumbnail(std::move(source))) {
+        jniThrowException(env, "java/lang/IllegalStateException",
+                "Failed to set thumbnail.");
+        return;
+    }
+}
+
+static void DngCreator_nativeSetThumbnailYuv(JNIEnv* env, jobject thiz, jobjectArray planes,
+        jintArray rowStrides, jintArray pixelStrides, jint width, jint height) {
+    ALOGV("%s:", __FUNCTION__);
+
+    NativeContext* context = DngCreator_getNativeContext(env, thiz);
+    if (context == nullptr) {
+        ALOGE("%s: Failed to initialize DngCreator", __FUNCTION__);
+        jniThrowException(env, "java/lang/AssertionError",
+                "setThumbnail called with uninitialized DngCreator");
         return;
     }
 
-    uint8_t* pixelBytes = reinterpret_cast<uint8_t*>(env->GetDirectBufferAddress(buffer));
-    if (pixelBytes == nullptr) {
-        ALOGE("%s: Could not get native ByteBuffer", __FUNCTION__);
-        jniThrowException(env, "java/lang/IllegalArgumentException", "Invalid ByteBuffer");
+    const int planeCount = ThumbnailSource::YUV_PLANE_COUNT;
+    if (env->GetArrayLength(planes) != planeCount ||
+            env->GetArrayLength(rowStrides) != planeCount ||
+            env->GetArrayLength(pixelStrides) != planeCount) {
+        jniThrowException(env, "java/lang/IllegalArgumentException",
+                "Thumbnail must have 3 planes");
         return;
     }
 
-    if (!context->setThumbnail(pixelBytes, width, height)) {
+    jint rowStrideArray[planeCount];
+    jint pixelStrideArray[planeCount];
+    env->GetIntArrayRegion(rowStrides, 0, planeCount, rowStrideArray);
+    env->GetIntArrayRegion(pixelStrides, 0, planeCount, pixelStrideArray);
+
+    const uint8_t* planeBytes[planeCount];
+    size_t planeSizes[planeCount];
+    uint32_t uRowStrides[planeCount];
+    uint32_t uPixelStrides[planeCount];
+    for (int i = 0; i < planeCount; ++i) {
+        jobject plane = env->GetObjectArrayElement(planes, i);
+        planeBytes[i] = reinterpret_cast<const uint8_t*>(env->GetDirectBufferAddress(plane));
+        jlong capacity = env->GetDirectBufferCapacity(plane);
+        env->DeleteLocalRef(plane);
+        if (planeBytes[i] == nullptr || capacity < 0) {
+            ALOGE("%s: Could not get native ByteBuffer for plane %d", __FUNCTION__, i);
+            jniThrowException(env, "java/lang/IllegalArgumentException", "Invalid ByteBuffer");
+            return;
+        }
+
+        // Every sample read during conversion has to lie within the plane.
+        uint32_t planeWidth = (i == 0) ? width : (width + 1) / 2;
+        uint32_t planeHeight = (i == 0) ? height : (height + 1) / 2;
+        uint64_t lastSample = static_cast<uint64_t>(rowStrideArray[i]) * (planeHeight - 1) +
+                static_cast<uint64_t>(pixelStrideArray[i]) * (planeWidth - 1);
+        if (rowStrideArray[i] < 0 || pixelStrideArray[i] < 0 ||
+                lastSample >= static_cast<uint64_t>(capacity)) {
+            jniThrowExceptionFmt(env, "java/lang/IllegalArgumentException",
+                    "Invalid size %" PRId64 " for thumbnail plane %d", capacity, i);
+            return;
+        }
+        planeSizes[i] = capacity;
+        uRowStrides[i] = rowStrideArray[i];
+        uPixelStrides[i] = pixelStrideArray[i];
+    }
+
+    std::unique_ptr<ThumbnailSource> source(new ThumbnailSource(planeBytes, planeSizes,
+            uRowStrides, uPixelStrides, width, height));
+    if (!context->setThumbnail(std::move(source))) {
         jniThrowException(env, "java/lang/IllegalStateException",
                 "Failed to set thumbnail.");
         return;
     }
 }
 
+/**
+ * Returns the output for a write: the file descriptor behind outFd if one was given, and the
+ * Java OutputStream otherwise.
+ */
+static sp<BufferedOutput> DngCreator_createOutput(JNIEnv* env, jobject outStream, jobject outFd) {
+    if (outFd != nullptr) {
+        int fd = jniGetFDFromFileDescriptor(env, outFd);
+        if (fd >= 0) {
+            ALOGV("%s: Writing directly to fd %d.", __FUNCTION__, fd);
+            return new FdOutput(env, fd);
+        }
+    }
+    sp<BufferedOutput> out = new JniOutputStream(env, outStream);
+    if (env->ExceptionCheck()) {
+        ALOGE("%s: Could not allocate buffers for output stream", __FUNCTION__);
+        return nullptr;
+    }
+    return out;
+}
+
+/**
+ * Writes the DNG file laid out by writer to out, throwing if that fails.
+ */
+static void DngCreator_writeFile(JNIEnv* env, const sp<TiffWriter>& writer,
+        const sp<BufferedOutput>& out, Vector<StripSource*>& sources) {
+    status_t ret = OK;
+    if ((ret = writer->write(out.get(), sources.editArray(), sources.size())) != OK ||
+            (ret = out->flush()) != OK) {
+        ALOGE("%s: write failed with error %d.", __FUNCTION__, ret);
+        if (!env->ExceptionCheck()) {
+            jniThrowExceptionFmt(env, "java/io/IOException",
+                    "Encountered error %d while writing file.", ret);
+        }
+    }
+}
+
 // TODO: Refactor out common preamble for the two nativeWrite methods.
-static void DngCreator_nativeWriteImage(JNIEnv* env, jobject thiz, jobject outStream, jint width,
-        jint height, jobject inBuffer, jint rowStride, jint pixStride, jlong offset,
-        jboolean isDirect) {
+static void DngCreator_nativeWriteImage(JNIEnv* env, jobject thiz, jobject outStream,
+        jobject outFd, jint width, jint height, jobject inBuffer, jint rowStride, jint pixStride,
+        jlong offset, jboolean isDirect) {
     ALOGV("%s:", __FUNCTION__);
     ALOGV("%s: nativeWriteImage called with: width=%d, height=%d, "
           "rowStride=%d, pixStride=%d, offset=%" PRId64, __FUNCTION__, width,
@@ -2143,9 +2526,8 @@ static void DngCreator_nativeWriteImage(JNIEnv* env, jobject thiz, jobject outSt
     uint32_t uHeight = static_cast<uint32_t>(height);
     uint64_t uOffset = static_cast<uint64_t>(offset);
 
-    sp<JniOutputStream> out = new JniOutputStream(env, outStream);
-    if(env->ExceptionCheck()) {
-        ALOGE("%s: Could not allocate buffers for output stream", __FUNCTION__);
+    sp<BufferedOutput> out = DngCreator_createOutput(env, outStream, outFd);
+    if (out.get() == nullptr) {
         return;
     }
 
@@ -2176,12 +2558,7 @@ static void DngCreator_nativeWriteImage(JNIEnv* env, jobject thiz, jobject outSt
 
     if (hasThumbnail) {
         ALOGV("%s: Adding thumbnail strip sources.", __FUNCTION__);
-        uint32_t bytesPerPixel = SAMPLES_PER_RGB_PIXEL * BYTES_PER_RGB_SAMPLE;
-        uint32_t thumbWidth = context->getThumbnailWidth();
-        thumbnailSource = new DirectStripSource(env, context->getThumbnail(), TIFF_IFD_0,
-                thumbWidth, context->getThumbnailHeight(), bytesPerPixel,
-                bytesPerPixel * thumbWidth, /*offset*/0, BYTES_PER_RGB_SAMPLE,
-                SAMPLES_PER_RGB_PIXEL);
+        thumbnailSource = new ThumbnailStripSource(env, context);
         sources.add(thumbnailSource.get());
         targetIfd = TIFF_IFD_SUB1;
     }
@@ -2208,15 +2585,7 @@ static void DngCreator_nativeWriteImage(JNIEnv* env, jobject thiz, jobject outSt
                 rStride, uOffset, BYTES_PER_SAMPLE, SAMPLES_PER_RAW_PIXEL);
         sources.add(&stripSource);
 
-        status_t ret = OK;
-        if ((ret = writer->write(out.get(), sources.editArray(), sources.size())) != OK) {
-            ALOGE("%s: write failed with error %d.", __FUNCTION__, ret);
-            if (!env->ExceptionCheck()) {
-                jniThrowExceptionFmt(env, "java/io/IOException",
-                        "Encountered error %d while writing file.", ret);
-            }
-            return;
-        }
+        DngCreator_writeFile(env, writer, out, sources);
     } else {
         inBuf = new JniInputByteBuffer(env, inBuffer);
 
@@ -2225,20 +2594,12 @@ static void DngCreator_nativeWriteImage(JNIEnv* env, jobject thiz, jobject outSt
                  rStride, uOffset, BYTES_PER_SAMPLE, SAMPLES_PER_RAW_PIXEL);
         sources.add(&stripSource);
 
-        status_t ret = OK;
-        if ((ret = writer->write(out.get(), sources.editArray(), sources.size())) != OK) {
-            ALOGE("%s: write failed with error %d.", __FUNCTION__, ret);
-            if (!env->ExceptionCheck()) {
-                jniThrowExceptionFmt(env, "java/io/IOException",
-                        "Encountered error %d while writing file.", ret);
-            }
-            return;
-        }
+        DngCreator_writeFile(env, writer, out, sources);
     }
 }
 
 static void DngCreator_nativeWriteInputStream(JNIEnv* env, jobject thiz, jobject outStream,
-        jobject inStream, jint width, jint height, jlong offset) {
+        jobject outFd, jobject inStream, jint width, jint height, jlong offset) {
     ALOGV("%s:", __FUNCTION__);
 
     uint32_t rowStride = width * BYTES_PER_SAMPLE;
@@ -2251,9 +2612,8 @@ static void DngCreator_nativeWriteInputStream(JNIEnv* env, jobject thiz, jobject
           "rowStride=%d, pixStride=%d, offset=%" PRId64, __FUNCTION__, width,
           height, rowStride, pixStride, offset);
 
-    sp<JniOutputStream> out = new JniOutputStream(env, outStream);
-    if (env->ExceptionCheck()) {
-        ALOGE("%s: Could not allocate buffers for output stream", __FUNCTION__);
+    sp<BufferedOutput> out = DngCreator_createOutput(env, outStream, outFd);
+    if (out.get() == nullptr) {
         return;
     }
 
@@ -2282,12 +2642,7 @@ static void DngCreator_nativeWriteInputStream(JNIEnv* env, jobject thiz, jobject
 
     if (hasThumbnail) {
         ALOGV("%s: Adding thumbnail strip sources.", __FUNCTION__);
-        uint32_t bytesPerPixel = SAMPLES_PER_RGB_PIXEL * BYTES_PER_RGB_SAMPLE;
-        uint32_t width = context->getThumbnailWidth();
-        thumbnailSource = new DirectStripSource(env, context->getThumbnail(), TIFF_IFD_0,
-                width, context->getThumbnailHeight(), bytesPerPixel,
-                bytesPerPixel * width, /*offset*/0, BYTES_PER_RGB_SAMPLE,
-                SAMPLES_PER_RGB_PIXEL);
+        thumbnailSource = new ThumbnailStripSource(env, context);
         sources.add(thumbnailSource.get());
         targetIfd = TIFF_IFD_SUB1;
     }
@@ -2299,15 +2654,7 @@ static void DngCreator_nativeWriteInputStream(JNIEnv* env, jobject thiz, jobject
              rowStride, uOffset, BYTES_PER_SAMPLE, SAMPLES_PER_RAW_PIXEL);
     sources.add(&stripSource);
 
-    status_t ret = OK;
-    if ((ret = writer->write(out.get(), sources.editArray(), sources.size())) != OK) {
-        ALOGE("%s: write failed with error %d.", __FUNCTION__, ret);
-        if (!env->ExceptionCheck()) {
-            jniThrowExceptionFmt(env, "java/io/IOException",
-                    "Encountered error %d while writing file.", ret);
-        }
-        return;
-    }
+    DngCreator_writeFile(env, writer, out, sources);
 }
 
 } /*extern "C" */
@@ -2322,10 +2669,14 @@ static const JNINativeMethod gDngCreatorMethods[] = {
     {"nativeSetDescription",    "(Ljava/lang/String;)V", (void*) DngCreator_nativeSetDescription},
     {"nativeSetGpsTags",    "([ILjava/lang/String;[ILjava/lang/String;Ljava/lang/String;[I)V",
             (void*) DngCreator_nativeSetGpsTags},
-    {"nativeSetThumbnail","(Ljava/nio/ByteBuffer;II)V", (void*) DngCreator_nativeSetThumbnail},
-    {"nativeWriteImage",        "(Ljava/io/OutputStream;IILjava/nio/ByteBuffer;IIJZ)V",
+    {"nativeSetThumbnailColors", "([III)V", (void*) DngCreator_nativeSetThumbnailColors},
+    {"nativeSetThumbnailYuv", "([Ljava/nio/ByteBuffer;[I[III)V",
+            (void*) DngCreator_nativeSetThumbnailYuv},
+    {"nativeWriteImage",        "(Ljava/io/OutputStream;Ljava/io/FileDescriptor;II"
+            "Ljava/nio/ByteBuffer;IIJZ)V",
             (void*) DngCreator_nativeWriteImage},
-    {"nativeWriteInputStream",    "(Ljava/io/OutputStream;Ljava/io/InputStream;IIJ)V",
+    {"nativeWriteInputStream",    "(Ljava/io/OutputStream;Ljava/io/FileDescriptor;"
+            "Ljava/io/InputStream;IIJ)V",
             (void*) DngCreator_nativeWriteInputStream},
 };
 
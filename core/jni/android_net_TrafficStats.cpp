@@ -23,11 +23,16 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#include <vector>
+
 #include "core_jni_helpers.h"
 #include <jni.h>
 #include <nativehelper/ScopedUtfChars.h>
 #include <utils/misc.h>
 #include <utils/Log.h>
+#include <utils/Mutex.h>
+
+#include "netstats_reader.h"
 
 namespace android {
 
@@ -74,79 +79,61 @@ static uint64_t getStatsType(struct Stats* stats, StatsType type) {
     }
 }
 
+// Reused across calls, guarded by gReadLock.
+static Mutex gReadLock;
+static std::vector<char> gReadBuffer;
+
 static int parseIfaceStats(const char* iface, struct Stats* stats) {
-    FILE *fp = fopen(QTAGUID_IFACE_STATS, "r");
-    if (fp == NULL) {
+    Mutex::Autolock _l(gReadLock);
+    if (!readStatsFile(QTAGUID_IFACE_STATS, &gReadBuffer)) {
         return -1;
     }
 
-    char buffer[384];
-    char cur_iface[32];
+    const size_t ifaceLen = iface ? strlen(iface) : 0;
     bool foundTcp = false;
-    uint64_t rxBytes, rxPackets, txBytes, txPackets, tcpRxPackets, tcpTxPackets;
-
-    while (fgets(buffer, sizeof(buffer), fp) != NULL) {
-        int matched = sscanf(buffer, "%31s %" SCNu64 " %" SCNu64 " %" SCNu64
-                " %" SCNu64 " " "%*u %" SCNu64 " %*u %*u %*u %*u "
-                "%*u %" SCNu64 " %*u %*u %*u %*u", cur_iface, &rxBytes,
-                &rxPackets, &txBytes, &txPackets, &tcpRxPackets, &tcpTxPackets);
-        if (matched >= 5) {
-            if (matched == 7) {
-                foundTcp = true;
-            }
-            if (!iface || !strcmp(iface, cur_iface)) {
-                stats->rxBytes += rxBytes;
-                stats->rxPackets += rxPackets;
-                stats->txBytes += txBytes;
-                stats->txPackets += txPackets;
-                if (matched == 7) {
-                    stats->tcpRxPackets += tcpRxPackets;
-                    stats->tcpTxPackets += tcpTxPackets;
-                }
-            }
+    forEachStatsLine(gReadBuffer.data(), gReadBuffer.size() - 1, [&](char* line, char* end) {
+        IfaceStatsRow row;
+        if (!parseIfaceStatsLine(line, end, &row)) {
+            return;
         }
-    }
+        if (row.hasTcp) {
+            foundTcp = true;
+        }
+        if (!iface || (row.ifaceLen == ifaceLen && !memcmp(iface, row.iface, ifaceLen))) {
+            stats->rxBytes += row.rxBytes;
+            stats->rxPackets += row.rxPackets;
+            stats->txBytes += row.txBytes;
+            stats->txPackets += row.txPackets;
+            stats->tcpRxPackets += row.tcpRxPackets;
+            stats->tcpTxPackets += row.tcpTxPackets;
+        }
+    });
 
     if (!foundTcp) {
         stats->tcpRxPackets = UNKNOWN;
         stats->tcpTxPackets = UNKNOWN;
     }
-
-    if (fclose(fp) != 0) {
-        return -1;
-    }
     return 0;
 }
 
 static int parseUidStats(const uint32_t uid, struct Stats* stats) {
-    FILE *fp = fopen(QTAGUID_UID_STATS, "r");
-    if (fp == NULL) {
+    Mutex::Autolock _l(gReadLock);
+    if (!readStatsFile(QTAGUID_UID_STATS, &gReadBuffer)) {
         return -1;
     }
 
-    char buffer[384];
-    char iface[32];
-    uint32_t idx, cur_uid, set;
-    uint64_t tag, rxBytes, rxPackets, txBytes, txPackets;
-
-    while (fgets(buffer, sizeof(buffer), fp) != NULL) {
-        if (sscanf(buffer,
-                "%" SCNu32 " %31s 0x%" SCNx64 " %u %u %" SCNu64 " %" SCNu64
-                " %" SCNu64 " %" SCNu64 "",
-                &idx, iface, &tag, &cur_uid, &set, &rxBytes, &rxPackets,
-                &txBytes, &txPackets) == 9) {
-            if (uid == cur_uid && tag == 0L) {
-                stats->rxBytes += rxBytes;
-                stats->rxPackets += rxPackets;
-                stats->txBytes += txBytes;
-                stats->txPackets += txPackets;
-            }
+    forEachStatsLine(gReadBuffer.data(), gReadBuffer.size() - 1, [&](char* line, char* end) {
+        QtaguidStatsRow row;
+        if (parseQtaguidStatsLine(line, end, &row) != QTAGUID_ROW_OK) {
+            return;
         }
-    }
-
-    if (fclose(fp) != 0) {
-        return -1;
-    }
+        if (uid == (uint32_t) row.uid && row.kernelTag == 0) {
+            stats->rxBytes += row.rxBytes;
+            stats->rxPackets += row.rxPackets;
+            stats->txBytes += row.txBytes;
+            stats->txPackets += row.txPackets;
+        }
+    });
     return 0;
 }
 
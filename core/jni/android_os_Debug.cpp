@@ -860,6 +860,7 @@ static jint android_os_getBinderReceivedTransactions(JNIEnv *env, jobject clazz)
 // these are implemented in android_util_Binder.cpp
 jint android_os_Debug_getLocalObjectCount(JNIEnv* env, jobject clazz);
 jint android_os_Debug_getProxyObjectCount(JNIEnv* env, jobject clazz);
+jlongArray android_os_Debug_getBinderProxyLookupStats(JNIEnv* env, jobject clazz);
 jint android_os_Debug_getDeathObjectCount(JNIEnv* env, jobject clazz);
 
 
@@ -1108,6 +1109,8 @@ static const JNINativeMethod gMethods[] = {
             (void*)android_os_Debug_getLocalObjectCount },
     { "getBinderProxyObjectCount", "()I",
             (void*)android_os_Debug_getProxyObjectCount },
+    { "getBinderProxyLookupStats", "()[J",
+            (void*)android_os_Debug_getBinderProxyLookupStats },
     { "getBinderDeathObjectCount", "()I",
             (void*)android_os_Debug_getDeathObjectCount },
     { "dumpJavaBacktraceToFileTimeout", "(ILjava/lang/String;I)Z",
@@ -21,6 +21,7 @@
 #include "android_util_Binder.h"
 
 #include <atomic>
+#include <unordered_map>
 #include <fcntl.h>
 #include <inttypes.h>
 #include <stdio.h>
@@ -41,6 +42,7 @@
 #include <utils/Log.h>
 #include <utils/String8.h>
 #include <utils/SystemClock.h>
+#include <utils/Timers.h>
 #include <utils/threads.h>
 
 #include <nativehelper/JNIHelp.h>
@@ -97,7 +99,7 @@ static struct binderproxy_offsets_t
 {
     // Class state.
     jclass mClass;
-    jmethodID mGetInstance;
+    jmethodID mConstructor;
     jmethodID mSendDeathNotice;
 
     // Object state.
@@ -145,9 +147,9 @@ static struct thread_dispatch_offsets_t
 static constexpr int32_t PROXY_WARN_INTERVAL = 5000;
 static constexpr uint32_t GC_INTERVAL = 1000;
 
-// Protected by gProxyLock. We warn if this gets too large.
-static int32_t gNumProxies = 0;
-static int32_t gProxiesWarned = 0;
+// Number of live BinderProxies. We warn if this gets too large.
+static std::atomic<int32_t> gNumProxies(0);
+static std::atomic<int32_t> gProxiesWarned(0);
 
 // Number of GlobalRefs held by JavaBBinders.
 static std::atomic<uint32_t> gNumLocalRefsCreated(0);
@@ -616,17 +618,92 @@ struct BinderProxyNativeData {
     // Death recipients for mObject. Reference counted only because DeathRecipients
     // hold a weak reference that can be temporarily promoted.
     sp<DeathRecipientList> mOrgue;  // Death recipients for mObject.
+
+    // Set once the BinderProxy's NativeAllocationRegistry has taken this over, after which
+    // only BinderProxy_destroy may free it.
+    bool mRegistered = false;
 };
 
 BinderProxyNativeData* getBPNativeData(JNIEnv* env, jobject obj) {
     return (BinderProxyNativeData *) env->GetLongField(obj, gBinderProxyOffsets.mNativeData);
 }
 
-static Mutex gProxyLock;
+// The BinderProxy for each native IBinder proxy, held by a weak global reference so that
+// the BinderProxy can be collected once Java code drops it. The map is split into shards
+// by IBinder address, so that threads unmarshalling different binders rarely wait for each
+// other, and finding an existing BinderProxy takes no call into Java.
+struct BinderProxyEntry {
+    jweak mProxy;
+    // The BinderProxy's native data. Lets BinderProxy_destroy tell whether the entry still
+    // belongs to the proxy being destroyed, or to a newer one for the same IBinder.
+    BinderProxyNativeData* mNativeData;
+};
+
+struct BinderProxyShard {
+    Mutex mLock;
+    std::unordered_map<IBinder*, BinderProxyEntry> mProxies;
+};
+
+static constexpr size_t PROXY_SHARD_COUNT = 32;
+static BinderProxyShard gProxyShards[PROXY_SHARD_COUNT];
 
-// We may cache a single BinderProxyNativeData node to avoid repeat allocation.
-// All fields are null. Protected by gProxyLock.
-static BinderProxyNativeData *gNativeDataCache;
+// Used to delete weak references from BinderProxy_destroy, which is passed no JNIEnv.
+static JavaVM* gProxyVM;
+
+// Lookup statistics, reported by Debug.getBinderProxyLookupStats().
+static std::atomic<uint64_t> gProxyLookups(0);
+static std::atomic<uint64_t> gProxyLookupHits(0);
+static std::atomic<uint64_t> gProxiesCreated(0);
+// Times two threads created a BinderProxy for the same IBinder at once; one was dropped.
+static std::atomic<uint64_t> gProxyCreationRaces(0);
+// Times a shard's lock was already held when a thread came to take it.
+static std::atomic<uint64_t> gProxyShardContention(0);
+static std::atomic<uint64_t> gProxyLookupNanos(0);
+static std::atomic<uint64_t> gProxyMaxLookupNanos(0);
+
+static BinderProxyShard& proxyShardFor(IBinder* binder)
+{
+    // Objects are at least 8-byte aligned; mix the bits above that.
+    uintptr_t hash = reinterpret_cast<uintptr_t>(binder) >> 3;
+    hash ^= hash >> 5;
+    return gProxyShards[hash % PROXY_SHARD_COUNT];
+}
+
+// Holds a shard's lock, counting the times it had to wait for it.
+class AutoShardLock {
+public:
+    explicit AutoShardLock(BinderProxyShard& shard) : mLock(shard.mLock) {
+        if (mLock.tryLock() != NO_ERROR) {
+            gProxyShardContention.fetch_add(1, std::memory_order_relaxed);
+            mLock.lock();
+        }
+    }
+    ~AutoShardLock() { mLock.unlock(); }
+
+private:
+    Mutex& mLock;
+};
+
+// Returns a local reference to the live BinderProxy for binder, or NULL if there is none.
+static jobject findProxyLocked(JNIEnv* env, BinderProxyShard& shard, IBinder* binder)
+{
+    auto it = shard.mProxies.find(binder);
+    if (it == shard.mProxies.end()) {
+        return NULL;
+    }
+    // NULL if the BinderProxy has been collected; BinderProxy_destroy removes the entry.
+    return env->NewLocalRef(it->second.mProxy);
+}
+
+static void recordProxyLookup(nsecs_t startTime)
+{
+    uint64_t nanos = systemTime(SYSTEM_TIME_MONOTONIC) - startTime;
+    gProxyLookupNanos.fetch_add(nanos, std::memory_order_relaxed);
+    uint64_t max = gProxyMaxLookupNanos.load(std::memory_order_relaxed);
+    while (nanos > max && !gProxyMaxLookupNanos.compare_exchange_weak(max, nanos,
+            std::memory_order_relaxed)) {
+    }
+}
 
 // If the argument is a JavaBBinder, return the Java object that was used to create it.
 // Otherwise return a BinderProxy for the IBinder. If a previous call was passed the
@@ -642,37 +719,69 @@ jobject javaObjectForIBinder(JNIEnv* env, const sp<IBinder>& val)
         return object;
     }
 
-    // For the rest of the function we will hold this lock, to serialize
-    // looking/creation/destruction of Java proxies for native Binder proxies.
-    AutoMutex _l(gProxyLock);
+    const nsecs_t startTime = systemTime(SYSTEM_TIME_MONOTONIC);
+    gProxyLookups.fetch_add(1, std::memory_order_relaxed);
+    BinderProxyShard& shard = proxyShardFor(val.get());
+    jobject object;
+    {
+        AutoShardLock _l(shard);
+        object = findProxyLocked(env, shard, val.get());
+    }
+    if (object != NULL) {
+        gProxyLookupHits.fetch_add(1, std::memory_order_relaxed);
+        recordProxyLookup(startTime);
+        return object;
+    }
 
-    BinderProxyNativeData* nativeData = gNativeDataCache;
-    if (nativeData == nullptr) {
-        nativeData = new BinderProxyNativeData();
+    // Create the BinderProxy without holding the shard's lock; the constructor calls into
+    // Java, and may wait for a GC that destroys other proxies in this shard.
+    BinderProxyNativeData* nativeData = new BinderProxyNativeData();
+    nativeData->mOrgue = new DeathRecipientList;
+    nativeData->mObject = val;
+    object = env->NewObject(gBinderProxyOffsets.mClass, gBinderProxyOffsets.mConstructor,
+            (jlong) nativeData);
+    // Once registered, nativeData belongs to the BinderProxy, and BinderProxy_destroy counts
+    // it down even if the constructor throws afterwards or the proxy loses the race below.
+    int32_t numProxies = 0;
+    if (nativeData->mRegistered) {
+        numProxies = ++gNumProxies;
     }
-    // gNativeDataCache is now logically empty.
-    jobject object = env->CallStaticObjectMethod(gBinderProxyOffsets.mClass,
-            gBinderProxyOffsets.mGetInstance, (jlong) nativeData, (jlong) val.get());
     if (env->ExceptionCheck()) {
-        gNativeDataCache = nativeData;
+        // If the constructor threw after registering nativeData, the registry frees it
+        // once the unreachable BinderProxy is collected.
+        if (!nativeData->mRegistered) {
+            delete nativeData;
+        }
         return NULL;
     }
-    BinderProxyNativeData* actualNativeData = getBPNativeData(env, object);
-    if (actualNativeData == nativeData) {
-        // New BinderProxy; we still have exclusive access.
-        nativeData->mOrgue = new DeathRecipientList;
-        nativeData->mObject = val;
-        gNativeDataCache = nullptr;
-        ++gNumProxies;
-        if (++gNumProxies >= gProxiesWarned + PROXY_WARN_INTERVAL) {
-            ALOGW("Unexpectedly many live BinderProxies: %d\n", gNumProxies);
-            gProxiesWarned = gNumProxies;
+    gProxiesCreated.fetch_add(1, std::memory_order_relaxed);
+    int32_t warned = gProxiesWarned.load(std::memory_order_relaxed);
+    if (numProxies >= warned + PROXY_WARN_INTERVAL
+            && gProxiesWarned.compare_exchange_strong(warned, numProxies)) {
+        ALOGW("Unexpectedly many live BinderProxies: %d\n", numProxies);
+    }
+
+    {
+        AutoShardLock _l(shard);
+        jobject existing = findProxyLocked(env, shard, val.get());
+        if (existing != NULL) {
+            // Another thread created one first. Ours is never handed out and will be
+            // collected.
+            gProxyCreationRaces.fetch_add(1, std::memory_order_relaxed);
+            env->DeleteLocalRef(object);
+            object = existing;
+        } else {
+            BinderProxyEntry& entry = shard.mProxies[val.get()];
+            if (entry.mProxy != NULL) {
+                // The previous BinderProxy was collected but not destroyed yet.
+                env->DeleteWeakGlobalRef(entry.mProxy);
+            }
+            entry.mProxy = env->NewWeakGlobalRef(object);
+            entry.mNativeData = nativeData;
         }
-    } else {
-        // nativeData wasn't used. Reuse it the next time.
-        gNativeDataCache = nativeData;
     }
 
+    recordProxyLookup(startTime);
     return object;
 }
 
@@ -948,10 +1057,28 @@ jint android_os_Debug_getLocalObjectCount(JNIEnv* env, jobject clazz)
 
 jint android_os_Debug_getProxyObjectCount(JNIEnv* env, jobject clazz)
 {
-    AutoMutex _l(gProxyLock);
     return gNumProxies;
 }
 
+jlongArray android_os_Debug_getBinderProxyLookupStats(JNIEnv* env, jobject clazz)
+{
+    // Ordered as the Debug.BINDER_PROXY_STATS_* indices.
+    const jlong stats[] = {
+        (jlong) gProxyLookups.load(std::memory_order_relaxed),
+        (jlong) gProxyLookupHits.load(std::memory_order_relaxed),
+        (jlong) gProxiesCreated.load(std::memory_order_relaxed),
+        (jlong) gProxyCreationRaces.load(std::memory_order_relaxed),
+        (jlong) gProxyShardContention.load(std::memory_order_relaxed),
+        (jlong) gProxyLookupNanos.load(std::memory_order_relaxed),
+        (jlong) gProxyMaxLookupNanos.load(std::memory_order_relaxed),
+    };
+    jlongArray result = env->NewLongArray(NELEM(stats));
+    if (result != NULL) {
+        env->SetLongArrayRegion(result, 0, NELEM(stats), stats);
+    }
+    return result;
+}
+
 jint android_os_Debug_getDeathObjectCount(JNIEnv* env, jobject clazz)
 {
     return gNumDeathRefsCreated - gNumDeathRefsDeleted;
@@ -1287,12 +1414,26 @@ static jboolean android_os_BinderProxy_unlinkToDeath(JNIEnv* env, jobject obj,
 
 static void BinderProxy_destroy(void* rawNativeData)
 {
-    // Don't race with construction/initialization
-    AutoMutex _l(gProxyLock);
-
     BinderProxyNativeData * nativeData = (BinderProxyNativeData *) rawNativeData;
     LOGDEATH("Destroying BinderProxy: binder=%p drl=%p\n",
             nativeData->mObject.get(), nativeData->mOrgue.get());
+
+    // Drop the map entry, unless it already points to a newer BinderProxy.
+    BinderProxyShard& shard = proxyShardFor(nativeData->mObject.get());
+    {
+        AutoShardLock _l(shard);
+        auto it = shard.mProxies.find(nativeData->mObject.get());
+        if (it != shard.mProxies.end() && it->second.mNativeData == nativeData) {
+            JNIEnv* env = javavm_to_jnienv(gProxyVM);
+            if (env != NULL) {
+                env->DeleteWeakGlobalRef(it->second.mProxy);
+            } else {
+                ALOGW("BinderProxy destroyed on a detached thread; leaking a weak reference");
+            }
+            shard.mProxies.erase(it);
+        }
+    }
+
     delete nativeData;
     IPCThreadState::self()->flushCommands();
     --gNumProxies;
@@ -1302,6 +1443,10 @@ JNIEXPORT jlong JNICALL android_os_BinderProxy_getNativeFinalizer(JNIEnv*, jclas
     return (jlong) BinderProxy_destroy;
 }
 
+static void android_os_BinderProxy_markRegistered(JNIEnv*, jclass, jlong nativeData) {
+    ((BinderProxyNativeData*) nativeData)->mRegistered = true;
+}
+
 // ----------------------------------------------------------------------------
 
 static const JNINativeMethod gBinderProxyMethods[] = {
@@ -1313,6 +1458,7 @@ static const JNINativeMethod gBinderProxyMethods[] = {
     {"linkToDeath",         "(Landroid/os/IBinder$DeathRecipient;I)V", (void*)android_os_BinderProxy_linkToDeath},
     {"unlinkToDeath",       "(Landroid/os/IBinder$DeathRecipient;I)Z", (void*)android_os_BinderProxy_unlinkToDeath},
     {"getNativeFinalizer",  "()J", (void*)android_os_BinderProxy_getNativeFinalizer},
+    {"markRegistered",      "(J)V", (void*)android_os_BinderProxy_markRegistered},
 };
 
 const char* const kBinderProxyPathName = "android/os/BinderProxy";
@@ -1324,8 +1470,7 @@ static int int_register_android_os_BinderProxy(JNIEnv* env)
 
     clazz = FindClassOrDie(env, kBinderProxyPathName);
     gBinderProxyOffsets.mClass = MakeGlobalRefOrDie(env, clazz);
-    gBinderProxyOffsets.mGetInstance = GetStaticMethodIDOrDie(env, clazz, "getInstance",
-            "(JJ)Landroid/os/BinderProxy;");
+    gBinderProxyOffsets.mConstructor = GetMethodIDOrDie(env, clazz, "<init>", "(J)V");
     gBinderProxyOffsets.mSendDeathNotice = GetStaticMethodIDOrDie(env, clazz, "sendDeathNotice",
             "(Landroid/os/IBinder$DeathRecipient;)V");
     gBinderProxyOffsets.mNativeData = GetFieldIDOrDie(env, clazz, "mNativeData", "J");
@@ -1333,6 +1478,8 @@ static int int_register_android_os_BinderProxy(JNIEnv* env)
     clazz = FindClassOrDie(env, "java/lang/Class");
     gClassOffsets.mGetName = GetMethodIDOrDie(env, clazz, "getName", "()Ljava/lang/String;");
 
+    gProxyVM = jnienv_to_javavm(env);
+
     return RegisterMethodsOrDie(
         env, kBinderProxyPathName,
         gBinderProxyMethods, NELEM(gBinderProxyMethods));
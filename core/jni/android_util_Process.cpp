@@ -23,6 +23,7 @@
 #include <binder/IPCThreadState.h>
 #include <binder/IServiceManager.h>
 #include <cutils/sched_policy.h>
+#include <utils/Mutex.h>
 #include <utils/String8.h>
 #include <utils/Vector.h>
 #include <processgroup/processgroup.h>
@@ -44,6 +45,10 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
 #define GUARD_THREAD_PRIORITY 0
 
 using namespace android;
@@ -662,6 +667,47 @@ static jlong android_os_Process_getTotalMemory(JNIEnv* env, jobject clazz)
     return getFreeMemoryImpl(sums, sumsLen, 1);
 }
 
+// Fills out[i] with the number following each line that starts with fields[i] in the
+// NUL-terminated buffer.  Fields that aren't found are left alone.
+static void parseProcLines(char* buffer, const Vector<String8>& fields, jlong* out)
+{
+    const size_t count = fields.size();
+    size_t foundCount = 0;
+
+    char* p = buffer;
+    while (*p && foundCount < count) {
+        bool skipToEol = true;
+        //ALOGI("Parsing at: %s", p);
+        for (size_t i=0; i<count; i++) {
+            const String8& field = fields[i];
+            if (strncmp(p, field.string(), field.length()) == 0) {
+                p += field.length();
+                while (*p == ' ' || *p == '\t') p++;
+                char* num = p;
+                while (*p >= '0' && *p <= '9') p++;
+                skipToEol = *p != '\n';
+                if (*p != 0) {
+                    *p = 0;
+                    p++;
+                }
+                char* end;
+                out[i] = strtoll(num, &end, 10);
+                //ALOGI("Field %s = %" PRId64, field.string(), out[i]);
+                foundCount++;
+                break;
+            }
+        }
+        if (skipToEol) {
+            while (*p && *p != '\n') {
+                p++;
+            }
+            if (*p == '\n') {
+                p++;
+            }
+        }
+    }
+}
+
 void android_os_Process_readProcLines(JNIEnv* env, jobject clazz, jstring fileStr,
                                       jobjectArray reqFields, jlongArray outFields)
 {
@@ -729,40 +775,7 @@ void android_os_Process_readProcLines(JNIEnv* env, jobject clazz, jstring fileSt
         }
         buffer[len] = 0;
 
-        int foundCount = 0;
-
-        char* p = buffer;
-        while (*p && foundCount < count) {
-            bool skipToEol = true;
-            //ALOGI("Parsing at: %s", p);
-            for (i=0; i<count; i++) {
-                const String8& field = fields[i];
-                if (strncmp(p, field.string(), field.length()) == 0) {
-                    p += field.length();
-                    while (*p == ' ' || *p == '\t') p++;
-                    char* num = p;
-                    while (*p >= '0' && *p <= '9') p++;
-                    skipToEol = *p != '\n';
-                    if (*p != 0) {
-                        *p = 0;
-                        p++;
-                    }
-                    char* end;
-                    sizesArray[i] = strtoll(num, &end, 10);
-                    //ALOGI("Field %s = %" PRId64, field.string(), sizesArray[i]);
-                    foundCount++;
-                    break;
-                }
-            }
-            if (skipToEol) {
-                while (*p && *p != '\n') {
-                    p++;
-                }
-                if (*p == '\n') {
-                    p++;
-                }
-            }
-        }
+        parseProcLines(buffer, fields, sizesArray);
 
         free(buffer);
     } else {
@@ -869,43 +882,20 @@ enum {
     PROC_OUT_FLOAT = 0x4000,
 };
 
-jboolean android_os_Process_parseProcLineArray(JNIEnv* env, jobject clazz,
-        char* buffer, jint startIndex, jint endIndex, jintArray format,
-        jobjectArray outStrings, jlongArray outLongs, jfloatArray outFloats)
+// Splits buffer[startIndex, endIndex) into the fields described by format, and calls
+// onField(mode, index, field) with each field that is marked for output, NUL-terminated
+// in place.  index counts the output fields.  Returns false if the data ran out first.
+template <typename OnField>
+static bool parseProcFields(char* buffer, jsize startIndex, jsize endIndex,
+        const jint* format, jsize NF, OnField onField)
 {
-
-    const jsize NF = env->GetArrayLength(format);
-    const jsize NS = outStrings ? env->GetArrayLength(outStrings) : 0;
-    const jsize NL = outLongs ? env->GetArrayLength(outLongs) : 0;
-    const jsize NR = outFloats ? env->GetArrayLength(outFloats) : 0;
-
-    jint* formatData = env->GetIntArrayElements(format, 0);
-    jlong* longsData = outLongs ?
-        env->GetLongArrayElements(outLongs, 0) : NULL;
-    jfloat* floatsData = outFloats ?
-        env->GetFloatArrayElements(outFloats, 0) : NULL;
-    if (formatData == NULL || (NL > 0 && longsData == NULL)
-            || (NR > 0 && floatsData == NULL)) {
-        if (formatData != NULL) {
-            env->ReleaseIntArrayElements(format, formatData, 0);
-        }
-        if (longsData != NULL) {
-            env->ReleaseLongArrayElements(outLongs, longsData, 0);
-        }
-        if (floatsData != NULL) {
-            env->ReleaseFloatArrayElements(outFloats, floatsData, 0);
-        }
-        jniThrowException(env, "java/lang/OutOfMemoryError", NULL);
-        return JNI_FALSE;
-    }
-
     jsize i = startIndex;
     jsize di = 0;
 
-    jboolean res = JNI_TRUE;
+    bool res = true;
 
     for (jsize fi=0; fi<NF; fi++) {
-        jint mode = formatData[fi];
+        jint mode = format[fi];
         if ((mode&PROC_PARENS) != 0) {
             i++;
         } else if ((mode&PROC_QUOTES) != 0) {
@@ -921,7 +911,7 @@ jboolean android_os_Process_parseProcLineArray(JNIEnv* env, jobject clazz,
             if (kDebugProc) {
                 ALOGW("Ran off end of data @%d", i);
             }
-            res = JNI_FALSE;
+            res = false;
             break;
         }
 
@@ -960,28 +950,66 @@ jboolean android_os_Process_parseProcLineArray(JNIEnv* env, jobject clazz,
         if ((mode&(PROC_OUT_FLOAT|PROC_OUT_LONG|PROC_OUT_STRING)) != 0) {
             char c = buffer[end];
             buffer[end] = 0;
-            if ((mode&PROC_OUT_FLOAT) != 0 && di < NR) {
-                char* end;
-                floatsData[di] = strtof(buffer+start, &end);
-            }
-            if ((mode&PROC_OUT_LONG) != 0 && di < NL) {
-                if ((mode&PROC_CHAR) != 0) {
-                    // Caller wants single first character returned as one long.
-                    longsData[di] = buffer[start];
-                } else {
-                    char* end;
-                    longsData[di] = strtoll(buffer+start, &end, 10);
-                }
-            }
-            if ((mode&PROC_OUT_STRING) != 0 && di < NS) {
-                jstring str = env->NewStringUTF(buffer+start);
-                env->SetObjectArrayElement(outStrings, di, str);
-            }
+            onField(mode, di, buffer+start);
             buffer[end] = c;
             di++;
         }
     }
 
+    return res;
+}
+
+jboolean android_os_Process_parseProcLineArray(JNIEnv* env, jobject clazz,
+        char* buffer, jint startIndex, jint endIndex, jintArray format,
+        jobjectArray outStrings, jlongArray outLongs, jfloatArray outFloats)
+{
+
+    const jsize NF = env->GetArrayLength(format);
+    const jsize NS = outStrings ? env->GetArrayLength(outStrings) : 0;
+    const jsize NL = outLongs ? env->GetArrayLength(outLongs) : 0;
+    const jsize NR = outFloats ? env->GetArrayLength(outFloats) : 0;
+
+    jint* formatData = env->GetIntArrayElements(format, 0);
+    jlong* longsData = outLongs ?
+        env->GetLongArrayElements(outLongs, 0) : NULL;
+    jfloat* floatsData = outFloats ?
+        env->GetFloatArrayElements(outFloats, 0) : NULL;
+    if (formatData == NULL || (NL > 0 && longsData == NULL)
+            || (NR > 0 && floatsData == NULL)) {
+        if (formatData != NULL) {
+            env->ReleaseIntArrayElements(format, formatData, 0);
+        }
+        if (longsData != NULL) {
+            env->ReleaseLongArrayElements(outLongs, longsData, 0);
+        }
+        if (floatsData != NULL) {
+            env->ReleaseFloatArrayElements(outFloats, floatsData, 0);
+        }
+        jniThrowException(env, "java/lang/OutOfMemoryError", NULL);
+        return JNI_FALSE;
+    }
+
+    jboolean res = parseProcFields(buffer, startIndex, endIndex, formatData, NF,
+            [&](jint mode, jsize di, const char* field) {
+        if ((mode&PROC_OUT_FLOAT) != 0 && di < NR) {
+            char* end;
+            floatsData[di] = strtof(field, &end);
+        }
+        if ((mode&PROC_OUT_LONG) != 0 && di < NL) {
+            if ((mode&PROC_CHAR) != 0) {
+                // Caller wants single first character returned as one long.
+                longsData[di] = field[0];
+            } else {
+                char* end;
+                longsData[di] = strtoll(field, &end, 10);
+            }
+        }
+        if ((mode&PROC_OUT_STRING) != 0 && di < NS) {
+            jstring str = env->NewStringUTF(field);
+            env->SetObjectArrayElement(outStrings, di, str);
+        }
+    }) ? JNI_TRUE : JNI_FALSE;
+
     env->ReleaseIntArrayElements(format, formatData, 0);
     if (longsData != NULL) {
         env->ReleaseLongArrayElements(outLongs, longsData, 0);
@@ -1050,6 +1078,233 @@ jboolean android_os_Process_readProcFile(JNIEnv* env, jobject clazz,
 
 }
 
+// Reads the same fields of /proc/<pid>/stat, statm and status for many pids at once.
+// Each pid's files stay open between reads, so a read is one pread() per file instead of
+// an open/read/close; a file whose process has died fails with ESRCH and is reopened in
+// case the pid has been reused.
+struct ProcSnapshot {
+    enum {
+        FILE_STAT = 0,
+        FILE_STATM,
+        FILE_STATUS,
+        FILE_COUNT
+    };
+
+    struct PidFiles {
+        int fds[FILE_COUNT];
+    };
+
+    // Past this many processes, files are opened and closed on each read rather than
+    // piling up open descriptors in the caller.
+    static const size_t MAX_OPEN_PIDS = 256;
+
+    std::vector<jint> formats[FILE_STATUS];     // stat and statm field formats
+    size_t formatLongs[FILE_STATUS] = { 0, 0 }; // number of fields each produces
+    Vector<String8> statusFields;
+
+    Mutex lock;
+    std::unordered_map<pid_t, PidFiles> openFiles;
+
+    bool wants(int file) const {
+        return file == FILE_STATUS ? !statusFields.isEmpty() : !formats[file].empty();
+    }
+
+    size_t stride() const {
+        return 1 + formatLongs[FILE_STAT] + formatLongs[FILE_STATM] + statusFields.size();
+    }
+
+    ~ProcSnapshot() {
+        for (auto& entry : openFiles) {
+            closeFiles(&entry.second);
+        }
+    }
+
+    static void closeFiles(PidFiles* files) {
+        for (int f = 0; f < FILE_COUNT; f++) {
+            if (files->fds[f] >= 0) {
+                close(files->fds[f]);
+                files->fds[f] = -1;
+            }
+        }
+    }
+
+    static int openFile(pid_t pid, int file) {
+        static const char* const names[FILE_COUNT] = { "stat", "statm", "status" };
+        char path[64];
+        snprintf(path, sizeof(path), "/proc/%d/%s", pid, names[file]);
+        return open(path, O_RDONLY | O_CLOEXEC);
+    }
+
+    // Reads one file of pid into buffer, NUL-terminated, returning its length or -1.
+    static ssize_t readFile(pid_t pid, int file, int* fd, char* buffer, size_t size) {
+        for (int attempt = 0; attempt < 2; attempt++) {
+            if (*fd < 0 && (*fd = openFile(pid, file)) < 0) {
+                return -1;
+            }
+            ssize_t len = TEMP_FAILURE_RETRY(pread(*fd, buffer, size - 1, 0));
+            if (len >= 0) {
+                buffer[len] = 0;
+                return len;
+            }
+            // The process this fd belonged to is gone; the pid may be someone else's now.
+            close(*fd);
+            *fd = -1;
+        }
+        return -1;
+    }
+
+    // Fills out[0 .. stride()) for pid.  The caller holds lock.
+    void read(pid_t pid, PidFiles* files, char* buffer, size_t size, jlong* out) {
+        bool ok = true;
+        jlong* fields = out + 1;
+        for (int f = 0; f < FILE_COUNT; f++) {
+            if (!wants(f)) {
+                continue;
+            }
+            ssize_t len = readFile(pid, f, &files->fds[f], buffer, size);
+            if (len < 0) {
+                ok = false;
+            } else if (f == FILE_STATUS) {
+                parseProcLines(buffer, statusFields, fields);
+            } else {
+                ok &= parseProcFields(buffer, 0, len, formats[f].data(), formats[f].size(),
+                        [fields](jint mode, jsize di, const char* field) {
+                    if ((mode&PROC_CHAR) != 0) {
+                        fields[di] = field[0];
+                    } else {
+                        char* end;
+                        fields[di] = strtoll(field, &end, 10);
+                    }
+                });
+            }
+            fields += f == FILE_STATUS ? statusFields.size() : formatLongs[f];
+        }
+        out[0] = ok ? 1 : 0;
+    }
+};
+
+// Copies a stat/statm format for a ProcSnapshot.  Only long output fields are supported.
+static bool compileProcFormat(JNIEnv* env, jintArray format, std::vector<jint>* outFormat,
+        size_t* outLongs)
+{
+    if (format == NULL) {
+        return true;
+    }
+    const jsize NF = env->GetArrayLength(format);
+    outFormat->resize(NF);
+    env->GetIntArrayRegion(format, 0, NF, outFormat->data());
+    for (jint mode : *outFormat) {
+        if ((mode&(PROC_OUT_STRING|PROC_OUT_FLOAT)) != 0) {
+            jniThrowException(env, "java/lang/IllegalArgumentException",
+                    "Snapshot formats may only output longs");
+            return false;
+        }
+        if ((mode&PROC_OUT_LONG) != 0) {
+            (*outLongs)++;
+        }
+    }
+    return true;
+}
+
+jlong android_os_Process_openProcSnapshot(JNIEnv* env, jobject clazz,
+        jintArray statFormat, jintArray statmFormat, jobjectArray statusFields)
+{
+    std::unique_ptr<ProcSnapshot> snapshot(new ProcSnapshot());
+    if (!compileProcFormat(env, statFormat, &snapshot->formats[ProcSnapshot::FILE_STAT],
+                &snapshot->formatLongs[ProcSnapshot::FILE_STAT])
+            || !compileProcFormat(env, statmFormat, &snapshot->formats[ProcSnapshot::FILE_STATM],
+                &snapshot->formatLongs[ProcSnapshot::FILE_STATM])) {
+        return 0;
+    }
+
+    const jsize count = statusFields != NULL ? env->GetArrayLength(statusFields) : 0;
+    for (jsize i = 0; i < count; i++) {
+        jstring obj = (jstring) env->GetObjectArrayElement(statusFields, i);
+        if (obj == NULL) {
+            jniThrowNullPointerException(env, "Element in statusFields");
+            return 0;
+        }
+        const char* str8 = env->GetStringUTFChars(obj, NULL);
+        if (str8 == NULL) {
+            return 0;
+        }
+        snapshot->statusFields.add(String8(str8));
+        env->ReleaseStringUTFChars(obj, str8);
+        env->DeleteLocalRef(obj);
+    }
+
+    return reinterpret_cast<jlong>(snapshot.release());
+}
+
+jlongArray android_os_Process_readProcSnapshot(JNIEnv* env, jobject clazz,
+        jlong snapshotPtr, jintArray pids)
+{
+    ProcSnapshot* snapshot = reinterpret_cast<ProcSnapshot*>(snapshotPtr);
+    if (snapshot == NULL || pids == NULL) {
+        jniThrowNullPointerException(env, NULL);
+        return NULL;
+    }
+
+    const jsize NP = env->GetArrayLength(pids);
+    std::vector<jint> pidList(NP);
+    env->GetIntArrayRegion(pids, 0, NP, pidList.data());
+
+    const size_t stride = snapshot->stride();
+    std::vector<jlong> values(NP * stride, 0);
+
+    // Big enough for /proc/<pid>/status, by far the largest of the three.
+    const size_t BUFFER_SIZE = 4096;
+    std::unique_ptr<char[]> buffer(new char[BUFFER_SIZE]);
+
+    {
+        AutoMutex _l(snapshot->lock);
+
+        std::unordered_map<pid_t, ProcSnapshot::PidFiles> stillOpen;
+        for (jsize i = 0; i < NP; i++) {
+            const pid_t pid = pidList[i];
+            ProcSnapshot::PidFiles files;
+            auto it = snapshot->openFiles.find(pid);
+            if (it != snapshot->openFiles.end()) {
+                files = it->second;
+                snapshot->openFiles.erase(it);
+            } else if (stillOpen.count(pid) != 0) {
+                // Listed twice; the first entry already has its files.
+                files = stillOpen[pid];
+                stillOpen.erase(pid);
+            } else {
+                for (int f = 0; f < ProcSnapshot::FILE_COUNT; f++) {
+                    files.fds[f] = -1;
+                }
+            }
+
+            snapshot->read(pid, &files, buffer.get(), BUFFER_SIZE, &values[i * stride]);
+
+            if (stillOpen.size() < ProcSnapshot::MAX_OPEN_PIDS) {
+                stillOpen[pid] = files;
+            } else {
+                ProcSnapshot::closeFiles(&files);
+            }
+        }
+
+        // Whatever is left belongs to processes the caller no longer cares about.
+        for (auto& entry : snapshot->openFiles) {
+            ProcSnapshot::closeFiles(&entry.second);
+        }
+        snapshot->openFiles.swap(stillOpen);
+    }
+
+    jlongArray result = env->NewLongArray(values.size());
+    if (result != NULL) {
+        env->SetLongArrayRegion(result, 0, values.size(), values.data());
+    }
+    return result;
+}
+
+void android_os_Process_closeProcSnapshot(JNIEnv* env, jobject clazz, jlong snapshotPtr)
+{
+    delete reinterpret_cast<ProcSnapshot*>(snapshotPtr);
+}
+
 void android_os_Process_setApplicationObject(JNIEnv* env, jobject clazz,
                                              jobject binderObject)
 {
@@ -1240,6 +1495,9 @@ static const JNINativeMethod methods[] = {
     {"getPids", "(Ljava/lang/String;[I)[I", (void*)android_os_Process_getPids},
     {"readProcFile", "(Ljava/lang/String;[I[Ljava/lang/String;[J[F)Z", (void*)android_os_Process_readProcFile},
     {"parseProcLine", "([BII[I[Ljava/lang/String;[J[F)Z", (void*)android_os_Process_parseProcLine},
+    {"openProcSnapshot", "([I[I[Ljava/lang/String;)J", (void*)android_os_Process_openProcSnapshot},
+    {"readProcSnapshot", "(J[I)[J", (void*)android_os_Process_readProcSnapshot},
+    {"closeProcSnapshot", "(J)V", (void*)android_os_Process_closeProcSnapshot},
     {"getElapsedCpuTime", "()J", (void*)android_os_Process_getElapsedCpuTime},
     {"getPss", "(I)J", (void*)android_os_Process_getPss},
     {"getPidsForCommands", "([Ljava/lang/String;)[I", (void*)android_os_Process_getPidsForCommands},
@@ -41,6 +41,7 @@
 #include <system/window.h>
 
 #include "android_os_MessageQueue.h"
+#include "android/graphics/TiledRegionDecoder.h"
 
 #include <Animator.h>
 #include <AnimationContext.h>
@@ -778,6 +779,7 @@ static void android_view_ThreadedRenderer_destroyHardwareResources(JNIEnv* env,
 static void android_view_ThreadedRenderer_trimMemory(JNIEnv* env, jobject clazz,
         jint level) {
     RenderProxy::trimMemory(level);
+    TiledRegionDecoder::trimMemory(level);
 }
 
 static void android_view_ThreadedRenderer_overrideProperty(JNIEnv* env, jobject clazz,
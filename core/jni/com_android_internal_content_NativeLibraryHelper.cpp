@@ -33,10 +33,23 @@
 #include <time.h>
 #include <unistd.h>
 #include <inttypes.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#include <algorithm>
+#include <atomic>
 #include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__aarch64__)
+#include <arm_acle.h>
+#include <asm/hwcap.h>
+#include <sys/auxv.h>
+#endif
 
 #define APK_LIB "lib/"
 #define APK_LIB_LEN (sizeof(APK_LIB) - 1)
@@ -52,6 +65,10 @@
 #define TMP_FILE_PATTERN "/tmp.XXXXXX"
 #define TMP_FILE_PATTERN_LEN (sizeof(TMP_FILE_PATTERN) - 1)
 
+// Upper bound on the threads used to verify and extract libraries. Installs are
+// mostly bound by storage, which stops scaling after a few outstanding requests.
+#define MAX_COPY_THREADS 4
+
 namespace android {
 
 // These match PackageManager.java install codes
@@ -100,6 +117,85 @@ isFilenameSafe(const char* filename)
     // Should not reach here.
 }
 
+#if defined(__aarch64__)
+// CRC-32 with the ARMv8 CRC32 instructions, which use the same polynomial as zip.
+__attribute__((target("crc")))
+static uint32_t
+crc32Armv8(uint32_t crc, const uint8_t* data, size_t size)
+{
+    crc = ~crc;
+    while (size > 0 && (reinterpret_cast<uintptr_t>(data) & 7) != 0) {
+        crc = __crc32b(crc, *data++);
+        size--;
+    }
+    for (; size >= 8; data += 8, size -= 8) {
+        uint64_t value;
+        memcpy(&value, data, sizeof(value));
+        crc = __crc32d(crc, value);
+    }
+    while (size-- > 0) {
+        crc = __crc32b(crc, *data++);
+    }
+    return ~crc;
+}
+#endif
+
+// Continues a zip CRC-32 over data, with the CPU's CRC instructions where available.
+static uint32_t
+updateCrc32(uint32_t crc, const uint8_t* data, size_t size)
+{
+#if defined(__aarch64__)
+    static const bool hasCrc32Instructions = (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+    if (hasCrc32Instructions) {
+        return crc32Armv8(crc, data, size);
+    }
+#endif
+    // zlib takes a uInt length, so feed it in bounded pieces.
+    static const size_t kMaxChunk = 1u << 30;
+    while (size > 0) {
+        const size_t chunk = std::min(size, kMaxChunk);
+        crc = crc32(crc, data, chunk);
+        data += chunk;
+        size -= chunk;
+    }
+    return crc;
+}
+
+// Computes the zip CRC-32 of the first size bytes of fd. The file is mapped rather
+// than read so the data is checksummed straight out of the page cache.
+static bool
+fileCrc32(int fd, size_t size, uint32_t* outCrc)
+{
+    uint32_t crc = crc32(0L, Z_NULL, 0);
+    if (size == 0) {
+        *outCrc = crc;
+        return true;
+    }
+
+    void* data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data != MAP_FAILED) {
+        madvise(data, size, MADV_SEQUENTIAL);
+        *outCrc = updateCrc32(crc, static_cast<const uint8_t*>(data), size);
+        munmap(data, size);
+        return true;
+    }
+
+    // Fall back to reading when the file can't be mapped.
+    unsigned char crcBuffer[16384];
+    ssize_t numBytes;
+    off64_t offset = 0;
+    while ((numBytes = TEMP_FAILURE_RETRY(
+            pread64(fd, crcBuffer, sizeof(crcBuffer), offset))) > 0) {
+        crc = updateCrc32(crc, crcBuffer, numBytes);
+        offset += numBytes;
+    }
+    if (numBytes < 0) {
+        return false;
+    }
+    *outCrc = crc;
+    return true;
+}
+
 static bool
 isFileDifferent(const char* filePath, uint32_t fileSize, time_t modifiedTime,
         uint32_t zipCrc, struct stat64* st)
@@ -130,19 +226,17 @@ isFileDifferent(const char* filePath, uint32_t fileSize, time_t modifiedTime,
         return true;
     }
 
-    // uLong comes from zlib.h. It's a bit of a wart that they're
-    // potentially using a 64-bit type for a 32-bit CRC.
-    uLong crc = crc32(0L, Z_NULL, 0);
-    unsigned char crcBuffer[16384];
-    ssize_t numBytes;
-    while ((numBytes = TEMP_FAILURE_RETRY(read(fd, crcBuffer, sizeof(crcBuffer)))) > 0) {
-        crc = crc32(crc, crcBuffer, numBytes);
-    }
+    uint32_t crc;
+    bool readOk = fileCrc32(fd, fileSize, &crc);
     close(fd);
+    if (!readOk) {
+        ALOGV("Couldn't read file %s: %s", filePath, strerror(errno));
+        return true;
+    }
 
-    ALOGV("%s: crc = %lx, zipCrc = %" PRIu32 "\n", filePath, crc, zipCrc);
+    ALOGV("%s: crc = %" PRIx32 ", zipCrc = %" PRIu32 "\n", filePath, crc, zipCrc);
 
-    if (crc != static_cast<uLong>(zipCrc)) {
+    if (crc != zipCrc) {
         return true;
     }
 
@@ -164,21 +258,43 @@ sumFiles(JNIEnv*, void* arg, ZipFileRO* zipFile, ZipEntryRO zipEntry, const char
     return INSTALL_SUCCEEDED;
 }
 
+/*
+ * Write a stored (uncompressed) entry to fd by having the kernel copy it straight
+ * out of the APK, then check the copy against the entry's CRC.
+ */
+static bool
+copyStoredEntry(ZipFileRO* zipFile, off64_t offset, uint32_t size, uint32_t crc, int fd)
+{
+    const int apkFd = zipFile->getFileDescriptor();
+    off64_t inOffset = offset;
+    size_t remaining = size;
+    while (remaining > 0) {
+        ssize_t numBytes = TEMP_FAILURE_RETRY(sendfile64(fd, apkFd, &inOffset, remaining));
+        if (numBytes <= 0) {
+            ALOGV("sendfile failed: %s", numBytes < 0 ? strerror(errno) : "unexpected EOF");
+            return false;
+        }
+        remaining -= numBytes;
+    }
+
+    uint32_t actualCrc;
+    if (!fileCrc32(fd, size, &actualCrc) || actualCrc != crc) {
+        ALOGI("CRC mismatch copying stored entry at offset %" PRId64, static_cast<int64_t>(offset));
+        return false;
+    }
+    return true;
+}
+
 /*
  * Copy the native library if needed.
  *
  * This function assumes the library and path names passed in are considered safe.
+ * It does not touch the JNIEnv, so it may run on any thread.
  */
 static install_status_t
-copyFileIfChanged(JNIEnv *env, void* arg, ZipFileRO* zipFile, ZipEntryRO zipEntry, const char* fileName)
+copyFileIfChanged(ZipFileRO* zipFile, ZipEntryRO zipEntry, const char* fileName,
+        const std::string& nativeLibPath, bool extractNativeLibs, bool hasNativeBridge)
 {
-    void** args = reinterpret_cast<void**>(arg);
-    jstring* javaNativeLibPath = (jstring*) args[0];
-    jboolean extractNativeLibs = *(jboolean*) args[1];
-    jboolean hasNativeBridge = *(jboolean*) args[2];
-
-    ScopedUtfChars nativeLibPath(env, *javaNativeLibPath);
-
     uint32_t uncompLen;
     uint32_t when;
     uint32_t crc;
@@ -257,7 +373,19 @@ copyFileIfChanged(JNIEnv *env, void* arg, ZipFileRO* zipFile, ZipEntryRO zipEntr
         return INSTALL_FAILED_CONTAINER_ERROR;
     }
 
-    if (!zipFile->uncompressEntry(zipEntry, fd)) {
+    bool copied = false;
+    if (method == ZipFileRO::kCompressStored) {
+        copied = copyStoredEntry(zipFile, offset, uncompLen, crc, fd);
+        if (!copied && (ftruncate(fd, 0) < 0 || lseek(fd, 0, SEEK_SET) < 0)) {
+            ALOGI("Couldn't reset %s: %s\n", localTmpFileName, strerror(errno));
+            close(fd);
+            unlink(localTmpFileName);
+            return INSTALL_FAILED_CONTAINER_ERROR;
+        }
+    }
+
+    // Compressed entries, and stored ones the kernel couldn't copy, go through libziparchive.
+    if (!copied && !zipFile->uncompressEntry(zipEntry, fd)) {
         ALOGI("Failed uncompressing %s to %s\n", fileName, localTmpFileName);
         close(fd);
         unlink(localTmpFileName);
@@ -487,14 +615,99 @@ static int findSupportedAbi(JNIEnv *env, jlong apkHandle, jobjectArray supported
     return status;
 }
 
+// A library matched by iterateOverNativeFiles, kept by name so it can be copied later.
+struct NativeLibrary {
+    std::string entryName;
+    std::string fileName;
+};
+
+static install_status_t
+collectFile(JNIEnv*, void* arg, ZipFileRO* zipFile, ZipEntryRO zipEntry, const char* fileName)
+{
+    std::vector<NativeLibrary>* libraries = reinterpret_cast<std::vector<NativeLibrary>*>(arg);
+
+    char entryName[PATH_MAX];
+    if (zipFile->getEntryFileName(zipEntry, entryName, sizeof(entryName))) {
+        return INSTALL_FAILED_INVALID_APK;
+    }
+
+    libraries->push_back(NativeLibrary{entryName, fileName});
+    return INSTALL_SUCCEEDED;
+}
+
+static install_status_t
+copyLibraryIfChanged(ZipFileRO* zipFile, const NativeLibrary& library,
+        const std::string& nativeLibPath, bool extractNativeLibs, bool hasNativeBridge)
+{
+    // Entries handed out during iteration don't outlive it, so look the library up again.
+    ZipEntryRO zipEntry = zipFile->findEntryByName(library.entryName.c_str());
+    if (zipEntry == NULL) {
+        return INSTALL_FAILED_INVALID_APK;
+    }
+
+    install_status_t ret = copyFileIfChanged(zipFile, zipEntry, library.fileName.c_str(),
+            nativeLibPath, extractNativeLibs, hasNativeBridge);
+    zipFile->releaseEntry(zipEntry);
+    return ret;
+}
+
 static jint
 com_android_internal_content_NativeLibraryHelper_copyNativeBinaries(JNIEnv *env, jclass clazz,
         jlong apkHandle, jstring javaNativeLibPath, jstring javaCpuAbi,
         jboolean extractNativeLibs, jboolean hasNativeBridge, jboolean debuggable)
 {
-    void* args[] = { &javaNativeLibPath, &extractNativeLibs, &hasNativeBridge };
-    return (jint) iterateOverNativeFiles(env, apkHandle, javaCpuAbi, debuggable,
-            copyFileIfChanged, reinterpret_cast<void*>(args));
+    std::vector<NativeLibrary> libraries;
+    install_status_t ret = iterateOverNativeFiles(env, apkHandle, javaCpuAbi, debuggable,
+            collectFile, &libraries);
+    if (ret != INSTALL_SUCCEEDED) {
+        return (jint) ret;
+    }
+
+    ScopedUtfChars nativeLibPathChars(env, javaNativeLibPath);
+    if (nativeLibPathChars.c_str() == NULL) {
+        // This would've thrown, so this return code isn't observable by
+        // Java.
+        return (jint) INSTALL_FAILED_INTERNAL_ERROR;
+    }
+    const std::string nativeLibPath(nativeLibPathChars.c_str());
+    ZipFileRO* zipFile = reinterpret_cast<ZipFileRO*>(apkHandle);
+
+    // Libraries are independent, so verify and extract them on a few threads. Once
+    // any library fails no new ones are started, and the first failure in APK order
+    // is reported, as it was when they were copied one at a time. Each worker looks up
+    // entries of its own, which ZipFileRO allows across threads.
+    std::vector<install_status_t> results(libraries.size(), INSTALL_SUCCEEDED);
+    std::atomic<size_t> nextIndex(0);
+    std::atomic<bool> failed(false);
+    auto worker = [&]() {
+        size_t i;
+        while (!failed && (i = nextIndex++) < libraries.size()) {
+            results[i] = copyLibraryIfChanged(zipFile, libraries[i], nativeLibPath,
+                    extractNativeLibs, hasNativeBridge);
+            if (results[i] != INSTALL_SUCCEEDED) {
+                ALOGV("Failure for entry %s", libraries[i].fileName.c_str());
+                failed = true;
+            }
+        }
+    };
+
+    const size_t numThreads = std::min<size_t>(libraries.size(),
+            std::min<size_t>(MAX_COPY_THREADS, std::max(1u, std::thread::hardware_concurrency())));
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < numThreads; i++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    for (install_status_t result : results) {
+        if (result != INSTALL_SUCCEEDED) {
+            return (jint) result;
+        }
+    }
+    return (jint) INSTALL_SUCCEEDED;
 }
 
 static jlong
@@ -18,9 +18,14 @@
 
 #include <errno.h>
 #include <inttypes.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#include <string>
+#include <unordered_map>
+#include <vector>
+
 #include <core_jni_helpers.h>
 #include <jni.h>
 
@@ -30,8 +35,11 @@
 
 #include <utils/Log.h>
 #include <utils/misc.h>
+#include <utils/Mutex.h>
 #include <utils/Vector.h>
 
+#include "netstats_reader.h"
+
 namespace android {
 
 static jclass gStringClass;
@@ -52,17 +60,59 @@ static struct {
     jfieldID operations;
 } gNetworkStatsClassInfo;
 
-struct stats_line {
-    char iface[32];
-    int32_t uid;
-    int32_t set;
-    int32_t tag;
+// Counters of one row as of the last read, keyed by iface, uid, set and tag.
+struct DeltaCounters {
     int64_t rxBytes;
     int64_t rxPackets;
     int64_t txBytes;
     int64_t txPackets;
 };
 
+struct DeltaState {
+    // Rows as of the last successful read.  A row that isn't here hasn't been seen.
+    std::unordered_map<std::string, DeltaCounters> rows;
+    // Rows of the read in progress, swapped into rows only once it has succeeded, so a
+    // failed read doesn't leave changes marked as delivered.
+    std::unordered_map<std::string, DeltaCounters> pending;
+};
+
+// Longest iface name accepted, as in the kernel's own formatting of the file.
+static const size_t MAX_IFACE_LENGTH = 31;
+
+// Interned iface strings handed out as global refs.  There are only ever a handful of
+// ifaces, but cap the table in case something churns through names.
+static const size_t MAX_INTERNED_IFACES = 256;
+
+// Guards everything below.  The buffers are reused from one read to the next: a read
+// borrows them through ScopedScratch, so the lock is never held across file or JNI work.
+static Mutex gReadLock;
+static std::vector<char> gReadBuffer;
+static std::vector<QtaguidStatsRow> gRows;
+static std::unordered_map<std::string, jstring> gIfaceStrings;
+
+// Takes over the shared read buffers, or starts empty ones if another read has them, and
+// hands back whichever are larger.
+struct ScopedScratch {
+    std::vector<char> buffer;
+    std::vector<QtaguidStatsRow> rows;
+
+    ScopedScratch() {
+        Mutex::Autolock _l(gReadLock);
+        buffer.swap(gReadBuffer);
+        rows.swap(gRows);
+    }
+
+    ~ScopedScratch() {
+        Mutex::Autolock _l(gReadLock);
+        if (buffer.capacity() > gReadBuffer.capacity()) {
+            buffer.swap(gReadBuffer);
+        }
+        if (rows.capacity() > gRows.capacity()) {
+            rows.swap(gRows);
+        }
+    }
+};
+
 static jobjectArray get_string_array(JNIEnv* env, jobject obj, jfieldID field, int size, bool grow)
 {
     if (!grow) {
@@ -96,15 +146,61 @@ static jlongArray get_long_array(JNIEnv* env, jobject obj, jfieldID field, int s
     return env->NewLongArray(size);
 }
 
-static int readNetworkStatsDetail(JNIEnv* env, jclass clazz, jobject stats,
-        jstring path, jint limitUid, jobjectArray limitIfacesObj, jint limitTag) {
-    ScopedUtfChars path8(env, path);
-    if (path8.c_str() == NULL) {
-        return -1;
+static std::string makeDeltaKey(const QtaguidStatsRow& row) {
+    std::string key(row.iface, row.ifaceLen);
+    key.push_back(0);
+    key.append((const char*) &row.uid, sizeof(row.uid));
+    key.append((const char*) &row.set, sizeof(row.set));
+    key.append((const char*) &row.tag, sizeof(row.tag));
+    return key;
+}
+
+// Returns whether row is new or differs from the last successful read through state, and
+// stages it for the next one.
+static bool stageDeltaRow(DeltaState* state, const QtaguidStatsRow& row) {
+    std::string key = makeDeltaKey(row);
+    bool changed = true;
+    auto it = state->rows.find(key);
+    if (it != state->rows.end()) {
+        const DeltaCounters& last = it->second;
+        changed = last.rxBytes != row.rxBytes || last.rxPackets != row.rxPackets
+                || last.txBytes != row.txBytes || last.txPackets != row.txPackets;
+    }
+    DeltaCounters& counters = state->pending[std::move(key)];
+    counters.rxBytes = row.rxBytes;
+    counters.rxPackets = row.rxPackets;
+    counters.txBytes = row.txBytes;
+    counters.txPackets = row.txPackets;
+    return changed;
+}
+
+// Returns the Java string for iface.  Must be called with gReadLock held; a new string is
+// only ever created for the first few ifaces.  *isLocal is set if the caller has to delete
+// the returned reference.
+static jstring getIfaceString(JNIEnv* env, const char* iface, size_t len, bool* isLocal) {
+    std::string key(iface, len);
+    auto it = gIfaceStrings.find(key);
+    if (it != gIfaceStrings.end()) {
+        *isLocal = false;
+        return it->second;
     }
 
-    FILE *fp = fopen(path8.c_str(), "r");
-    if (fp == NULL) {
+    jstring string = env->NewStringUTF(key.c_str());
+    if (string == NULL || gIfaceStrings.size() >= MAX_INTERNED_IFACES) {
+        *isLocal = true;
+        return string;
+    }
+    jstring global = (jstring) env->NewGlobalRef(string);
+    env->DeleteLocalRef(string);
+    gIfaceStrings[key] = global;
+    *isLocal = false;
+    return global;
+}
+
+static int readNetworkStatsDetailInternal(JNIEnv* env, jobject stats, jstring path,
+        jint limitUid, jobjectArray limitIfacesObj, jint limitTag, DeltaState* deltaState) {
+    ScopedUtfChars path8(env, path);
+    if (path8.c_str() == NULL) {
         return -1;
     }
 
@@ -121,111 +217,92 @@ static int readNetworkStatsDetail(JNIEnv* env, jclass clazz, jobject stats,
         }
     }
 
-    Vector<stats_line> lines;
+    ScopedScratch scratch;
+    std::vector<QtaguidStatsRow>& rows = scratch.rows;
+
+    if (!readStatsFile(path8.c_str(), &scratch.buffer)) {
+        return -1;
+    }
+    char* const data = scratch.buffer.data();
+    const size_t len = scratch.buffer.size() - 1;
+
+    // Every row is a line, so the line count bounds the number of rows.
+    size_t maxRows = 0;
+    for (const char* p = data; (p = (const char*) memchr(p, '\n', data + len - p)) != NULL;
+            p++) {
+        maxRows++;
+    }
+    rows.clear();
+    rows.reserve(maxRows + 1);
+    if (deltaState != NULL) {
+        deltaState->pending.clear();
+    }
 
     int lastIdx = 1;
-    int idx;
-    char buffer[384];
-    while (fgets(buffer, sizeof(buffer), fp) != NULL) {
-        stats_line s;
-        int64_t rawTag;
-        char* pos = buffer;
-        char* endPos;
-        // First field is the index.
-        idx = (int)strtol(pos, &endPos, 10);
-        //ALOGI("Index #%d: %s", idx, buffer);
-        if (pos == endPos) {
-            // Skip lines that don't start with in index.  In particular,
-            // this will skip the initial header line.
-            continue;
-        }
-        if (idx != lastIdx + 1) {
-            ALOGE("inconsistent idx=%d after lastIdx=%d: %s", idx, lastIdx, buffer);
-            fclose(fp);
-            return -1;
+    bool failed = false;
+    forEachStatsLine(data, len, [&](char* line, char* end) {
+        if (failed) {
+            return;
         }
-        lastIdx = idx;
-        pos = endPos;
-        // Skip whitespace.
-        while (*pos == ' ') {
-            pos++;
+        QtaguidStatsRow row;
+        QtaguidParseResult result = parseQtaguidStatsLine(line, end, &row);
+        if (result == QTAGUID_ROW_NO_INDEX) {
+            // Skip lines that don't start with an index.  In particular, this will skip
+            // the initial header line.
+            return;
         }
-        // Next field is iface.
-        int ifaceIdx = 0;
-        while (*pos != ' ' && *pos != 0 && ifaceIdx < (int)(sizeof(s.iface)-1)) {
-            s.iface[ifaceIdx] = *pos;
-            ifaceIdx++;
-            pos++;
+        if (row.idx != lastIdx + 1) {
+            ALOGE("inconsistent idx=%d after lastIdx=%d: %.*s", row.idx, lastIdx,
+                    (int) (end - line), line);
+            failed = true;
+            return;
         }
-        if (*pos != ' ') {
-            ALOGE("bad iface: %s", buffer);
-            fclose(fp);
-            return -1;
+        lastIdx = row.idx;
+        if (result == QTAGUID_ROW_BAD_IFACE || row.ifaceLen > MAX_IFACE_LENGTH) {
+            ALOGE("bad iface: %.*s", (int) (end - line), line);
+            failed = true;
+            return;
         }
-        s.iface[ifaceIdx] = 0;
         if (limitIfaces.size() > 0) {
             // Is this an iface the caller is interested in?
-            int i = 0;
-            while (i < (int)limitIfaces.size()) {
-                if (limitIfaces[i] == s.iface) {
+            size_t i = 0;
+            while (i < limitIfaces.size()) {
+                if (limitIfaces[i].length() == row.ifaceLen
+                        && memcmp(limitIfaces[i].string(), row.iface, row.ifaceLen) == 0) {
                     break;
                 }
                 i++;
             }
-            if (i >= (int)limitIfaces.size()) {
+            if (i >= limitIfaces.size()) {
                 // Nothing matched; skip this line.
-                //ALOGI("skipping due to iface: %s", buffer);
-                continue;
+                return;
             }
         }
-
-        // Ignore whitespace
-        while (*pos == ' ') pos++;
-
-        // Find end of tag field
-        endPos = pos;
-        while (*endPos != ' ') endPos++;
-
-        // Three digit field is always 0x0, otherwise parse
-        if (endPos - pos == 3) {
-            rawTag = 0;
-        } else {
-            if (sscanf(pos, "%" PRIx64, &rawTag) != 1) {
-                ALOGE("bad tag: %s", pos);
-                fclose(fp);
-                return -1;
-            }
+        if (result == QTAGUID_ROW_BAD_TAG) {
+            ALOGE("bad tag: %.*s", (int) (end - line), line);
+            failed = true;
+            return;
         }
-        s.tag = rawTag >> 32;
-        if (limitTag != -1 && s.tag != limitTag) {
-            //ALOGI("skipping due to tag: %s", buffer);
-            continue;
+        if (limitTag != -1 && row.tag != limitTag) {
+            return;
         }
-        pos = endPos;
-
-        // Ignore whitespace
-        while (*pos == ' ') pos++;
-
-        // Parse remaining fields.
-        if (sscanf(pos, "%u %u %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64,
-                &s.uid, &s.set, &s.rxBytes, &s.rxPackets,
-                &s.txBytes, &s.txPackets) == 6) {
-            if (limitUid != -1 && limitUid != s.uid) {
-                //ALOGI("skipping due to uid: %s", buffer);
-                continue;
-            }
-            lines.push_back(s);
-        } else {
-            //ALOGI("skipping due to bad remaining fields: %s", pos);
+        if (result != QTAGUID_ROW_OK) {
+            // Not enough counters on the line.
+            return;
         }
-    }
-
-    if (fclose(fp) != 0) {
-        ALOGE("Failed to close netstats file");
+        if (limitUid != -1 && limitUid != row.uid) {
+            return;
+        }
+        if (deltaState != NULL && !stageDeltaRow(deltaState, row)) {
+            return;
+        }
+        rows.push_back(row);
+    });
+    if (failed) {
         return -1;
     }
 
-    int size = lines.size();
+    int size = rows.size();
     bool grow = size > env->GetIntField(stats, gNetworkStatsClassInfo.capacity);
 
     ScopedLocalRef<jobjectArray> iface(env, get_string_array(env, stats,
@@ -262,18 +339,29 @@ static int readNetworkStatsDetail(JNIEnv* env, jclass clazz, jobject stats,
             gNetworkStatsClassInfo.operations, size, grow));
     if (operations.get() == NULL) return -1;
 
-    for (int i = 0; i < size; i++) {
-        ScopedLocalRef<jstring> ifaceString(env, env->NewStringUTF(lines[i].iface));
-        env->SetObjectArrayElement(iface.get(), i, ifaceString.get());
+    {
+        Mutex::Autolock _l(gReadLock);
+        for (int i = 0; i < size; i++) {
+            const QtaguidStatsRow& row = rows[i];
+            bool isLocal;
+            jstring ifaceString = getIfaceString(env, row.iface, row.ifaceLen, &isLocal);
+            env->SetObjectArrayElement(iface.get(), i, ifaceString);
+            if (isLocal) {
+                env->DeleteLocalRef(ifaceString);
+            }
+        }
+    }
 
-        uid[i] = lines[i].uid;
-        set[i] = lines[i].set;
-        tag[i] = lines[i].tag;
+    for (int i = 0; i < size; i++) {
+        const QtaguidStatsRow& row = rows[i];
+        uid[i] = row.uid;
+        set[i] = row.set;
+        tag[i] = row.tag;
         // Metered and Roaming are populated in Java-land by inspecting the iface properties.
-        rxBytes[i] = lines[i].rxBytes;
-        rxPackets[i] = lines[i].rxPackets;
-        txBytes[i] = lines[i].txBytes;
-        txPackets[i] = lines[i].txPackets;
+        rxBytes[i] = row.rxBytes;
+        rxPackets[i] = row.rxPackets;
+        txBytes[i] = row.txBytes;
+        txPackets[i] = row.txPackets;
     }
 
     env->SetIntField(stats, gNetworkStatsClassInfo.size, size);
@@ -292,13 +380,44 @@ static int readNetworkStatsDetail(JNIEnv* env, jclass clazz, jobject stats,
         env->SetObjectField(stats, gNetworkStatsClassInfo.operations, operations.getJavaArray());
     }
 
+    if (deltaState != NULL) {
+        // Rows that have gone from the file drop out of the state here too.
+        deltaState->rows.swap(deltaState->pending);
+    }
     return 0;
 }
 
+static int readNetworkStatsDetail(JNIEnv* env, jclass clazz, jobject stats,
+        jstring path, jint limitUid, jobjectArray limitIfacesObj, jint limitTag) {
+    return readNetworkStatsDetailInternal(env, stats, path, limitUid, limitIfacesObj, limitTag,
+            NULL);
+}
+
+static int readNetworkStatsDetailChanges(JNIEnv* env, jclass clazz, jlong deltaStatePtr,
+        jobject stats, jstring path, jint limitUid, jobjectArray limitIfacesObj,
+        jint limitTag) {
+    DeltaState* deltaState = reinterpret_cast<DeltaState*>(deltaStatePtr);
+    return readNetworkStatsDetailInternal(env, stats, path, limitUid, limitIfacesObj, limitTag,
+            deltaState);
+}
+
+static jlong createDeltaState(JNIEnv* env, jclass clazz) {
+    return reinterpret_cast<jlong>(new DeltaState());
+}
+
+static void destroyDeltaState(JNIEnv* env, jclass clazz, jlong deltaStatePtr) {
+    delete reinterpret_cast<DeltaState*>(deltaStatePtr);
+}
+
 static const JNINativeMethod gMethods[] = {
         { "nativeReadNetworkStatsDetail",
                 "(Landroid/net/NetworkStats;Ljava/lang/String;I[Ljava/lang/String;I)I",
-                (void*) readNetworkStatsDetail }
+                (void*) readNetworkStatsDetail },
+        { "nativeReadNetworkStatsDetailChanges",
+                "(JLandroid/net/NetworkStats;Ljava/lang/String;I[Ljava/lang/String;I)I",
+                (void*) readNetworkStatsDetailChanges },
+        { "nativeCreateDeltaState", "()J", (void*) createDeltaState },
+        { "nativeDestroyDeltaState", "(J)V", (void*) destroyDeltaState },
 };
 
 int register_com_android_internal_net_NetworkStatsFactory(JNIEnv* env) {
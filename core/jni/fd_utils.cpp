@@ -221,42 +221,39 @@ bool FileDescriptorInfo::Restat() const {
   return f_stat.st_ino == stat.st_ino && f_stat.st_dev == stat.st_dev;
 }
 
-bool FileDescriptorInfo::ReopenOrDetach() const {
+bool FileDescriptorInfo::ReopenOrDetach(int dev_null_fd) const {
   if (is_sock) {
-    return DetachSocket();
+    return DetachSocket(dev_null_fd);
   }
 
   // NOTE: This might happen if the file was unlinked after being opened.
   // It's a common pattern in the case of temporary files and the like but
   // we should not allow such usage from the zygote.
-  const int new_fd = TEMP_FAILURE_RETRY(open(file_path.c_str(), open_flags));
+  const int new_fd = TEMP_FAILURE_RETRY(open(file_path.c_str(), reopen_flags_));
 
   if (new_fd == -1) {
-    PLOG(ERROR) << "Failed open(" << file_path << ", " << open_flags << ")";
+    PLOG(ERROR) << "Failed open(" << file_path << ", " << reopen_flags_ << ")";
     return false;
   }
 
-  if (TEMP_FAILURE_RETRY(fcntl(new_fd, F_SETFD, fd_flags)) == -1) {
-    close(new_fd);
-    PLOG(ERROR) << "Failed fcntl(" << new_fd << ", F_SETFD, " << fd_flags << ")";
-    return false;
-  }
-
-  if (TEMP_FAILURE_RETRY(fcntl(new_fd, F_SETFL, fs_flags)) == -1) {
+  if (setfl_flags_ != 0 && TEMP_FAILURE_RETRY(fcntl(new_fd, F_SETFL, fs_flags)) == -1) {
     close(new_fd);
     PLOG(ERROR) << "Failed fcntl(" << new_fd << ", F_SETFL, " << fs_flags << ")";
     return false;
   }
 
-  if (offset != -1 && TEMP_FAILURE_RETRY(lseek64(new_fd, offset, SEEK_SET)) == -1) {
+  // A freshly opened file is already at offset zero.
+  if (offset > 0 && TEMP_FAILURE_RETRY(lseek64(new_fd, offset, SEEK_SET)) == -1) {
     close(new_fd);
     PLOG(ERROR) << "Failed lseek64(" << new_fd << ", SEEK_SET)";
     return false;
   }
 
-  if (TEMP_FAILURE_RETRY(dup2(new_fd, fd)) == -1) {
+  // Unlike dup2(), dup3() can set FD_CLOEXEC on the target descriptor.
+  const int dup_flags = (fd_flags & FD_CLOEXEC) ? O_CLOEXEC : 0;
+  if (TEMP_FAILURE_RETRY(dup3(new_fd, fd, dup_flags)) == -1) {
     close(new_fd);
-    PLOG(ERROR) << "Failed dup2(" << fd << ", " << new_fd << ")";
+    PLOG(ERROR) << "Failed dup3(" << fd << ", " << new_fd << ", " << dup_flags << ")";
     return false;
   }
 
@@ -265,6 +262,11 @@ bool FileDescriptorInfo::ReopenOrDetach() const {
   return true;
 }
 
+// Status flags that open() sets just as F_SETFL would. Of the flags F_SETFL
+// can change, that leaves only O_ASYNC.
+static const int kOpenableStatusFlags =
+    (O_APPEND | O_NONBLOCK | O_DIRECT | O_NOATIME | O_LARGEFILE);
+
 FileDescriptorInfo::FileDescriptorInfo(int fd) :
   fd(fd),
   stat(),
@@ -272,7 +274,9 @@ FileDescriptorInfo::FileDescriptorInfo(int fd) :
   fd_flags(0),
   fs_flags(0),
   offset(0),
-  is_sock(true) {
+  is_sock(true),
+  reopen_flags_(0),
+  setfl_flags_(0) {
 }
 
 FileDescriptorInfo::FileDescriptorInfo(struct stat stat, const std::string& file_path,
@@ -285,7 +289,9 @@ FileDescriptorInfo::FileDescriptorInfo(struct stat stat, const std::string& file
   fd_flags(fd_flags),
   fs_flags(fs_flags),
   offset(offset),
-  is_sock(false) {
+  is_sock(false),
+  reopen_flags_(open_flags | (fs_flags & kOpenableStatusFlags)),
+  setfl_flags_(fs_flags & ~kOpenableStatusFlags) {
 }
 
 // static
@@ -330,193 +336,195 @@ bool FileDescriptorInfo::GetSocketName(const int fd, std::string* result) {
   return true;
 }
 
-bool FileDescriptorInfo::DetachSocket() const {
-  const int dev_null_fd = open("/dev/null", O_RDWR);
-  if (dev_null_fd < 0) {
-    PLOG(ERROR) << "Failed to open /dev/null";
-    return false;
-  }
-
+bool FileDescriptorInfo::DetachSocket(int dev_null_fd) const {
   if (dup2(dev_null_fd, fd) == -1) {
     PLOG(ERROR) << "Failed dup2 on socket descriptor " << fd;
     return false;
   }
 
-  if (close(dev_null_fd) == -1) {
-    PLOG(ERROR) << "Failed close(" << dev_null_fd << ")";
-    return false;
-  }
-
   return true;
 }
 
 // static
 FileDescriptorTable* FileDescriptorTable::Create(const std::vector<int>& fds_to_ignore) {
-  DIR* d = opendir(kFdPath);
-  if (d == NULL) {
-    PLOG(ERROR) << "Unable to open directory " << std::string(kFdPath);
+  std::vector<int> open_fds;
+  if (!ListOpenFds(fds_to_ignore, &open_fds)) {
     return NULL;
   }
-  int dir_fd = dirfd(d);
-  dirent* e;
-
-  std::unordered_map<int, FileDescriptorInfo*> open_fd_map;
-  while ((e = readdir(d)) != NULL) {
-    const int fd = ParseFd(e, dir_fd);
-    if (fd == -1) {
-      continue;
-    }
-    if (std::find(fds_to_ignore.begin(), fds_to_ignore.end(), fd) != fds_to_ignore.end()) {
-      LOG(INFO) << "Ignoring open file descriptor " << fd;
-      continue;
-    }
 
+  std::vector<FileDescriptorInfo*> entries;
+  entries.reserve(open_fds.size());
+  for (const int fd : open_fds) {
     FileDescriptorInfo* info = FileDescriptorInfo::CreateFromFd(fd);
     if (info == NULL) {
-      if (closedir(d) == -1) {
-        PLOG(ERROR) << "Unable to close directory";
+      for (FileDescriptorInfo* entry : entries) {
+        delete entry;
       }
       return NULL;
     }
-    open_fd_map[fd] = info;
+    entries.push_back(info);
   }
 
-  if (closedir(d) == -1) {
-    PLOG(ERROR) << "Unable to close directory";
-    return NULL;
-  }
-  return new FileDescriptorTable(open_fd_map);
+  return new FileDescriptorTable(std::move(entries));
 }
 
 bool FileDescriptorTable::Restat(const std::vector<int>& fds_to_ignore) {
-  std::set<int> open_fds;
-
   // First get the list of open descriptors.
-  DIR* d = opendir(kFdPath);
-  if (d == NULL) {
-    PLOG(ERROR) << "Unable to open directory " << std::string(kFdPath);
-    return false;
-  }
-
-  int dir_fd = dirfd(d);
-  dirent* e;
-  while ((e = readdir(d)) != NULL) {
-    const int fd = ParseFd(e, dir_fd);
-    if (fd == -1) {
-      continue;
-    }
-    if (std::find(fds_to_ignore.begin(), fds_to_ignore.end(), fd) != fds_to_ignore.end()) {
-      LOG(INFO) << "Ignoring open file descriptor " << fd;
-      continue;
-    }
-
-    open_fds.insert(fd);
-  }
-
-  if (closedir(d) == -1) {
-    PLOG(ERROR) << "Unable to close directory";
+  if (!ListOpenFds(fds_to_ignore, &open_fds_)) {
     return false;
   }
 
-  return RestatInternal(open_fds);
+  return RestatInternal(open_fds_);
 }
 
 // Reopens all file descriptors that are contained in the table. Returns true
 // if all descriptors were successfully re-opened or detached, and false if an
 // error occurred.
 bool FileDescriptorTable::ReopenOrDetach() {
-  std::unordered_map<int, FileDescriptorInfo*>::const_iterator it;
-  for (it = open_fd_map_.begin(); it != open_fd_map_.end(); ++it) {
-    const FileDescriptorInfo* info = it->second;
-    if (info == NULL || !info->ReopenOrDetach()) {
-      return false;
+  // Every socket is pointed at the same /dev/null description, so it is
+  // only opened once.
+  int dev_null_fd = -1;
+  for (const FileDescriptorInfo* info : entries_) {
+    if (info->is_sock) {
+      dev_null_fd = open("/dev/null", O_RDWR);
+      if (dev_null_fd < 0) {
+        PLOG(ERROR) << "Failed to open /dev/null";
+        return false;
+      }
+      break;
     }
   }
 
-  return true;
+  bool success = true;
+  for (const FileDescriptorInfo* info : entries_) {
+    if (!info->ReopenOrDetach(dev_null_fd)) {
+      success = false;
+      break;
+    }
+  }
+
+  if (dev_null_fd != -1 && close(dev_null_fd) == -1) {
+    PLOG(ERROR) << "Failed close(" << dev_null_fd << ")";
+    return false;
+  }
+
+  return success;
+}
+
+FileDescriptorTable::FileDescriptorTable(std::vector<FileDescriptorInfo*>&& entries)
+    : entries_(std::move(entries)) {
 }
 
-FileDescriptorTable::FileDescriptorTable(
-    const std::unordered_map<int, FileDescriptorInfo*>& map)
-    : open_fd_map_(map) {
+FileDescriptorTable::~FileDescriptorTable() {
+  for (FileDescriptorInfo* info : entries_) {
+    delete info;
+  }
 }
 
-bool FileDescriptorTable::RestatInternal(std::set<int>& open_fds) {
+bool FileDescriptorTable::RestatInternal(const std::vector<int>& open_fds) {
   bool error = false;
 
-  // Iterate through the list of file descriptors we've already recorded
-  // and check whether :
+  // Both the table and |open_fds| are sorted by fd, so walk them side by
+  // side and check whether the descriptors we've already recorded :
   //
-  // (a) they continue to be open.
-  // (b) they refer to the same file.
-  std::unordered_map<int, FileDescriptorInfo*>::iterator it = open_fd_map_.begin();
-  while (it != open_fd_map_.end()) {
-    std::set<int>::const_iterator element = open_fds.find(it->first);
-    if (element == open_fds.end()) {
+  // (a) continue to be open.
+  // (b) refer to the same file.
+  //
+  // and whether any new ones have been opened. The updated table is built in
+  // |restat_entries_|, which keeps its capacity from one call to the next.
+  restat_entries_.clear();
+  restat_entries_.reserve(std::max(entries_.size(), open_fds.size()));
+  auto entry = entries_.begin();
+  auto open_fd = open_fds.begin();
+  while (entry != entries_.end() || open_fd != open_fds.end()) {
+    if (open_fd == open_fds.end() || (entry != entries_.end() && (*entry)->fd < *open_fd)) {
       // The entry from the file descriptor table is no longer in the list
-      // of open files. We warn about this condition and remove it from
-      // the list of FDs under consideration.
+      // of open files. We remove it from the list of FDs under
+      // consideration.
       //
       // TODO(narayan): This will be an error in a future android release.
       // error = true;
-      // ALOGW("Zygote closed file descriptor %d.", it->first);
-      it = open_fd_map_.erase(it);
+      // ALOGW("Zygote closed file descriptor %d.", (*entry)->fd);
+      delete *entry;
+      ++entry;
+    } else if (entry == entries_.end() || *open_fd < (*entry)->fd) {
+      // The zygote has opened a new file descriptor since our last
+      // inspection. We add it to our table.
+      //
+      // TODO(narayan): This will be an error in a future android release.
+      // error = true;
+      // ALOGW("Zygote opened new file descriptor %d.", *open_fd);
+      FileDescriptorInfo* info = FileDescriptorInfo::CreateFromFd(*open_fd);
+      if (info == NULL) {
+        // A newly opened file is not on the whitelist. Flag an error and
+        // continue.
+        error = true;
+      } else {
+        restat_entries_.push_back(info);
+      }
+      ++open_fd;
     } else {
       // The entry from the file descriptor table is still open. Restat
       // it and check whether it refers to the same file.
-      const bool same_file = it->second->Restat();
-      if (!same_file) {
+      FileDescriptorInfo* info = *entry;
+      if (!info->Restat()) {
         // The file descriptor refers to a different description. We must
         // update our entry in the table.
-        delete it->second;
-        it->second = FileDescriptorInfo::CreateFromFd(*element);
-        if (it->second == NULL) {
+        delete info;
+        info = FileDescriptorInfo::CreateFromFd(*open_fd);
+        if (info == NULL) {
           // The descriptor no longer no longer refers to a whitelisted file.
           // We flag an error and remove it from the list of files we're
           // tracking.
           error = true;
-          it = open_fd_map_.erase(it);
-        } else {
-          // Successfully restatted the file, move on to the next open FD.
-          ++it;
         }
-      } else {
-        // It's the same file. Nothing to do here. Move on to the next open
-        // FD.
-        ++it;
       }
-
-      // Finally, remove the FD from the set of open_fds. We do this last because
-      // |element| will not remain valid after a call to erase.
-      open_fds.erase(element);
+      if (info != NULL) {
+        restat_entries_.push_back(info);
+      }
+      ++entry;
+      ++open_fd;
     }
   }
 
-  if (open_fds.size() > 0) {
-    // The zygote has opened new file descriptors since our last inspection.
-    // We warn about this condition and add them to our table.
-    //
-    // TODO(narayan): This will be an error in a future android release.
-    // error = true;
-    // ALOGW("Zygote opened %zd new file descriptor(s).", open_fds.size());
+  entries_.swap(restat_entries_);
+  return !error;
+}
 
-    // TODO(narayan): This code will be removed in a future android release.
-    std::set<int>::const_iterator it;
-    for (it = open_fds.begin(); it != open_fds.end(); ++it) {
-      const int fd = (*it);
-      FileDescriptorInfo* info = FileDescriptorInfo::CreateFromFd(fd);
-      if (info == NULL) {
-        // A newly opened file is not on the whitelist. Flag an error and
-        // continue.
-        error = true;
-      } else {
-        // Track the newly opened file.
-        open_fd_map_[fd] = info;
-      }
+// static
+bool FileDescriptorTable::ListOpenFds(const std::vector<int>& fds_to_ignore,
+                                      std::vector<int>* open_fds) {
+  open_fds->clear();
+
+  DIR* d = opendir(kFdPath);
+  if (d == NULL) {
+    PLOG(ERROR) << "Unable to open directory " << std::string(kFdPath);
+    return false;
+  }
+
+  int dir_fd = dirfd(d);
+  dirent* e;
+  while ((e = readdir(d)) != NULL) {
+    const int fd = ParseFd(e, dir_fd);
+    if (fd == -1) {
+      continue;
     }
+    if (std::find(fds_to_ignore.begin(), fds_to_ignore.end(), fd) != fds_to_ignore.end()) {
+      LOG(INFO) << "Ignoring open file descriptor " << fd;
+      continue;
+    }
+
+    open_fds->push_back(fd);
   }
 
-  return !error;
+  if (closedir(d) == -1) {
+    PLOG(ERROR) << "Unable to close directory";
+    return false;
+  }
+
+  // procfs lists descriptors in ascending order already, so this is cheap.
+  std::sort(open_fds->begin(), open_fds->end());
+  return true;
 }
 
 // static
@@ -17,9 +17,7 @@
 #ifndef FRAMEWORKS_BASE_CORE_JNI_FD_UTILS_H_
 #define FRAMEWORKS_BASE_CORE_JNI_FD_UTILS_H_
 
-#include <set>
 #include <string>
-#include <unordered_map>
 #include <vector>
 
 #include <dirent.h>
@@ -78,7 +76,11 @@ class FileDescriptorInfo {
   // refers to the same description.
   bool Restat() const;
 
-  bool ReopenOrDetach() const;
+  // Reopens the file, or points the socket at |dev_null_fd|. This runs in
+  // the child after every fork, so everything that can be worked out ahead
+  // of time already has been: a file takes a single open(), with its status
+  // flags folded in, and a dup3() that also restores FD_CLOEXEC.
+  bool ReopenOrDetach(int dev_null_fd) const;
 
   const int fd;
   const struct stat stat;
@@ -104,13 +106,20 @@ class FileDescriptorInfo {
   //   address).
   static bool GetSocketName(const int fd, std::string* result);
 
-  bool DetachSocket() const;
+  bool DetachSocket(int dev_null_fd) const;
+
+  // Flags for reopening the file : its access mode and those status flags
+  // that open() accepts.
+  const int reopen_flags_;
+
+  // Status flags that only F_SETFL can set, if any.
+  const int setfl_flags_;
 
   DISALLOW_COPY_AND_ASSIGN(FileDescriptorInfo);
 };
 
 // A FileDescriptorTable is a collection of FileDescriptorInfo objects
-// keyed by their FDs.
+// sorted by their FDs.
 class FileDescriptorTable {
  public:
   // Creates a new FileDescriptorTable. This function scans
@@ -118,6 +127,11 @@ class FileDescriptorTable {
   // information about them. Returns NULL if an error occurs.
   static FileDescriptorTable* Create(const std::vector<int>& fds_to_ignore);
 
+  ~FileDescriptorTable();
+
+  // Brings the table up to date with the open file descriptors. Only
+  // descriptors that were opened or replaced since the last call are
+  // inspected in full; the rest cost a single fstat().
   bool Restat(const std::vector<int>& fds_to_ignore);
 
   // Reopens all file descriptors that are contained in the table. Returns true
@@ -126,14 +140,23 @@ class FileDescriptorTable {
   bool ReopenOrDetach();
 
  private:
-  FileDescriptorTable(const std::unordered_map<int, FileDescriptorInfo*>& map);
+  FileDescriptorTable(std::vector<FileDescriptorInfo*>&& entries);
 
-  bool RestatInternal(std::set<int>& open_fds);
+  bool RestatInternal(const std::vector<int>& open_fds);
+
+  // Lists the open file descriptors, other than those in |fds_to_ignore|,
+  // in ascending order.
+  static bool ListOpenFds(const std::vector<int>& fds_to_ignore, std::vector<int>* open_fds);
 
   static int ParseFd(dirent* e, int dir_fd);
 
-  // Invariant: All values in this unordered_map are non-NULL.
-  std::unordered_map<int, FileDescriptorInfo*> open_fd_map_;
+  // Invariant: All values are non-NULL, and sorted by fd.
+  std::vector<FileDescriptorInfo*> entries_;
+
+  // Kept between calls to Restat(), so that the common case of nothing
+  // having changed does not allocate.
+  std::vector<int> open_fds_;
+  std::vector<FileDescriptorInfo*> restat_entries_;
 
   DISALLOW_COPY_AND_ASSIGN(FileDescriptorTable);
 };
@@ -0,0 +1,197 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "netstats_reader.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace android {
+
+// The stats file of a busy device runs to a few hundred KB; start at a size that covers
+// a typical one in a single read.
+static const size_t INITIAL_BUFFER_SIZE = 64 * 1024;
+
+bool readStatsFile(const char* path, std::vector<char>* buffer) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    if (buffer->size() < INITIAL_BUFFER_SIZE) {
+        buffer->resize(INITIAL_BUFFER_SIZE);
+    }
+
+    size_t len = 0;
+    while (true) {
+        if (len + 1 >= buffer->size()) {
+            buffer->resize(buffer->size() * 2);
+        }
+        ssize_t amt = TEMP_FAILURE_RETRY(
+                pread(fd, buffer->data() + len, buffer->size() - len - 1, len));
+        if (amt < 0) {
+            close(fd);
+            return false;
+        }
+        if (amt == 0) {
+            break;
+        }
+        len += amt;
+    }
+    close(fd);
+
+    (*buffer)[len] = 0;
+    buffer->resize(len + 1);
+    return true;
+}
+
+static inline const char* skipSpaces(const char* p, const char* end) {
+    while (p < end && *p == ' ') {
+        p++;
+    }
+    return p;
+}
+
+// Parses an unsigned decimal at *p.  Returns false, leaving *p alone, if there isn't one.
+static inline bool parseDecimal(const char** p, const char* end, uint64_t* out) {
+    const char* q = *p;
+    uint64_t value = 0;
+    while (q < end && (unsigned) (*q - '0') < 10) {
+        value = value * 10 + (*q - '0');
+        q++;
+    }
+    if (q == *p) {
+        return false;
+    }
+    *out = value;
+    *p = q;
+    return true;
+}
+
+static inline bool parseHex(const char** p, const char* end, uint64_t* out) {
+    const char* q = *p;
+    uint64_t value = 0;
+    while (q < end) {
+        unsigned digit;
+        if ((unsigned) (*q - '0') < 10) {
+            digit = *q - '0';
+        } else if ((unsigned) ((*q | 0x20) - 'a') < 6) {
+            digit = (*q | 0x20) - 'a' + 10;
+        } else {
+            break;
+        }
+        value = (value << 4) | digit;
+        q++;
+    }
+    if (q == *p) {
+        return false;
+    }
+    *out = value;
+    *p = q;
+    return true;
+}
+
+// Parses up to count space-separated decimals, returning how many there were.
+static inline size_t parseDecimals(const char** p, const char* end, uint64_t* out,
+        size_t count) {
+    size_t parsed = 0;
+    while (parsed < count) {
+        const char* q = skipSpaces(*p, end);
+        if (!parseDecimal(&q, end, &out[parsed])) {
+            break;
+        }
+        *p = q;
+        parsed++;
+    }
+    return parsed;
+}
+
+QtaguidParseResult parseQtaguidStatsLine(const char* line, const char* end,
+        QtaguidStatsRow* row) {
+    const char* p = line;
+    uint64_t value;
+
+    // First field is the index.
+    if (!parseDecimal(&p, end, &value)) {
+        return QTAGUID_ROW_NO_INDEX;
+    }
+    row->idx = (int32_t) value;
+
+    // Next field is iface.
+    p = skipSpaces(p, end);
+    row->iface = p;
+    while (p < end && *p != ' ') {
+        p++;
+    }
+    row->ifaceLen = p - row->iface;
+    if (p == end || row->ifaceLen == 0) {
+        return QTAGUID_ROW_BAD_IFACE;
+    }
+
+    // Then the tag, as "0x" and the 64-bit kernel tag in hex; the app tag is the top half.
+    p = skipSpaces(p, end);
+    if (end - p < 3 || p[0] != '0' || (p[1] | 0x20) != 'x') {
+        return QTAGUID_ROW_BAD_TAG;
+    }
+    p += 2;
+    if (!parseHex(&p, end, &value)) {
+        return QTAGUID_ROW_BAD_TAG;
+    }
+    row->kernelTag = value;
+    row->tag = (int32_t) (value >> 32);
+
+    // Then uid, counter set and the four totals.  The per-protocol counters that follow
+    // aren't used.
+    uint64_t fields[6];
+    if (parseDecimals(&p, end, fields, 6) != 6) {
+        return QTAGUID_ROW_SHORT;
+    }
+    row->uid = (int32_t) fields[0];
+    row->set = (int32_t) fields[1];
+    row->rxBytes = fields[2];
+    row->rxPackets = fields[3];
+    row->txBytes = fields[4];
+    row->txPackets = fields[5];
+    return QTAGUID_ROW_OK;
+}
+
+bool parseIfaceStatsLine(const char* line, const char* end, IfaceStatsRow* row) {
+    const char* p = skipSpaces(line, end);
+    row->iface = p;
+    while (p < end && *p != ' ') {
+        p++;
+    }
+    row->ifaceLen = p - row->iface;
+
+    // Totals, then rx tcp bytes/packets, rx udp and other bytes/packets, and tx tcp
+    // bytes/packets.
+    uint64_t fields[12];
+    size_t parsed = parseDecimals(&p, end, fields, 12);
+    if (row->ifaceLen == 0 || parsed < 4) {
+        return false;
+    }
+    row->rxBytes = fields[0];
+    row->rxPackets = fields[1];
+    row->txBytes = fields[2];
+    row->txPackets = fields[3];
+    row->hasTcp = parsed == 12;
+    row->tcpRxPackets = row->hasTcp ? fields[5] : 0;
+    row->tcpTxPackets = row->hasTcp ? fields[11] : 0;
+    return true;
+}
+
+}  // namespace android
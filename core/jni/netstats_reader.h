@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FRAMEWORKS_BASE_CORE_JNI_NETSTATS_READER_H_
+#define FRAMEWORKS_BASE_CORE_JNI_NETSTATS_READER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+// Shared parsing of the xt_qtaguid stats files for NetworkStatsFactory and TrafficStats.
+//
+// A file is pulled in whole with a few large reads into a buffer that callers keep around,
+// then split into lines with memchr() and parsed in place, instead of one fgets() and a
+// handful of sscanf()/strtol() calls per line.
+
+namespace android {
+
+// Reads all of path into *buffer, replacing its contents and NUL-terminating them.
+// Returns false if the file couldn't be opened or read.
+bool readStatsFile(const char* path, std::vector<char>* buffer);
+
+// Calls onLine(line, end) for each line in [data, data + len), without the newline.
+template <typename OnLine>
+void forEachStatsLine(char* data, size_t len, OnLine onLine) {
+    char* const limit = data + len;
+    char* line = data;
+    while (line < limit) {
+        char* end = (char*) memchr(line, '\n', limit - line);
+        if (end == NULL) {
+            end = limit;
+        }
+        onLine(line, end);
+        line = end + 1;
+    }
+}
+
+// One row of /proc/net/xt_qtaguid/stats.  iface points into the parsed buffer.
+struct QtaguidStatsRow {
+    int32_t idx;
+    const char* iface;
+    size_t ifaceLen;
+    uint64_t kernelTag;
+    int32_t tag;            // the app's tag, the top half of kernelTag
+    int32_t uid;
+    int32_t set;
+    int64_t rxBytes;
+    int64_t rxPackets;
+    int64_t txBytes;
+    int64_t txPackets;
+};
+
+enum QtaguidParseResult {
+    QTAGUID_ROW_OK,
+    QTAGUID_ROW_NO_INDEX,   // doesn't start with an index, like the header line
+    QTAGUID_ROW_SHORT,      // not enough counters
+    QTAGUID_ROW_BAD_IFACE,
+    QTAGUID_ROW_BAD_TAG,
+};
+
+// Parses a line of /proc/net/xt_qtaguid/stats.  Fields before the one that made parsing
+// stop are filled in, so callers can apply their filters in the order the fields appear.
+QtaguidParseResult parseQtaguidStatsLine(const char* line, const char* end,
+        QtaguidStatsRow* row);
+
+// One row of /proc/net/xt_qtaguid/iface_stat_fmt.
+struct IfaceStatsRow {
+    const char* iface;
+    size_t ifaceLen;
+    uint64_t rxBytes;
+    uint64_t rxPackets;
+    uint64_t txBytes;
+    uint64_t txPackets;
+    bool hasTcp;            // older kernels don't report the TCP packet counts
+    uint64_t tcpRxPackets;
+    uint64_t tcpTxPackets;
+};
+
+// Parses a line of /proc/net/xt_qtaguid/iface_stat_fmt.  Returns false for the header
+// line and anything else without at least the four totals.
+bool parseIfaceStatsLine(const char* line, const char* end, IfaceStatsRow* row);
+
+}  // namespace android
+
+#endif  // FRAMEWORKS_BASE_CORE_JNI_NETSTATS_READER_H_
@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include "YuvToJpegEncoder.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+namespace {
+
+// Exposes the strip encoders, so that the stitched output can be compared with a single
+// encode that has the same restart interval.
+template <typename Encoder>
+class StripTestEncoder : public Encoder {
+public:
+    explicit StripTestEncoder(int* strides) : Encoder(strides) {}
+
+    using YuvToJpegEncoder::encodeStrip;
+    using YuvToJpegEncoder::encodeStrips;
+};
+
+struct Frame {
+    std::vector<uint8_t> data;
+    int offsets[2];
+    int strides[2];
+};
+
+// Gradients with some noise, and rows padded past the width, so that every strip has
+// different content and the plane offsets of each strip matter.
+Frame makeFrame(bool nv21, int width, int height) {
+    Frame frame;
+    if (nv21) {
+        frame.strides[0] = width + 6;
+        frame.strides[1] = width + 6;
+        frame.offsets[0] = 0;
+        frame.offsets[1] = frame.strides[0] * height;
+        frame.data.resize(frame.offsets[1] + frame.strides[1] * (height / 2));
+    } else {
+        frame.strides[0] = width * 2 + 4;
+        frame.strides[1] = 0;
+        frame.offsets[0] = 0;
+        frame.offsets[1] = 0;
+        frame.data.resize(frame.strides[0] * height);
+    }
+    uint32_t seed = 7;
+    for (size_t i = 0; i < frame.data.size(); i++) {
+        seed = seed * 1103515245u + 12345u;
+        frame.data[i] = ((seed >> 16) & 15) + (i % 200);
+    }
+    return frame;
+}
+
+template <typename Encoder>
+void expectStripsMatchSingleEncode(bool nv21, int width, int height, int stripCount) {
+    Frame frame = makeFrame(nv21, width, height);
+    StripTestEncoder<Encoder> encoder(frame.strides);
+
+    SkDynamicMemoryWStream single;
+    ASSERT_TRUE(encoder.encodeStrip(&single, frame.data.data(), width, height, frame.offsets,
+            90, true));
+    SkDynamicMemoryWStream strips;
+    ASSERT_TRUE(encoder.encodeStrips(&strips, frame.data.data(), width, height, frame.offsets,
+            90, stripCount));
+
+    sk_sp<SkData> expected = single.detachAsData();
+    sk_sp<SkData> actual = strips.detachAsData();
+    ASSERT_EQ(expected->size(), actual->size());
+    EXPECT_EQ(0, memcmp(expected->bytes(), actual->bytes(), expected->size()));
+}
+
+}  // namespace
+
+TEST(YuvToJpegEncoder, Nv21StripsMatchSingleEncode) {
+    expectStripsMatchSingleEncode<Yuv420SpToJpegEncoder>(true, 200,
+            2 * YuvToJpegEncoder::kStripRowAlignment, 2);
+}
+
+TEST(YuvToJpegEncoder, Nv21StripsMatchSingleEncodeWithPartialLastStrip) {
+    // The last strip is 40 rows: two and a half MCU rows.
+    expectStripsMatchSingleEncode<Yuv420SpToJpegEncoder>(true, 200,
+            2 * YuvToJpegEncoder::kStripRowAlignment + 40, 3);
+}
+
+TEST(YuvToJpegEncoder, Yuy2StripsMatchSingleEncode) {
+    expectStripsMatchSingleEncode<Yuv422IToJpegEncoder>(false, 200,
+            2 * YuvToJpegEncoder::kStripRowAlignment, 2);
+}
+
+TEST(YuvToJpegEncoder, Yuy2StripsMatchSingleEncodeWithPartialLastStrip) {
+    expectStripsMatchSingleEncode<Yuv422IToJpegEncoder>(false, 200,
+            2 * YuvToJpegEncoder::kStripRowAlignment + 40, 3);
+}
+
+TEST(YuvToJpegEncoder, EncodeIsSingleThreadedByDefault) {
+    const int width = 2048;
+    const int height = YuvToJpegEncoder::kMinParallelPixels / width;
+    Frame frame = makeFrame(true, width, height);
+    StripTestEncoder<Yuv420SpToJpegEncoder> encoder(frame.strides);
+
+    // Large enough to be split, but encode() must not add restart markers unless asked.
+    SkDynamicMemoryWStream plain;
+    ASSERT_TRUE(encoder.encodeStrip(&plain, frame.data.data(), width, height, frame.offsets,
+            90, false));
+    SkDynamicMemoryWStream encoded;
+    ASSERT_TRUE(encoder.encode(&encoded, frame.data.data(), width, height, frame.offsets, 90));
+
+    sk_sp<SkData> expected = plain.detachAsData();
+    sk_sp<SkData> actual = encoded.detachAsData();
+    ASSERT_EQ(expected->size(), actual->size());
+    EXPECT_EQ(0, memcmp(expected->bytes(), actual->bytes(), expected->size()));
+}
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include "fd_utils.h"
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// Roughly what a zygote holds open when it forks: the boot class path and
+// framework resources, plus a few devices.
+static const size_t kFdCount = 64;
+
+// The benchmark's own stdio, which the zygote does not have open either.
+static const std::vector<int> kFdsToIgnore = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+
+// Opens every jar under /system/framework, as the zygote does, and makes up
+// the rest of kFdCount with /dev/null. Whatever else the benchmark itself has
+// open must be in kFdsToIgnore or whitelisted, or the table cannot be created.
+static std::vector<int> OpenZygoteFds() {
+  std::vector<int> fds;
+  std::unique_ptr<DIR, int(*)(DIR*)> dir(opendir("/system/framework"), closedir);
+  if (dir != nullptr) {
+    dirent* e;
+    while (fds.size() < kFdCount && (e = readdir(dir.get())) != nullptr) {
+      std::string name(e->d_name);
+      if (name.size() > 4 && name.compare(name.size() - 4, 4, ".jar") == 0) {
+        int fd = open(("/system/framework/" + name).c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd != -1) {
+          fds.push_back(fd);
+        }
+      }
+    }
+  }
+  while (fds.size() < kFdCount) {
+    fds.push_back(open("/dev/null", O_RDWR | O_CLOEXEC));
+  }
+  return fds;
+}
+
+static void CloseFds(const std::vector<int>& fds) {
+  for (int fd : fds) {
+    close(fd);
+  }
+}
+
+// The first fork: every descriptor is inspected in full.
+static void BM_FileDescriptorTable_Create(benchmark::State& state) {
+  std::vector<int> fds = OpenZygoteFds();
+  while (state.KeepRunning()) {
+    std::unique_ptr<FileDescriptorTable> table(FileDescriptorTable::Create(kFdsToIgnore));
+    if (table == nullptr) {
+      state.SkipWithError("Unable to construct file descriptor table");
+      break;
+    }
+  }
+  CloseFds(fds);
+}
+BENCHMARK(BM_FileDescriptorTable_Create);
+
+// Every later fork, with nothing changed in between.
+static void BM_FileDescriptorTable_Restat(benchmark::State& state) {
+  std::vector<int> fds = OpenZygoteFds();
+  std::unique_ptr<FileDescriptorTable> table(FileDescriptorTable::Create(kFdsToIgnore));
+  if (table == nullptr) {
+    state.SkipWithError("Unable to construct file descriptor table");
+  }
+  while (table != nullptr && state.KeepRunning()) {
+    if (!table->Restat(kFdsToIgnore)) {
+      state.SkipWithError("Unable to restat file descriptor table");
+      break;
+    }
+  }
+  CloseFds(fds);
+}
+BENCHMARK(BM_FileDescriptorTable_Restat);
+
+// What a fork costs the zygote until the child has its own descriptors:
+// restat, fork, and in the child reopen everything. The child then exits,
+// and is reaped, which BM_Fork measures alone.
+static void BM_FileDescriptorTable_Fork(benchmark::State& state) {
+  std::vector<int> fds = OpenZygoteFds();
+  std::unique_ptr<FileDescriptorTable> table(FileDescriptorTable::Create(kFdsToIgnore));
+  if (table == nullptr) {
+    state.SkipWithError("Unable to construct file descriptor table");
+  }
+  while (table != nullptr && state.KeepRunning()) {
+    table->Restat(kFdsToIgnore);
+    pid_t pid = fork();
+    if (pid == 0) {
+      _exit(table->ReopenOrDetach() ? 0 : 1);
+    }
+    int status;
+    if (pid == -1 || waitpid(pid, &status, 0) != pid || status != 0) {
+      state.SkipWithError("Child failed to reopen file descriptors");
+      break;
+    }
+  }
+  CloseFds(fds);
+}
+BENCHMARK(BM_FileDescriptorTable_Fork);
+
+static void BM_Fork(benchmark::State& state) {
+  std::vector<int> fds = OpenZygoteFds();
+  while (state.KeepRunning()) {
+    pid_t pid = fork();
+    if (pid == 0) {
+      _exit(0);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+  }
+  CloseFds(fds);
+}
+BENCHMARK(BM_Fork);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,185 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include "fd_utils.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <android-base/test_utils.h>
+
+class FileDescriptorTableTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    FileDescriptorWhitelist::Get()->Allow(allowed_.path);
+    FileDescriptorWhitelist::Get()->Allow(other_allowed_.path);
+
+    // Whatever the test process has open, including the temporary files
+    // themselves, is left out of the table; only descriptors that the tests
+    // open are tracked.
+    std::unique_ptr<DIR, int(*)(DIR*)> dir(opendir("/proc/self/fd"), closedir);
+    ASSERT_NE(nullptr, dir);
+    dirent* e;
+    while ((e = readdir(dir.get())) != nullptr) {
+      char* end;
+      const int fd = strtol(e->d_name, &end, 10);
+      if (*end == '\0' && e->d_name[0] != '\0' && fd != dirfd(dir.get())) {
+        fds_to_ignore_.push_back(fd);
+      }
+    }
+  }
+
+  void TearDown() override {
+    for (int fd : opened_) {
+      close(fd);
+    }
+  }
+
+  int Open(const char* path, off_t offset) {
+    int fd = open(path, O_RDONLY);
+    if (fd != -1) {
+      lseek(fd, offset, SEEK_SET);
+      opened_.push_back(fd);
+    }
+    return fd;
+  }
+
+  // Reopens the table in a forked child, as the zygote does, and returns
+  // whether that and |check| both succeeded there.
+  static bool ReopenInChild(FileDescriptorTable* table, const std::function<bool()>& check) {
+    pid_t pid = fork();
+    if (pid == 0) {
+      _exit(table->ReopenOrDetach() && check() ? 0 : 1);
+    }
+    int status;
+    return pid != -1 && waitpid(pid, &status, 0) == pid && WIFEXITED(status)
+        && WEXITSTATUS(status) == 0;
+  }
+
+  // Checks in the child that |fd| is at |offset| and has its own file
+  // description: seeking it must not move the parent's.
+  static bool IsReopenedAt(int fd, off_t offset) {
+    return lseek(fd, 0, SEEK_CUR) == offset && lseek(fd, offset + 1, SEEK_SET) == offset + 1;
+  }
+
+  TemporaryFile allowed_;
+  TemporaryFile other_allowed_;
+  TemporaryFile not_allowed_;
+  std::vector<int> fds_to_ignore_;
+  std::vector<int> opened_;
+};
+
+TEST_F(FileDescriptorTableTest, RestatKeepsUnchangedFd) {
+  int fd = Open(allowed_.path, 4);
+  ASSERT_NE(-1, fd);
+  std::unique_ptr<FileDescriptorTable> table(FileDescriptorTable::Create(fds_to_ignore_));
+  ASSERT_NE(nullptr, table);
+
+  ASSERT_TRUE(table->Restat(fds_to_ignore_));
+  ASSERT_TRUE(table->Restat(fds_to_ignore_));
+  EXPECT_TRUE(ReopenInChild(table.get(), [fd]() { return IsReopenedAt(fd, 4); }));
+  EXPECT_EQ(4, lseek(fd, 0, SEEK_CUR));
+}
+
+TEST_F(FileDescriptorTableTest, RestatDropsClosedFd) {
+  int kept = Open(allowed_.path, 0);
+  int closed = Open(other_allowed_.path, 0);
+  ASSERT_NE(-1, kept);
+  ASSERT_NE(-1, closed);
+  std::unique_ptr<FileDescriptorTable> table(FileDescriptorTable::Create(fds_to_ignore_));
+  ASSERT_NE(nullptr, table);
+
+  close(closed);
+  opened_.pop_back();
+  ASSERT_TRUE(table->Restat(fds_to_ignore_));
+  // A stale entry would be reopened onto the closed descriptor.
+  EXPECT_TRUE(ReopenInChild(table.get(), [closed]() {
+    return fcntl(closed, F_GETFD) == -1 && errno == EBADF;
+  }));
+}
+
+TEST_F(FileDescriptorTableTest, RestatAddsNewFd) {
+  int fd = Open(allowed_.path, 4);
+  ASSERT_NE(-1, fd);
+  std::unique_ptr<FileDescriptorTable> table(FileDescriptorTable::Create(fds_to_ignore_));
+  ASSERT_NE(nullptr, table);
+
+  int added = Open(other_allowed_.path, 7);
+  ASSERT_NE(-1, added);
+  ASSERT_TRUE(table->Restat(fds_to_ignore_));
+  EXPECT_TRUE(ReopenInChild(table.get(), [fd, added]() {
+    return IsReopenedAt(fd, 4) && IsReopenedAt(added, 7);
+  }));
+  EXPECT_EQ(7, lseek(added, 0, SEEK_CUR));
+}
+
+TEST_F(FileDescriptorTableTest, RestatRejectsNewFdNotWhitelisted) {
+  std::unique_ptr<FileDescriptorTable> table(FileDescriptorTable::Create(fds_to_ignore_));
+  ASSERT_NE(nullptr, table);
+
+  int fd = Open(not_allowed_.path, 0);
+  ASSERT_NE(-1, fd);
+  EXPECT_FALSE(table->Restat(fds_to_ignore_));
+
+  close(fd);
+  opened_.pop_back();
+  EXPECT_TRUE(table->Restat(fds_to_ignore_));
+}
+
+TEST_F(FileDescriptorTableTest, RestatUpdatesReplacedFd) {
+  int fd = Open(allowed_.path, 4);
+  ASSERT_NE(-1, fd);
+  std::unique_ptr<FileDescriptorTable> table(FileDescriptorTable::Create(fds_to_ignore_));
+  ASSERT_NE(nullptr, table);
+
+  int replacement = open(other_allowed_.path, O_RDONLY);
+  ASSERT_NE(-1, replacement);
+  lseek(replacement, 7, SEEK_SET);
+  ASSERT_EQ(fd, dup2(replacement, fd));
+  close(replacement);
+  struct stat expected;
+  ASSERT_EQ(0, fstat(fd, &expected));
+
+  ASSERT_TRUE(table->Restat(fds_to_ignore_));
+  // A stale entry would reopen the first file instead.
+  EXPECT_TRUE(ReopenInChild(table.get(), [fd, expected]() {
+    struct stat actual;
+    return fstat(fd, &actual) == 0 && actual.st_dev == expected.st_dev
+        && actual.st_ino == expected.st_ino && IsReopenedAt(fd, 7);
+  }));
+  EXPECT_EQ(7, lseek(fd, 0, SEEK_CUR));
+}
+
+TEST_F(FileDescriptorTableTest, RestatRejectsReplacementNotWhitelisted) {
+  int fd = Open(allowed_.path, 0);
+  ASSERT_NE(-1, fd);
+  std::unique_ptr<FileDescriptorTable> table(FileDescriptorTable::Create(fds_to_ignore_));
+  ASSERT_NE(nullptr, table);
+
+  int replacement = open(not_allowed_.path, O_RDONLY);
+  ASSERT_NE(-1, replacement);
+  ASSERT_EQ(fd, dup2(replacement, fd));
+  close(replacement);
+  EXPECT_FALSE(table->Restat(fds_to_ignore_));
+}
@@ -106,4 +106,42 @@ public class CursorWindowTest extends TestCase implements PerformanceTestCase {
         assertTrue(window.putBlob(blob, 0, 6));
         assertTrue(Arrays.equals(blob, window.getBlob(0, 6)));
     }
+
+    @SmallTest
+    public void testBulkGetters() {
+        CursorWindow window = new CursorWindow("MyWindow");
+        window.setStartPosition(10);
+        assertTrue(window.setNumColumns(2));
+        for (int i = 0; i < 250; i++) {
+            assertTrue(window.allocRow());
+            assertTrue(window.putLong(i * 3L, 10 + i, 0));
+            if (i % 5 == 0) {
+                assertTrue(window.putNull(10 + i, 1));
+            } else {
+                assertTrue(window.putString("r\u00e9sum\u00e9 " + i, 10 + i, 1));
+            }
+        }
+
+        long[] longs = new long[200];
+        window.getLongs(40, 200, 0, longs);
+        double[] doubles = new double[200];
+        window.getDoubles(40, 200, 0, doubles);
+        String[] strings = window.getStrings(40, 200, 1);
+        String[] longStrings = window.getStrings(40, 200, 0);
+        for (int i = 0; i < 200; i++) {
+            int row = 40 + i;
+            assertEquals(window.getLong(row, 0), longs[i]);
+            assertEquals(window.getDouble(row, 0), doubles[i]);
+            assertEquals(window.getString(row, 1), strings[i]);
+            assertEquals(window.getString(row, 0), longStrings[i]);
+        }
+        assertNull(strings[0]);
+
+        try {
+            window.getLongs(250, 20, 0, new long[20]);
+            fail("expected an IllegalStateException for rows past the end of the window");
+        } catch (IllegalStateException expected) {
+        }
+        window.close();
+    }
 }
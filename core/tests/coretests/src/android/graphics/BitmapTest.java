@@ -16,10 +16,13 @@
 
 package android.graphics;
 
+import android.os.Parcel;
 import android.test.suitebuilder.annotation.SmallTest;
 
 import junit.framework.TestCase;
 
+import java.util.Random;
+
 
 public class BitmapTest extends TestCase {
 
@@ -244,4 +247,49 @@ public class BitmapTest extends TestCase {
         assertTrue(hardwareBitmap.isPremultiplied());
         assertFalse(hardwareBitmap.isMutable());
     }
+
+    // Writes the bitmap to a parcel that does not allow fds, so that its pixels go into the
+    // parcel itself, and checks that they come back. Returns the parcel's size.
+    private static int parcelWithoutFds(Bitmap bitmap) {
+        Parcel parcel = Parcel.obtain();
+        try {
+            parcel.pushAllowFds(false);
+            bitmap.writeToParcel(parcel, 0);
+            parcel.setDataPosition(0);
+            Bitmap copy = Bitmap.CREATOR.createFromParcel(parcel);
+            assertTrue(bitmap.sameAs(copy));
+            return parcel.dataSize();
+        } finally {
+            parcel.recycle();
+        }
+    }
+
+    private static void fillWithNoise(Bitmap bitmap, int top, int bottom) {
+        Random random = new Random(0);
+        for (int y = top; y < bottom; y++) {
+            for (int x = 0; x < bitmap.getWidth(); x++) {
+                bitmap.setPixel(x, y, random.nextInt() | 0xff000000);
+            }
+        }
+    }
+
+    @SmallTest
+    public void testParcelWithoutFdsCompressesFlatPixels() {
+        Bitmap bitmap = Bitmap.createBitmap(256, 256, Bitmap.Config.ARGB_8888);
+        bitmap.eraseColor(Color.BLUE);
+        assertTrue(parcelWithoutFds(bitmap) < bitmap.getByteCount() / 2);
+    }
+
+    @SmallTest
+    public void testParcelWithoutFdsSendsNoisyPixelsAsTheyAre() {
+        Bitmap bitmap = Bitmap.createBitmap(256, 256, Bitmap.Config.ARGB_8888);
+        fillWithNoise(bitmap, 0, 256);
+        assertTrue(parcelWithoutFds(bitmap) >= bitmap.getByteCount());
+
+        // Flat in the middle, where the compression sample is taken, but noisy elsewhere.
+        bitmap.eraseColor(Color.BLUE);
+        fillWithNoise(bitmap, 0, 120);
+        fillWithNoise(bitmap, 136, 256);
+        assertTrue(parcelWithoutFds(bitmap) >= bitmap.getByteCount());
+    }
 }
@@ -0,0 +1,186 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package android.os;
+
+import android.test.suitebuilder.annotation.MediumTest;
+import android.test.suitebuilder.annotation.SmallTest;
+
+import junit.framework.TestCase;
+
+import java.lang.ref.WeakReference;
+import java.util.concurrent.CountDownLatch;
+import java.util.concurrent.CyclicBarrier;
+
+public class BinderProxyTest extends TestCase {
+
+    // Not used by the framework classes that a test process loads, so that its proxy can be
+    // collected between tests.
+    private static final String SERVICE = "dropbox";
+
+    private IBinder getRemoteBinder() {
+        IBinder binder = ServiceManager.getService(SERVICE);
+        assertNotNull(binder);
+        assertEquals("android.os.BinderProxy", binder.getClass().getName());
+        return binder;
+    }
+
+    private static Parcel parcelWith(IBinder binder) {
+        Parcel parcel = Parcel.obtain();
+        parcel.writeStrongBinder(binder);
+        parcel.setDataPosition(0);
+        return parcel;
+    }
+
+    // Collects the BinderProxy that weakProxy refers to, if nothing else in the process holds
+    // it, so that the next lookup has to create a new one.
+    private static void collect(WeakReference<IBinder> weakProxy) {
+        for (int i = 0; i < 10 && weakProxy.get() != null; i++) {
+            Runtime.getRuntime().gc();
+            Runtime.getRuntime().runFinalization();
+        }
+    }
+
+    @SmallTest
+    public void testLookupStatsLength() {
+        long[] stats = Debug.getBinderProxyLookupStats();
+        assertEquals(Debug.BINDER_PROXY_STATS_MAX_NANOS + 1, stats.length);
+        for (long stat : stats) {
+            assertTrue(stat >= 0);
+        }
+        assertTrue(stats[Debug.BINDER_PROXY_STATS_HITS]
+                <= stats[Debug.BINDER_PROXY_STATS_LOOKUPS]);
+        assertTrue(stats[Debug.BINDER_PROXY_STATS_CREATION_RACES]
+                <= stats[Debug.BINDER_PROXY_STATS_CREATED]);
+        assertTrue(stats[Debug.BINDER_PROXY_STATS_MAX_NANOS]
+                <= stats[Debug.BINDER_PROXY_STATS_TOTAL_NANOS]);
+    }
+
+    @SmallTest
+    public void testLiveProxyIsReturnedAgain() {
+        IBinder binder = getRemoteBinder();
+        long[] before = Debug.getBinderProxyLookupStats();
+
+        final int reads = 5;
+        for (int i = 0; i < reads; i++) {
+            Parcel parcel = parcelWith(binder);
+            try {
+                assertSame(binder, parcel.readStrongBinder());
+            } finally {
+                parcel.recycle();
+            }
+        }
+
+        long[] after = Debug.getBinderProxyLookupStats();
+        assertTrue(after[Debug.BINDER_PROXY_STATS_LOOKUPS]
+                - before[Debug.BINDER_PROXY_STATS_LOOKUPS] >= reads);
+        assertTrue(after[Debug.BINDER_PROXY_STATS_HITS]
+                - before[Debug.BINDER_PROXY_STATS_HITS] >= reads);
+        assertTrue(after[Debug.BINDER_PROXY_STATS_TOTAL_NANOS]
+                >= before[Debug.BINDER_PROXY_STATS_TOTAL_NANOS]);
+    }
+
+    @SmallTest
+    public void testCollectedProxyIsReplaced() {
+        Parcel parcel = parcelWith(getRemoteBinder());
+        try {
+            // The parcel keeps the native IBinder alive while its BinderProxy is collected.
+            WeakReference<IBinder> weakProxy = new WeakReference<>(parcel.readStrongBinder());
+            collect(weakProxy);
+
+            parcel.setDataPosition(0);
+            IBinder binder = parcel.readStrongBinder();
+            assertNotNull(binder);
+            assertTrue(binder.pingBinder());
+            IBinder previous = weakProxy.get();
+            if (previous != null) {
+                // Still referenced elsewhere, so it must have been returned again.
+                assertSame(previous, binder);
+            }
+
+            parcel.setDataPosition(0);
+            assertSame(binder, parcel.readStrongBinder());
+        } finally {
+            parcel.recycle();
+        }
+    }
+
+    @MediumTest
+    public void testConcurrentLookupsReturnOneProxy() throws Exception {
+        final int threadCount = 8;
+        final int rounds = 20;
+        final Parcel[] parcels = new Parcel[threadCount];
+        IBinder binder = getRemoteBinder();
+        for (int i = 0; i < threadCount; i++) {
+            parcels[i] = parcelWith(binder);
+        }
+        WeakReference<IBinder> weakProxy = new WeakReference<>(binder);
+        binder = null;
+
+        long[] before = Debug.getBinderProxyLookupStats();
+        try {
+            for (int round = 0; round < rounds; round++) {
+                collect(weakProxy);
+
+                // Start all lookups at once, so that threads that miss race to create the
+                // BinderProxy; only one may win.
+                final IBinder[] results = new IBinder[threadCount];
+                final Throwable[] failures = new Throwable[threadCount];
+                final CyclicBarrier barrier = new CyclicBarrier(threadCount);
+                final CountDownLatch done = new CountDownLatch(threadCount);
+                for (int i = 0; i < threadCount; i++) {
+                    final int index = i;
+                    new Thread(() -> {
+                        try {
+                            parcels[index].setDataPosition(0);
+                            barrier.await();
+                            results[index] = parcels[index].readStrongBinder();
+                        } catch (Throwable t) {
+                            failures[index] = t;
+                        } finally {
+                            done.countDown();
+                        }
+                    }).start();
+                }
+                done.await();
+
+                for (int i = 0; i < threadCount; i++) {
+                    assertNull(failures[i]);
+                    assertNotNull(results[i]);
+                    assertSame(results[0], results[i]);
+                }
+                weakProxy = new WeakReference<>(results[0]);
+            }
+        } finally {
+            for (Parcel parcel : parcels) {
+                parcel.recycle();
+            }
+        }
+
+        long[] after = Debug.getBinderProxyLookupStats();
+        long lookups = after[Debug.BINDER_PROXY_STATS_LOOKUPS]
+                - before[Debug.BINDER_PROXY_STATS_LOOKUPS];
+        long hits = after[Debug.BINDER_PROXY_STATS_HITS] - before[Debug.BINDER_PROXY_STATS_HITS];
+        long created = after[Debug.BINDER_PROXY_STATS_CREATED]
+                - before[Debug.BINDER_PROXY_STATS_CREATED];
+        long races = after[Debug.BINDER_PROXY_STATS_CREATION_RACES]
+                - before[Debug.BINDER_PROXY_STATS_CREATION_RACES];
+        assertTrue(lookups >= threadCount * rounds);
+        assertTrue(hits <= lookups);
+        // Every lost race created a BinderProxy that was never handed out.
+        assertTrue(races <= created);
+    }
+}
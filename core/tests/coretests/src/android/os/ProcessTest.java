@@ -24,6 +24,9 @@ import android.test.suitebuilder.annotation.SmallTest;
 
 import junit.framework.TestCase;
 
+import java.io.File;
+import java.util.concurrent.CountDownLatch;
+
 
 public class ProcessTest extends TestCase {
 
@@ -51,4 +54,114 @@ public class ProcessTest extends TestCase {
         assertEquals(-1, Process.getUidForName("u2jhsajhfkjhsafkhskafhkashfkjashfkjhaskjfdhakj3"));
     }
 
+    // Field 1 of /proc/<pid>/stat is the pid itself.
+    private static final int[] PID_STAT_FORMAT = new int[] {
+        Process.PROC_SPACE_TERM|Process.PROC_OUT_LONG,
+    };
+
+    /** Runs a thread that parks until {@link #finish}, so its tid can be read and then die. */
+    private static class ParkedThread extends Thread {
+        private final CountDownLatch mStarted = new CountDownLatch(1);
+        private final CountDownLatch mFinish = new CountDownLatch(1);
+        private volatile int mTid;
+
+        @Override
+        public void run() {
+            mTid = Process.myTid();
+            mStarted.countDown();
+            try {
+                mFinish.await();
+            } catch (InterruptedException e) {
+            }
+        }
+
+        int startAndGetTid() throws InterruptedException {
+            start();
+            mStarted.await();
+            return mTid;
+        }
+
+        void finish() throws InterruptedException {
+            mFinish.countDown();
+            join();
+            // join() returns before the kernel task is gone; wait for that too.
+            final File task = new File("/proc/self/task/" + mTid);
+            for (int i = 0; i < 500 && task.exists(); i++) {
+                Thread.sleep(10);
+            }
+        }
+    }
+
+    @SmallTest
+    public void testProcSnapshotReadsEachPid() throws Exception {
+        ParkedThread thread = new ParkedThread();
+        final int tid = thread.startAndGetTid();
+        final long snapshot = Process.openProcSnapshot(PID_STAT_FORMAT, null, null);
+        try {
+            long[] values = Process.readProcSnapshot(snapshot,
+                    new int[] { Process.myPid(), tid });
+            assertEquals(4, values.length);
+            assertEquals(1, values[0]);
+            assertEquals(Process.myPid(), values[1]);
+            assertEquals(1, values[2]);
+            assertEquals(tid, values[3]);
+        } finally {
+            Process.closeProcSnapshot(snapshot);
+            thread.finish();
+        }
+    }
+
+    @SmallTest
+    public void testProcSnapshotPidDiesWhileOpen() throws Exception {
+        ParkedThread thread = new ParkedThread();
+        final int tid = thread.startAndGetTid();
+        final long snapshot = Process.openProcSnapshot(PID_STAT_FORMAT, null, null);
+        try {
+            final int[] pids = new int[] { tid, Process.myPid() };
+            long[] values = Process.readProcSnapshot(snapshot, pids);
+            assertEquals(1, values[0]);
+            assertEquals(tid, values[1]);
+
+            // The stat file kept open for tid now fails with ESRCH, and reopening it by
+            // pid finds nothing.  That must not affect the other pids in the read.
+            thread.finish();
+            values = Process.readProcSnapshot(snapshot, pids);
+            assertEquals(0, values[0]);
+            assertEquals(1, values[2]);
+            assertEquals(Process.myPid(), values[3]);
+        } finally {
+            Process.closeProcSnapshot(snapshot);
+        }
+    }
+
+    @SmallTest
+    public void testProcSnapshotReopensDroppedPid() throws Exception {
+        // A reused pid can't be forced from a test, but it is handled the same way as a pid
+        // that drops out of the list and comes back: its file is opened again by pid, so
+        // the read reflects whatever owns the pid now.
+        ParkedThread first = new ParkedThread();
+        ParkedThread second = new ParkedThread();
+        final int firstTid = first.startAndGetTid();
+        final int secondTid = second.startAndGetTid();
+        final long snapshot = Process.openProcSnapshot(PID_STAT_FORMAT, null, null);
+        try {
+            long[] values = Process.readProcSnapshot(snapshot, new int[] { firstTid });
+            assertEquals(1, values[0]);
+            assertEquals(firstTid, values[1]);
+
+            // firstTid drops out of the list, so its file is closed.
+            first.finish();
+            values = Process.readProcSnapshot(snapshot, new int[] { secondTid });
+            assertEquals(1, values[0]);
+            assertEquals(secondTid, values[1]);
+
+            values = Process.readProcSnapshot(snapshot, new int[] { firstTid, secondTid });
+            assertEquals(0, values[0]);
+            assertEquals(1, values[2]);
+            assertEquals(secondTid, values[3]);
+        } finally {
+            Process.closeProcSnapshot(snapshot);
+            second.finish();
+        }
+    }
 }
@@ -0,0 +1,233 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.android.internal.content;
+
+import static android.content.pm.PackageManager.INSTALL_FAILED_CONTAINER_ERROR;
+import static android.content.pm.PackageManager.INSTALL_FAILED_INVALID_APK;
+import static android.content.pm.PackageManager.INSTALL_SUCCEEDED;
+
+import android.os.FileUtils;
+import android.test.suitebuilder.annotation.MediumTest;
+
+import junit.framework.TestCase;
+
+import java.io.File;
+import java.io.FileOutputStream;
+import java.io.FilterOutputStream;
+import java.io.IOException;
+import java.io.OutputStream;
+import java.lang.reflect.Method;
+import java.nio.file.Files;
+import java.util.Arrays;
+import java.util.Random;
+import java.util.zip.CRC32;
+import java.util.zip.ZipEntry;
+import java.util.zip.ZipOutputStream;
+
+public class NativeLibraryHelperTest extends TestCase {
+
+    private static final String ABI = "x86";
+    private static final int PAGE_SIZE = 4096;
+    private static final int LIBRARY_COUNT = 12;
+
+    private File mDir;
+    private File mApk;
+    private File mLibDir;
+
+    private Method mOpenApk;
+    private Method mClose;
+    private Method mCopyNativeBinaries;
+
+    @Override
+    protected void setUp() throws Exception {
+        super.setUp();
+        mDir = Files.createTempDirectory("NativeLibraryHelperTest").toFile();
+        mApk = new File(mDir, "test.apk");
+        mLibDir = new File(mDir, "lib");
+        assertTrue(mLibDir.mkdir());
+
+        // The natives are called directly so that the test can pick the flags that
+        // copyNativeBinaries() takes from the package and the device.
+        mOpenApk = NativeLibraryHelper.class.getDeclaredMethod("nativeOpenApk", String.class);
+        mClose = NativeLibraryHelper.class.getDeclaredMethod("nativeClose", long.class);
+        mCopyNativeBinaries = NativeLibraryHelper.class.getDeclaredMethod(
+                "nativeCopyNativeBinaries", long.class, String.class, String.class,
+                boolean.class, boolean.class, boolean.class);
+        mOpenApk.setAccessible(true);
+        mClose.setAccessible(true);
+        mCopyNativeBinaries.setAccessible(true);
+    }
+
+    @Override
+    protected void tearDown() throws Exception {
+        FileUtils.deleteContentsAndDir(mDir);
+        super.tearDown();
+    }
+
+    private static String libraryName(int i) {
+        return "lib" + i + ".so";
+    }
+
+    private int copyNativeBinaries(boolean extractNativeLibs, boolean hasNativeBridge)
+            throws Exception {
+        long handle = (long) mOpenApk.invoke(null, mApk.getPath());
+        assertTrue(handle != 0);
+        try {
+            return (int) mCopyNativeBinaries.invoke(null, handle, mLibDir.getPath(), ABI,
+                    extractNativeLibs, hasNativeBridge, false /* debuggable */);
+        } finally {
+            mClose.invoke(null, handle);
+        }
+    }
+
+    @MediumTest
+    public void testParallelCopyWritesEveryLibrary() throws Exception {
+        byte[][] contents = new byte[LIBRARY_COUNT][];
+        Random random = new Random(0);
+        try (ApkWriter apk = new ApkWriter(mApk)) {
+            for (int i = 0; i < LIBRARY_COUNT; i++) {
+                contents[i] = new byte[64 * 1024 + i * 1000];
+                random.nextBytes(contents[i]);
+                // Compressible libraries take the inflate path, the rest sendfile().
+                if (i % 2 == 0) {
+                    Arrays.fill(contents[i], 0, contents[i].length / 2, (byte) i);
+                    apk.addDeflated(libraryName(i), contents[i]);
+                } else {
+                    apk.addStored(libraryName(i), contents[i], false /* pageAligned */);
+                }
+            }
+        }
+
+        assertEquals(INSTALL_SUCCEEDED, copyNativeBinaries(true /* extractNativeLibs */,
+                false /* hasNativeBridge */));
+        for (int i = 0; i < LIBRARY_COUNT; i++) {
+            File library = new File(mLibDir, libraryName(i));
+            assertTrue(library.getName(), Arrays.equals(contents[i],
+                    Files.readAllBytes(library.toPath())));
+        }
+
+        // A second copy finds every library up to date.
+        assertEquals(INSTALL_SUCCEEDED, copyNativeBinaries(true /* extractNativeLibs */,
+                false /* hasNativeBridge */));
+    }
+
+    @MediumTest
+    public void testParallelCopyReportsSameFailureEveryTime() throws Exception {
+        final int blocked = 3;
+        final int compressed = 8;
+        byte[] content = new byte[32 * 1024];
+        new Random(0).nextBytes(content);
+        try (ApkWriter apk = new ApkWriter(mApk)) {
+            for (int i = 0; i < LIBRARY_COUNT; i++) {
+                if (i == compressed) {
+                    // Libraries that stay in the APK must be stored.
+                    apk.addDeflated(libraryName(i), content);
+                } else {
+                    apk.addStored(libraryName(i), content, true /* pageAligned */);
+                }
+            }
+        }
+        // A directory in the way of a library fails its copy.
+        File blocker = new File(mLibDir, libraryName(blocked));
+        assertTrue(blocker.mkdir());
+        assertTrue(new File(blocker, "file").createNewFile());
+
+        // Workers finish in any order, but the failure reported must always be the first in
+        // the APK, whichever of the two that is.
+        int first = copyNativeBinaries(false /* extractNativeLibs */, true /* hasNativeBridge */);
+        assertTrue(Integer.toString(first), first == INSTALL_FAILED_CONTAINER_ERROR
+                || first == INSTALL_FAILED_INVALID_APK);
+        for (int i = 0; i < 20; i++) {
+            for (File file : mLibDir.listFiles()) {
+                if (file.isFile()) {
+                    assertTrue(file.delete());
+                }
+            }
+            assertEquals(first, copyNativeBinaries(false /* extractNativeLibs */,
+                    true /* hasNativeBridge */));
+        }
+    }
+
+    /**
+     * Writes a zip with libraries under lib/ABI/, optionally padding stored ones so that
+     * their data starts on a page boundary, as zipalign does.
+     */
+    private static class ApkWriter implements AutoCloseable {
+        private final CountingOutputStream mCounter;
+        private final ZipOutputStream mZip;
+
+        ApkWriter(File file) throws IOException {
+            mCounter = new CountingOutputStream(new FileOutputStream(file));
+            mZip = new ZipOutputStream(mCounter);
+        }
+
+        void addStored(String name, byte[] data, boolean pageAligned) throws IOException {
+            ZipEntry entry = new ZipEntry("lib/" + ABI + "/" + name);
+            entry.setMethod(ZipEntry.STORED);
+            entry.setSize(data.length);
+            entry.setCompressedSize(data.length);
+            CRC32 crc = new CRC32();
+            crc.update(data);
+            entry.setCrc(crc.getValue());
+            if (pageAligned) {
+                // The local header is 30 bytes, then the name, then the extra field.
+                long dataStart = mCounter.mCount + 30 + entry.getName().length() + 4;
+                int padding = (int) ((PAGE_SIZE - dataStart % PAGE_SIZE) % PAGE_SIZE);
+                byte[] extra = new byte[4 + padding];
+                extra[0] = (byte) 0x35;
+                extra[1] = (byte) 0xd9;
+                extra[2] = (byte) padding;
+                extra[3] = (byte) (padding >> 8);
+                entry.setExtra(extra);
+            }
+            mZip.putNextEntry(entry);
+            mZip.write(data);
+            mZip.closeEntry();
+        }
+
+        void addDeflated(String name, byte[] data) throws IOException {
+            mZip.putNextEntry(new ZipEntry("lib/" + ABI + "/" + name));
+            mZip.write(data);
+            mZip.closeEntry();
+        }
+
+        @Override
+        public void close() throws IOException {
+            mZip.close();
+        }
+    }
+
+    private static class CountingOutputStream extends FilterOutputStream {
+        long mCount;
+
+        CountingOutputStream(OutputStream out) {
+            super(out);
+        }
+
+        @Override
+        public void write(int b) throws IOException {
+            out.write(b);
+            mCount++;
+        }
+
+        @Override
+        public void write(byte[] b, int off, int len) throws IOException {
+            out.write(b, off, len);
+            mCount += len;
+        }
+    }
+}
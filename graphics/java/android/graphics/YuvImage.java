@@ -121,6 +121,20 @@ public class YuvImage {
      *                  100]; or stream is null.
      */
     public boolean compressToJpeg(Rect rectangle, int quality, OutputStream stream) {
+        return compressToJpeg(rectangle, quality, stream, 1);
+    }
+
+    /**
+     * Like {@link #compressToJpeg(Rect, int, OutputStream)}, but a large region may be
+     * compressed on up to maxThreads threads.  Doing so adds a restart interval, with a
+     * restart marker after every row of MCUs, so the output is a few bytes larger and differs
+     * from the single threaded output.
+     *
+     * @param maxThreads the most threads to use; 1 compresses on the calling thread only.
+     * @hide
+     */
+    public boolean compressToJpeg(Rect rectangle, int quality, OutputStream stream,
+            int maxThreads) {
         Rect wholeImage = new Rect(0, 0, mWidth, mHeight);
         if (!wholeImage.contains(rectangle)) {
             throw new IllegalArgumentException(
@@ -140,7 +154,7 @@ public class YuvImage {
 
         return nativeCompressToJpeg(mData, mFormat, rectangle.width(),
                 rectangle.height(), offsets, mStrides, quality, stream,
-                new byte[WORKING_COMPRESS_STORAGE]);
+                new byte[WORKING_COMPRESS_STORAGE], Math.max(1, maxThreads));
     }
 
 
@@ -236,5 +250,5 @@ public class YuvImage {
 
     private static native boolean nativeCompressToJpeg(byte[] oriYuv,
             int format, int width, int height, int[] offsets, int[] strides,
-            int quality, OutputStream stream, byte[] tempStorage);
+            int quality, OutputStream stream, byte[] tempStorage, int maxThreads);
 }
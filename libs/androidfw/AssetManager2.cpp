@@ -821,7 +821,15 @@ ApkAssetsCookie Theme::GetAttribute(uint32_t resid, Res_value* out_value,
 
     switch (entry.value.dataType) {
       case Res_value::TYPE_NULL:
-        return kInvalidCookie;
+        // @empty is a value the theme defines; anything else is simply missing.
+        if (entry.value.data != Res_value::DATA_NULL_EMPTY) {
+          return kInvalidCookie;
+        }
+        *out_value = entry.value;
+        if (out_flags != nullptr) {
+          *out_flags = type_spec_flags;
+        }
+        return entry.cookie;
 
       case Res_value::TYPE_ATTRIBUTE:
         resid = entry.value.data;
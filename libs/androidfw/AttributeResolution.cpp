@@ -17,9 +17,11 @@
 #include "androidfw/AttributeResolution.h"
 
 #include <cstdint>
+#include <vector>
 
 #include <log/log.h>
 
+#include "androidfw/AssetManager2.h"
 #include "androidfw/AttributeFinder.h"
 #include "androidfw/ResourceTypes.h"
 
@@ -27,22 +29,6 @@ constexpr bool kDebugStyles = false;
 
 namespace android {
 
-class XmlAttributeFinder
-    : public BackTrackingAttributeFinder<XmlAttributeFinder, size_t> {
- public:
-  explicit XmlAttributeFinder(const ResXMLParser* parser)
-      : BackTrackingAttributeFinder(
-            0, parser != nullptr ? parser->getAttributeCount() : 0),
-        parser_(parser) {}
-
-  inline uint32_t GetAttribute(size_t index) const {
-    return parser_->getAttributeNameResID(index);
-  }
-
- private:
-  const ResXMLParser* parser_;
-};
-
 class BagAttributeFinder
     : public BackTrackingAttributeFinder<BagAttributeFinder, const ResTable::bag_entry*> {
  public:
@@ -55,6 +41,95 @@ class BagAttributeFinder
   }
 };
 
+class ResolvedBagAttributeFinder
+    : public BackTrackingAttributeFinder<ResolvedBagAttributeFinder, const ResolvedBag::Entry*> {
+ public:
+  ResolvedBagAttributeFinder(const ResolvedBag::Entry* start, const ResolvedBag::Entry* end)
+      : BackTrackingAttributeFinder(start, end) {}
+
+  inline uint32_t GetAttribute(const ResolvedBag::Entry* entry) const {
+    return entry->key;
+  }
+};
+
+// Resolves references against an AssetManager2, remembering the result for each resource ID.
+// Styles point many attributes at the same few resources (a shared color, dimension or
+// drawable), and each resolution walks every ApkAssets, so within a single call each distinct
+// reference is only resolved once. A resolver must not outlive the call that created it, since it
+// knows nothing about configuration changes.
+class ReferenceResolver {
+ public:
+  explicit ReferenceResolver(AssetManager2* assetmanager) : assetmanager_(assetmanager) {}
+
+  // Same as AssetManager2::ResolveReference(). `in_out_config` is expected to be in the same
+  // state on every call, as it is when callers reset it per attribute.
+  ApkAssetsCookie Resolve(ApkAssetsCookie cookie, Res_value* in_out_value,
+                          ResTable_config* in_out_config, uint32_t* in_out_flags,
+                          uint32_t* out_last_ref) {
+    if (in_out_value->dataType != Res_value::TYPE_REFERENCE || in_out_value->data == 0u) {
+      *out_last_ref = 0u;
+      return cookie;
+    }
+
+    // Calls only ever see a handful of distinct references, so a linear scan beats hashing.
+    const uint32_t resid = in_out_value->data;
+    const Resolution* resolution = nullptr;
+    for (const Resolution& candidate : resolutions_) {
+      if (candidate.resid == resid) {
+        resolution = &candidate;
+        break;
+      }
+    }
+
+    if (resolution == nullptr) {
+      Resolution new_resolution;
+      new_resolution.resid = resid;
+      new_resolution.value = *in_out_value;
+      new_resolution.config = *in_out_config;
+      new_resolution.flags = 0u;
+      new_resolution.cookie =
+          assetmanager_->ResolveReference(cookie, &new_resolution.value, &new_resolution.config,
+                                          &new_resolution.flags, &new_resolution.last_ref);
+      resolutions_.push_back(new_resolution);
+      resolution = &resolutions_.back();
+    }
+
+    *in_out_value = resolution->value;
+    *in_out_config = resolution->config;
+    *in_out_flags |= resolution->flags;
+    *out_last_ref = resolution->last_ref;
+    return resolution->cookie;
+  }
+
+  // Same as Theme::ResolveAttributeReference(), with references resolved through Resolve().
+  ApkAssetsCookie ResolveAttribute(const Theme* theme, ApkAssetsCookie cookie,
+                                   Res_value* in_out_value, ResTable_config* in_out_config,
+                                   uint32_t* in_out_flags, uint32_t* out_last_ref) {
+    if (in_out_value->dataType == Res_value::TYPE_ATTRIBUTE) {
+      uint32_t new_flags = 0u;
+      cookie = theme->GetAttribute(in_out_value->data, in_out_value, &new_flags);
+      if (cookie == kInvalidCookie) {
+        return kInvalidCookie;
+      }
+      *in_out_flags |= new_flags;
+    }
+    return Resolve(cookie, in_out_value, in_out_config, in_out_flags, out_last_ref);
+  }
+
+ private:
+  struct Resolution {
+    uint32_t resid;
+    ApkAssetsCookie cookie;
+    Res_value value;
+    ResTable_config config;
+    uint32_t flags;
+    uint32_t last_ref;
+  };
+
+  AssetManager2* assetmanager_;
+  std::vector<Resolution> resolutions_;
+};
+
 bool ResolveAttrs(ResTable::Theme* theme, uint32_t def_style_attr,
                   uint32_t def_style_res, uint32_t* src_values,
                   size_t src_values_length, uint32_t* attrs,
@@ -274,11 +349,8 @@ void ApplyStyle(ResTable::Theme* theme, ResXMLParser* xml_parser, uint32_t def_s
       style_attr_start + (bag_off >= 0 ? bag_off : 0);
   BagAttributeFinder style_attr_finder(style_attr_start, style_attr_end);
 
-  // Retrieve the XML attributes, if requested.
+  // Values found in the XML attributes are reported as coming from this block.
   static const ssize_t kXmlBlock = 0x10000000;
-  XmlAttributeFinder xml_attr_finder(xml_parser);
-  const size_t xml_attr_end =
-      xml_parser != nullptr ? xml_parser->getAttributeCount() : 0;
 
   // Now iterate through all of the attributes that the client has requested,
   // filling in each with whatever data we can find.
@@ -301,8 +373,9 @@ void ApplyStyle(ResTable::Theme* theme, ResXMLParser* xml_parser, uint32_t def_s
     // style, and finally the theme.
 
     // Walk through the xml attributes looking for the requested attribute.
-    const size_t xml_attr_idx = xml_attr_finder.Find(cur_ident);
-    if (xml_attr_idx != xml_attr_end) {
+    const ssize_t xml_attr_idx =
+        xml_parser != nullptr ? xml_parser->indexOfAttribute(cur_ident) : NAME_NOT_FOUND;
+    if (xml_attr_idx >= 0) {
       // We found the attribute we were looking for.
       xml_parser->getAttributeValue(xml_attr_idx, &value);
       if (kDebugStyles) {
@@ -419,11 +492,6 @@ bool RetrieveAttributes(const ResTable* res, ResXMLParser* xml_parser,
   // Now lock down the resource object and start pulling stuff from it.
   res->lock();
 
-  // Retrieve the XML attributes, if requested.
-  const size_t xml_attr_count = xml_parser->getAttributeCount();
-  size_t ix = 0;
-  uint32_t cur_xml_attr = xml_parser->getAttributeNameResID(ix);
-
   static const ssize_t kXmlBlock = 0x10000000;
 
   // Now iterate through all of the attributes that the client has requested,
@@ -437,17 +505,11 @@ bool RetrieveAttributes(const ResTable* res, ResXMLParser* xml_parser,
     value.data = Res_value::DATA_NULL_UNDEFINED;
     config.density = 0;
 
-    // Try to find a value for this attribute...
-    // Skip through XML attributes until the end or the next possible match.
-    while (ix < xml_attr_count && cur_ident > cur_xml_attr) {
-      ix++;
-      cur_xml_attr = xml_parser->getAttributeNameResID(ix);
-    }
-    // Retrieve the current XML attribute if it matches, and step to next.
-    if (ix < xml_attr_count && cur_ident == cur_xml_attr) {
-      xml_parser->getAttributeValue(ix, &value);
-      ix++;
-      cur_xml_attr = xml_parser->getAttributeNameResID(ix);
+    // Try to find a value for this attribute... The parser searches its attributes by
+    // resource ID, which also copes with elements whose IDs were remapped out of order.
+    const ssize_t xml_attr_idx = xml_parser->indexOfAttribute(cur_ident);
+    if (xml_attr_idx >= 0) {
+      xml_parser->getAttributeValue(xml_attr_idx, &value);
     }
 
     uint32_t resid = 0;
@@ -493,4 +555,411 @@ bool RetrieveAttributes(const ResTable* res, ResXMLParser* xml_parser,
   return true;
 }
 
+bool ResolveAttrs(Theme* theme, uint32_t def_style_attr, uint32_t def_style_resid,
+                  uint32_t* src_values, size_t src_values_length, uint32_t* attrs,
+                  size_t attrs_length, uint32_t* out_values, uint32_t* out_indices) {
+  if (kDebugStyles) {
+    ALOGI("APPLY STYLE: theme=0x%p defStyleAttr=0x%x defStyleRes=0x%x", theme,
+          def_style_attr, def_style_resid);
+  }
+
+  AssetManager2* assetmanager = theme->GetAssetManager();
+  ReferenceResolver resolver(assetmanager);
+  ResTable_config config;
+  Res_value value;
+
+  int indices_idx = 0;
+
+  // Load default style from attribute, if specified...
+  uint32_t def_style_flags = 0u;
+  if (def_style_attr != 0) {
+    Res_value value;
+    if (theme->GetAttribute(def_style_attr, &value, &def_style_flags) != kInvalidCookie) {
+      if (value.dataType == Res_value::TYPE_REFERENCE) {
+        def_style_resid = value.data;
+      }
+    }
+  }
+
+  // Retrieve the default style bag, if requested.
+  const ResolvedBag* default_style_bag = nullptr;
+  if (def_style_resid != 0) {
+    default_style_bag = assetmanager->GetBag(def_style_resid);
+    if (default_style_bag != nullptr) {
+      def_style_flags |= default_style_bag->type_spec_flags;
+    }
+  }
+  const ResolvedBag::Entry* const def_style_start =
+      default_style_bag != nullptr ? begin(default_style_bag) : nullptr;
+  const ResolvedBag::Entry* const def_style_end =
+      default_style_bag != nullptr ? end(default_style_bag) : nullptr;
+  ResolvedBagAttributeFinder def_style_attr_finder(def_style_start, def_style_end);
+
+  // Now iterate through all of the attributes that the client has requested,
+  // filling in each with whatever data we can find.
+  for (size_t ii = 0; ii < attrs_length; ii++) {
+    const uint32_t cur_ident = attrs[ii];
+
+    if (kDebugStyles) {
+      ALOGI("RETRIEVING ATTR 0x%08x...", cur_ident);
+    }
+
+    ApkAssetsCookie cookie = kInvalidCookie;
+    uint32_t type_set_flags = 0;
+
+    value.dataType = Res_value::TYPE_NULL;
+    value.data = Res_value::DATA_NULL_UNDEFINED;
+    config.density = 0;
+
+    // Try to find a value for this attribute...  we prioritize values
+    // coming from, first XML attributes, then XML style, then default
+    // style, and finally the theme.
+
+    // Retrieve the current input value if available.
+    if (src_values_length > 0 && src_values[ii] != 0) {
+      value.dataType = Res_value::TYPE_ATTRIBUTE;
+      value.data = src_values[ii];
+      if (kDebugStyles) {
+        ALOGI("-> From values: type=0x%x, data=0x%08x", value.dataType, value.data);
+      }
+    } else {
+      const ResolvedBag::Entry* const def_style_entry = def_style_attr_finder.Find(cur_ident);
+      if (def_style_entry != def_style_end) {
+        cookie = def_style_entry->cookie;
+        type_set_flags = def_style_flags;
+        value = def_style_entry->value;
+        if (kDebugStyles) {
+          ALOGI("-> From def style: type=0x%x, data=0x%08x", value.dataType, value.data);
+        }
+      }
+    }
+
+    uint32_t resid = 0;
+    if (value.dataType != Res_value::TYPE_NULL) {
+      // Take care of resolving the found resource to its final value.
+      ApkAssetsCookie new_cookie = resolver.ResolveAttribute(theme, cookie, &value, &config,
+                                                             &type_set_flags, &resid);
+      if (new_cookie != kInvalidCookie) {
+        cookie = new_cookie;
+      }
+      if (kDebugStyles) {
+        ALOGI("-> Resolved attr: type=0x%x, data=0x%08x", value.dataType, value.data);
+      }
+    } else if (value.data != Res_value::DATA_NULL_EMPTY) {
+      // If we still don't have a value for this attribute, try to find it in the theme!
+      ApkAssetsCookie new_cookie = theme->GetAttribute(cur_ident, &value, &type_set_flags);
+      if (new_cookie != kInvalidCookie) {
+        if (kDebugStyles) {
+          ALOGI("-> From theme: type=0x%x, data=0x%08x", value.dataType, value.data);
+        }
+        new_cookie = resolver.Resolve(new_cookie, &value, &config, &type_set_flags, &resid);
+        if (new_cookie != kInvalidCookie) {
+          cookie = new_cookie;
+        }
+        if (kDebugStyles) {
+          ALOGI("-> Resolved theme: type=0x%x, data=0x%08x", value.dataType, value.data);
+        }
+      }
+    }
+
+    // Deal with the special @null value -- it turns back to TYPE_NULL.
+    if (value.dataType == Res_value::TYPE_REFERENCE && value.data == 0) {
+      if (kDebugStyles) {
+        ALOGI("-> Setting to @null!");
+      }
+      value.dataType = Res_value::TYPE_NULL;
+      value.data = Res_value::DATA_NULL_UNDEFINED;
+      cookie = kInvalidCookie;
+    }
+
+    if (kDebugStyles) {
+      ALOGI("Attribute 0x%08x: type=0x%x, data=0x%08x", cur_ident, value.dataType, value.data);
+    }
+
+    // Write the final value back to Java.
+    out_values[STYLE_TYPE] = value.dataType;
+    out_values[STYLE_DATA] = value.data;
+    out_values[STYLE_ASSET_COOKIE] = static_cast<uint32_t>(cookie);
+    out_values[STYLE_RESOURCE_ID] = resid;
+    out_values[STYLE_CHANGING_CONFIGURATIONS] = type_set_flags;
+    out_values[STYLE_DENSITY] = config.density;
+
+    if (out_indices != nullptr &&
+        (value.dataType != Res_value::TYPE_NULL || value.data == Res_value::DATA_NULL_EMPTY)) {
+      indices_idx++;
+      out_indices[indices_idx] = ii;
+    }
+
+    out_values += STYLE_NUM_ENTRIES;
+  }
+
+  if (out_indices != nullptr) {
+    out_indices[0] = indices_idx;
+  }
+  return true;
+}
+
+void ApplyStyle(Theme* theme, ResXMLParser* xml_parser, uint32_t def_style_attr,
+                uint32_t def_style_resid, const uint32_t* attrs, size_t attrs_length,
+                uint32_t* out_values, uint32_t* out_indices) {
+  if (kDebugStyles) {
+    ALOGI("APPLY STYLE: theme=0x%p defStyleAttr=0x%x defStyleRes=0x%x xml=0x%p",
+          theme, def_style_attr, def_style_resid, xml_parser);
+  }
+
+  AssetManager2* assetmanager = theme->GetAssetManager();
+  ReferenceResolver resolver(assetmanager);
+  ResTable_config config;
+  Res_value value;
+
+  int indices_idx = 0;
+
+  // Load default style from attribute, if specified...
+  uint32_t def_style_flags = 0u;
+  if (def_style_attr != 0) {
+    Res_value value;
+    if (theme->GetAttribute(def_style_attr, &value, &def_style_flags) != kInvalidCookie) {
+      if (value.dataType == Res_value::TYPE_REFERENCE) {
+        def_style_resid = value.data;
+      }
+    }
+  }
+
+  // Retrieve the style class associated with the current XML tag.
+  uint32_t style_resid = 0u;
+  uint32_t style_flags = 0u;
+  if (xml_parser != nullptr) {
+    ssize_t idx = xml_parser->indexOfStyle();
+    if (idx >= 0 && xml_parser->getAttributeValue(idx, &value) >= 0) {
+      if (value.dataType == value.TYPE_ATTRIBUTE) {
+        if (theme->GetAttribute(value.data, &value, &style_flags) == kInvalidCookie) {
+          value.dataType = Res_value::TYPE_NULL;
+        }
+      }
+      if (value.dataType == value.TYPE_REFERENCE) {
+        style_resid = value.data;
+      }
+    }
+  }
+
+  // Retrieve the default style bag, if requested.
+  const ResolvedBag* default_style_bag = nullptr;
+  if (def_style_resid != 0) {
+    default_style_bag = assetmanager->GetBag(def_style_resid);
+    if (default_style_bag != nullptr) {
+      def_style_flags |= default_style_bag->type_spec_flags;
+    }
+  }
+  const ResolvedBag::Entry* const def_style_start =
+      default_style_bag != nullptr ? begin(default_style_bag) : nullptr;
+  const ResolvedBag::Entry* const def_style_end =
+      default_style_bag != nullptr ? end(default_style_bag) : nullptr;
+  ResolvedBagAttributeFinder def_style_attr_finder(def_style_start, def_style_end);
+
+  // Retrieve the style class bag, if requested.
+  const ResolvedBag* xml_style_bag = nullptr;
+  if (style_resid != 0) {
+    xml_style_bag = assetmanager->GetBag(style_resid);
+    if (xml_style_bag != nullptr) {
+      style_flags |= xml_style_bag->type_spec_flags;
+    }
+  }
+  const ResolvedBag::Entry* const style_start =
+      xml_style_bag != nullptr ? begin(xml_style_bag) : nullptr;
+  const ResolvedBag::Entry* const style_end =
+      xml_style_bag != nullptr ? end(xml_style_bag) : nullptr;
+  ResolvedBagAttributeFinder style_attr_finder(style_start, style_end);
+
+  // Now iterate through all of the attributes that the client has requested,
+  // filling in each with whatever data we can find. `attrs` and the style bags are sorted
+  // by attribute, so each bag finder walks its bag once, in step with `attrs`.
+  for (size_t ii = 0; ii < attrs_length; ii++) {
+    const uint32_t cur_ident = attrs[ii];
+
+    if (kDebugStyles) {
+      ALOGI("RETRIEVING ATTR 0x%08x...", cur_ident);
+    }
+
+    ApkAssetsCookie cookie = kInvalidCookie;
+    uint32_t type_set_flags = 0;
+
+    value.dataType = Res_value::TYPE_NULL;
+    value.data = Res_value::DATA_NULL_UNDEFINED;
+    config.density = 0;
+
+    // Try to find a value for this attribute...  we prioritize values
+    // coming from, first XML attributes, then XML style, then default
+    // style, and finally the theme.
+
+    // Walk through the xml attributes looking for the requested attribute.
+    const ssize_t xml_attr_idx =
+        xml_parser != nullptr ? xml_parser->indexOfAttribute(cur_ident) : NAME_NOT_FOUND;
+    if (xml_attr_idx >= 0) {
+      // We found the attribute we were looking for.
+      xml_parser->getAttributeValue(xml_attr_idx, &value);
+      if (kDebugStyles) {
+        ALOGI("-> From XML: type=0x%x, data=0x%08x", value.dataType, value.data);
+      }
+    }
+
+    if (value.dataType == Res_value::TYPE_NULL && value.data != Res_value::DATA_NULL_EMPTY) {
+      // Walk through the style class values looking for the requested attribute.
+      const ResolvedBag::Entry* const style_entry = style_attr_finder.Find(cur_ident);
+      if (style_entry != style_end) {
+        // We found the attribute we were looking for.
+        cookie = style_entry->cookie;
+        type_set_flags = style_flags;
+        value = style_entry->value;
+        if (kDebugStyles) {
+          ALOGI("-> From style: type=0x%x, data=0x%08x", value.dataType, value.data);
+        }
+      }
+    }
+
+    if (value.dataType == Res_value::TYPE_NULL && value.data != Res_value::DATA_NULL_EMPTY) {
+      // Walk through the default style values looking for the requested attribute.
+      const ResolvedBag::Entry* const def_style_entry = def_style_attr_finder.Find(cur_ident);
+      if (def_style_entry != def_style_end) {
+        // We found the attribute we were looking for.
+        cookie = def_style_entry->cookie;
+        type_set_flags = def_style_flags;
+        value = def_style_entry->value;
+        if (kDebugStyles) {
+          ALOGI("-> From def style: type=0x%x, data=0x%08x", value.dataType, value.data);
+        }
+      }
+    }
+
+    uint32_t resid = 0u;
+    if (value.dataType != Res_value::TYPE_NULL) {
+      // Take care of resolving the found resource to its final value.
+      ApkAssetsCookie new_cookie = resolver.ResolveAttribute(theme, cookie, &value, &config,
+                                                             &type_set_flags, &resid);
+      if (new_cookie != kInvalidCookie) {
+        cookie = new_cookie;
+      }
+
+      if (kDebugStyles) {
+        ALOGI("-> Resolved attr: type=0x%x, data=0x%08x", value.dataType, value.data);
+      }
+    } else if (value.data != Res_value::DATA_NULL_EMPTY) {
+      // If we still don't have a value for this attribute, try to find it in the theme!
+      ApkAssetsCookie new_cookie = theme->GetAttribute(cur_ident, &value, &type_set_flags);
+      if (new_cookie != kInvalidCookie) {
+        if (kDebugStyles) {
+          ALOGI("-> From theme: type=0x%x, data=0x%08x", value.dataType, value.data);
+        }
+        new_cookie = resolver.Resolve(new_cookie, &value, &config, &type_set_flags, &resid);
+        if (new_cookie != kInvalidCookie) {
+          cookie = new_cookie;
+        }
+
+        if (kDebugStyles) {
+          ALOGI("-> Resolved theme: type=0x%x, data=0x%08x", value.dataType, value.data);
+        }
+      }
+    }
+
+    // Deal with the special @null value -- it turns back to TYPE_NULL.
+    if (value.dataType == Res_value::TYPE_REFERENCE && value.data == 0) {
+      if (kDebugStyles) {
+        ALOGI("-> Setting to @null!");
+      }
+      value.dataType = Res_value::TYPE_NULL;
+      value.data = Res_value::DATA_NULL_UNDEFINED;
+      cookie = kInvalidCookie;
+    }
+
+    if (kDebugStyles) {
+      ALOGI("Attribute 0x%08x: type=0x%x, data=0x%08x", cur_ident, value.dataType, value.data);
+    }
+
+    // Write the final value back to Java.
+    out_values[STYLE_TYPE] = value.dataType;
+    out_values[STYLE_DATA] = value.data;
+    out_values[STYLE_ASSET_COOKIE] = static_cast<uint32_t>(cookie);
+    out_values[STYLE_RESOURCE_ID] = resid;
+    out_values[STYLE_CHANGING_CONFIGURATIONS] = type_set_flags;
+    out_values[STYLE_DENSITY] = config.density;
+
+    if (value.dataType != Res_value::TYPE_NULL || value.data == Res_value::DATA_NULL_EMPTY) {
+      indices_idx++;
+
+      // out_indices must NOT be nullptr.
+      out_indices[indices_idx] = ii;
+    }
+
+    out_values += STYLE_NUM_ENTRIES;
+  }
+
+  // out_indices must NOT be nullptr.
+  out_indices[0] = indices_idx;
+}
+
+bool RetrieveAttributes(AssetManager2* assetmanager, ResXMLParser* xml_parser, uint32_t* attrs,
+                        size_t attrs_length, uint32_t* out_values, uint32_t* out_indices) {
+  ReferenceResolver resolver(assetmanager);
+  ResTable_config config;
+  Res_value value;
+
+  int indices_idx = 0;
+
+  // Now iterate through all of the attributes that the client has requested,
+  // filling in each with whatever data we can find.
+  for (size_t ii = 0; ii < attrs_length; ii++) {
+    const uint32_t cur_ident = attrs[ii];
+    ApkAssetsCookie cookie = kInvalidCookie;
+    uint32_t type_set_flags = 0u;
+
+    value.dataType = Res_value::TYPE_NULL;
+    value.data = Res_value::DATA_NULL_UNDEFINED;
+    config.density = 0;
+
+    // Try to find a value for this attribute... The parser searches its attributes by
+    // resource ID, which also copes with elements whose IDs were remapped out of order.
+    const ssize_t xml_attr_idx = xml_parser->indexOfAttribute(cur_ident);
+    if (xml_attr_idx >= 0) {
+      xml_parser->getAttributeValue(xml_attr_idx, &value);
+    }
+
+    uint32_t resid = 0u;
+    if (value.dataType != Res_value::TYPE_NULL) {
+      // Take care of resolving the found resource to its final value.
+      ApkAssetsCookie new_cookie =
+          resolver.Resolve(cookie, &value, &config, &type_set_flags, &resid);
+      if (new_cookie != kInvalidCookie) {
+        cookie = new_cookie;
+      }
+    }
+
+    // Deal with the special @null value -- it turns back to TYPE_NULL.
+    if (value.dataType == Res_value::TYPE_REFERENCE && value.data == 0) {
+      value.dataType = Res_value::TYPE_NULL;
+      value.data = Res_value::DATA_NULL_UNDEFINED;
+      cookie = kInvalidCookie;
+    }
+
+    // Write the final value back to Java.
+    out_values[STYLE_TYPE] = value.dataType;
+    out_values[STYLE_DATA] = value.data;
+    out_values[STYLE_ASSET_COOKIE] = static_cast<uint32_t>(cookie);
+    out_values[STYLE_RESOURCE_ID] = resid;
+    out_values[STYLE_CHANGING_CONFIGURATIONS] = type_set_flags;
+    out_values[STYLE_DENSITY] = config.density;
+
+    if (out_indices != nullptr &&
+        (value.dataType != Res_value::TYPE_NULL || value.data == Res_value::DATA_NULL_EMPTY)) {
+      indices_idx++;
+      out_indices[indices_idx] = ii;
+    }
+
+    out_values += STYLE_NUM_ENTRIES;
+  }
+
+  if (out_indices != nullptr) {
+    out_indices[0] = indices_idx;
+  }
+  return true;
+}
+
 }  // namespace android
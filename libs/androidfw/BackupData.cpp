@@ -16,8 +16,11 @@
 
 #define LOG_TAG "backup_data"
 
+#include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/sendfile.h>
 #include <unistd.h>
 
 #include <androidfw/BackupHelpers.h>
@@ -167,6 +170,67 @@ BackupDataWriter::WriteEntityData(const void* data, size_t size)
     return NO_ERROR;
 }
 
+status_t
+BackupDataWriter::WriteEntityDataFromFile(int fd, size_t size, size_t* outWritten)
+{
+    if (kIsDebug) ALOGD("Writing data from fd %d: size=%lu", fd, (unsigned long) size);
+
+    *outWritten = 0;
+    if (m_status != NO_ERROR) {
+        return m_status;
+    }
+
+    const size_t COPY_BUF_SIZE = 64 * 1024;
+    bool useSendfile = true;
+    char* buf = NULL;
+    status_t result = NO_ERROR;
+
+    while (*outWritten < size) {
+        size_t toCopy = size - *outWritten;
+        ssize_t amt;
+        if (useSendfile) {
+            amt = TEMP_FAILURE_RETRY(sendfile(m_fd, fd, NULL, toCopy));
+            if (amt < 0 && (errno == EINVAL || errno == ENOSYS || errno == EAGAIN)) {
+                // Not a pair of fds the kernel can copy between, or a non-blocking one
+                // that isn't ready; do it by hand.  Whatever was already sent moved the
+                // input offset along, so the copy picks up where sendfile() stopped.
+                useSendfile = false;
+                continue;
+            }
+            if (amt < 0) {
+                // sendfile() can't say which side failed, so assume the worst.
+                m_status = errno;
+                result = m_status;
+                break;
+            }
+        } else {
+            if (buf == NULL && (buf = (char*) malloc(COPY_BUF_SIZE)) == NULL) {
+                result = NO_MEMORY;
+                break;
+            }
+            amt = TEMP_FAILURE_RETRY(read(fd, buf, toCopy < COPY_BUF_SIZE ? toCopy : COPY_BUF_SIZE));
+            if (amt < 0) {
+                result = errno;
+                break;
+            }
+            if (amt > 0 && write(m_fd, buf, amt) != amt) {
+                m_status = errno;
+                result = m_status;
+                break;
+            }
+        }
+        if (amt == 0) {
+            result = NOT_ENOUGH_DATA;
+            break;
+        }
+        *outWritten += amt;
+        m_pos += amt;
+    }
+
+    free(buf);
+    return result;
+}
+
 void
 BackupDataWriter::SetKeyPrefix(const String8& keyPrefix)
 {
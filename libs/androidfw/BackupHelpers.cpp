@@ -30,6 +30,11 @@
 #include <utime.h>
 #include <zlib.h>
 
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
 #include <log/log.h>
 #include <utils/ByteOrder.h>
 #include <utils/KeyedVector.h>
@@ -207,23 +212,55 @@ write_delete_file(BackupDataWriter* dataStream, const String8& key)
     return dataStream->WriteEntityHeader(key, -1);
 }
 
+/*
+ * Files are read in large page-aligned chunks: backup mostly touches files that aren't
+ * in the page cache, and a bigger read lets the kernel read ahead much further than the
+ * old 4K loop did.
+ */
+static const size_t FILE_BUFFER_SIZE = 64*1024;
+static const size_t FILE_BUFFER_ALIGNMENT = 4096;
+
+// Hashing is spread over up to this many threads, each taking at least
+// MIN_FILES_PER_HASH_THREAD files so that small backups don't pay for thread startup.
+static const size_t MAX_HASH_THREADS = 4;
+static const size_t MIN_FILES_PER_HASH_THREAD = 16;
+
+static char*
+alloc_file_buffer()
+{
+    void* buf = NULL;
+    if (posix_memalign(&buf, FILE_BUFFER_ALIGNMENT, FILE_BUFFER_SIZE) != 0) {
+        return NULL;
+    }
+    return (char*)buf;
+}
+
+/*
+ * Writes the entity for the file open on fd, computing the CRC32 of the data sent on the
+ * way so that the file is only read once.
+ */
 static int
 write_update_file(BackupDataWriter* dataStream, int fd, int mode, const String8& key,
-        char const* realFilename)
+        char const* realFilename, int* outCrc)
 {
     LOGP("write_update_file %s (%s) : mode 0%o\n", realFilename, key.string(), mode);
 
-    const int bufsize = 4*1024;
+    const int bufsize = FILE_BUFFER_SIZE;
     int err;
     int amt;
     int fileSize;
     int bytesLeft;
     file_metadata_v1 metadata;
+    uLong crc = crc32(0L, Z_NULL, 0);
 
-    char* buf = (char*)malloc(bufsize);
+    char* buf = alloc_file_buffer();
+    if (buf == NULL) {
+        return NO_MEMORY;
+    }
 
     fileSize = lseek(fd, 0, SEEK_END);
     lseek(fd, 0, SEEK_SET);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
 
     if (sizeof(metadata) != 16) {
         ALOGE("ERROR: metadata block is the wrong size!");
@@ -248,11 +285,12 @@ write_update_file(BackupDataWriter* dataStream, int fd, int mode, const String8&
     bytesLeft -= sizeof(metadata); // bytesLeft should == fileSize now
 
     // now store the file content
-    while ((amt = read(fd, buf, bufsize)) != 0 && bytesLeft > 0) {
+    while (bytesLeft > 0 && (amt = TEMP_FAILURE_RETRY(read(fd, buf, bufsize))) > 0) {
         bytesLeft -= amt;
         if (bytesLeft < 0) {
             amt += bytesLeft; // Plus a negative is minus.  Don't write more than we promised.
         }
+        crc = crc32(crc, (Bytef*)buf, amt);
         err = dataStream->WriteEntityData(buf, amt);
         if (err != 0) {
             free(buf);
@@ -279,56 +317,93 @@ write_update_file(BackupDataWriter* dataStream, int fd, int mode, const String8&
     }
 
     free(buf);
+    if (outCrc != NULL) {
+        *outCrc = crc;
+    }
     return NO_ERROR;
 }
 
+/*
+ * Backs up the file described by r, filling in its CRC32.  A file that can no longer be
+ * opened is marked deleted so that it stays out of the new snapshot, exactly as if it had
+ * already been unreadable when the snapshot was taken.
+ */
 static int
-write_update_file(BackupDataWriter* dataStream, const String8& key, char const* realFilename)
+write_update_file(BackupDataWriter* dataStream, const String8& key, FileRec* r)
 {
-    int err;
-    struct stat st;
-
-    err = stat(realFilename, &st);
-    if (err < 0) {
-        return errno;
-    }
-
-    int fd = open(realFilename, O_RDONLY);
+    int fd = open(r->file.string(), O_RDONLY | O_CLOEXEC);
     if (fd == -1) {
+        ALOGE("Unable to read file for backup: %s", r->file.string());
+        r->deleted = true;
         return errno;
     }
 
-    err = write_update_file(dataStream, fd, st.st_mode, key, realFilename);
+    int err = write_update_file(dataStream, fd, r->s.mode, key, r->file.string(), &r->s.crc32);
     close(fd);
     return err;
 }
 
 static int
-compute_crc32(const char* file, FileRec* out) {
-    int fd = open(file, O_RDONLY);
+compute_crc32(const char* file, char* buf, FileRec* out) {
+    int fd = open(file, O_RDONLY | O_CLOEXEC);
     if (fd < 0) {
         return -1;
     }
 
-    const int bufsize = 4*1024;
-    int amt;
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
 
-    char* buf = (char*)malloc(bufsize);
-    int crc = crc32(0L, Z_NULL, 0);
-
-    lseek(fd, 0, SEEK_SET);
+    int amt;
+    uLong crc = crc32(0L, Z_NULL, 0);
 
-    while ((amt = read(fd, buf, bufsize)) != 0) {
+    while ((amt = TEMP_FAILURE_RETRY(read(fd, buf, FILE_BUFFER_SIZE))) > 0) {
         crc = crc32(crc, (Bytef*)buf, amt);
     }
 
     close(fd);
-    free(buf);
 
     out->s.crc32 = crc;
     return NO_ERROR;
 }
 
+/*
+ * Computes the CRC32 of every file in recs.  The files are independent, so they're hashed
+ * in parallel when there are enough of them.  A file that can't be read is marked deleted.
+ */
+static void
+compute_crc32s(const std::vector<FileRec*>& recs)
+{
+    std::atomic<size_t> next(0);
+    auto hashFiles = [&recs, &next]() {
+        char* buf = alloc_file_buffer();
+        if (buf == NULL) {
+            return;
+        }
+        for (size_t i = next++; i < recs.size(); i = next++) {
+            FileRec* r = recs[i];
+            if (compute_crc32(r->file.string(), buf, r) != NO_ERROR) {
+                ALOGW("Unable to open file %s", r->file.string());
+                r->deleted = true;
+            }
+        }
+        free(buf);
+    };
+
+    size_t threadCount = std::min(MAX_HASH_THREADS, recs.size() / MIN_FILES_PER_HASH_THREAD);
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < threadCount; i++) {
+        threads.emplace_back(hashFiles);
+    }
+    hashFiles();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    // Files nobody got to because no buffer could be allocated are treated as unreadable.
+    for (size_t i = next; i < recs.size(); i++) {
+        recs[i]->deleted = true;
+    }
+}
+
 int
 back_up_files(int oldSnapshotFD, BackupDataWriter* dataStream, int newSnapshotFD,
         char const* const* files, char const* const* keys, int fileCount)
@@ -363,21 +438,41 @@ back_up_files(int oldSnapshotFD, BackupDataWriter* dataStream, int newSnapshotFD
             //r.s.modTime_nsec = st.st_mtime_nsec;
             r.s.mode = st.st_mode;
             r.s.size = st.st_size;
+            r.s.crc32 = 0; // filled in below, or while the file is backed up
 
             if (newSnapshot.indexOfKey(key) >= 0) {
                 LOGP("back_up_files key already in use '%s'", key.string());
                 return -1;
             }
-
-            // compute the CRC
-            if (compute_crc32(file, &r) != NO_ERROR) {
-                ALOGW("Unable to open file %s", file);
-                continue;
-            }
         }
         newSnapshot.add(key, r);
     }
 
+    // Only files whose stat data is unchanged need hashing up front: the CRC is what
+    // tells us whether to send them.  Everything else is sent regardless, and its CRC is
+    // computed as it is written out.
+    std::vector<FileRec*> toHash;
+    for (size_t m = 0; m < newSnapshot.size(); m++) {
+        ssize_t n = oldSnapshot.indexOfKey(newSnapshot.keyAt(m));
+        if (n < 0) {
+            continue;
+        }
+        const FileState& f = oldSnapshot.valueAt(n);
+        FileRec& g = newSnapshot.editValueAt(m);
+        if (f.modTime_sec == g.s.modTime_sec && f.modTime_nsec == g.s.modTime_nsec
+                && f.mode == g.s.mode && f.size == g.s.size) {
+            toHash.push_back(&g);
+        }
+    }
+    compute_crc32s(toHash);
+
+    // Drop the files that couldn't be read; they are backed up as if they were missing.
+    for (size_t m = newSnapshot.size(); m > 0; m--) {
+        if (newSnapshot.valueAt(m - 1).deleted) {
+            newSnapshot.removeItemsAt(m - 1);
+        }
+    }
+
     int n = 0;
     int N = oldSnapshot.size();
     int m = 0;
@@ -395,8 +490,8 @@ back_up_files(int oldSnapshotFD, BackupDataWriter* dataStream, int newSnapshotFD
             n++;
         } else if (cmp > 0) {
             // file added
-            LOGP("file added: %s crc=0x%08x", g.file.string(), g.s.crc32);
-            write_update_file(dataStream, q, g.file.string());
+            LOGP("file added: %s", g.file.string());
+            write_update_file(dataStream, q, &g);
             m++;
         } else {
             // same file exists in both old and new; check whether to update
@@ -409,13 +504,7 @@ back_up_files(int oldSnapshotFD, BackupDataWriter* dataStream, int newSnapshotFD
                     g.s.modTime_sec, g.s.modTime_nsec, g.s.mode, g.s.size, g.s.crc32);
             if (f.modTime_sec != g.s.modTime_sec || f.modTime_nsec != g.s.modTime_nsec
                     || f.mode != g.s.mode || f.size != g.s.size || f.crc32 != g.s.crc32) {
-                int fd = open(g.file.string(), O_RDONLY);
-                if (fd < 0) {
-                    ALOGE("Unable to read file for backup: %s", g.file.string());
-                } else {
-                    write_update_file(dataStream, fd, g.s.mode, p, g.file.string());
-                    close(fd);
-                }
+                write_update_file(dataStream, p, &g);
             }
             n++;
             m++;
@@ -432,7 +521,7 @@ back_up_files(int oldSnapshotFD, BackupDataWriter* dataStream, int newSnapshotFD
     while (m<M) {
         const String8& q = newSnapshot.keyAt(m);
         FileRec& g = newSnapshot.editValueAt(m);
-        write_update_file(dataStream, q, g.file.string());
+        write_update_file(dataStream, q, &g);
         m++;
     }
 
@@ -478,6 +567,54 @@ void send_tarfile_chunk(BackupDataWriter* writer, const char* buffer, size_t siz
     if (size != 0) writer->WriteEntityData(buffer, size);
 }
 
+// File contents are sent in chunks of up to this many bytes, copied straight from the
+// file to the output by the kernel.  Must be a multiple of the 512-byte tar block size.
+static const size_t TAR_DATA_CHUNK_SIZE = 1024 * 1024;
+
+// Files at least this large are dropped from the page cache once sent, so that a full
+// backup doesn't push the rest of the device's working set out.
+static const off64_t TAR_DONTNEED_THRESHOLD = 1024 * 1024;
+
+// Sends size bytes from fd as tar file data, NUL-padded to a whole number of blocks.
+static int send_tarfile_data(BackupDataWriter* writer, int fd, off64_t size,
+        const String8& filepath) {
+    static const char zeros[512] = { 0 };
+
+    off64_t toWrite = size;
+    while (toWrite > 0) {
+        size_t chunk = toWrite > (off64_t) TAR_DATA_CHUNK_SIZE ? TAR_DATA_CHUNK_SIZE : toWrite;
+        size_t padding = (512 - chunk % 512) % 512;   // only ever nonzero for the last chunk
+        uint32_t chunk_size_no = htonl(chunk + padding);
+        writer->WriteEntityData(&chunk_size_no, 4);
+
+        int err = 0;
+        size_t written = 0;
+        status_t status = writer->WriteEntityDataFromFile(fd, chunk, &written);
+        if (status == NOT_ENOUGH_DATA) {
+            ALOGE("EOF but expect %lld more bytes in [%s]", (long long) (toWrite - written),
+                    filepath.string());
+            err = EIO;
+        } else if (status != NO_ERROR) {
+            err = status;
+            ALOGE("Unable to read file [%s], err=%d (%s)", filepath.string(),
+                    err, strerror(err));
+        }
+
+        // The chunk size has already gone out, so make up any shortfall with NULs.
+        padding += chunk - written;
+        while (padding > 0) {
+            size_t amt = padding < sizeof(zeros) ? padding : sizeof(zeros);
+            writer->WriteEntityData(zeros, amt);
+            padding -= amt;
+        }
+        if (err != 0) {
+            return err;
+        }
+        toWrite -= chunk;
+    }
+    return 0;
+}
+
 int write_tarfile(const String8& packageName, const String8& domain,
         const String8& rootpath, const String8& filepath, off_t* outSize,
         BackupDataWriter* writer)
@@ -539,30 +676,32 @@ int write_tarfile(const String8& packageName, const String8& domain,
     // Measure case: we've returned the size; now return without moving data
     if (!writer) return 0;
 
-    // !!! TODO: use mmap when possible to avoid churning the buffer cache
     // !!! TODO: this will break with symlinks; need to use readlink(2)
-    int fd = open(filepath.string(), O_RDONLY);
+    int fd = open(filepath.string(), O_RDONLY | O_CLOEXEC);
     if (fd < 0) {
         err = errno;
         ALOGE("Error %d (%s) from open(%s)", err, strerror(err), filepath.string());
         return err;
     }
 
-    // read/write up to this much at a time.
-    const size_t BUFSIZE = 32 * 1024;
-    char* buf = (char *)calloc(1,BUFSIZE);
-    const size_t PAXHEADER_OFFSET = 512;
+    // Start reading the file in while the headers are being put together.
+    if (!isdir) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+    }
+
+    // The headers are assembled here and sent as a single chunk: the pax header block
+    // and its data when needed, then the ustar header.  Only the data is allocated
+    // elsewhere, and it is copied by the kernel rather than through a buffer of ours.
     const size_t PAXHEADER_SIZE = 512;
-    const size_t PAXDATA_SIZE = BUFSIZE - (PAXHEADER_SIZE + PAXHEADER_OFFSET);
-    char* const paxHeader = buf + PAXHEADER_OFFSET; // use a different chunk of
-                                                    // it as separate scratch
+    const size_t PAXDATA_SIZE = 8 * 1024;   // path plus size entries; PATH_MAX is 4096
+    char headers[PAXHEADER_SIZE + PAXDATA_SIZE + 512];
+    char buf[512];
+    char* const paxHeader = headers;
     char* const paxData = paxHeader + PAXHEADER_SIZE;
+    size_t headersLen = 0;
 
-    if (buf == NULL) {
-        ALOGE("Out of mem allocating transfer buffer");
-        err = ENOMEM;
-        goto done;
-    }
+    memset(buf, 0, sizeof(buf));
 
     // Magic fields for the ustar file format
     strcat(buf + 257, "ustar");
@@ -593,7 +732,7 @@ int write_tarfile(const String8& packageName, const String8& domain,
         type = '0';     // tar magic: '0' == normal file
     } else {
         ALOGW("Error: unknown file mode 0%o [%s]", s.st_mode, filepath.string());
-        goto cleanup;
+        goto done;
     }
     buf[156] = type;
 
@@ -631,7 +770,7 @@ int write_tarfile(const String8& packageName, const String8& domain,
 
     ALOGI("   Name: %s", fullname.string());
 
-    // If we're using a pax extended header, build & write that here; lengths are
+    // If we're using a pax extended header, build that here; lengths are
     // already preflighted
     if (needExtended) {
         char sizeStr[32];   // big enough for a 64-bit unsigned value in decimal
@@ -648,6 +787,11 @@ int write_tarfile(const String8& packageName, const String8& domain,
         // fullname was generated above with the ustar paths
         paxLen += write_pax_header_entry(paxData + paxLen, PAXDATA_SIZE - paxLen,
                 "path", fullname.string());
+        if (paxLen >= (int) PAXDATA_SIZE) {
+            ALOGE("Path too long for pax header: %s", fullname.string());
+            err = ENAMETOOLONG;
+            goto done;
+        }
 
         // Now we know how big the pax data is
 
@@ -666,57 +810,27 @@ int write_tarfile(const String8& packageName, const String8& domain,
         memset(paxHeader + 124, 0, 12);
         snprintf(paxHeader + 124, 12, "%011o", (unsigned int)paxLen);
 
-        // Checksum and write the pax block header
+        // Checksum the pax block header; the pax data itself follows it
         calc_tar_checksum(paxHeader, PAXHEADER_SIZE);
-        send_tarfile_chunk(writer, paxHeader, 512);
-
-        // Now write the pax data itself
         int paxblocks = (paxLen + 511) / 512;
-        send_tarfile_chunk(writer, paxData, 512 * paxblocks);
+        headersLen = PAXHEADER_SIZE + 512 * paxblocks;
     }
 
-    // Checksum and write the 512-byte ustar file header block to the output
-    calc_tar_checksum(buf, BUFSIZE);
-    send_tarfile_chunk(writer, buf, 512);
+    // Checksum the 512-byte ustar file header block, and write all headers to the output
+    calc_tar_checksum(buf, sizeof(buf));
+    memcpy(headers + headersLen, buf, 512);
+    headersLen += 512;
+    send_tarfile_chunk(writer, headers, headersLen);
 
     // Now write the file data itself, for real files.  We honor tar's convention that
     // only full 512-byte blocks are sent to write().
     if (!isdir) {
-        off64_t toWrite = s.st_size;
-        while (toWrite > 0) {
-            size_t toRead = toWrite;
-            if (toRead > BUFSIZE) {
-                toRead = BUFSIZE;
-            }
-            ssize_t nRead = read(fd, buf, toRead);
-            if (nRead < 0) {
-                err = errno;
-                ALOGE("Unable to read file [%s], err=%d (%s)", filepath.string(),
-                        err, strerror(err));
-                break;
-            } else if (nRead == 0) {
-                ALOGE("EOF but expect %lld more bytes in [%s]", (long long) toWrite,
-                        filepath.string());
-                err = EIO;
-                break;
-            }
-
-            // At EOF we might have a short block; NUL-pad that to a 512-byte multiple.  This
-            // depends on the OS guarantee that for ordinary files, read() will never return
-            // less than the number of bytes requested.
-            ssize_t partial = (nRead+512) % 512;
-            if (partial > 0) {
-                ssize_t remainder = 512 - partial;
-                memset(buf + nRead, 0, remainder);
-                nRead += remainder;
-            }
-            send_tarfile_chunk(writer, buf, nRead);
-            toWrite -= nRead;
+        err = send_tarfile_data(writer, fd, s.st_size, filepath);
+        if (s.st_size >= TAR_DONTNEED_THRESHOLD) {
+            posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
         }
     }
 
-cleanup:
-    free(buf);
 done:
     close(fd);
     return err;
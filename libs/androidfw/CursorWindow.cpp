@@ -24,6 +24,7 @@
 #include <cutils/ashmem.h>
 #include <sys/mman.h>
 
+#include <algorithm>
 #include <assert.h>
 #include <string.h>
 #include <stdlib.h>
@@ -109,6 +110,7 @@ status_t CursorWindow::createFromParcel(Parcel* parcel, CursorWindow** outCursor
                 } else {
                     CursorWindow* window = new CursorWindow(name, dupAshmemFd,
                             data, size, true /*readOnly*/);
+                    window->buildChunkDirectory();
                     LOG_WINDOW("Created CursorWindow from parcel: freeOffset=%d, "
                             "numRows=%d, numColumns=%d, mSize=%d, mData=%p",
                             window->mHeader->freeOffset,
@@ -146,6 +148,7 @@ status_t CursorWindow::clear() {
 
     RowSlotChunk* firstChunk = static_cast<RowSlotChunk*>(offsetToPtr(mHeader->firstChunkOffset));
     firstChunk->nextChunkOffset = 0;
+    mChunkOffsets.assign(1, mHeader->firstChunkOffset);
     return OK;
 }
 
@@ -203,6 +206,81 @@ status_t CursorWindow::freeLastRow() {
     return OK;
 }
 
+status_t CursorWindow::appendRow(const FieldValue* values) {
+    if (mReadOnly) {
+        return INVALID_OPERATION;
+    }
+
+    // Size the field directory and the row's data together.
+    const uint32_t numColumns = mHeader->numColumns;
+    const size_t fieldDirSize = numColumns * sizeof(FieldSlot);
+    if (fieldDirSize > mSize) {
+        return NO_MEMORY;
+    }
+    size_t rowSize = fieldDirSize;
+    for (uint32_t i = 0; i < numColumns; i++) {
+        switch (values[i].type) {
+            case FIELD_TYPE_STRING:
+            case FIELD_TYPE_BLOB:
+                if (values[i].data.buffer.size > mSize - rowSize) {
+                    return NO_MEMORY;
+                }
+                rowSize += values[i].data.buffer.size;
+                break;
+            case FIELD_TYPE_NULL:
+            case FIELD_TYPE_INTEGER:
+            case FIELD_TYPE_FLOAT:
+                break;
+            default:
+                ALOGE("Unknown field type %d for column %u", values[i].type, i);
+                return BAD_VALUE;
+        }
+    }
+
+    RowSlot* rowSlot = allocRowSlot();
+    if (rowSlot == NULL) {
+        return NO_MEMORY;
+    }
+
+    uint32_t rowOffset = alloc(rowSize, true /*aligned*/);
+    if (!rowOffset) {
+        mHeader->numRows--;
+        LOG_WINDOW("The row failed, so back out the new row accounting "
+                "from allocRowSlot %d", mHeader->numRows);
+        return NO_MEMORY;
+    }
+
+    FieldSlot* fieldDir = static_cast<FieldSlot*>(offsetToPtr(rowOffset));
+    memset(fieldDir, 0, fieldDirSize);
+    uint32_t dataOffset = rowOffset + fieldDirSize;
+    for (uint32_t i = 0; i < numColumns; i++) {
+        const FieldValue& value = values[i];
+        FieldSlot& fieldSlot = fieldDir[i];
+        fieldSlot.type = value.type;
+        switch (value.type) {
+            case FIELD_TYPE_STRING:
+            case FIELD_TYPE_BLOB:
+                memcpy(static_cast<uint8_t*>(mData) + dataOffset, value.data.buffer.value,
+                        value.data.buffer.size);
+                fieldSlot.data.buffer.offset = dataOffset;
+                fieldSlot.data.buffer.size = value.data.buffer.size;
+                dataOffset += value.data.buffer.size;
+                break;
+            case FIELD_TYPE_INTEGER:
+                fieldSlot.data.l = value.data.l;
+                break;
+            case FIELD_TYPE_FLOAT:
+                fieldSlot.data.d = value.data.d;
+                break;
+        }
+    }
+
+    LOG_WINDOW("Appended row %u, rowSlot is at offset %u, row is %zu bytes at offset %u\n",
+            mHeader->numRows - 1, offsetFromPtr(rowSlot), rowSize, rowOffset);
+    rowSlot->offset = rowOffset;
+    return OK;
+}
+
 uint32_t CursorWindow::alloc(size_t size, bool aligned) {
     uint32_t padding;
     if (aligned) {
@@ -225,35 +303,82 @@ uint32_t CursorWindow::alloc(size_t size, bool aligned) {
     return offset;
 }
 
-CursorWindow::RowSlot* CursorWindow::getRowSlot(uint32_t row) {
-    uint32_t chunkPos = row;
-    RowSlotChunk* chunk = static_cast<RowSlotChunk*>(
-            offsetToPtr(mHeader->firstChunkOffset));
-    while (chunkPos >= ROW_SLOT_CHUNK_NUM_ROWS) {
-        chunk = static_cast<RowSlotChunk*>(offsetToPtr(chunk->nextChunkOffset));
-        chunkPos -= ROW_SLOT_CHUNK_NUM_ROWS;
+void CursorWindow::buildChunkDirectory() {
+    const uint32_t numChunks = mHeader->numRows / ROW_SLOT_CHUNK_NUM_ROWS + 1;
+    mChunkOffsets.clear();
+    uint32_t offset = mHeader->firstChunkOffset;
+    while (offset && mChunkOffsets.size() < numChunks) {
+        RowSlotChunk* chunk = static_cast<RowSlotChunk*>(
+                offsetToPtr(offset, sizeof(RowSlotChunk)));
+        if (!chunk) {
+            break;
+        }
+        mChunkOffsets.push_back(offset);
+        offset = chunk->nextChunkOffset;
     }
-    return &chunk->slots[chunkPos];
 }
 
-CursorWindow::RowSlot* CursorWindow::allocRowSlot() {
-    uint32_t chunkPos = mHeader->numRows;
-    RowSlotChunk* chunk = static_cast<RowSlotChunk*>(
-            offsetToPtr(mHeader->firstChunkOffset));
-    while (chunkPos > ROW_SLOT_CHUNK_NUM_ROWS) {
-        chunk = static_cast<RowSlotChunk*>(offsetToPtr(chunk->nextChunkOffset));
-        chunkPos -= ROW_SLOT_CHUNK_NUM_ROWS;
+CursorWindow::RowSlotChunk* CursorWindow::getRowSlotChunk(uint32_t chunkIndex) {
+    if (mChunkOffsets.empty()) {
+        return NULL;
     }
-    if (chunkPos == ROW_SLOT_CHUNK_NUM_ROWS) {
+    uint32_t index = std::min<size_t>(chunkIndex, mChunkOffsets.size() - 1);
+    RowSlotChunk* chunk = static_cast<RowSlotChunk*>(
+            offsetToPtr(mChunkOffsets[index], sizeof(RowSlotChunk)));
+    // Only a read-only window whose owner added rows after sending it can have chunks past
+    // the directory. Walk to those without recording them, so that reads never modify the
+    // window.
+    while (chunk && index < chunkIndex) {
         if (!chunk->nextChunkOffset) {
-            chunk->nextChunkOffset = alloc(sizeof(RowSlotChunk), true /*aligned*/);
-            if (!chunk->nextChunkOffset) {
+            return NULL;
+        }
+        chunk = static_cast<RowSlotChunk*>(
+                offsetToPtr(chunk->nextChunkOffset, sizeof(RowSlotChunk)));
+        index++;
+    }
+    return chunk;
+}
+
+CursorWindow::RowSlot* CursorWindow::getRowSlot(uint32_t row) {
+    RowSlotChunk* chunk = getRowSlotChunk(row / ROW_SLOT_CHUNK_NUM_ROWS);
+    if (!chunk) {
+        return NULL;
+    }
+    return &chunk->slots[row % ROW_SLOT_CHUNK_NUM_ROWS];
+}
+
+CursorWindow::RowSlot* CursorWindow::allocRowSlot() {
+    uint32_t chunkIndex = mHeader->numRows / ROW_SLOT_CHUNK_NUM_ROWS;
+    uint32_t chunkPos = mHeader->numRows % ROW_SLOT_CHUNK_NUM_ROWS;
+    RowSlotChunk* chunk;
+    if (chunkIndex > 0 && chunkPos == 0) {
+        // The new row starts a chunk. Reuse the chunk left behind by freeLastRow()
+        // if there is one, otherwise link in a new one.
+        RowSlotChunk* prevChunk = getRowSlotChunk(chunkIndex - 1);
+        if (!prevChunk) {
+            return NULL;
+        }
+        if (!prevChunk->nextChunkOffset) {
+            uint32_t nextChunkOffset = alloc(sizeof(RowSlotChunk), true /*aligned*/);
+            if (!nextChunkOffset) {
                 return NULL;
             }
+            prevChunk->nextChunkOffset = nextChunkOffset;
         }
-        chunk = static_cast<RowSlotChunk*>(offsetToPtr(chunk->nextChunkOffset));
+        chunk = static_cast<RowSlotChunk*>(
+                offsetToPtr(prevChunk->nextChunkOffset, sizeof(RowSlotChunk)));
+        if (!chunk) {
+            return NULL;
+        }
+        // Chunks after the new one are no longer part of the list.
+        mChunkOffsets.resize(chunkIndex);
+        mChunkOffsets.push_back(prevChunk->nextChunkOffset);
         chunk->nextChunkOffset = 0;
-        chunkPos = 0;
+    } else {
+        chunk = getRowSlotChunk(chunkIndex);
+        if (!chunk) {
+            return NULL;
+        }
     }
     mHeader->numRows += 1;
     return &chunk->slots[chunkPos];
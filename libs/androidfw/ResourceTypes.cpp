@@ -1019,7 +1019,8 @@ bool ResStringPool::isUTF8() const
 // --------------------------------------------------------------------
 
 ResXMLParser::ResXMLParser(const ResXMLTree& tree)
-    : mTree(tree), mEventCode(BAD_DOCUMENT)
+    : mTree(tree), mEventCode(BAD_DOCUMENT), mAttrIndexExt(NULL), mAttrRunStart(0),
+      mAttrRunEnd(0)
 {
 }
 
@@ -1027,6 +1028,7 @@ void ResXMLParser::restart()
 {
     mCurNode = NULL;
     mEventCode = mTree.mError == NO_ERROR ? START_DOCUMENT : BAD_DOCUMENT;
+    mAttrIndexExt = NULL;
 }
 const ResStringPool& ResXMLParser::getStrings() const
 {
@@ -1429,6 +1431,81 @@ ssize_t ResXMLParser::indexOfAttribute(const char16_t* ns, size_t nsLen,
     return NAME_NOT_FOUND;
 }
 
+ssize_t ResXMLParser::indexOfAttribute(uint32_t resId) const
+{
+    if (mEventCode != START_TAG || resId == 0) {
+        return NAME_NOT_FOUND;
+    }
+    if (mAttrIndexExt != mCurExt) {
+        buildAttributeIndex();
+    }
+
+    const size_t count = mAttrIndex.empty() ? mAttrRunEnd - mAttrRunStart : mAttrIndex.size();
+    size_t lo = 0;
+    size_t hi = count;
+    while (lo < hi) {
+        const size_t mid = lo + (hi - lo) / 2;
+        if (getIndexedAttributeResID(mid) < resId) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo < count && getIndexedAttributeResID(lo) == resId) {
+        return mAttrIndex.empty() ? mAttrRunStart + lo : mAttrIndex[lo];
+    }
+    return NAME_NOT_FOUND;
+}
+
+void ResXMLParser::buildAttributeIndex() const
+{
+    mAttrIndexExt = mCurExt;
+    mAttrIndex.clear();
+
+    // Attributes without a resource ID may come before or after the ones that have
+    // one. If those with IDs form a single ascending run, search them in place.
+    const size_t N = getAttributeCount();
+    size_t start = 0;
+    while (start < N && getAttributeNameResID(start) == 0) {
+        start++;
+    }
+    size_t end = start;
+    uint32_t prevResId = 0;
+    while (end < N) {
+        const uint32_t resId = getAttributeNameResID(end);
+        if (resId == 0 || resId < prevResId) {
+            break;
+        }
+        prevResId = resId;
+        end++;
+    }
+    size_t rest = end;
+    while (rest < N && getAttributeNameResID(rest) == 0) {
+        rest++;
+    }
+    if (rest == N) {
+        mAttrRunStart = start;
+        mAttrRunEnd = end;
+        return;
+    }
+
+    mAttrRunStart = mAttrRunEnd = 0;
+    for (size_t i = 0; i < N; i++) {
+        if (getAttributeNameResID(i) != 0) {
+            mAttrIndex.push_back(static_cast<uint16_t>(i));
+        }
+    }
+    // Stable, so that duplicates resolve to the first one like the name lookup does.
+    std::stable_sort(mAttrIndex.begin(), mAttrIndex.end(), [this](uint16_t a, uint16_t b) {
+        return getAttributeNameResID(a) < getAttributeNameResID(b);
+    });
+}
+
+uint32_t ResXMLParser::getIndexedAttributeResID(size_t pos) const
+{
+    return getAttributeNameResID(mAttrIndex.empty() ? mAttrRunStart + pos : mAttrIndex[pos]);
+}
+
 ssize_t ResXMLParser::indexOfID() const
 {
     if (mEventCode == START_TAG) {
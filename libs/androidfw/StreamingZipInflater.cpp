@@ -20,11 +20,16 @@
 
 #include <androidfw/StreamingZipInflater.h>
 #include <utils/FileMap.h>
+#include <utils/threads.h>
+#include <inttypes.h>
 #include <string.h>
 #include <stddef.h>
 #include <assert.h>
 #include <unistd.h>
 #include <errno.h>
+#include <stdlib.h>
+
+#include <algorithm>
 
 /*
  * TEMP_FAILURE_RETRY is defined by some, but not all, versions of
@@ -47,6 +52,77 @@ static inline size_t min_of(size_t a, size_t b) { return (a < b) ? a : b; }
 
 using namespace android;
 
+struct StreamingZipInflater::InflateContext {
+    z_stream stream;
+    size_t allocatedBytes;      // heap zlib holds for this stream, window included
+};
+
+/*
+ * Inflate contexts no longer in use.  Streaming inflaters are short-lived and few are
+ * open at any one time, so a couple of pooled contexts covers nearly every open, and
+ * zlib keeps its state and window allocated across inflateReset().  The chunk buffers
+ * are not pooled: they are sized to each asset instead.
+ */
+static const size_t kMaxPooledContexts = 4;
+static const size_t kMaxPooledBytes = 96 * 1024;
+static Mutex gContextPoolLock;
+static void* gContextPool[kMaxPooledContexts];
+static size_t gContextPoolSize = 0;
+static size_t gContextPoolBytes = 0;
+
+// zlib only frees what it allocated in inflateEnd(), so a running total is exact.
+static voidpf contextAlloc(voidpf opaque, uInt items, uInt size) {
+    static_cast<size_t*>(opaque)[0] += (size_t) items * size;
+    return calloc(items, size);
+}
+
+static void contextFree(voidpf /* opaque */, voidpf address) {
+    free(address);
+}
+
+StreamingZipInflater::InflateContext* StreamingZipInflater::obtainContext() {
+    {
+        AutoMutex _l(gContextPoolLock);
+        if (gContextPoolSize > 0) {
+            InflateContext* context =
+                    static_cast<InflateContext*>(gContextPool[--gContextPoolSize]);
+            gContextPoolBytes -= context->allocatedBytes;
+            return context;
+        }
+    }
+
+    InflateContext* context = new InflateContext;
+    memset(&context->stream, 0, sizeof(context->stream));
+    context->allocatedBytes = 0;
+    context->stream.zalloc = contextAlloc;
+    context->stream.zfree = contextFree;
+    context->stream.opaque = &context->allocatedBytes;
+    int result = inflateInit2(&context->stream, -MAX_WBITS);
+    if (result != Z_OK) {
+        ALOGE("Unable to initialize zlib: %d", result);
+        delete context;
+        return NULL;
+    }
+    return context;
+}
+
+void StreamingZipInflater::releaseContext(InflateContext* context) {
+    if (context == NULL) {
+        return;
+    }
+    {
+        AutoMutex _l(gContextPoolLock);
+        if (gContextPoolSize < kMaxPooledContexts
+                && gContextPoolBytes + context->allocatedBytes <= kMaxPooledBytes) {
+            gContextPool[gContextPoolSize++] = context;
+            gContextPoolBytes += context->allocatedBytes;
+            return;
+        }
+    }
+    ::inflateEnd(&context->stream);
+    delete context;
+}
+
 /*
  * Streaming access to compressed asset data in an open fd
  */
@@ -58,11 +134,19 @@ StreamingZipInflater::StreamingZipInflater(int fd, off64_t compDataStart,
     mOutTotalSize = uncompSize;
     mInTotalSize = compSize;
 
-    mInBufSize = StreamingZipInflater::INPUT_CHUNK_SIZE;
-    mInBuf = new uint8_t[mInBufSize];
+    mContext = obtainContext();
+    mInflateState = mContext != NULL ? &mContext->stream : NULL;
+
+    // Small assets don't need full-sized chunks.
+    mInBufSize = std::max<size_t>(
+            min_of(compSize, StreamingZipInflater::INPUT_CHUNK_SIZE), 1);
+    mInBufStorage.reset(new uint8_t[mInBufSize]);
+    mInBuf = mInBufStorage.get();
 
-    mOutBufSize = StreamingZipInflater::OUTPUT_CHUNK_SIZE;
-    mOutBuf = new uint8_t[mOutBufSize];
+    mOutBufSize = std::max<size_t>(
+            min_of(uncompSize, StreamingZipInflater::OUTPUT_CHUNK_SIZE), 1);
+    mOutBufStorage.reset(new uint8_t[mOutBufSize]);
+    mOutBuf = mOutBufStorage.get();
 
     initInflateState();
 }
@@ -76,46 +160,48 @@ StreamingZipInflater::StreamingZipInflater(FileMap* dataMap, size_t uncompSize)
     mOutTotalSize = uncompSize;
     mInTotalSize = dataMap->getDataLength();
 
+    mContext = obtainContext();
+    mInflateState = mContext != NULL ? &mContext->stream : NULL;
+
+    // zlib reads straight from the map, so there is no input buffer.
     mInBuf = (uint8_t*) dataMap->getDataPtr();
     mInBufSize = mInTotalSize;
 
-    mOutBufSize = StreamingZipInflater::OUTPUT_CHUNK_SIZE;
-    mOutBuf = new uint8_t[mOutBufSize];
+    mOutBufSize = std::max<size_t>(
+            min_of(uncompSize, StreamingZipInflater::OUTPUT_CHUNK_SIZE), 1);
+    mOutBufStorage.reset(new uint8_t[mOutBufSize]);
+    mOutBuf = mOutBufStorage.get();
 
     initInflateState();
 }
 
 StreamingZipInflater::~StreamingZipInflater() {
-    // tear down the in-flight zip state just in case
-    ::inflateEnd(&mInflateState);
-
-    if (mDataMap == NULL) {
-        delete [] mInBuf;
-    }
-    delete [] mOutBuf;
+    // hand the zlib state back for the next asset
+    releaseContext(mContext);
 }
 
 void StreamingZipInflater::initInflateState() {
     ALOGV("Initializing inflate state");
 
-    memset(&mInflateState, 0, sizeof(mInflateState));
-    mInflateState.zalloc = Z_NULL;
-    mInflateState.zfree = Z_NULL;
-    mInflateState.opaque = Z_NULL;
-    mInflateState.next_in = (Bytef*)mInBuf;
-    mInflateState.next_out = (Bytef*) mOutBuf;
-    mInflateState.avail_out = mOutBufSize;
-    mInflateState.data_type = Z_UNKNOWN;
-
     mOutLastDecoded = mOutDeliverable = mOutCurPosition = 0;
     mInNextChunkOffset = 0;
-    mStreamNeedsInit = true;
+    mStreamEnded = false;
+
+    if (mInflateState == NULL) {
+        return;
+    }
+
+    ::inflateReset(mInflateState);
+    mInflateState->next_in = (Bytef*)mInBuf;
+    mInflateState->next_out = (Bytef*) mOutBuf;
+    mInflateState->avail_out = mOutBufSize;
+    mInflateState->data_type = Z_UNKNOWN;
 
     if (mDataMap == NULL) {
         ::lseek(mFd, mInFileStart, SEEK_SET);
-        mInflateState.avail_in = 0; // set when a chunk is read in
+        mInflateState->avail_in = 0; // set when a chunk is read in
     } else {
-        mInflateState.avail_in = mInBufSize;
+        mInflateState->avail_in = mInBufSize;
     }
 }
 
@@ -130,10 +216,15 @@ void StreamingZipInflater::initInflateState() {
  *    0. if the request is for more data than exists, bail.
  *    a. if there is no input data to decode, read some into the input buffer
  *       and readjust the z_stream input pointers
- *    b. point the output to the start of the output buffer and decode what we can
+ *    b. point the output to the start of the output buffer and decode what we can,
+ *       stopping at deflate block boundaries so that checkpoints can be taken there
  *    c. deliver whatever output data we can
  */
 ssize_t StreamingZipInflater::read(void* outBuf, size_t count) {
+    if (mInflateState == NULL) {
+        return -1;
+    }
+
     uint8_t* dest = (uint8_t*) outBuf;
     size_t bytesRead = 0;
     size_t toRead = min_of(count, size_t(mOutTotalSize - mOutCurPosition));
@@ -151,53 +242,52 @@ ssize_t StreamingZipInflater::read(void* outBuf, size_t count) {
 
         // need more data?  time to decode some.
         if (toRead > 0) {
+            if (mStreamEnded) {
+                // The compressed data ended before the size we were promised.
+                ALOGE("Asset data ended %zu bytes early", toRead);
+                initInflateState();
+                return -1;
+            }
+
             // if we don't have any data to decode, read some in.  If we're working
             // from mmapped data this won't happen, because the clipping to total size
             // will prevent reading off the end of the mapped input chunk.
-            if ((mInflateState.avail_in == 0) && (mDataMap == NULL)) {
+            if ((mInflateState->avail_in == 0) && (mDataMap == NULL)) {
                 int err = readNextChunk();
                 if (err < 0) {
                     ALOGE("Unable to access asset data: %d", err);
-                    if (!mStreamNeedsInit) {
-                        ::inflateEnd(&mInflateState);
-                        initInflateState();
-                    }
+                    initInflateState();
                     return -1;
                 }
             }
             // we know we've drained whatever is in the out buffer now, so just
             // start from scratch there, reading all the input we have at present.
-            mInflateState.next_out = (Bytef*) mOutBuf;
-            mInflateState.avail_out = mOutBufSize;
+            mInflateState->next_out = (Bytef*) mOutBuf;
+            mInflateState->avail_out = mOutBufSize;
 
             /*
             ALOGV("Inflating to outbuf: avail_in=%u avail_out=%u next_in=%p next_out=%p",
-                    mInflateState.avail_in, mInflateState.avail_out,
-                    mInflateState.next_in, mInflateState.next_out);
+                    mInflateState->avail_in, mInflateState->avail_out,
+                    mInflateState->next_in, mInflateState->next_out);
             */
-            int result = Z_OK;
-            if (mStreamNeedsInit) {
-                ALOGV("Initializing zlib to inflate");
-                result = inflateInit2(&mInflateState, -MAX_WBITS);
-                mStreamNeedsInit = false;
-            }
-            if (result == Z_OK) result = ::inflate(&mInflateState, Z_SYNC_FLUSH);
+            int result = ::inflate(mInflateState, Z_BLOCK);
             if (result < 0) {
                 // Whoops, inflation failed
                 ALOGE("Error inflating asset: %d", result);
-                ::inflateEnd(&mInflateState);
                 initInflateState();
                 return -1;
             } else {
+                // Note how much data we got, and off we go
+                mOutDeliverable = 0;
+                mOutLastDecoded = mOutBufSize - mInflateState->avail_out;
+
                 if (result == Z_STREAM_END) {
                     // we know we have to have reached the target size here and will
-                    // not try to read any further, so just wind things up.
-                    ::inflateEnd(&mInflateState);
+                    // not try to read any further.
+                    mStreamEnded = true;
+                } else {
+                    maybeAddCheckpoint();
                 }
-
-                // Note how much data we got, and off we go
-                mOutDeliverable = 0;
-                mOutLastDecoded = mOutBufSize - mInflateState.avail_out;
             }
         }
     }
@@ -219,26 +309,110 @@ int StreamingZipInflater::readNextChunk() {
                 return didRead;
             } else {
                 mInNextChunkOffset += didRead;
-                mInflateState.next_in = (Bytef*) mInBuf;
-                mInflateState.avail_in = didRead;
+                mInflateState->next_in = (Bytef*) mInBuf;
+                mInflateState->avail_in = didRead;
             }
         }
     }
     return 0;
 }
 
-// seeking backwards requires uncompressing fom the beginning, so is very
-// expensive.  seeking forwards only requires uncompressing from the current
-// position to the destination.
+/*
+ * Called after each inflate() call.  zlib stops at the end of every deflate block,
+ * which is the only place decoding can be restarted without replaying what came
+ * before it: all that's needed is the input position and the sliding window.
+ */
+void StreamingZipInflater::maybeAddCheckpoint() {
+    // bit 7: stopped at the end of a block; bit 6: that block was the last one.
+    const int dataType = mInflateState->data_type;
+    if ((dataType & 128) == 0 || (dataType & 64) != 0) {
+        return;
+    }
+
+    // mOutBuf was empty when inflate() started, so it begins at mOutCurPosition.
+    const off64_t outOffset = mOutCurPosition + mOutLastDecoded;
+    const off64_t lastOffset = mCheckpoints.empty() ? 0 : mCheckpoints.back().outOffset;
+    if (outOffset < lastOffset + (off64_t) CHECKPOINT_INTERVAL) {
+        return;
+    }
+
+    const int bits = dataType & 7;
+    if (bits != 0 && mInflateState->next_in == mInBuf) {
+        // The partially consumed byte came from the previous input chunk and is gone.
+        return;
+    }
+
+    Checkpoint checkpoint;
+    checkpoint.outOffset = outOffset;
+    checkpoint.inOffset = mDataMap == NULL
+            ? mInNextChunkOffset - mInflateState->avail_in
+            : (size_t) (mInflateState->next_in - mInBuf);
+    checkpoint.bits = bits;
+    checkpoint.partialByte = bits != 0 ? mInflateState->next_in[-1] : 0;
+
+    uInt windowSize = 1u << MAX_WBITS;
+    checkpoint.window.reset(new uint8_t[windowSize]);
+    if (inflateGetDictionary(mInflateState, checkpoint.window.get(), &windowSize) != Z_OK) {
+        return;
+    }
+    checkpoint.windowSize = windowSize;
+
+    if (kIsDebug) {
+        ALOGV("Checkpoint at out=%" PRId64 " in=%zu bits=%d window=%zu",
+                (int64_t) checkpoint.outOffset, checkpoint.inOffset, bits, checkpoint.windowSize);
+    }
+    mCheckpoints.push_back(std::move(checkpoint));
+}
+
+void StreamingZipInflater::restoreCheckpoint(const Checkpoint& checkpoint) {
+    ALOGV("Restarting inflate at %" PRId64, (int64_t) checkpoint.outOffset);
+
+    ::inflateReset(mInflateState);
+    if (checkpoint.bits != 0) {
+        ::inflatePrime(mInflateState, checkpoint.bits,
+                checkpoint.partialByte >> (8 - checkpoint.bits));
+    }
+    ::inflateSetDictionary(mInflateState, checkpoint.window.get(), checkpoint.windowSize);
+
+    mOutCurPosition = checkpoint.outOffset;
+    mOutLastDecoded = mOutDeliverable = 0;
+    mStreamEnded = false;
+
+    if (mDataMap == NULL) {
+        ::lseek(mFd, mInFileStart + checkpoint.inOffset, SEEK_SET);
+        mInNextChunkOffset = checkpoint.inOffset;
+        mInflateState->next_in = (Bytef*) mInBuf;
+        mInflateState->avail_in = 0; // set when a chunk is read in
+    } else {
+        mInflateState->next_in = (Bytef*) (mInBuf + checkpoint.inOffset);
+        mInflateState->avail_in = mInBufSize - checkpoint.inOffset;
+    }
+}
+
+// Restart from the closest checkpoint at or before the destination if going there
+// saves work, otherwise keep going from the current position (or, when moving
+// backwards without a checkpoint, from the very beginning).
 off64_t StreamingZipInflater::seekAbsolute(off64_t absoluteInputPosition) {
-    if (absoluteInputPosition < mOutCurPosition) {
+    if (mInflateState == NULL) {
+        return -1;
+    }
+
+    std::vector<Checkpoint>::const_iterator next = std::upper_bound(
+            mCheckpoints.begin(), mCheckpoints.end(), absoluteInputPosition,
+            [](off64_t position, const Checkpoint& checkpoint) {
+                return position < checkpoint.outOffset;
+            });
+    const Checkpoint* checkpoint = next != mCheckpoints.begin() ? &*(next - 1) : NULL;
+
+    if (checkpoint != NULL && (absoluteInputPosition < mOutCurPosition
+            || checkpoint->outOffset > mOutCurPosition)) {
+        restoreCheckpoint(*checkpoint);
+    } else if (absoluteInputPosition < mOutCurPosition) {
         // rewind and reprocess the data from the beginning
-        if (!mStreamNeedsInit) {
-            ::inflateEnd(&mInflateState);
-        }
         initInflateState();
-        read(NULL, absoluteInputPosition);
-    } else if (absoluteInputPosition > mOutCurPosition) {
+    }
+
+    if (absoluteInputPosition > mOutCurPosition) {
         read(NULL, absoluteInputPosition - mOutCurPosition);
     }
     // else if the target position *is* our current position, do nothing
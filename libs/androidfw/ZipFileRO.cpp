@@ -217,6 +217,11 @@ FileMap* ZipFileRO::createEntryFileMap(ZipEntryRO entry) const
     return newMap;
 }
 
+int ZipFileRO::getFileDescriptor() const
+{
+    return GetFileDescriptor(mHandle);
+}
+
 /*
  * Uncompress an entry, in its entirety, into the provided output buffer.
  *
@@ -17,6 +17,7 @@
 #ifndef ANDROIDFW_ATTRIBUTERESOLUTION_H
 #define ANDROIDFW_ATTRIBUTERESOLUTION_H
 
+#include <androidfw/AssetManager2.h>
 #include <androidfw/ResourceTypes.h>
 
 namespace android {
@@ -57,6 +58,29 @@ void ApplyStyle(ResTable::Theme* theme, ResXMLParser* xml_parser, uint32_t def_s
 bool RetrieveAttributes(const ResTable* res, ResXMLParser* xml_parser, uint32_t* attrs,
                         size_t attrs_length, uint32_t* out_values, uint32_t* out_indices);
 
+// The following are the same operations run against AssetManager2 and Theme. They write the
+// same layout to `out_values`, except that STYLE_ASSET_COOKIE holds the ApkAssetsCookie of the
+// value, or -1 (kInvalidCookie) when the value came from XML or wasn't found.
+// References are resolved once per call, so attributes pointing at the same resource share the
+// lookup.
+
+// `out_values` must NOT be nullptr.
+// `out_indices` may be nullptr.
+bool ResolveAttrs(Theme* theme, uint32_t def_style_attr, uint32_t def_style_resid,
+                  uint32_t* src_values, size_t src_values_length, uint32_t* attrs,
+                  size_t attrs_length, uint32_t* out_values, uint32_t* out_indices);
+
+// `out_values` must NOT be nullptr.
+// `out_indices` is NOT optional and must NOT be nullptr.
+void ApplyStyle(Theme* theme, ResXMLParser* xml_parser, uint32_t def_style_attr,
+                uint32_t def_style_resid, const uint32_t* attrs, size_t attrs_length,
+                uint32_t* out_values, uint32_t* out_indices);
+
+// `out_values` must NOT be nullptr.
+// `out_indices` may be nullptr.
+bool RetrieveAttributes(AssetManager2* assetmanager, ResXMLParser* xml_parser, uint32_t* attrs,
+                        size_t attrs_length, uint32_t* out_values, uint32_t* out_indices);
+
 }  // namespace android
 
 #endif /* ANDROIDFW_ATTRIBUTERESOLUTION_H */
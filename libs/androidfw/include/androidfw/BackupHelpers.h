@@ -82,6 +82,14 @@ public:
      */
     status_t WriteEntityData(const void* data, size_t size);
 
+    /* Like WriteEntityData, but copies size bytes from the current position of fd
+     * and advances it.  The kernel moves the data directly when it can, so the
+     * bytes never pass through user space.  The number of bytes actually copied is
+     * returned in outWritten; NOT_ENOUGH_DATA means fd ended early, and any other
+     * error reading fd leaves the stream usable.
+     */
+    status_t WriteEntityDataFromFile(int fd, size_t size, size_t* outWritten);
+
     void SetKeyPrefix(const String8& keyPrefix);
 
 private:
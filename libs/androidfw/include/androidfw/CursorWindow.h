@@ -21,6 +21,8 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <vector>
+
 #include <binder/Parcel.h>
 #include <log/log.h>
 #include <utils/String8.h>
@@ -47,6 +49,10 @@ namespace android {
  * FieldSlot per column, which has the size, offset, and type of the data for that field.
  * Note that the data types come from sqlite3.h.
  *
+ * Each CursorWindow object also keeps a private directory of the chunk offsets it has seen,
+ * so finding a row slot is O(1) rather than a walk of the chunk list. The directory is not
+ * part of the shared window, which keeps the ashmem format unchanged.
+ *
  * Strings are stored in UTF-8.
  */
 class CursorWindow {
@@ -79,6 +85,19 @@ public:
         friend class CursorWindow;
     } __attribute((packed));
 
+    /* The value of one field of a row passed to appendRow(). */
+    struct FieldValue {
+        int32_t type;
+        union {
+            double d;
+            int64_t l;
+            struct {
+                const void* value;
+                size_t size;
+            } buffer;
+        } data;
+    };
+
     ~CursorWindow();
 
     static status_t create(const String8& name, size_t size, CursorWindow** outCursorWindow);
@@ -108,6 +127,14 @@ public:
     status_t putDouble(uint32_t row, uint32_t column, double value);
     status_t putNull(uint32_t row, uint32_t column);
 
+    /**
+     * Allocate a row and fill in every field at once. values holds one entry per column.
+     * The field directory and all string and blob data for the row are carved out of a
+     * single allocation, so this is cheaper than allocRow() followed by a put per field.
+     * Returns NO_MEMORY and adds no row if the row does not fit in the window.
+     */
+    status_t appendRow(const FieldValue* values);
+
     /**
      * Gets the field slot at the specified row and column.
      * Returns null if the requested row or column is not in the window.
@@ -168,6 +195,10 @@ private:
     bool mReadOnly;
     Header* mHeader;
 
+    // Offsets of the row slot chunks, in list order. Only clear(), allocRowSlot() and
+    // createFromParcel() change it, so that concurrent readers of a window never race.
+    std::vector<uint32_t> mChunkOffsets;
+
     inline void* offsetToPtr(uint32_t offset, uint32_t bufferSize = 0) {
         if (offset >= mSize) {
             ALOGE("Offset %" PRIu32 " out of bounds, max value %zu", offset, mSize);
@@ -192,6 +223,10 @@ private:
      */
     uint32_t alloc(size_t size, bool aligned = false);
 
+    // Fills mChunkOffsets from the chunk list of a window that was filled elsewhere.
+    void buildChunkDirectory();
+
+    RowSlotChunk* getRowSlotChunk(uint32_t chunkIndex);
     RowSlot* getRowSlot(uint32_t row);
     RowSlot* allocRowSlot();
 
@@ -35,6 +35,7 @@
 #include <android/configuration.h>
 
 #include <memory>
+#include <vector>
 
 namespace android {
 
@@ -767,6 +768,14 @@ public:
     ssize_t indexOfAttribute(const char16_t* ns, size_t nsLen,
                              const char16_t* attr, size_t attrLen) const;
 
+    // Returns the index of the current element's attribute whose name maps to
+    // the resource ID `resId`, or NAME_NOT_FOUND. This is a binary search:
+    // aapt and aapt2 write attributes sorted by resource ID, so they are
+    // searched in place, and a sorted index is built on first use for
+    // elements that aren't in order (e.g. after shared library IDs are
+    // remapped).
+    ssize_t indexOfAttribute(uint32_t resId) const;
+
     ssize_t indexOfID() const;
     ssize_t indexOfClass() const;
     ssize_t indexOfStyle() const;
@@ -778,11 +787,21 @@ private:
     friend class ResXMLTree;
     
     event_code_t nextNode();
+    void buildAttributeIndex() const;
+    uint32_t getIndexedAttributeResID(size_t pos) const;
 
     const ResXMLTree&           mTree;
     event_code_t                mEventCode;
     const ResXMLTree_node*      mCurNode;
     const void*                 mCurExt;
+
+    // Lookup state for indexOfAttribute(uint32_t), valid while mAttrIndexExt == mCurExt.
+    // The attributes with resource IDs in [mAttrRunStart, mAttrRunEnd) are already in
+    // order; otherwise mAttrIndex holds their indices sorted by resource ID.
+    mutable const void*         mAttrIndexExt;
+    mutable size_t              mAttrRunStart;
+    mutable size_t              mAttrRunEnd;
+    mutable std::vector<uint16_t> mAttrIndex;
 };
 
 class DynamicRefTable;
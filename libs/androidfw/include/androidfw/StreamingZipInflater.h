@@ -21,6 +21,9 @@
 #include <inttypes.h>
 #include <zlib.h>
 
+#include <memory>
+#include <vector>
+
 #include <utils/Compat.h>
 
 namespace android {
@@ -30,6 +33,11 @@ public:
     static const size_t INPUT_CHUNK_SIZE = 64 * 1024;
     static const size_t OUTPUT_CHUNK_SIZE = 64 * 1024;
 
+    // Spacing, in uncompressed bytes, of the restart points recorded while
+    // inflating. Seeking to an offset that was already decoded never costs
+    // more than inflating this much data.
+    static const size_t CHECKPOINT_INTERVAL = 1024 * 1024;
+
     // Flavor that pages in the compressed data from a fd
     StreamingZipInflater(int fd, off64_t compDataStart, size_t uncompSize, size_t compSize);
 
@@ -42,25 +50,48 @@ public:
     // be NULL, in which case the data is consumed and discarded.
     ssize_t read(void* outBuf, size_t count);
 
-    // seeking backwards requires uncompressing fom the beginning, so is very
-    // expensive.  seeking forwards only requires uncompressing from the current
+    // seeking restarts inflation from the closest checkpoint at or before the
+    // destination when that is closer than the current position, so seeking
+    // backwards only re-inflates from the start when no checkpoint has been
+    // recorded yet.  seeking forwards otherwise uncompresses from the current
     // position to the destination.
     off64_t seekAbsolute(off64_t absoluteInputPosition);
 
 private:
+    // zlib state, kept in a process-wide pool (capped by the memory zlib holds)
+    // so that opening an asset doesn't allocate and initialize it each time.
+    struct InflateContext;
+
+    // A point at a deflate block boundary from which inflation can restart.
+    struct Checkpoint {
+        off64_t outOffset;          // uncompressed offset of the restart point
+        size_t inOffset;            // compressed bytes consumed up to the restart point
+        int bits;                   // unused bits of the byte at inOffset - 1
+        uint8_t partialByte;        // that byte, when bits != 0
+        size_t windowSize;
+        std::unique_ptr<uint8_t[]> window;  // the last (up to) 32K of output
+    };
+
+    static InflateContext* obtainContext();
+    static void releaseContext(InflateContext* context);
+
     void initInflateState();
     int readNextChunk();
+    void maybeAddCheckpoint();
+    void restoreCheckpoint(const Checkpoint& checkpoint);
 
     // where to find the uncompressed data
     int mFd;
     off64_t mInFileStart;         // where the compressed data lives in the file
     class FileMap* mDataMap;
 
-    z_stream mInflateState;
-    bool mStreamNeedsInit;
+    InflateContext* mContext;
+    z_stream* mInflateState;
+    bool mStreamEnded;
 
     // output invariants for this asset
     uint8_t* mOutBuf;           // output buf for decompressed bytes
+    std::unique_ptr<uint8_t[]> mOutBufStorage;
     size_t mOutBufSize;         // allocated size of mOutBuf
     size_t mOutTotalSize;       // total uncompressed size of the blob
 
@@ -70,13 +101,17 @@ private:
     size_t mOutDeliverable;     // next undelivered byte of decoded output in mOutBuf
 
     // input invariants
-    uint8_t* mInBuf;
+    uint8_t* mInBuf;            // compressed chunk, or the whole mapped blob
+    std::unique_ptr<uint8_t[]> mInBufStorage;  // owns mInBuf when reading from a fd
     size_t mInBufSize;          // allocated size of mInBuf;
     size_t mInTotalSize;        // total size of compressed data for this blob
 
     // input state bookkeeping
     size_t mInNextChunkOffset;  // offset from start of blob at which the next input chunk lies
     // the z_stream contains state about input block consumption
+
+    // restart points, in increasing order of outOffset
+    std::vector<Checkpoint> mCheckpoints;
 };
 
 }
@@ -65,6 +65,12 @@ typedef void* ZipEntryRO;
  * NOTE: If this is used on file descriptors inherited from a fork() operation,
  * you must be on a platform that implements pread() to guarantee correctness
  * on the shared file descriptors.
+ *
+ * Once open() has returned, the const methods may be called from several
+ * threads at once, as long as each entry is used by one thread at a time:
+ * they only read the central directory, which stays mapped until the archive
+ * is closed, and read entry data with pread(). An iteration cookie must not
+ * be shared between threads.
  */
 class ZipFileRO {
 public:
@@ -136,6 +142,13 @@ public:
      */
     FileMap* createEntryFileMap(ZipEntryRO entry) const;
 
+    /*
+     * Return the file descriptor of the open archive. It remains owned by
+     * this object, and may be shared between threads, so only use calls
+     * that take an explicit offset (pread(), sendfile() with an offset).
+     */
+    int getFileDescriptor() const;
+
     /*
      * Uncompress the data into a buffer.  Depending on the compression
      * format, this is either an "inflate" operation or a memcpy.
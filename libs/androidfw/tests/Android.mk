@@ -34,7 +34,9 @@ testFiles := \
     LoadedArsc_test.cpp \
     ResourceUtils_test.cpp \
     ResTable_test.cpp \
+    ResXMLParser_test.cpp \
     Split_test.cpp \
+    StreamingZipInflater_test.cpp \
     StringPiece_test.cpp \
     TestHelpers.cpp \
     TestMain.cpp \
@@ -44,9 +46,12 @@ testFiles := \
 
 benchmarkFiles := \
     AssetManager2_bench.cpp \
+    BackupHelpers_bench.cpp \
     BenchMain.cpp \
     BenchmarkHelpers.cpp \
+    CursorWindow_bench.cpp \
     SparseEntry_bench.cpp \
+    StreamingZipInflater_bench.cpp \
     TestHelpers.cpp \
     Theme_bench.cpp
 
@@ -90,14 +95,17 @@ LOCAL_MODULE := libandroidfw_tests
 LOCAL_CFLAGS := $(androidfw_test_cflags)
 LOCAL_SRC_FILES := $(testFiles) \
     BackupData_test.cpp \
+    CursorWindow_test.cpp \
     ObbFile_test.cpp \
 
 LOCAL_SHARED_LIBRARIES := \
     libandroidfw \
     libbase \
+    libbinder \
     libcutils \
     libutils \
     libui \
+    libz \
     libziparchive 
 LOCAL_PICKUP_FILES := $(LOCAL_PATH)/data
 
@@ -116,8 +124,10 @@ LOCAL_STATIC_LIBRARIES := \
 LOCAL_SHARED_LIBRARIES := \
     libandroidfw \
     libbase \
+    libbinder \
     libcutils \
     libutils \
+    libz \
     libziparchive
 LOCAL_PICKUP_FILES := $(LOCAL_PATH)/data
 
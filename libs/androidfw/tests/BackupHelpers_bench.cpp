@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "android-base/file.h"
+#include "android-base/stringprintf.h"
+#include "android-base/test_utils.h"
+#include "benchmark/benchmark.h"
+
+#include "androidfw/BackupHelpers.h"
+
+namespace android {
+
+// A synthetic app data directory: many small files, as written by SharedPreferences
+// and friends, plus a few large ones standing in for databases and downloaded media.
+struct BackupTree {
+  BackupTree() {
+    std::string small(4 * 1024, 's');
+    for (int i = 0; i < 1000; i++) {
+      std::string path = android::base::StringPrintf("%s/small_%04d", dir.path, i);
+      android::base::WriteStringToFile(small, path);
+      small_files.push_back(path);
+      small_bytes += small.size();
+    }
+
+    std::string large(64 * 1024 * 1024, 'L');
+    for (int i = 0; i < 2; i++) {
+      std::string path = android::base::StringPrintf("%s/large_%d", dir.path, i);
+      android::base::WriteStringToFile(large, path);
+      large_files.push_back(path);
+      large_bytes += large.size();
+    }
+  }
+
+  TemporaryDir dir;
+  std::vector<std::string> small_files;
+  std::vector<std::string> large_files;
+  int64_t small_bytes = 0;
+  int64_t large_bytes = 0;
+};
+
+static BackupTree* GetTree() {
+  static BackupTree* tree = new BackupTree();
+  return tree;
+}
+
+// Writes files as a full backup tar stream into a pipe, which is how the backup
+// manager receives it, while another thread drains the other end.
+static bool BackUpToPipe(const std::vector<std::string>& files, const char* root) {
+  int fds[2];
+  if (pipe(fds) != 0) {
+    return false;
+  }
+
+  std::thread drain([&fds]() {
+    char buf[64 * 1024];
+    while (read(fds[0], buf, sizeof(buf)) > 0) {
+    }
+  });
+
+  bool ok = true;
+  {
+    BackupDataWriter writer(fds[1]);
+    for (const std::string& file : files) {
+      off_t size;
+      if (write_tarfile(String8("com.example.app"), String8("f"), String8(root),
+                        String8(file.c_str()), &size, &writer) != 0) {
+        ok = false;
+        break;
+      }
+    }
+  }
+  close(fds[1]);
+  drain.join();
+  close(fds[0]);
+  return ok;
+}
+
+static void BM_WriteTarfileSmallFiles(benchmark::State& state) {
+  BackupTree* tree = GetTree();
+  while (state.KeepRunning()) {
+    if (!BackUpToPipe(tree->small_files, tree->dir.path)) {
+      state.SkipWithError("write_tarfile failed");
+      return;
+    }
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * tree->small_bytes);
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * tree->small_files.size());
+}
+BENCHMARK(BM_WriteTarfileSmallFiles);
+
+static void BM_WriteTarfileLargeFiles(benchmark::State& state) {
+  BackupTree* tree = GetTree();
+  while (state.KeepRunning()) {
+    if (!BackUpToPipe(tree->large_files, tree->dir.path)) {
+      state.SkipWithError("write_tarfile failed");
+      return;
+    }
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * tree->large_bytes);
+}
+BENCHMARK(BM_WriteTarfileLargeFiles);
+
+}  // namespace android
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "benchmark/benchmark.h"
+
+#include "androidfw/CursorWindow.h"
+
+namespace android {
+
+// The default size of a CursorWindow created by the framework.
+constexpr const static size_t kWindowSize = 2 * 1024 * 1024;
+
+// Fills a window with state.range(0) single-integer rows, the narrowest row a query
+// can produce, then reads every row back in order.
+static void BM_CursorWindowFillAndScanNarrowRows(benchmark::State& state) {
+  CursorWindow* window = nullptr;
+  if (CursorWindow::create(String8("bench"), kWindowSize, &window) != OK) {
+    state.SkipWithError("failed to create CursorWindow");
+    return;
+  }
+
+  const uint32_t numRows = static_cast<uint32_t>(state.range(0));
+  while (state.KeepRunning()) {
+    window->clear();
+    window->setNumColumns(1);
+    for (uint32_t row = 0; row < numRows; row++) {
+      if (window->allocRow() != OK || window->putLong(row, 0, row) != OK) {
+        state.SkipWithError("window is full");
+        delete window;
+        return;
+      }
+    }
+
+    int64_t sum = 0;
+    for (uint32_t row = 0; row < numRows; row++) {
+      sum += window->getFieldSlotValueLong(window->getFieldSlot(row, 0));
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * numRows);
+  delete window;
+}
+BENCHMARK(BM_CursorWindowFillAndScanNarrowRows)->RangeMultiplier(10)->Range(1000, 100000);
+
+}  // namespace android
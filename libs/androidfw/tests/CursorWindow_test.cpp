@@ -0,0 +1,242 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "androidfw/CursorWindow.h"
+
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "binder/Parcel.h"
+#include "gtest/gtest.h"
+
+namespace android {
+
+static std::unique_ptr<CursorWindow> CreateWindow(size_t size, uint32_t numColumns) {
+  CursorWindow* window = nullptr;
+  if (CursorWindow::create(String8("test"), size, &window) != OK) {
+    return {};
+  }
+  std::unique_ptr<CursorWindow> result(window);
+  if (result->setNumColumns(numColumns) != OK) {
+    return {};
+  }
+  return result;
+}
+
+static void ExpectLong(CursorWindow* window, uint32_t row, uint32_t column, int64_t expected) {
+  CursorWindow::FieldSlot* slot = window->getFieldSlot(row, column);
+  ASSERT_NE(nullptr, slot) << "row " << row;
+  ASSERT_EQ(CursorWindow::FIELD_TYPE_INTEGER, window->getFieldSlotType(slot)) << "row " << row;
+  EXPECT_EQ(expected, window->getFieldSlotValueLong(slot)) << "row " << row;
+}
+
+TEST(CursorWindowTest, RowsSpanningManyChunksReadBack) {
+  std::unique_ptr<CursorWindow> window = CreateWindow(2 * 1024 * 1024, 2);
+  ASSERT_NE(nullptr, window);
+
+  const uint32_t kRows = 10000;
+  for (uint32_t row = 0; row < kRows; row++) {
+    ASSERT_EQ(OK, window->allocRow());
+    ASSERT_EQ(OK, window->putLong(row, 0, row));
+    ASSERT_EQ(OK, window->putString(row, 1, "abc", 4));
+  }
+  ASSERT_EQ(kRows, window->getNumRows());
+
+  // Read back out of order so the lookups cannot rely on sequential access.
+  for (uint32_t i = 0; i < kRows; i++) {
+    const uint32_t row = (i * 7919) % kRows;
+    ASSERT_NO_FATAL_FAILURE(ExpectLong(window.get(), row, 0, row));
+
+    CursorWindow::FieldSlot* slot = window->getFieldSlot(row, 1);
+    ASSERT_NE(nullptr, slot);
+    size_t size;
+    EXPECT_STREQ("abc", window->getFieldSlotValueString(slot, &size));
+    EXPECT_EQ(4u, size);
+  }
+  EXPECT_EQ(nullptr, window->getFieldSlot(kRows, 0));
+}
+
+TEST(CursorWindowTest, FreedRowsAcrossChunkBoundaryAreReallocated) {
+  std::unique_ptr<CursorWindow> window = CreateWindow(1024 * 1024, 1);
+  ASSERT_NE(nullptr, window);
+
+  for (uint32_t row = 0; row < 350; row++) {
+    ASSERT_EQ(OK, window->allocRow());
+    ASSERT_EQ(OK, window->putLong(row, 0, row));
+  }
+
+  // Drop back past two chunk boundaries and grow again with different values.
+  for (uint32_t i = 0; i < 160; i++) {
+    ASSERT_EQ(OK, window->freeLastRow());
+  }
+  ASSERT_EQ(190u, window->getNumRows());
+  for (uint32_t row = 190; row < 420; row++) {
+    ASSERT_EQ(OK, window->allocRow());
+    ASSERT_EQ(OK, window->putLong(row, 0, row * 2));
+  }
+
+  ASSERT_EQ(420u, window->getNumRows());
+  for (uint32_t row = 0; row < 420; row++) {
+    ASSERT_NO_FATAL_FAILURE(ExpectLong(window.get(), row, 0, row < 190 ? row : row * 2));
+  }
+}
+
+TEST(CursorWindowTest, ClearForgetsPreviousRows) {
+  std::unique_ptr<CursorWindow> window = CreateWindow(1024 * 1024, 1);
+  ASSERT_NE(nullptr, window);
+
+  for (uint32_t row = 0; row < 500; row++) {
+    ASSERT_EQ(OK, window->allocRow());
+    ASSERT_EQ(OK, window->putLong(row, 0, row));
+  }
+
+  ASSERT_EQ(OK, window->clear());
+  ASSERT_EQ(OK, window->setNumColumns(1));
+  EXPECT_EQ(nullptr, window->getFieldSlot(0, 0));
+
+  for (uint32_t row = 0; row < 300; row++) {
+    ASSERT_EQ(OK, window->allocRow());
+    ASSERT_EQ(OK, window->putLong(row, 0, -static_cast<int64_t>(row)));
+  }
+  for (uint32_t row = 0; row < 300; row++) {
+    ASSERT_NO_FATAL_FAILURE(ExpectLong(window.get(), row, 0, -static_cast<int64_t>(row)));
+  }
+}
+
+TEST(CursorWindowTest, WindowFromParcelReadsAllChunks) {
+  std::unique_ptr<CursorWindow> window = CreateWindow(1024 * 1024, 1);
+  ASSERT_NE(nullptr, window);
+  for (uint32_t row = 0; row < 450; row++) {
+    ASSERT_EQ(OK, window->allocRow());
+    ASSERT_EQ(OK, window->putLong(row, 0, row));
+  }
+
+  Parcel parcel;
+  ASSERT_EQ(OK, window->writeToParcel(&parcel));
+  parcel.setDataPosition(0);
+  CursorWindow* received = nullptr;
+  ASSERT_EQ(OK, CursorWindow::createFromParcel(&parcel, &received));
+  std::unique_ptr<CursorWindow> copy(received);
+
+  ASSERT_EQ(450u, copy->getNumRows());
+  for (uint32_t row = 0; row < 450; row++) {
+    ASSERT_NO_FATAL_FAILURE(ExpectLong(copy.get(), row, 0, row));
+  }
+  EXPECT_EQ(nullptr, copy->getFieldSlot(450, 0));
+}
+
+TEST(CursorWindowTest, ConcurrentReadersSeeAllRows) {
+  std::unique_ptr<CursorWindow> window = CreateWindow(1024 * 1024, 1);
+  ASSERT_NE(nullptr, window);
+  const uint32_t kRows = 1000;
+  for (uint32_t row = 0; row < kRows; row++) {
+    ASSERT_EQ(OK, window->allocRow());
+    ASSERT_EQ(OK, window->putLong(row, 0, row));
+  }
+
+  // Lookups do not modify the window, so readers need no lock between them.
+  std::vector<std::thread> readers;
+  std::vector<int> mismatches(4, 0);
+  for (size_t i = 0; i < mismatches.size(); i++) {
+    readers.emplace_back([&window, &mismatches, i]() {
+      for (uint32_t n = 0; n < kRows; n++) {
+        const uint32_t row = (kRows - 1 - n + i * 251) % kRows;
+        CursorWindow::FieldSlot* slot = window->getFieldSlot(row, 0);
+        if (!slot || window->getFieldSlotValueLong(slot) != row) {
+          mismatches[i]++;
+        }
+      }
+    });
+  }
+  for (std::thread& reader : readers) {
+    reader.join();
+  }
+  for (int count : mismatches) {
+    EXPECT_EQ(0, count);
+  }
+}
+
+TEST(CursorWindowTest, AppendRowMatchesFieldByFieldPuts) {
+  std::unique_ptr<CursorWindow> appended = CreateWindow(64 * 1024, 5);
+  std::unique_ptr<CursorWindow> put = CreateWindow(64 * 1024, 5);
+  ASSERT_NE(nullptr, appended);
+  ASSERT_NE(nullptr, put);
+
+  const char kBlob[] = {1, 2, 3};
+  CursorWindow::FieldValue values[5];
+  values[0].type = CursorWindow::FIELD_TYPE_NULL;
+  values[1].type = CursorWindow::FIELD_TYPE_INTEGER;
+  values[1].data.l = -42;
+  values[2].type = CursorWindow::FIELD_TYPE_FLOAT;
+  values[2].data.d = 0.5;
+  values[3].type = CursorWindow::FIELD_TYPE_STRING;
+  values[3].data.buffer.value = "hello";
+  values[3].data.buffer.size = 6;
+  values[4].type = CursorWindow::FIELD_TYPE_BLOB;
+  values[4].data.buffer.value = kBlob;
+  values[4].data.buffer.size = sizeof(kBlob);
+
+  for (uint32_t row = 0; row < 250; row++) {
+    ASSERT_EQ(OK, appended->appendRow(values));
+
+    ASSERT_EQ(OK, put->allocRow());
+    ASSERT_EQ(OK, put->putNull(row, 0));
+    ASSERT_EQ(OK, put->putLong(row, 1, -42));
+    ASSERT_EQ(OK, put->putDouble(row, 2, 0.5));
+    ASSERT_EQ(OK, put->putString(row, 3, "hello", 6));
+    ASSERT_EQ(OK, put->putBlob(row, 4, kBlob, sizeof(kBlob)));
+  }
+
+  // Both paths lay out the same bytes.
+  ASSERT_EQ(put->freeSpace(), appended->freeSpace());
+  ASSERT_EQ(put->getNumRows(), appended->getNumRows());
+  for (uint32_t row = 0; row < 250; row++) {
+    for (uint32_t column = 0; column < 5; column++) {
+      CursorWindow::FieldSlot* expected = put->getFieldSlot(row, column);
+      CursorWindow::FieldSlot* actual = appended->getFieldSlot(row, column);
+      ASSERT_NE(nullptr, actual);
+      EXPECT_EQ(0, memcmp(expected, actual, sizeof(CursorWindow::FieldSlot)))
+          << "row " << row << ", column " << column;
+    }
+  }
+
+  size_t size;
+  CursorWindow::FieldSlot* slot = appended->getFieldSlot(249, 3);
+  EXPECT_STREQ("hello", appended->getFieldSlotValueString(slot, &size));
+}
+
+TEST(CursorWindowTest, AppendRowThatDoesNotFitAddsNoRow) {
+  std::unique_ptr<CursorWindow> window = CreateWindow(4096, 1);
+  ASSERT_NE(nullptr, window);
+
+  const std::string big(8192, 'x');
+  CursorWindow::FieldValue value;
+  value.type = CursorWindow::FIELD_TYPE_STRING;
+  value.data.buffer.value = big.c_str();
+  value.data.buffer.size = big.size() + 1;
+  EXPECT_EQ(NO_MEMORY, window->appendRow(&value));
+  EXPECT_EQ(0u, window->getNumRows());
+
+  value.type = CursorWindow::FIELD_TYPE_INTEGER;
+  value.data.l = 7;
+  ASSERT_EQ(OK, window->appendRow(&value));
+  ASSERT_NO_FATAL_FAILURE(ExpectLong(window.get(), 0, 0, 7));
+}
+
+}  // namespace android
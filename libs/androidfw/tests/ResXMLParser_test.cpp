@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "androidfw/ResourceTypes.h"
+
+#include <algorithm>
+
+#include "utils/ByteOrder.h"
+
+#include "TestHelpers.h"
+#include "data/styles/R.h"
+
+using com::android::app::R;
+
+namespace android {
+
+class ResXMLParserTest : public ::testing::Test {
+ public:
+  void SetUp() override {
+    ASSERT_TRUE(ReadFileFromZipToString(GetTestDataPath() + "/styles/styles.apk",
+                                        "res/layout/layout.xml", &contents_));
+  }
+
+ protected:
+  // Reverses the resource ID map of the compiled XML in contents_, so that the IDs of the
+  // attributes are no longer in ascending order, as happens when a shared library's package
+  // ID is remapped at runtime.
+  void ReverseResourceMap() {
+    char* data = &contents_[0];
+    const ResChunk_header* root = reinterpret_cast<const ResChunk_header*>(data);
+    size_t offset = dtohs(root->headerSize);
+    while (offset + sizeof(ResChunk_header) <= contents_.size()) {
+      const ResChunk_header* chunk = reinterpret_cast<const ResChunk_header*>(data + offset);
+      if (dtohs(chunk->type) == RES_XML_RESOURCE_MAP_TYPE) {
+        uint32_t* ids = reinterpret_cast<uint32_t*>(data + offset + dtohs(chunk->headerSize));
+        const size_t count = (dtohl(chunk->size) - dtohs(chunk->headerSize)) / sizeof(uint32_t);
+        std::reverse(ids, ids + count);
+        return;
+      }
+      offset += dtohl(chunk->size);
+    }
+    FAIL() << "no resource map in compiled XML";
+  }
+
+  void SetToFirstTag(ResXMLTree* tree) {
+    ASSERT_EQ(NO_ERROR, tree->setTo(contents_.data(), contents_.size(), true /*copyData*/));
+    while (tree->next() != ResXMLParser::START_TAG) {
+      ASSERT_NE(ResXMLParser::BAD_DOCUMENT, tree->getEventType());
+      ASSERT_NE(ResXMLParser::END_DOCUMENT, tree->getEventType());
+    }
+  }
+
+  std::string contents_;
+};
+
+TEST_F(ResXMLParserTest, IndexOfAttributeByResourceId) {
+  ResXMLTree tree;
+  SetToFirstTag(&tree);
+
+  ASSERT_EQ(3u, tree.getAttributeCount());
+  EXPECT_EQ(R::attr::attr_one, tree.getAttributeNameResID(0));
+  EXPECT_EQ(R::attr::attr_three, tree.getAttributeNameResID(1));
+  EXPECT_EQ(R::attr::attr_four, tree.getAttributeNameResID(2));
+
+  EXPECT_EQ(0, tree.indexOfAttribute(R::attr::attr_one));
+  EXPECT_EQ(1, tree.indexOfAttribute(R::attr::attr_three));
+  EXPECT_EQ(2, tree.indexOfAttribute(R::attr::attr_four));
+
+  EXPECT_EQ(NAME_NOT_FOUND, tree.indexOfAttribute(R::attr::attr_two));
+  EXPECT_EQ(NAME_NOT_FOUND, tree.indexOfAttribute(0u));
+}
+
+TEST_F(ResXMLParserTest, IndexOfAttributeByResourceIdOutOfOrder) {
+  ReverseResourceMap();
+
+  ResXMLTree tree;
+  SetToFirstTag(&tree);
+
+  ASSERT_EQ(3u, tree.getAttributeCount());
+  EXPECT_EQ(R::attr::attr_four, tree.getAttributeNameResID(0));
+  EXPECT_EQ(R::attr::attr_three, tree.getAttributeNameResID(1));
+  EXPECT_EQ(R::attr::attr_one, tree.getAttributeNameResID(2));
+
+  EXPECT_EQ(0, tree.indexOfAttribute(R::attr::attr_four));
+  EXPECT_EQ(1, tree.indexOfAttribute(R::attr::attr_three));
+  EXPECT_EQ(2, tree.indexOfAttribute(R::attr::attr_one));
+
+  EXPECT_EQ(NAME_NOT_FOUND, tree.indexOfAttribute(R::attr::attr_two));
+  EXPECT_EQ(NAME_NOT_FOUND, tree.indexOfAttribute(0u));
+}
+
+TEST_F(ResXMLParserTest, IndexOfAttributeByResourceIdIsResetPerElement) {
+  ResXMLTree tree;
+  SetToFirstTag(&tree);
+  ASSERT_EQ(0, tree.indexOfAttribute(R::attr::attr_one));
+
+  // Past the element, its attributes are no longer found.
+  ASSERT_EQ(ResXMLParser::END_TAG, tree.next());
+  EXPECT_EQ(NAME_NOT_FOUND, tree.indexOfAttribute(R::attr::attr_one));
+
+  tree.restart();
+  while (tree.next() != ResXMLParser::START_TAG) {
+    ASSERT_NE(ResXMLParser::END_DOCUMENT, tree.getEventType());
+  }
+  EXPECT_EQ(0, tree.indexOfAttribute(R::attr::attr_one));
+}
+
+}  // namespace android
@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <zlib.h>
+
+#include <string>
+#include <vector>
+
+#include "android-base/file.h"
+#include "android-base/test_utils.h"
+#include "benchmark/benchmark.h"
+
+#include "androidfw/StreamingZipInflater.h"
+
+namespace android {
+
+// Size of the uncompressed asset, large enough to hold several checkpoints.
+constexpr const static size_t kAssetSize = 8 * 1024 * 1024;
+
+// A raw-deflated asset written to a temporary file, as it would sit inside an APK.
+struct CompressedAsset {
+  CompressedAsset() {
+    std::string data(kAssetSize, '\0');
+    uint32_t seed = 1;
+    for (size_t i = 0; i < data.size(); i++) {
+      seed = seed * 1103515245u + 12345u;
+      data[i] = static_cast<char>('a' + (seed >> 16) % 16);
+    }
+
+    z_stream stream = {};
+    deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+    std::string compressed(deflateBound(&stream, data.size()), '\0');
+    stream.next_in = reinterpret_cast<Bytef*>(&data[0]);
+    stream.avail_in = data.size();
+    stream.next_out = reinterpret_cast<Bytef*>(&compressed[0]);
+    stream.avail_out = compressed.size();
+    deflate(&stream, Z_FINISH);
+    compressed.resize(stream.total_out);
+    deflateEnd(&stream);
+
+    compressed_size = compressed.size();
+    android::base::WriteStringToFd(compressed, file.fd);
+  }
+
+  TemporaryFile file;
+  size_t compressed_size;
+};
+
+static CompressedAsset* GetAsset() {
+  static CompressedAsset* asset = new CompressedAsset();
+  return asset;
+}
+
+// Opens the asset and streams all of it through a buffer of state.range(0) bytes.
+static void BM_StreamingZipInflaterSequentialRead(benchmark::State& state) {
+  CompressedAsset* asset = GetAsset();
+  std::vector<char> buf(state.range(0));
+  while (state.KeepRunning()) {
+    StreamingZipInflater inflater(asset->file.fd, 0, kAssetSize, asset->compressed_size);
+    ssize_t result;
+    while ((result = inflater.read(buf.data(), buf.size())) > 0) {
+      benchmark::DoNotOptimize(buf.data());
+    }
+    if (result < 0) {
+      state.SkipWithError("read failed");
+      return;
+    }
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * kAssetSize);
+}
+BENCHMARK(BM_StreamingZipInflaterSequentialRead)->Arg(4096)->Arg(64 * 1024);
+
+// Reads 4K from pseudo-random offsets of an asset that has already been read once,
+// the access pattern of a font or a database shipped compressed.
+static void BM_StreamingZipInflaterRandomRead(benchmark::State& state) {
+  CompressedAsset* asset = GetAsset();
+  StreamingZipInflater inflater(asset->file.fd, 0, kAssetSize, asset->compressed_size);
+  if (inflater.read(nullptr, kAssetSize) != static_cast<ssize_t>(kAssetSize)) {
+    state.SkipWithError("read failed");
+    return;
+  }
+
+  char buf[4096];
+  uint32_t seed = 7;
+  while (state.KeepRunning()) {
+    seed = seed * 1103515245u + 12345u;
+    const off64_t offset = (seed >> 4) % (kAssetSize - sizeof(buf));
+    if (inflater.seekAbsolute(offset) != offset ||
+        inflater.read(buf, sizeof(buf)) != static_cast<ssize_t>(sizeof(buf))) {
+      state.SkipWithError("seek failed");
+      return;
+    }
+    benchmark::DoNotOptimize(buf);
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * sizeof(buf));
+}
+BENCHMARK(BM_StreamingZipInflaterRandomRead);
+
+}  // namespace android
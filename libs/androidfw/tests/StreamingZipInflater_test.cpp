@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "androidfw/StreamingZipInflater.h"
+
+#include <fcntl.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "android-base/file.h"
+#include "android-base/test_utils.h"
+#include "android-base/unique_fd.h"
+#include "gtest/gtest.h"
+
+namespace android {
+
+// Text-like data that compresses into many deflate blocks.
+static std::string MakeData(size_t size) {
+  static const char* const kWords[] = {"asset ", "inflate ", "window ", "chunk ",
+                                       "stream ", "font ",    "glyph ",  "\n"};
+  std::string data;
+  data.reserve(size);
+  uint32_t seed = 0x2545f491u;
+  while (data.size() < size) {
+    seed = seed * 1664525u + 1013904223u;
+    data.append(kWords[seed >> 29]);
+    data.push_back(static_cast<char>('a' + (seed >> 8) % 26));
+  }
+  data.resize(size);
+  return data;
+}
+
+// Compresses `data` the way zip stores it: raw deflate, no zlib header.
+static std::string Deflate(const std::string& data) {
+  z_stream stream = {};
+  EXPECT_EQ(Z_OK, deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8,
+                               Z_DEFAULT_STRATEGY));
+  std::string out(deflateBound(&stream, data.size()), '\0');
+  stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+  stream.avail_in = data.size();
+  stream.next_out = reinterpret_cast<Bytef*>(&out[0]);
+  stream.avail_out = out.size();
+  EXPECT_EQ(Z_STREAM_END, deflate(&stream, Z_FINISH));
+  out.resize(stream.total_out);
+  deflateEnd(&stream);
+  return out;
+}
+
+class StreamingZipInflaterTest : public ::testing::Test {
+ public:
+  void SetUp() override {
+    data_ = MakeData(5 * StreamingZipInflater::CHECKPOINT_INTERVAL + 12345);
+    compressed_ = Deflate(data_);
+
+    // Put the compressed data behind some padding, as it would be inside an APK.
+    ASSERT_TRUE(android::base::WriteStringToFd(std::string(kPadding, 'p') + compressed_,
+                                               file_.fd));
+  }
+
+ protected:
+  static constexpr size_t kPadding = 1000;
+
+  void ExpectRead(StreamingZipInflater* inflater, size_t offset, size_t size) {
+    std::vector<char> buf(size);
+    ASSERT_EQ(static_cast<ssize_t>(size), inflater->read(buf.data(), size));
+    EXPECT_EQ(0, memcmp(data_.data() + offset, buf.data(), size)) << "at " << offset;
+  }
+
+  std::string data_;
+  std::string compressed_;
+  TemporaryFile file_;
+};
+
+TEST_F(StreamingZipInflaterTest, SequentialRead) {
+  StreamingZipInflater inflater(file_.fd, kPadding, data_.size(), compressed_.size());
+  size_t offset = 0;
+  while (offset < data_.size()) {
+    const size_t size = std::min<size_t>(40000, data_.size() - offset);
+    ASSERT_NO_FATAL_FAILURE(ExpectRead(&inflater, offset, size));
+    offset += size;
+  }
+
+  char extra;
+  EXPECT_EQ(0, inflater.read(&extra, 1));
+}
+
+TEST_F(StreamingZipInflaterTest, SeekBackwardsAndForwards) {
+  StreamingZipInflater inflater(file_.fd, kPadding, data_.size(), compressed_.size());
+
+  // Read to the end once so checkpoints exist all the way through.
+  ASSERT_EQ(static_cast<ssize_t>(data_.size()), inflater.read(nullptr, data_.size()));
+
+  const size_t interval = StreamingZipInflater::CHECKPOINT_INTERVAL;
+  const size_t offsets[] = {0,
+                            17,
+                            3 * interval + 4321,
+                            interval,
+                            interval - 1,
+                            4 * interval + 99,
+                            2 * interval + 7,
+                            data_.size() - 100,
+                            5};
+  for (size_t offset : offsets) {
+    ASSERT_EQ(static_cast<off64_t>(offset), inflater.seekAbsolute(offset));
+    ASSERT_NO_FATAL_FAILURE(ExpectRead(&inflater, offset, 100));
+  }
+}
+
+TEST_F(StreamingZipInflaterTest, SeekBeyondDecodedData) {
+  StreamingZipInflater inflater(file_.fd, kPadding, data_.size(), compressed_.size());
+  const size_t offset = 3 * StreamingZipInflater::CHECKPOINT_INTERVAL + 1;
+  ASSERT_EQ(static_cast<off64_t>(offset), inflater.seekAbsolute(offset));
+  ASSERT_NO_FATAL_FAILURE(ExpectRead(&inflater, offset, 5000));
+
+  ASSERT_EQ(0, inflater.seekAbsolute(0));
+  ASSERT_NO_FATAL_FAILURE(ExpectRead(&inflater, 0, 5000));
+}
+
+TEST_F(StreamingZipInflaterTest, InflatersReuseStateCleanly) {
+  // Each inflater returns its state to the pool; the next must start from scratch.
+  for (int i = 0; i < 3; i++) {
+    StreamingZipInflater inflater(file_.fd, kPadding, data_.size(), compressed_.size());
+    ASSERT_NO_FATAL_FAILURE(ExpectRead(&inflater, 0, 70000));
+  }
+
+  // Two inflaters open at once must not share a context. The fd flavor owns the file
+  // position, so the second one gets its own descriptor.
+  android::base::unique_fd other_fd(open(file_.path, O_RDONLY));
+  ASSERT_NE(-1, other_fd.get());
+  StreamingZipInflater first(file_.fd, kPadding, data_.size(), compressed_.size());
+  StreamingZipInflater second(other_fd.get(), kPadding, data_.size(), compressed_.size());
+  ASSERT_NO_FATAL_FAILURE(ExpectRead(&first, 0, 70000));
+  ASSERT_NO_FATAL_FAILURE(ExpectRead(&second, 0, 70000));
+  ASSERT_NO_FATAL_FAILURE(ExpectRead(&first, 70000, 1000));
+}
+
+}  // namespace android
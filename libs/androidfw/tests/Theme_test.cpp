@@ -123,6 +123,28 @@ TEST_F(ThemeTest, SingleThemeWithParent) {
   EXPECT_EQ(static_cast<uint32_t>(ResTable_typeSpec::SPEC_PUBLIC), flags);
 }
 
+TEST_F(ThemeTest, AttributeSetToEmptyIsFound) {
+  AssetManager2 assetmanager;
+  assetmanager.SetApkAssets({style_assets_.get()});
+
+  std::unique_ptr<Theme> theme = assetmanager.NewTheme();
+  ASSERT_TRUE(theme->ApplyStyle(app::R::style::StyleTwo));
+
+  Res_value value;
+  uint32_t flags;
+
+  // @empty is an explicit value, unlike an attribute the theme does not define.
+  ApkAssetsCookie cookie = theme->GetAttribute(app::R::attr::attr_empty, &value, &flags);
+  ASSERT_NE(kInvalidCookie, cookie);
+  EXPECT_EQ(0, cookie);
+  EXPECT_EQ(Res_value::TYPE_NULL, value.dataType);
+  EXPECT_EQ(static_cast<uint32_t>(Res_value::DATA_NULL_EMPTY), value.data);
+  EXPECT_EQ(static_cast<uint32_t>(ResTable_typeSpec::SPEC_PUBLIC), flags);
+
+  // An attribute the theme does not set is still not found.
+  EXPECT_EQ(kInvalidCookie, theme->GetAttribute(app::R::attr::attr_six, &value, &flags));
+}
+
 TEST_F(ThemeTest, MultipleThemesOverlaidNotForce) {
   AssetManager2 assetmanager;
   assetmanager.SetApkAssets({style_assets_.get()});
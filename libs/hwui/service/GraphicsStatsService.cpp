@@ -19,34 +19,75 @@
 #include "JankTracker.h"
 
 #include <frameworks/base/core/proto/android/service/graphicsstats.pb.h>
+#include <google/protobuf/io/coded_stream.h>
 #include <google/protobuf/io/zero_copy_stream_impl_lite.h>
 #include <log/log.h>
 
 #include <errno.h>
 #include <fcntl.h>
 #include <inttypes.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/file.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 #include <sys/mman.h>
 
+#include <algorithm>
+
 namespace android {
 namespace uirenderer {
 
 using namespace google::protobuf;
 
-constexpr int32_t sCurrentFileVersion = 1;
+// Version 1 files hold a serialized GraphicsStatsProto after the header. They are still
+// read, and are converted to the current format the next time they are saved to.
+constexpr int32_t sProtoFileVersion = 1;
+constexpr int32_t sCurrentFileVersion = 2;
 constexpr int32_t sHeaderSize = 4;
 static_assert(sizeof(sCurrentFileVersion) == sHeaderSize, "Header size is wrong");
 
-constexpr int sHistogramSize =
-        std::tuple_size<decltype(ProfileData::frameCounts)>::value +
+constexpr int sFrameCountsSize = std::tuple_size<decltype(ProfileData::frameCounts)>::value;
+constexpr int sHistogramSize = sFrameCountsSize +
         std::tuple_size<decltype(ProfileData::slowFrameCounts)>::value;
 
-static void mergeProfileDataIntoProto(service::GraphicsStatsProto* proto,
-        const std::string& package, int versionCode, int64_t startTime, int64_t endTime,
+// Directory names are limited to 255 bytes, and the package name is one
+constexpr uint32_t sMaxPackageNameLength = 255;
+
+/*
+ * The contents of a stats file since version 2: a fixed size record, which saveBuffer()
+ * merges into in place with atomic adds through a shared mapping, and which dumps read
+ * directly. Neither has to parse or serialize a protobuf; that only happens when a dump
+ * is requested as one.
+ */
+struct StatsFileData {
+    int32_t fileVersion;
+    int32_t histogramSize;
+    int32_t versionCode;
+    uint32_t packageNameLength;
+    char packageName[sMaxPackageNameLength + 1];
+    int64_t statsStart;
+    int64_t statsEnd;
+    uint32_t totalFrames;
+    uint32_t jankyFrames;
+    uint32_t missedVsyncCount;
+    uint32_t highInputLatencyCount;
+    uint32_t slowUiThreadCount;
+    uint32_t slowBitmapUploadCount;
+    uint32_t slowDrawCount;
+    // Frame counts, in the order of ProfileData::frameCounts then slowFrameCounts
+    uint32_t histogram[sHistogramSize];
+};
+static_assert(offsetof(StatsFileData, fileVersion) == 0, "Version must be the header");
+static_assert(offsetof(StatsFileData, statsStart) % sizeof(int64_t) == 0,
+        "Timestamps must be aligned for atomic access");
+
+static void initStatsFileData(StatsFileData* stats, const std::string& package,
+        int versionCode);
+static void mergeProfileData(StatsFileData* stats, int64_t startTime, int64_t endTime,
         const ProfileData* data);
-static void dumpAsTextToFd(service::GraphicsStatsProto* proto, int outFd);
+static void dumpAsTextToFd(const StatsFileData& stats, int outFd);
 
 class FileDescriptor {
 public:
@@ -112,210 +153,347 @@ private:
     io::CopyingOutputStreamAdaptor mImpl;
 };
 
-bool GraphicsStatsService::parseFromFile(const std::string& path, service::GraphicsStatsProto* output) {
-
-    FileDescriptor fd{open(path.c_str(), O_RDONLY)};
-    if (!fd.valid()) {
+// Parses a version 1 file, the header followed by a serialized GraphicsStatsProto
+static bool parseProtoFile(int fd, const std::string& path, off_t size,
+        service::GraphicsStatsProto* output) {
+    void* addr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
         int err = errno;
-        // The file not existing is normal for addToDump(), so only log if
-        // we get an unexpected error
-        if (err != ENOENT) {
-            ALOGW("Failed to open '%s', errno=%d (%s)", path.c_str(), err, strerror(err));
-        }
+        ALOGW("Failed to mmap '%s', errno=%d (%s)", path.c_str(), err, strerror(err));
+        return false;
+    }
+    void* data = reinterpret_cast<uint8_t*>(addr) + sHeaderSize;
+    int dataSize = size - sHeaderSize;
+    io::ArrayInputStream input{data, dataSize};
+    bool success = output->ParseFromZeroCopyStream(&input);
+    if (!success) {
+        ALOGW("Parse failed on '%s' error='%s'",
+                path.c_str(), output->InitializationErrorString().c_str());
+    }
+    munmap(addr, size);
+    return success;
+}
+
+static bool protoToStatsFileData(const service::GraphicsStatsProto& proto,
+        StatsFileData* stats) {
+    if (proto.histogram_size() != sHistogramSize) {
+        ALOGW("Histogram size mismatch, proto is %d expected %d",
+                proto.histogram_size(), sHistogramSize);
         return false;
     }
+    if (proto.package_name().empty()) {
+        ALOGW("Missing package name in proto");
+        return false;
+    }
+    initStatsFileData(stats, proto.package_name(), proto.version_code());
+    stats->statsStart = proto.stats_start();
+    stats->statsEnd = proto.stats_end();
+    const auto& summary = proto.summary();
+    stats->totalFrames = summary.total_frames();
+    stats->jankyFrames = summary.janky_frames();
+    stats->missedVsyncCount = summary.missed_vsync_count();
+    stats->highInputLatencyCount = summary.high_input_latency_count();
+    stats->slowUiThreadCount = summary.slow_ui_thread_count();
+    stats->slowBitmapUploadCount = summary.slow_bitmap_upload_count();
+    stats->slowDrawCount = summary.slow_draw_count();
+    for (int i = 0; i < sHistogramSize; i++) {
+        stats->histogram[i] = proto.histogram(i).frame_count();
+    }
+    return true;
+}
+
+static int32_t frameTimeForHistogramIndex(int index) {
+    return index < sFrameCountsSize
+            ? JankTracker::frameTimeForFrameCountIndex(index)
+            : JankTracker::frameTimeForSlowFrameCountIndex(index - sFrameCountsSize);
+}
+
+static void statsFileDataToProto(const StatsFileData& stats,
+        service::GraphicsStatsProto* proto) {
+    proto->set_package_name(stats.packageName, stats.packageNameLength);
+    proto->set_version_code(stats.versionCode);
+    proto->set_stats_start(stats.statsStart);
+    proto->set_stats_end(stats.statsEnd);
+    auto summary = proto->mutable_summary();
+    summary->set_total_frames(stats.totalFrames);
+    summary->set_janky_frames(stats.jankyFrames);
+    summary->set_missed_vsync_count(stats.missedVsyncCount);
+    summary->set_high_input_latency_count(stats.highInputLatencyCount);
+    summary->set_slow_ui_thread_count(stats.slowUiThreadCount);
+    summary->set_slow_bitmap_upload_count(stats.slowBitmapUploadCount);
+    summary->set_slow_draw_count(stats.slowDrawCount);
+    proto->mutable_histogram()->Reserve(sHistogramSize);
+    for (int i = 0; i < sHistogramSize; i++) {
+        auto bucket = proto->add_histogram();
+        bucket->set_render_millis(frameTimeForHistogramIndex(i));
+        bucket->set_frame_count(stats.histogram[i]);
+    }
+}
+
+/*
+ * Reads the stats file open on fd into output, converting it if it is in the protobuf
+ * format. Returns the version the file was in, or 0 if it is empty or unreadable.
+ */
+static int32_t readStatsFile(int fd, const std::string& path, StatsFileData* output) {
     struct stat sb;
-    if (fstat(fd, &sb) || sb.st_size < sHeaderSize) {
+    if (fstat(fd, &sb)) {
         int err = errno;
-        // The file not existing is normal for addToDump(), so only log if
-        // we get an unexpected error
-        if (err != ENOENT) {
-            ALOGW("Failed to fstat '%s', errno=%d (%s) (st_size %d)", path.c_str(), err,
-                    strerror(err), (int) sb.st_size);
+        ALOGW("Failed to fstat '%s', errno=%d (%s)", path.c_str(), err, strerror(err));
+        return 0;
+    }
+    if (sb.st_size < sHeaderSize) {
+        // Freshly created by saveBuffer()
+        return 0;
+    }
+    int32_t fileVersion;
+    if (TEMP_FAILURE_RETRY(pread(fd, &fileVersion, sHeaderSize, 0)) != sHeaderSize) {
+        int err = errno;
+        ALOGW("Failed to read header from '%s', errno=%d (%s)", path.c_str(), err,
+                strerror(err));
+        return 0;
+    }
+    if (fileVersion == sProtoFileVersion) {
+        service::GraphicsStatsProto proto;
+        if (!parseProtoFile(fd, path, sb.st_size, &proto)
+                || !protoToStatsFileData(proto, output)) {
+            return 0;
         }
-        return false;
+        return sProtoFileVersion;
+    }
+    if (fileVersion != sCurrentFileVersion) {
+        ALOGW("file_version mismatch! expected %d got %d", sCurrentFileVersion, fileVersion);
+        return 0;
+    }
+    if (sb.st_size != sizeof(StatsFileData)
+            || TEMP_FAILURE_RETRY(pread(fd, output, sizeof(StatsFileData), 0))
+                    != sizeof(StatsFileData)) {
+        ALOGW("Failed to read '%s', size %d expected %zu", path.c_str(), (int) sb.st_size,
+                sizeof(StatsFileData));
+        return 0;
+    }
+    if (output->histogramSize != sHistogramSize
+            || output->packageNameLength == 0
+            || output->packageNameLength > sMaxPackageNameLength) {
+        ALOGW("Corrupt stats file '%s', histogram size %d, package name length %u",
+                path.c_str(), output->histogramSize, output->packageNameLength);
+        return 0;
     }
-    void* addr = mmap(nullptr, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
-    if (!addr) {
+    return sCurrentFileVersion;
+}
+
+// Reads the stats file at path. It not existing is normal for addToDump(), so that is not
+// logged. The shared lock keeps mapStatsFile() from truncating and rewriting the file
+// while it is read.
+static bool readStatsFile(const std::string& path, StatsFileData* output) {
+    FileDescriptor fd{open(path.c_str(), O_RDONLY | O_CLOEXEC)};
+    if (!fd.valid()) {
         int err = errno;
-        // The file not existing is normal for addToDump(), so only log if
-        // we get an unexpected error
         if (err != ENOENT) {
-            ALOGW("Failed to mmap '%s', errno=%d (%s)", path.c_str(), err, strerror(err));
+            ALOGW("Failed to open '%s', errno=%d (%s)", path.c_str(), err, strerror(err));
         }
         return false;
     }
-    uint32_t file_version = *reinterpret_cast<uint32_t*>(addr);
-    if (file_version != sCurrentFileVersion) {
-        ALOGW("file_version mismatch! expected %d got %d", sCurrentFileVersion, file_version);
+    if (flock(fd, LOCK_SH)) {
+        int err = errno;
+        ALOGW("Failed to lock '%s', errno=%d (%s)", path.c_str(), err, strerror(err));
         return false;
     }
-
-    void* data = reinterpret_cast<uint8_t*>(addr) + sHeaderSize;
-    int dataSize = sb.st_size - sHeaderSize;
-    io::ArrayInputStream input{data, dataSize};
-    bool success = output->ParseFromZeroCopyStream(&input);
-    if (!success) {
-        ALOGW("Parse failed on '%s' error='%s'",
-                path.c_str(), output->InitializationErrorString().c_str());
-    }
+    bool success = readStatsFile(fd, path, output) != 0;
+    flock(fd, LOCK_UN);
     return success;
 }
 
-void mergeProfileDataIntoProto(service::GraphicsStatsProto* proto, const std::string& package,
-        int versionCode, int64_t startTime, int64_t endTime, const ProfileData* data) {
-    if (proto->stats_start() == 0 || proto->stats_start() > startTime) {
-        proto->set_stats_start(startTime);
-    }
-    if (proto->stats_end() == 0 || proto->stats_end() < endTime) {
-        proto->set_stats_end(endTime);
-    }
-    proto->set_package_name(package);
-    proto->set_version_code(versionCode);
-    auto summary = proto->mutable_summary();
-    summary->set_total_frames(summary->total_frames() + data->totalFrameCount);
-    summary->set_janky_frames(summary->janky_frames() + data->jankFrameCount);
-    summary->set_missed_vsync_count(
-            summary->missed_vsync_count() + data->jankTypeCounts[kMissedVsync]);
-    summary->set_high_input_latency_count(
-            summary->high_input_latency_count() + data->jankTypeCounts[kHighInputLatency]);
-    summary->set_slow_ui_thread_count(
-            summary->slow_ui_thread_count() + data->jankTypeCounts[kSlowUI]);
-    summary->set_slow_bitmap_upload_count(
-            summary->slow_bitmap_upload_count() + data->jankTypeCounts[kSlowSync]);
-    summary->set_slow_draw_count(
-            summary->slow_draw_count() + data->jankTypeCounts[kSlowRT]);
-
-    bool creatingHistogram = false;
-    if (proto->histogram_size() == 0) {
-        proto->mutable_histogram()->Reserve(sHistogramSize);
-        creatingHistogram = true;
-    } else if (proto->histogram_size() != sHistogramSize) {
-        LOG_ALWAYS_FATAL("Histogram size mismatch, proto is %d expected %d",
-                proto->histogram_size(), sHistogramSize);
+bool GraphicsStatsService::parseFromFile(const std::string& path, service::GraphicsStatsProto* output) {
+    StatsFileData stats;
+    if (!readStatsFile(path, &stats)) {
+        return false;
     }
+    statsFileDataToProto(stats, output);
+    return true;
+}
+
+void initStatsFileData(StatsFileData* stats, const std::string& package, int versionCode) {
+    memset(stats, 0, sizeof(StatsFileData));
+    stats->fileVersion = sCurrentFileVersion;
+    stats->histogramSize = sHistogramSize;
+    stats->versionCode = versionCode;
+    stats->packageNameLength = std::min<size_t>(package.size(), sMaxPackageNameLength);
+    memcpy(stats->packageName, package.data(), stats->packageNameLength);
+}
+
+template <typename T>
+static void atomicAdd(T* field, T value) {
+    __atomic_fetch_add(field, value, __ATOMIC_RELAXED);
+}
+
+// 0 means unset for both timestamps, as it did in the proto
+static void atomicSetStart(int64_t* field, int64_t value) {
+    int64_t current = __atomic_load_n(field, __ATOMIC_RELAXED);
+    while ((current == 0 || current > value) && !__atomic_compare_exchange_n(field,
+            &current, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {}
+}
+
+static void atomicSetEnd(int64_t* field, int64_t value) {
+    int64_t current = __atomic_load_n(field, __ATOMIC_RELAXED);
+    while ((current == 0 || current < value) && !__atomic_compare_exchange_n(field,
+            &current, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {}
+}
+
+void mergeProfileData(StatsFileData* stats, int64_t startTime, int64_t endTime,
+        const ProfileData* data) {
+    atomicSetStart(&stats->statsStart, startTime);
+    atomicSetEnd(&stats->statsEnd, endTime);
+    atomicAdd(&stats->totalFrames, data->totalFrameCount);
+    atomicAdd(&stats->jankyFrames, data->jankFrameCount);
+    atomicAdd(&stats->missedVsyncCount, data->jankTypeCounts[kMissedVsync]);
+    atomicAdd(&stats->highInputLatencyCount, data->jankTypeCounts[kHighInputLatency]);
+    atomicAdd(&stats->slowUiThreadCount, data->jankTypeCounts[kSlowUI]);
+    atomicAdd(&stats->slowBitmapUploadCount, data->jankTypeCounts[kSlowSync]);
+    atomicAdd(&stats->slowDrawCount, data->jankTypeCounts[kSlowRT]);
     for (size_t i = 0; i < data->frameCounts.size(); i++) {
-        service::GraphicsStatsHistogramBucketProto* bucket;
-        int32_t renderTime = JankTracker::frameTimeForFrameCountIndex(i);
-        if (creatingHistogram) {
-            bucket = proto->add_histogram();
-            bucket->set_render_millis(renderTime);
-        } else {
-            bucket = proto->mutable_histogram(i);
-            LOG_ALWAYS_FATAL_IF(bucket->render_millis() != renderTime,
-                    "Frame time mistmatch %d vs. %d", bucket->render_millis(), renderTime);
-        }
-        bucket->set_frame_count(bucket->frame_count() + data->frameCounts[i]);
+        atomicAdd(&stats->histogram[i], data->frameCounts[i]);
     }
     for (size_t i = 0; i < data->slowFrameCounts.size(); i++) {
-        service::GraphicsStatsHistogramBucketProto* bucket;
-        int32_t renderTime = JankTracker::frameTimeForSlowFrameCountIndex(i);
-        if (creatingHistogram) {
-            bucket = proto->add_histogram();
-            bucket->set_render_millis(renderTime);
-        } else {
-            constexpr int offset = std::tuple_size<decltype(ProfileData::frameCounts)>::value;
-            bucket = proto->mutable_histogram(offset + i);
-            LOG_ALWAYS_FATAL_IF(bucket->render_millis() != renderTime,
-                    "Frame time mistmatch %d vs. %d", bucket->render_millis(), renderTime);
-        }
-        bucket->set_frame_count(bucket->frame_count() + data->slowFrameCounts[i]);
+        atomicAdd(&stats->histogram[sFrameCountsSize + i],
+                static_cast<uint32_t>(data->slowFrameCounts[i]));
     }
 }
 
-static int32_t findPercentile(service::GraphicsStatsProto* proto, int percentile) {
-    int32_t pos = percentile * proto->summary().total_frames() / 100;
-    int32_t remaining = proto->summary().total_frames() - pos;
-    for (auto it = proto->histogram().rbegin(); it != proto->histogram().rend(); ++it) {
-        remaining -= it->frame_count();
+static int32_t findPercentile(const StatsFileData& stats, int percentile) {
+    int32_t totalFrames = stats.totalFrames;
+    int32_t pos = percentile * totalFrames / 100;
+    int32_t remaining = totalFrames - pos;
+    for (int i = sHistogramSize - 1; i >= 0; i--) {
+        remaining -= stats.histogram[i];
         if (remaining <= 0) {
-            return it->render_millis();
+            return frameTimeForHistogramIndex(i);
         }
     }
     return 0;
 }
 
-void dumpAsTextToFd(service::GraphicsStatsProto* proto, int fd) {
-    // This isn't a full validation, just enough that we can deref at will
-    LOG_ALWAYS_FATAL_IF(proto->package_name().empty()
-            || !proto->has_summary(), "package_name() '%s' summary %d",
-            proto->package_name().c_str(), proto->has_summary());
-    dprintf(fd, "\nPackage: %s", proto->package_name().c_str());
-    dprintf(fd, "\nVersion: %d", proto->version_code());
-    dprintf(fd, "\nStats since: %lldns", proto->stats_start());
-    dprintf(fd, "\nStats end: %lldns", proto->stats_end());
-    auto summary = proto->summary();
-    dprintf(fd, "\nTotal frames rendered: %d", summary.total_frames());
-    dprintf(fd, "\nJanky frames: %d (%.2f%%)", summary.janky_frames(),
-            (float) summary.janky_frames() / (float) summary.total_frames() * 100.0f);
-    dprintf(fd, "\n50th percentile: %dms", findPercentile(proto, 50));
-    dprintf(fd, "\n90th percentile: %dms", findPercentile(proto, 90));
-    dprintf(fd, "\n95th percentile: %dms", findPercentile(proto, 95));
-    dprintf(fd, "\n99th percentile: %dms", findPercentile(proto, 99));
-    dprintf(fd, "\nNumber Missed Vsync: %d", summary.missed_vsync_count());
-    dprintf(fd, "\nNumber High input latency: %d", summary.high_input_latency_count());
-    dprintf(fd, "\nNumber Slow UI thread: %d", summary.slow_ui_thread_count());
-    dprintf(fd, "\nNumber Slow bitmap uploads: %d", summary.slow_bitmap_upload_count());
-    dprintf(fd, "\nNumber Slow issue draw commands: %d", summary.slow_draw_count());
+void dumpAsTextToFd(const StatsFileData& stats, int fd) {
+    LOG_ALWAYS_FATAL_IF(stats.packageNameLength == 0, "package name is empty");
+    dprintf(fd, "\nPackage: %.*s", (int) stats.packageNameLength, stats.packageName);
+    dprintf(fd, "\nVersion: %d", stats.versionCode);
+    dprintf(fd, "\nStats since: %" PRId64 "ns", stats.statsStart);
+    dprintf(fd, "\nStats end: %" PRId64 "ns", stats.statsEnd);
+    int32_t totalFrames = stats.totalFrames;
+    int32_t jankyFrames = stats.jankyFrames;
+    dprintf(fd, "\nTotal frames rendered: %d", totalFrames);
+    dprintf(fd, "\nJanky frames: %d (%.2f%%)", jankyFrames,
+            (float) jankyFrames / (float) totalFrames * 100.0f);
+    dprintf(fd, "\n50th percentile: %dms", findPercentile(stats, 50));
+    dprintf(fd, "\n90th percentile: %dms", findPercentile(stats, 90));
+    dprintf(fd, "\n95th percentile: %dms", findPercentile(stats, 95));
+    dprintf(fd, "\n99th percentile: %dms", findPercentile(stats, 99));
+    dprintf(fd, "\nNumber Missed Vsync: %d", (int32_t) stats.missedVsyncCount);
+    dprintf(fd, "\nNumber High input latency: %d", (int32_t) stats.highInputLatencyCount);
+    dprintf(fd, "\nNumber Slow UI thread: %d", (int32_t) stats.slowUiThreadCount);
+    dprintf(fd, "\nNumber Slow bitmap uploads: %d", (int32_t) stats.slowBitmapUploadCount);
+    dprintf(fd, "\nNumber Slow issue draw commands: %d", (int32_t) stats.slowDrawCount);
     dprintf(fd, "\nHISTOGRAM:");
-    for (const auto& it : proto->histogram()) {
-        dprintf(fd, " %dms=%d", it.render_millis(), it.frame_count());
+    for (int i = 0; i < sHistogramSize; i++) {
+        dprintf(fd, " %dms=%d", frameTimeForHistogramIndex(i), (int32_t) stats.histogram[i]);
     }
     dprintf(fd, "\n");
 }
 
+/*
+ * Maps the stats file open on fd for merging into. A file that is new, unreadable, or in
+ * the protobuf format is first rewritten as a fresh record, under an exclusive lock so
+ * that a concurrent save cannot map it halfway through. After that the record is never
+ * rewritten, only added to.
+ */
+static StatsFileData* mapStatsFile(int fd, const std::string& path, const std::string& package,
+        int versionCode) {
+    if (flock(fd, LOCK_EX)) {
+        int err = errno;
+        ALOGW("Failed to lock '%s', errno=%d (%s)", path.c_str(), err, strerror(err));
+        return nullptr;
+    }
+    StatsFileData initial;
+    int32_t fileVersion = readStatsFile(fd, path, &initial);
+    bool success = true;
+    if (fileVersion != sCurrentFileVersion) {
+        if (fileVersion == 0) {
+            initStatsFileData(&initial, package, versionCode);
+        }
+        success = ftruncate(fd, 0) == 0
+                && TEMP_FAILURE_RETRY(pwrite(fd, &initial, sizeof(StatsFileData), 0))
+                        == sizeof(StatsFileData);
+        if (!success) {
+            int err = errno;
+            ALOGW("Failed to write '%s', errno=%d (%s)", path.c_str(), err, strerror(err));
+        }
+    }
+    flock(fd, LOCK_UN);
+    if (!success) {
+        return nullptr;
+    }
+    void* addr = mmap(nullptr, sizeof(StatsFileData), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        int err = errno;
+        ALOGW("Failed to mmap '%s', errno=%d (%s)", path.c_str(), err, strerror(err));
+        return nullptr;
+    }
+    return reinterpret_cast<StatsFileData*>(addr);
+}
+
 void GraphicsStatsService::saveBuffer(const std::string& path, const std::string& package,
         int versionCode, int64_t startTime, int64_t endTime, const ProfileData* data) {
-    service::GraphicsStatsProto statsProto;
-    if (!parseFromFile(path, &statsProto)) {
-        statsProto.Clear();
-    }
-    mergeProfileDataIntoProto(&statsProto, package, versionCode, startTime, endTime, data);
-    // Although we might not have read any data from the file, merging the existing data
-    // should always fully-initialize the proto
-    LOG_ALWAYS_FATAL_IF(!statsProto.IsInitialized(), "%s",
-            statsProto.InitializationErrorString().c_str());
-    LOG_ALWAYS_FATAL_IF(statsProto.package_name().empty()
-            || !statsProto.has_summary(), "package_name() '%s' summary %d",
-            statsProto.package_name().c_str(), statsProto.has_summary());
-    int outFd = open(path.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0660);
-    if (outFd <= 0) {
+    FileDescriptor fd{open(path.c_str(), O_CREAT | O_RDWR | O_CLOEXEC, 0660)};
+    if (!fd.valid()) {
         int err = errno;
         ALOGW("Failed to open '%s', error=%d (%s)", path.c_str(), err, strerror(err));
         return;
     }
-    int wrote = write(outFd, &sCurrentFileVersion, sHeaderSize);
-    if (wrote != sHeaderSize) {
-        int err = errno;
-        ALOGW("Failed to write header to '%s', returned=%d errno=%d (%s)",
-                path.c_str(), wrote, err, strerror(err));
-        close(outFd);
+    StatsFileData* stats = mapStatsFile(fd, path, package, versionCode);
+    if (!stats) {
         return;
     }
-    {
-        FileOutputStreamLite output(outFd);
-        bool success = statsProto.SerializeToZeroCopyStream(&output) && output.Flush();
-        if (output.GetErrno() != 0) {
-            ALOGW("Error writing to fd=%d, path='%s' err=%d (%s)",
-                    outFd, path.c_str(), output.GetErrno(), strerror(output.GetErrno()));
-            success = false;
-        } else if (!success) {
-            ALOGW("Serialize failed on '%s' unknown error", path.c_str());
-        }
-    }
-    close(outFd);
+    mergeProfileData(stats, startTime, endTime, data);
+    munmap(stats, sizeof(StatsFileData));
 }
 
+/*
+ * Stats are written out as each one is added rather than collected until finishDump(). A
+ * protobuf dump is the GraphicsStatsServiceDumpProto's repeated stats field, one
+ * length-delimited GraphicsStatsProto after another, which is the same bytes as
+ * serializing the whole message at once.
+ */
 class GraphicsStatsService::Dump {
 public:
-    Dump(int outFd, DumpType type) : mFd(outFd), mType(type) {}
+    Dump(int outFd, DumpType type) : mFd(outFd), mType(type), mStream(outFd) {}
     int fd() { return mFd; }
     DumpType type() { return mType; }
-    service::GraphicsStatsServiceDumpProto& proto() { return mProto; }
+
+    void add(const StatsFileData& stats) {
+        if (mType == DumpType::Text) {
+            dumpAsTextToFd(stats, mFd);
+            return;
+        }
+        service::GraphicsStatsProto proto;
+        statsFileDataToProto(stats, &proto);
+        io::CodedOutputStream output(&mStream);
+        output.WriteTag(sStatsFieldTag);
+        output.WriteVarint32(proto.ByteSize());
+        proto.SerializeWithCachedSizes(&output);
+    }
+
+    void finish() {
+        if (mType == DumpType::Protobuf) {
+            mStream.Flush();
+        }
+    }
+
 private:
+    // GraphicsStatsServiceDumpProto.stats, field 1, length delimited
+    static constexpr uint32_t sStatsFieldTag = (1 << 3) | 2;
+
     int mFd;
     DumpType mType;
-    service::GraphicsStatsServiceDumpProto mProto;
+    FileOutputStreamLite mStream;
 };
 
 GraphicsStatsService::Dump* GraphicsStatsService::createDump(int outFd, DumpType type) {
@@ -324,43 +502,33 @@ GraphicsStatsService::Dump* GraphicsStatsService::createDump(int outFd, DumpType
 
 void GraphicsStatsService::addToDump(Dump* dump, const std::string& path, const std::string& package,
         int versionCode, int64_t startTime, int64_t endTime, const ProfileData* data) {
-    service::GraphicsStatsProto statsProto;
-    if (!path.empty() && !parseFromFile(path, &statsProto)) {
-        statsProto.Clear();
-    }
+    StatsFileData stats;
+    bool loaded = !path.empty() && readStatsFile(path, &stats);
     if (data) {
-        mergeProfileDataIntoProto(&statsProto, package, versionCode, startTime, endTime, data);
+        if (!loaded) {
+            initStatsFileData(&stats, package, versionCode);
+            loaded = true;
+        }
+        mergeProfileData(&stats, startTime, endTime, data);
     }
-    if (!statsProto.IsInitialized()) {
+    if (!loaded || stats.packageNameLength == 0) {
         ALOGW("Failed to load profile data from path '%s' and data %p",
                 path.empty() ? "<empty>" : path.c_str(), data);
         return;
     }
-
-    if (dump->type() == DumpType::Protobuf) {
-        dump->proto().add_stats()->CopyFrom(statsProto);
-    } else {
-        dumpAsTextToFd(&statsProto, dump->fd());
-    }
+    dump->add(stats);
 }
 
 void GraphicsStatsService::addToDump(Dump* dump, const std::string& path) {
-    service::GraphicsStatsProto statsProto;
-    if (!parseFromFile(path, &statsProto)) {
+    StatsFileData stats;
+    if (!readStatsFile(path, &stats)) {
         return;
     }
-    if (dump->type() == DumpType::Protobuf) {
-        dump->proto().add_stats()->CopyFrom(statsProto);
-    } else {
-        dumpAsTextToFd(&statsProto, dump->fd());
-    }
+    dump->add(stats);
 }
 
 void GraphicsStatsService::finishDump(Dump* dump) {
-    if (dump->type() == DumpType::Protobuf) {
-        FileOutputStreamLite stream(dump->fd());
-        dump->proto().SerializeToZeroCopyStream(&stream);
-    }
+    dump->finish();
     delete dump;
 }
 
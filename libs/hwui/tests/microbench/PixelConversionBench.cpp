@@ -0,0 +1,165 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <SkColorPriv.h>
+#include <SkUnPreMultiply.h>
+
+#include "utils/PixelConversion.h"
+
+#include <vector>
+
+using namespace android;
+using namespace android::uirenderer;
+
+// One row of a 1080p screen.  Items processed are pixels, so the reported rate is pixels
+// per second.
+static const int kRowWidth = 1920;
+
+static std::vector<uint32_t> makeRow() {
+    std::vector<uint32_t> row(kRowWidth);
+    uint32_t seed = 1;
+    for (uint32_t& pixel : row) {
+        seed = seed * 1103515245u + 12345u;
+        pixel = SkPreMultiplyColor(seed);
+    }
+    return row;
+}
+
+static void BM_PixelConversion_n32ToColorsPremul_scalar(benchmark::State& state) {
+    std::vector<uint32_t> src = makeRow();
+    std::vector<SkColor> dst(kRowWidth);
+    while (state.KeepRunning()) {
+        for (int i = 0; i < kRowWidth; i++) {
+            dst[i] = SkUnPreMultiply::PMColorToColor(src[i]);
+        }
+        benchmark::DoNotOptimize(dst.data());
+    }
+    state.SetItemsProcessed(state.iterations() * kRowWidth);
+}
+BENCHMARK(BM_PixelConversion_n32ToColorsPremul_scalar);
+
+static void BM_PixelConversion_n32ToColors(benchmark::State& state) {
+    const SkAlphaType alphaType = static_cast<SkAlphaType>(state.range(0));
+    std::vector<uint32_t> src = makeRow();
+    std::vector<SkColor> dst(kRowWidth);
+    while (state.KeepRunning()) {
+        PixelConversion::n32ToColors(dst.data(), src.data(), kRowWidth, alphaType);
+        benchmark::DoNotOptimize(dst.data());
+    }
+    state.SetItemsProcessed(state.iterations() * kRowWidth);
+}
+BENCHMARK(BM_PixelConversion_n32ToColors)
+        ->Arg(kPremul_SkAlphaType)->Arg(kUnpremul_SkAlphaType)->Arg(kOpaque_SkAlphaType);
+
+static void BM_PixelConversion_colorsToN32Premul_scalar(benchmark::State& state) {
+    std::vector<SkColor> src = makeRow();
+    std::vector<uint32_t> dst(kRowWidth);
+    while (state.KeepRunning()) {
+        for (int i = 0; i < kRowWidth; i++) {
+            dst[i] = SkPreMultiplyColor(src[i]);
+        }
+        benchmark::DoNotOptimize(dst.data());
+    }
+    state.SetItemsProcessed(state.iterations() * kRowWidth);
+}
+BENCHMARK(BM_PixelConversion_colorsToN32Premul_scalar);
+
+static void BM_PixelConversion_colorsToN32(benchmark::State& state) {
+    const SkAlphaType alphaType = static_cast<SkAlphaType>(state.range(0));
+    std::vector<SkColor> src = makeRow();
+    std::vector<uint32_t> dst(kRowWidth);
+    while (state.KeepRunning()) {
+        PixelConversion::colorsToN32(dst.data(), src.data(), kRowWidth, alphaType);
+        benchmark::DoNotOptimize(dst.data());
+    }
+    state.SetItemsProcessed(state.iterations() * kRowWidth);
+}
+BENCHMARK(BM_PixelConversion_colorsToN32)->Arg(kPremul_SkAlphaType)->Arg(kUnpremul_SkAlphaType);
+
+static void BM_PixelConversion_argb4444ToColors(benchmark::State& state) {
+    std::vector<uint16_t> src(kRowWidth);
+    for (int i = 0; i < kRowWidth; i++) {
+        src[i] = i * 37;
+    }
+    std::vector<SkColor> dst(kRowWidth);
+    while (state.KeepRunning()) {
+        PixelConversion::argb4444ToColors(dst.data(), src.data(), kRowWidth,
+                kPremul_SkAlphaType);
+        benchmark::DoNotOptimize(dst.data());
+    }
+    state.SetItemsProcessed(state.iterations() * kRowWidth);
+}
+BENCHMARK(BM_PixelConversion_argb4444ToColors);
+
+static void BM_PixelConversion_rgb565ToColors(benchmark::State& state) {
+    std::vector<uint16_t> src(kRowWidth);
+    for (int i = 0; i < kRowWidth; i++) {
+        src[i] = i * 37;
+    }
+    std::vector<SkColor> dst(kRowWidth);
+    while (state.KeepRunning()) {
+        PixelConversion::rgb565ToColors(dst.data(), src.data(), kRowWidth);
+        benchmark::DoNotOptimize(dst.data());
+    }
+    state.SetItemsProcessed(state.iterations() * kRowWidth);
+}
+BENCHMARK(BM_PixelConversion_rgb565ToColors);
+
+static void BM_PixelConversion_index8ToColors(benchmark::State& state) {
+    std::vector<uint32_t> colors = makeRow();
+    std::vector<uint8_t> src(kRowWidth);
+    for (int i = 0; i < kRowWidth; i++) {
+        src[i] = i * 7;
+    }
+    std::vector<SkColor> dst(kRowWidth);
+    while (state.KeepRunning()) {
+        PixelConversion::index8ToColors(dst.data(), src.data(), kRowWidth, colors.data(),
+                kPremul_SkAlphaType);
+        benchmark::DoNotOptimize(dst.data());
+    }
+    state.SetItemsProcessed(state.iterations() * kRowWidth);
+}
+BENCHMARK(BM_PixelConversion_index8ToColors);
+
+static void BM_PixelConversion_f16ToColors(benchmark::State& state) {
+    const SkAlphaType alphaType = static_cast<SkAlphaType>(state.range(0));
+    std::vector<uint64_t> src(kRowWidth);
+    std::vector<SkColor> colors = makeRow();
+    PixelConversion::colorsToF16(src.data(), colors.data(), kRowWidth, alphaType);
+    std::vector<SkColor> dst(kRowWidth);
+    while (state.KeepRunning()) {
+        PixelConversion::f16ToColors(dst.data(), src.data(), kRowWidth, alphaType);
+        benchmark::DoNotOptimize(dst.data());
+    }
+    state.SetItemsProcessed(state.iterations() * kRowWidth);
+}
+BENCHMARK(BM_PixelConversion_f16ToColors)->Arg(kPremul_SkAlphaType)->Arg(kUnpremul_SkAlphaType);
+
+static void BM_PixelConversion_alpha8ToF16(benchmark::State& state) {
+    std::vector<uint8_t> src(kRowWidth);
+    for (int i = 0; i < kRowWidth; i++) {
+        src[i] = i;
+    }
+    std::vector<uint64_t> dst(kRowWidth);
+    while (state.KeepRunning()) {
+        PixelConversion::alpha8ToF16(dst.data(), src.data(), kRowWidth);
+        benchmark::DoNotOptimize(dst.data());
+    }
+    state.SetItemsProcessed(state.iterations() * kRowWidth);
+}
+BENCHMARK(BM_PixelConversion_alpha8ToF16);
@@ -20,12 +20,17 @@
 
 #include <frameworks/base/core/proto/android/service/graphicsstats.pb.h>
 
+#include <fcntl.h>
+#include <sys/file.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 
+#include <atomic>
+#include <thread>
+
 using namespace android;
 using namespace android::uirenderer;
 
@@ -161,3 +166,200 @@ TEST(GraphicsStats, merge) {
         EXPECT_EQ(expectedBucket, loadedProto.histogram().Get(i).render_millis());
     }
 }
+
+// Files written before the fixed layout store hold a version 1 header and a serialized
+// proto. They must still load, and be merged into when next saved to.
+TEST(GraphicsStats, mergeIntoProtoFile) {
+    std::string path = findRootPath() + "/test_mergeIntoProtoFile";
+    std::string packageName = "com.test.mergeIntoProtoFile";
+    service::GraphicsStatsProto oldProto;
+    oldProto.set_package_name(packageName);
+    oldProto.set_version_code(5);
+    oldProto.set_stats_start(3000);
+    oldProto.set_stats_end(7000);
+    oldProto.mutable_summary()->set_total_frames(100);
+    oldProto.mutable_summary()->set_janky_frames(20);
+    ProfileData mockData = {};
+    for (size_t i = 0; i < mockData.frameCounts.size(); i++) {
+        auto bucket = oldProto.add_histogram();
+        bucket->set_render_millis(JankTracker::frameTimeForFrameCountIndex(i));
+        bucket->set_frame_count(oldProto.histogram_size());
+    }
+    for (size_t i = 0; i < mockData.slowFrameCounts.size(); i++) {
+        auto bucket = oldProto.add_histogram();
+        bucket->set_render_millis(JankTracker::frameTimeForSlowFrameCountIndex(i));
+        bucket->set_frame_count(oldProto.histogram_size());
+    }
+    {
+        std::string contents = oldProto.SerializeAsString();
+        int32_t fileVersion = 1;
+        FILE* file = fopen(path.c_str(), "w");
+        ASSERT_NE(nullptr, file);
+        fwrite(&fileVersion, sizeof(fileVersion), 1, file);
+        fwrite(contents.data(), 1, contents.size(), file);
+        fclose(file);
+    }
+
+    service::GraphicsStatsProto loadedProto;
+    EXPECT_TRUE(GraphicsStatsService::parseFromFile(path, &loadedProto));
+    EXPECT_EQ(packageName, loadedProto.package_name());
+    EXPECT_EQ(100, loadedProto.summary().total_frames());
+
+    mockData.jankFrameCount = 50;
+    mockData.totalFrameCount = 500;
+    mockData.frameCounts.fill(1);
+    mockData.slowFrameCounts.fill(2);
+    GraphicsStatsService::saveBuffer(path, packageName, 5, 7050, 10000, &mockData);
+
+    loadedProto.Clear();
+    EXPECT_TRUE(GraphicsStatsService::parseFromFile(path, &loadedProto));
+    unlink(path.c_str());
+
+    EXPECT_EQ(packageName, loadedProto.package_name());
+    EXPECT_EQ(5, loadedProto.version_code());
+    EXPECT_EQ(3000, loadedProto.stats_start());
+    EXPECT_EQ(10000, loadedProto.stats_end());
+    EXPECT_EQ(20 + 50, loadedProto.summary().janky_frames());
+    EXPECT_EQ(100 + 500, loadedProto.summary().total_frames());
+    ASSERT_EQ(oldProto.histogram_size(), loadedProto.histogram_size());
+    for (size_t i = 0; i < (size_t) loadedProto.histogram_size(); i++) {
+        int expectedCount = i + 1 + (i < mockData.frameCounts.size() ? 1 : 2);
+        EXPECT_EQ(expectedCount, loadedProto.histogram().Get(i).frame_count());
+        EXPECT_EQ(oldProto.histogram().Get(i).render_millis(),
+                loadedProto.histogram().Get(i).render_millis());
+    }
+}
+
+// Stats are streamed out as they are added; together they must still parse as one dump.
+TEST(GraphicsStats, dumpProto) {
+    std::string path = findRootPath() + "/test_dumpProto";
+    std::string dumpPath = findRootPath() + "/test_dumpProto.dump";
+    ProfileData mockData = {};
+    mockData.jankFrameCount = 20;
+    mockData.totalFrameCount = 100;
+    mockData.frameCounts.fill(3);
+    GraphicsStatsService::saveBuffer(path, "com.test.saved", 5, 3000, 7000, &mockData);
+
+    int fd = open(dumpPath.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0660);
+    ASSERT_NE(-1, fd);
+    GraphicsStatsService::Dump* dump = GraphicsStatsService::createDump(fd,
+            GraphicsStatsService::DumpType::Protobuf);
+    GraphicsStatsService::addToDump(dump, path);
+    GraphicsStatsService::addToDump(dump, "", "com.test.active", 7, 8000, 9000, &mockData);
+    GraphicsStatsService::finishDump(dump);
+
+    service::GraphicsStatsServiceDumpProto dumpProto;
+    lseek(fd, 0, SEEK_SET);
+    EXPECT_TRUE(dumpProto.ParseFromFileDescriptor(fd));
+    close(fd);
+    unlink(dumpPath.c_str());
+    unlink(path.c_str());
+
+    ASSERT_EQ(2, dumpProto.stats_size());
+    EXPECT_EQ("com.test.saved", dumpProto.stats(0).package_name());
+    EXPECT_EQ(3000, dumpProto.stats(0).stats_start());
+    EXPECT_EQ("com.test.active", dumpProto.stats(1).package_name());
+    EXPECT_EQ(7, dumpProto.stats(1).version_code());
+    for (const auto& stats : dumpProto.stats()) {
+        EXPECT_EQ(100, stats.summary().total_frames());
+        EXPECT_EQ(20, stats.summary().janky_frames());
+        EXPECT_EQ(3, stats.histogram(0).frame_count());
+    }
+}
+
+// A stats file without a package name is corrupt. Dumping it must skip it rather than
+// abort, and the next save must start it over.
+TEST(GraphicsStats, rejectEmptyPackageName) {
+    std::string path = findRootPath() + "/test_rejectEmptyPackageName";
+    std::string dumpPath = findRootPath() + "/test_rejectEmptyPackageName.dump";
+    ProfileData mockData = {};
+    mockData.totalFrameCount = 100;
+    GraphicsStatsService::saveBuffer(path, "com.test.corrupt", 5, 3000, 7000, &mockData);
+    {
+        // packageNameLength follows the file version, histogram size and version code
+        uint32_t packageNameLength = 0;
+        int fd = open(path.c_str(), O_WRONLY);
+        ASSERT_NE(-1, fd);
+        EXPECT_EQ((ssize_t) sizeof(packageNameLength),
+                pwrite(fd, &packageNameLength, sizeof(packageNameLength), 3 * sizeof(int32_t)));
+        close(fd);
+    }
+
+    service::GraphicsStatsProto loadedProto;
+    EXPECT_FALSE(GraphicsStatsService::parseFromFile(path, &loadedProto));
+
+    int fd = open(dumpPath.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0660);
+    ASSERT_NE(-1, fd);
+    GraphicsStatsService::Dump* dump = GraphicsStatsService::createDump(fd,
+            GraphicsStatsService::DumpType::Text);
+    GraphicsStatsService::addToDump(dump, path);
+    GraphicsStatsService::finishDump(dump);
+    struct stat sb;
+    ASSERT_EQ(0, fstat(fd, &sb));
+    EXPECT_EQ(0, sb.st_size);
+    close(fd);
+    unlink(dumpPath.c_str());
+
+    GraphicsStatsService::saveBuffer(path, "com.test.corrupt", 6, 8000, 9000, &mockData);
+    EXPECT_TRUE(GraphicsStatsService::parseFromFile(path, &loadedProto));
+    unlink(path.c_str());
+    EXPECT_EQ("com.test.corrupt", loadedProto.package_name());
+    EXPECT_EQ(6, loadedProto.version_code());
+    EXPECT_EQ(8000, loadedProto.stats_start());
+    EXPECT_EQ(100, loadedProto.summary().total_frames());
+}
+
+TEST(GraphicsStats, rejectEmptyPackageNameInProtoFile) {
+    std::string path = findRootPath() + "/test_rejectEmptyPackageNameInProtoFile";
+    service::GraphicsStatsProto oldProto;
+    oldProto.set_version_code(5);
+    ProfileData mockData = {};
+    for (size_t i = 0; i < mockData.frameCounts.size() + mockData.slowFrameCounts.size(); i++) {
+        oldProto.add_histogram()->set_frame_count(1);
+    }
+    {
+        std::string contents = oldProto.SerializeAsString();
+        int32_t fileVersion = 1;
+        FILE* file = fopen(path.c_str(), "w");
+        ASSERT_NE(nullptr, file);
+        fwrite(&fileVersion, sizeof(fileVersion), 1, file);
+        fwrite(contents.data(), 1, contents.size(), file);
+        fclose(file);
+    }
+
+    service::GraphicsStatsProto loadedProto;
+    EXPECT_FALSE(GraphicsStatsService::parseFromFile(path, &loadedProto));
+
+    GraphicsStatsService::Dump* dump = GraphicsStatsService::createDump(STDOUT_FILENO,
+            GraphicsStatsService::DumpType::Text);
+    GraphicsStatsService::addToDump(dump, path);
+    GraphicsStatsService::finishDump(dump);
+    unlink(path.c_str());
+}
+
+TEST(GraphicsStats, readWaitsForRewrite) {
+    std::string path = findRootPath() + "/test_readWaitsForRewrite";
+    ProfileData mockData = {};
+    mockData.totalFrameCount = 20;
+    GraphicsStatsService::saveBuffer(path, "com.test.locked", 5, 3000, 7000, &mockData);
+
+    // A save that is rewriting the file holds an exclusive lock on it.
+    int fd = open(path.c_str(), O_RDONLY);
+    ASSERT_NE(-1, fd);
+    ASSERT_EQ(0, flock(fd, LOCK_EX));
+    std::atomic<bool> loaded(false);
+    service::GraphicsStatsProto loadedProto;
+    std::thread reader([&]() {
+        loaded = GraphicsStatsService::parseFromFile(path, &loadedProto);
+    });
+    usleep(100 * 1000);
+    EXPECT_FALSE(loaded);
+    flock(fd, LOCK_UN);
+    close(fd);
+    reader.join();
+
+    unlink(path.c_str());
+    EXPECT_TRUE(loaded);
+    EXPECT_EQ("com.test.locked", loadedProto.package_name());
+    EXPECT_EQ(20, loadedProto.summary().total_frames());
+}
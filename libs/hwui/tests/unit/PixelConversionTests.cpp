@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <SkColorPriv.h>
+#include <SkUnPreMultiply.h>
+
+#include "utils/PixelConversion.h"
+
+#include <vector>
+
+using namespace android;
+using namespace android::uirenderer;
+
+// Every alpha with a spread of color values, in a count that leaves a partial block at
+// the end of the row.
+static std::vector<uint32_t> makeTestPixels() {
+    std::vector<uint32_t> pixels;
+    uint32_t seed = 1;
+    for (int a = 0; a < 256; a++) {
+        for (int i = 0; i < 37; i++) {
+            seed = seed * 1103515245u + 12345u;
+            pixels.push_back((a << 24) | (seed >> 8 & 0xFFFFFF));
+        }
+    }
+    pixels.push_back(0xFFFFFFFF);
+    return pixels;
+}
+
+// The same pixels premultiplied, so that no channel exceeds alpha.
+static std::vector<uint32_t> makeTestPMColors() {
+    std::vector<uint32_t> pixels = makeTestPixels();
+    for (uint32_t& pixel : pixels) {
+        pixel = SkPreMultiplyColor(pixel);
+    }
+    return pixels;
+}
+
+TEST(PixelConversion, n32ToColorsPremul) {
+    std::vector<uint32_t> src = makeTestPMColors();
+    std::vector<SkColor> dst(src.size());
+    PixelConversion::n32ToColors(dst.data(), src.data(), src.size(), kPremul_SkAlphaType);
+    for (size_t i = 0; i < src.size(); i++) {
+        ASSERT_EQ(SkUnPreMultiply::PMColorToColor(src[i]), dst[i]) << "pixel " << i;
+    }
+}
+
+TEST(PixelConversion, n32ToColorsUnpremulAndOpaque) {
+    std::vector<uint32_t> src = makeTestPixels();
+    std::vector<SkColor> raw(src.size());
+    std::vector<SkColor> opaque(src.size());
+    PixelConversion::n32ToColors(raw.data(), src.data(), src.size(), kUnpremul_SkAlphaType);
+    PixelConversion::n32ToColors(opaque.data(), src.data(), src.size(), kOpaque_SkAlphaType);
+    for (size_t i = 0; i < src.size(); i++) {
+        uint32_t c = src[i];
+        ASSERT_EQ(SkColorSetARGB(SkGetPackedA32(c), SkGetPackedR32(c), SkGetPackedG32(c),
+                SkGetPackedB32(c)), raw[i]) << "pixel " << i;
+        ASSERT_EQ(SkColorSetRGB(SkGetPackedR32(c), SkGetPackedG32(c), SkGetPackedB32(c)),
+                opaque[i]) << "pixel " << i;
+    }
+}
+
+TEST(PixelConversion, colorsToN32) {
+    std::vector<SkColor> src = makeTestPixels();
+    std::vector<uint32_t> premul(src.size());
+    std::vector<uint32_t> raw(src.size());
+    PixelConversion::colorsToN32(premul.data(), src.data(), src.size(), kPremul_SkAlphaType);
+    PixelConversion::colorsToN32(raw.data(), src.data(), src.size(), kUnpremul_SkAlphaType);
+    for (size_t i = 0; i < src.size(); i++) {
+        SkColor c = src[i];
+        ASSERT_EQ(SkPreMultiplyColor(c), premul[i]) << "color " << i;
+        ASSERT_EQ(SkPackARGB32NoCheck(SkColorGetA(c), SkColorGetR(c), SkColorGetG(c),
+                SkColorGetB(c)), raw[i]) << "color " << i;
+    }
+}
+
+TEST(PixelConversion, argb4444ToColors) {
+    std::vector<uint16_t> src(65536);
+    for (size_t i = 0; i < src.size(); i++) {
+        src[i] = i;
+    }
+    std::vector<SkColor> premul(src.size());
+    std::vector<SkColor> opaque(src.size());
+    PixelConversion::argb4444ToColors(premul.data(), src.data(), src.size(),
+            kPremul_SkAlphaType);
+    PixelConversion::argb4444ToColors(opaque.data(), src.data(), src.size(),
+            kOpaque_SkAlphaType);
+    for (size_t i = 0; i < src.size(); i++) {
+        SkPMColor c = SkPixel4444ToPixel32(src[i]);
+        ASSERT_EQ(SkUnPreMultiply::PMColorToColor(c), premul[i]) << "pixel " << i;
+        ASSERT_EQ(SkColorSetRGB(SkGetPackedR32(c), SkGetPackedG32(c), SkGetPackedB32(c)),
+                opaque[i]) << "pixel " << i;
+    }
+}
+
+TEST(PixelConversion, rgb565ToColors) {
+    std::vector<uint16_t> src(65536 - 3);
+    for (size_t i = 0; i < src.size(); i++) {
+        src[i] = i;
+    }
+    std::vector<SkColor> dst(src.size());
+    PixelConversion::rgb565ToColors(dst.data(), src.data(), src.size());
+    for (size_t i = 0; i < src.size(); i++) {
+        uint16_t c = src[i];
+        ASSERT_EQ(SkColorSetRGB(SkPacked16ToR32(c), SkPacked16ToG32(c), SkPacked16ToB32(c)),
+                dst[i]) << "pixel " << i;
+    }
+}
+
+TEST(PixelConversion, index8ToColors) {
+    std::vector<uint32_t> colors = makeTestPMColors();
+    colors.resize(256);
+    std::vector<uint8_t> src(1001);
+    for (size_t i = 0; i < src.size(); i++) {
+        src[i] = i * 7;
+    }
+    std::vector<SkColor> dst(src.size());
+    PixelConversion::index8ToColors(dst.data(), src.data(), src.size(), colors.data(),
+            kPremul_SkAlphaType);
+    for (size_t i = 0; i < src.size(); i++) {
+        ASSERT_EQ(SkUnPreMultiply::PMColorToColor(colors[src[i]]), dst[i]) << "pixel " << i;
+    }
+}
+
+TEST(PixelConversion, alpha8) {
+    std::vector<uint8_t> src(256);
+    for (size_t i = 0; i < src.size(); i++) {
+        src[i] = i;
+    }
+    std::vector<SkColor> colors(src.size());
+    std::vector<uint8_t> back(src.size());
+    PixelConversion::alpha8ToColors(colors.data(), src.data(), src.size());
+    PixelConversion::colorsToAlpha8(back.data(), colors.data(), colors.size());
+    for (size_t i = 0; i < src.size(); i++) {
+        ASSERT_EQ(SkColorSetARGB(i, 0, 0, 0), colors[i]);
+        ASSERT_EQ(src[i], back[i]);
+    }
+}
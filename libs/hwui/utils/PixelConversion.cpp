@@ -0,0 +1,270 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "PixelConversion.h"
+
+#include <string.h>
+
+#include <type_traits>
+
+#include <SkColorPriv.h>
+#include <SkHalf.h>
+#include <SkPM4f.h>
+#include <SkPM4fPriv.h>
+#include <SkUnPreMultiply.h>
+
+namespace android {
+namespace uirenderer {
+
+// Four pixels, one per lane.  The compiler lowers the arithmetic on these to NEON or SSE,
+// so every channel of four pixels is converted by the same few instructions.
+typedef uint32_t U32x4 __attribute__((vector_size(16)));
+
+static inline U32x4 load4(const uint32_t* src) {
+    U32x4 v;
+    memcpy(&v, src, sizeof(v));
+    return v;
+}
+
+static inline void store4(uint32_t* dst, U32x4 v) {
+    memcpy(dst, &v, sizeof(v));
+}
+
+static inline U32x4 widen4(const uint16_t* src) {
+    return U32x4{ src[0], src[1], src[2], src[3] };
+}
+
+static inline U32x4 gather4(const SkPMColor* table, const uint8_t* index) {
+    return U32x4{ table[index[0]], table[index[1]], table[index[2]], table[index[3]] };
+}
+
+static inline U32x4 packColors(U32x4 a, U32x4 r, U32x4 g, U32x4 b) {
+    return (a << 24) | (r << 16) | (g << 8) | b;
+}
+
+// Needed to thwart the unreachable code detection from clang.
+static const bool sk_color_matches_pmcolor = SK_COLOR_MATCHES_PMCOLOR_BYTE_ORDER;
+
+// Runs kernel, which converts exactly four pixels, over a row.  The last few pixels go
+// through a padded copy so that they take the same path as the rest.
+template <typename Dst, typename Src, typename Kernel>
+static inline void convertRow(Dst* dst, const Src* src, int count, Kernel kernel) {
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        kernel(dst + i, src + i);
+    }
+    if (i < count) {
+        Src srcTail[4] = {};
+        Dst dstTail[4];
+        memcpy(srcTail, src + i, (count - i) * sizeof(Src));
+        kernel(dstTail, srcTail);
+        memcpy(dst + i, dstTail, (count - i) * sizeof(Dst));
+    }
+}
+
+// Calls kernel with alphaType as a compile time constant, so that each row loop is
+// specialized for it.
+template <typename Kernel>
+static inline void withAlphaType(SkAlphaType alphaType, Kernel kernel) {
+    switch (alphaType) {
+        case kPremul_SkAlphaType:
+            kernel(std::integral_constant<SkAlphaType, kPremul_SkAlphaType>());
+            break;
+        case kOpaque_SkAlphaType:
+            kernel(std::integral_constant<SkAlphaType, kOpaque_SkAlphaType>());
+            break;
+        default:
+            kernel(std::integral_constant<SkAlphaType, kUnpremul_SkAlphaType>());
+            break;
+    }
+}
+
+// N32 pixels to SkColors, as SkUnPreMultiply::PMColorToColor(), SkColorSetARGB() or
+// SkColorSetRGB() would do one at a time.
+template <SkAlphaType kAlphaType>
+static inline U32x4 n32ToColors4(U32x4 p) {
+    U32x4 a = (p >> SK_A32_SHIFT) & 0xFF;
+    U32x4 r = (p >> SK_R32_SHIFT) & 0xFF;
+    U32x4 g = (p >> SK_G32_SHIFT) & 0xFF;
+    U32x4 b = (p >> SK_B32_SHIFT) & 0xFF;
+    if (kAlphaType == kPremul_SkAlphaType) {
+        const SkUnPreMultiply::Scale* table = SkUnPreMultiply::GetScaleTable();
+        U32x4 scale = { table[a[0]], table[a[1]], table[a[2]], table[a[3]] };
+        r = (scale * r + (1 << 23)) >> 24;
+        g = (scale * g + (1 << 23)) >> 24;
+        b = (scale * b + (1 << 23)) >> 24;
+    } else if (kAlphaType == kOpaque_SkAlphaType) {
+        a = U32x4{ 0xFF, 0xFF, 0xFF, 0xFF };
+    }
+    return packColors(a, r, g, b);
+}
+
+// SkColors to N32 pixels, premultiplied as SkPreMultiplyColor() does, with
+// SkMulDiv255Round() on each channel.
+template <SkAlphaType kAlphaType>
+static inline U32x4 colorsToN32_4(U32x4 c) {
+    U32x4 a = c >> 24;
+    U32x4 r = (c >> 16) & 0xFF;
+    U32x4 g = (c >> 8) & 0xFF;
+    U32x4 b = c & 0xFF;
+    if (kAlphaType == kPremul_SkAlphaType) {
+        r = r * a + 128;
+        g = g * a + 128;
+        b = b * a + 128;
+        r = (r + (r >> 8)) >> 8;
+        g = (g + (g >> 8)) >> 8;
+        b = (b + (b >> 8)) >> 8;
+    }
+    return (a << SK_A32_SHIFT) | (r << SK_R32_SHIFT) | (g << SK_G32_SHIFT) |
+            (b << SK_B32_SHIFT);
+}
+
+// ARGB_4444 pixels to N32, as SkPixel4444ToPixel32() does.
+static inline U32x4 argb4444ToN32_4(U32x4 p) {
+    U32x4 d = (((p >> SK_A4444_SHIFT) & 0xF) << SK_A32_SHIFT) |
+            (((p >> SK_R4444_SHIFT) & 0xF) << SK_R32_SHIFT) |
+            (((p >> SK_G4444_SHIFT) & 0xF) << SK_G32_SHIFT) |
+            (((p >> SK_B4444_SHIFT) & 0xF) << SK_B32_SHIFT);
+    return d | (d << 4);
+}
+
+void PixelConversion::n32ToColors(SkColor* dst, const uint32_t* src, int count,
+        SkAlphaType alphaType) {
+    if (alphaType == kUnpremul_SkAlphaType && sk_color_matches_pmcolor) {
+        memcpy(dst, src, count * sizeof(SkColor));
+        return;
+    }
+    withAlphaType(alphaType, [=](auto tag) {
+        convertRow(dst, src, count, [](SkColor* d, const uint32_t* s) {
+            store4(d, n32ToColors4<decltype(tag)::value>(load4(s)));
+        });
+    });
+}
+
+void PixelConversion::argb4444ToColors(SkColor* dst, const uint16_t* src, int count,
+        SkAlphaType alphaType) {
+    withAlphaType(alphaType, [=](auto tag) {
+        convertRow(dst, src, count, [](SkColor* d, const uint16_t* s) {
+            store4(d, n32ToColors4<decltype(tag)::value>(argb4444ToN32_4(widen4(s))));
+        });
+    });
+}
+
+void PixelConversion::index8ToColors(SkColor* dst, const uint8_t* src, int count,
+        const SkPMColor* colors, SkAlphaType alphaType) {
+    withAlphaType(alphaType, [=](auto tag) {
+        convertRow(dst, src, count, [colors](SkColor* d, const uint8_t* s) {
+            store4(d, n32ToColors4<decltype(tag)::value>(gather4(colors, s)));
+        });
+    });
+}
+
+void PixelConversion::rgb565ToColors(SkColor* dst, const uint16_t* src, int count) {
+    convertRow(dst, src, count, [](SkColor* d, const uint16_t* s) {
+        U32x4 p = widen4(s);
+        // Replicate the top bits into the low ones, as SkPacked16ToR32() and friends do.
+        U32x4 r = (p >> SK_R16_SHIFT) & SK_R16_MASK;
+        U32x4 g = (p >> SK_G16_SHIFT) & SK_G16_MASK;
+        U32x4 b = (p >> SK_B16_SHIFT) & SK_B16_MASK;
+        r = (r << 3) | (r >> 2);
+        g = (g << 2) | (g >> 4);
+        b = (b << 3) | (b >> 2);
+        store4(d, packColors(U32x4{ 0xFF, 0xFF, 0xFF, 0xFF }, r, g, b));
+    });
+}
+
+void PixelConversion::alpha8ToColors(SkColor* dst, const uint8_t* src, int count) {
+    for (int i = 0; i < count; i++) {
+        dst[i] = SkColorSetARGB(src[i], 0, 0, 0);
+    }
+}
+
+void PixelConversion::f16ToColors(SkColor* dst, const uint64_t* src, int count,
+        SkAlphaType alphaType) {
+    if (alphaType == kPremul_SkAlphaType) {
+        for (int i = 0; i < count; i++) {
+            dst[i] = SkPM4f::FromF16((const uint16_t*) &src[i]).unpremul().toSkColor();
+        }
+    } else {
+        for (int i = 0; i < count; i++) {
+            dst[i] = Sk4f_toS32(swizzle_rb(SkHalfToFloat_finite_ftz(src[i])));
+        }
+    }
+}
+
+void PixelConversion::colorsToN32(uint32_t* dst, const SkColor* src, int count,
+        SkAlphaType alphaType) {
+    if (alphaType != kPremul_SkAlphaType && sk_color_matches_pmcolor) {
+        memcpy(dst, src, count * sizeof(SkColor));
+        return;
+    }
+    withAlphaType(alphaType, [=](auto tag) {
+        convertRow(dst, src, count, [](uint32_t* d, const SkColor* s) {
+            store4(d, colorsToN32_4<decltype(tag)::value>(load4(s)));
+        });
+    });
+}
+
+void PixelConversion::colorsToAlpha8(uint8_t* dst, const SkColor* src, int count) {
+    for (int i = 0; i < count; i++) {
+        dst[i] = SkColorGetA(src[i]);
+    }
+}
+
+void PixelConversion::colorsToF16(uint64_t* dst, const SkColor* src, int count,
+        SkAlphaType alphaType) {
+    if (alphaType == kPremul_SkAlphaType) {
+        for (int i = 0; i < count; i++) {
+            dst[i] = SkColor4f::FromColor(src[i]).premul().toF16();
+        }
+    } else {
+        for (int i = 0; i < count; i++) {
+            const SkColor4f color = SkColor4f::FromColor(src[i]);
+            uint16_t* scratch = reinterpret_cast<uint16_t*>(&dst[i]);
+            scratch[0] = SkFloatToHalf(color.fR);
+            scratch[1] = SkFloatToHalf(color.fG);
+            scratch[2] = SkFloatToHalf(color.fB);
+            scratch[3] = SkFloatToHalf(color.fA);
+        }
+    }
+}
+
+// There are only 256 alpha values, so their F16 pixels are computed once.
+static const uint64_t* alpha8ToF16Table() {
+    static const uint64_t* table = []() {
+        uint64_t* t = new uint64_t[256];
+        for (int c = 0; c < 256; c++) {
+            SkPM4f a;
+            a.fVec[SkPM4f::R] = 0.0f;
+            a.fVec[SkPM4f::G] = 0.0f;
+            a.fVec[SkPM4f::B] = 0.0f;
+            a.fVec[SkPM4f::A] = c / 255.0f;
+            t[c] = a.toF16();
+        }
+        return t;
+    }();
+    return table;
+}
+
+void PixelConversion::alpha8ToF16(uint64_t* dst, const uint8_t* src, int count) {
+    const uint64_t* table = alpha8ToF16Table();
+    for (int i = 0; i < count; i++) {
+        dst[i] = table[src[i]];
+    }
+}
+
+}; // namespace uirenderer
+}; // namespace android
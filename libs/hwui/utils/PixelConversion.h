@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HWUI_PIXEL_CONVERSION_H
+#define ANDROID_HWUI_PIXEL_CONVERSION_H
+
+#include <stdint.h>
+#include <cutils/compiler.h>
+
+#include <SkColor.h>
+#include <SkImageInfo.h>
+
+namespace android {
+namespace uirenderer {
+
+/**
+ * Row conversions between SkColor, the unpremultiplied ARGB ints of the Java API, and the
+ * pixel formats a Bitmap can have. Each call converts count pixels.
+ *
+ * Conversions work on several pixels per step and give the same results as converting each
+ * pixel with the scalar helpers in SkColorPriv.h and SkUnPreMultiply.h. Premultiplied
+ * sources are unpremultiplied with SkUnPreMultiply's reciprocal table rather than divides.
+ */
+class PixelConversion {
+public:
+    // Reading: alphaType is the bitmap's, and decides whether pixels are unpremultiplied
+    // (premul), taken as is (unpremul) or forced to opaque (opaque).
+    ANDROID_API static void n32ToColors(SkColor* dst, const uint32_t* src, int count,
+            SkAlphaType alphaType);
+    ANDROID_API static void argb4444ToColors(SkColor* dst, const uint16_t* src, int count,
+            SkAlphaType alphaType);
+    ANDROID_API static void index8ToColors(SkColor* dst, const uint8_t* src, int count,
+            const SkPMColor* colors, SkAlphaType alphaType);
+    ANDROID_API static void rgb565ToColors(SkColor* dst, const uint16_t* src, int count);
+    ANDROID_API static void alpha8ToColors(SkColor* dst, const uint8_t* src, int count);
+    ANDROID_API static void f16ToColors(SkColor* dst, const uint64_t* src, int count,
+            SkAlphaType alphaType);
+
+    // Writing: src colors are premultiplied for kPremul_SkAlphaType and stored as is
+    // otherwise.
+    ANDROID_API static void colorsToN32(uint32_t* dst, const SkColor* src, int count,
+            SkAlphaType alphaType);
+    ANDROID_API static void colorsToAlpha8(uint8_t* dst, const SkColor* src, int count);
+    ANDROID_API static void colorsToF16(uint64_t* dst, const SkColor* src, int count,
+            SkAlphaType alphaType);
+
+    // Expands alpha-only pixels to black with that alpha.
+    ANDROID_API static void alpha8ToF16(uint64_t* dst, const uint8_t* src, int count);
+};
+
+}; // namespace uirenderer
+}; // namespace android
+
+#endif // ANDROID_HWUI_PIXEL_CONVERSION_H
@@ -45,6 +45,12 @@ public final class ResampleInputStream extends InputStream
     
     // length of 2:1 fir
     private static final int mFirLength = 29;
+
+    // native polyphase resampler, for any ratio other than 2:1
+    private long mResampler;
+
+    // bytes of input read per call to the polyphase resampler
+    private static final int mResampleBufSize = 4096;
     
     // helper for bytewise read()
     private final byte[] mOneByte = new byte[1];
@@ -54,13 +60,16 @@ public final class ResampleInputStream extends InputStream
      * @param inputStream InputStream containing 16 bit PCM.
      * @param rateIn the input sample rate.
      * @param rateOut the output sample rate.
-     * This only handles rateIn == rateOut / 2 for the moment.
+     * 2:1 uses a fixed fir; any other ratio uses a polyphase resampler, and throws
+     * IllegalArgumentException if the reduced ratio is too fine for it.
      */
     public ResampleInputStream(InputStream inputStream, int rateIn, int rateOut) {
-        // only support 2:1 at the moment
-        if (rateIn != 2 * rateOut) throw new IllegalArgumentException("only support 2:1 at the moment");
-        rateIn = 2;
-        rateOut = 1;
+        if (rateIn == 2 * rateOut) {
+            rateIn = 2;
+            rateOut = 1;
+        } else {
+            mResampler = nativeCreate(rateIn, rateOut);
+        }
 
         mInputStream = inputStream;
         mRateIn = rateIn;
@@ -81,6 +90,7 @@ public final class ResampleInputStream extends InputStream
     @Override
     public int read(byte[] b, int offset, int length) throws IOException {
         if (mInputStream == null) throw new IllegalStateException("not open");
+        if (mResampler != 0) return readResampled(b, offset, length);
 
         // ensure that mBuf is big enough to cover requested 'length'
         int nIn = ((length / 2) * mRateIn / mRateOut + mFirLength) * 2;
@@ -116,6 +126,27 @@ public final class ResampleInputStream extends InputStream
         return length;
     }
 
+    private int readResampled(byte[] b, int offset, int length) throws IOException {
+        length = (length / 2) * 2;
+        if (length == 0) return 0;
+        if (mBuf == null) mBuf = new byte[mResampleBufSize];
+
+        // drain output from input queued by earlier reads before reading more
+        int n = nativeResample(mResampler, mBuf, 0, 0, b, offset, length);
+        while (n == 0) {
+            int nRead = mInputStream.read(mBuf, mBufCount, mBuf.length - mBufCount);
+            if (nRead == -1) return -1;
+            mBufCount += nRead;
+
+            // hand over whole samples, and keep an odd trailing byte for the next read
+            int nIn = (mBufCount / 2) * 2;
+            n = nativeResample(mResampler, mBuf, 0, nIn, b, offset, length);
+            mBufCount -= nIn;
+            if (mBufCount > 0) mBuf[0] = mBuf[nIn];
+        }
+        return n;
+    }
+
 /*
     @Override
     public int available() throws IOException {
@@ -130,6 +161,10 @@ public final class ResampleInputStream extends InputStream
             if (mInputStream != null) mInputStream.close();
         } finally {
             mInputStream = null;
+            if (mResampler != 0) {
+                nativeDestroy(mResampler);
+                mResampler = 0;
+            }
         }
     }
 
@@ -147,4 +182,10 @@ public final class ResampleInputStream extends InputStream
     private static native void fir21(byte[] in, int inOffset,
             byte[] out, int outOffset, int npoints);
 
+    private static native long nativeCreate(int rateIn, int rateOut);
+    private static native void nativeDestroy(long resampler);
+    // returns the number of output bytes written
+    private static native int nativeResample(long resampler, byte[] in, int inOffset,
+            int inLength, byte[] out, int outOffset, int outLength);
+
 }
@@ -0,0 +1,169 @@
+/*
+ * Copyright 2017, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "PolyphaseResampler.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace android {
+
+// Zero crossings of the sinc on each side of its center, at the lower of the two rates.
+static const uint32_t kHalfZeroCrossings = 24;
+// Stopband attenuation the Kaiser window is designed for.
+static const double kStopbandDb = 86;
+
+static uint32_t gcd(uint32_t a, uint32_t b) {
+    while (b != 0) {
+        uint32_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// Zeroth order modified Bessel function of the first kind.
+static double besselI0(double x) {
+    double sum = 1;
+    double term = 1;
+    for (int k = 1; k < 50; k++) {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+        if (term < sum * 1e-12) {
+            break;
+        }
+    }
+    return sum;
+}
+
+std::unique_ptr<PolyphaseResampler> PolyphaseResampler::create(uint32_t inRate,
+        uint32_t outRate) {
+    if (inRate == 0 || outRate == 0) {
+        return nullptr;
+    }
+    uint32_t divisor = gcd(inRate, outRate);
+    uint32_t up = outRate / divisor;
+    uint32_t down = inRate / divisor;
+    if (up > kMaxPhases || down > kMaxDecimation) {
+        return nullptr;
+    }
+    return std::unique_ptr<PolyphaseResampler>(new PolyphaseResampler(up, down));
+}
+
+PolyphaseResampler::PolyphaseResampler(uint32_t up, uint32_t down)
+        : mUp(up)
+        , mDown(down)
+        // Longer when decimating, so that the transition band stays as narrow relative to
+        // the output rate. A multiple of 8, for the inner product.
+        , mTaps((2 * kHalfZeroCrossings * std::max(up, down) / up + 7) & ~7u)
+        , mPosition(0)
+        , mPhase(0) {
+    // Prototype low-pass filter at the upsampled rate, cutting off below the lower
+    // Nyquist rate by half the Kaiser window's transition width.
+    const uint32_t length = mUp * mTaps;
+    const double transition = (kStopbandDb - 7.95) / (14.36 * length);
+    const double cutoff = 0.5 / std::max(mUp, mDown) - transition / 2;
+    const double beta = 0.1102 * (kStopbandDb - 8.7);
+    const double center = (length - 1) / 2.0;
+    std::vector<double> prototype(length);
+    for (uint32_t k = 0; k < length; k++) {
+        double t = k - center;
+        double sinc = (t == 0) ? 1 : std::sin(2 * M_PI * cutoff * t) / (2 * M_PI * cutoff * t);
+        double r = t / center;
+        double window = besselI0(beta * std::sqrt(std::max(0.0, 1 - r * r))) / besselI0(beta);
+        prototype[k] = sinc * window;
+    }
+
+    // Split into phases, each normalized to unity gain at DC so that no phase is louder
+    // than another.
+    mBank.resize(length);
+    std::vector<double> phase(mTaps);
+    for (uint32_t p = 0; p < mUp; p++) {
+        double sum = 0;
+        for (uint32_t j = 0; j < mTaps; j++) {
+            phase[j] = prototype[p + j * mUp];
+            sum += phase[j];
+        }
+        for (uint32_t k = 0; k < mTaps; k++) {
+            double coef = std::round(phase[mTaps - 1 - k] / sum * (1 << kCoefShift));
+            mBank[p * mTaps + k] = static_cast<int16_t>(
+                    std::min(std::max(coef, (double) INT16_MIN), (double) INT16_MAX));
+        }
+    }
+}
+
+typedef int16_t Int16x8 __attribute__((vector_size(16)));
+typedef int32_t Int32x8 __attribute__((vector_size(32)));
+
+// Inner product of count samples with count coefficients; count is a multiple of 8.
+// Each lane sums count / 8 products, which stays well inside 32 bits for a low-pass
+// filter in Q14.
+static inline int64_t dotProduct(const int16_t* x, const int16_t* h, size_t count) {
+    Int32x8 acc = {};
+    for (size_t i = 0; i < count; i += 8) {
+        Int16x8 xv;
+        Int16x8 hv;
+        memcpy(&xv, x + i, sizeof(xv));
+        memcpy(&hv, h + i, sizeof(hv));
+        acc += __builtin_convertvector(xv, Int32x8) * __builtin_convertvector(hv, Int32x8);
+    }
+    int64_t sum = 0;
+    for (int lane = 0; lane < 8; lane++) {
+        sum += acc[lane];
+    }
+    return sum;
+}
+
+size_t PolyphaseResampler::resample(const int16_t* in, size_t inCount, int16_t* out,
+        size_t outCapacity) {
+    mInput.insert(mInput.end(), in, in + inCount);
+
+    const int16_t* input = mInput.data();
+    const size_t available = mInput.size();
+    size_t written = 0;
+    while (written < outCapacity && mPosition + mTaps <= available) {
+        int64_t sum = dotProduct(input + mPosition, &mBank[mPhase * mTaps], mTaps);
+        sum = (sum + (1 << (kCoefShift - 1))) >> kCoefShift;
+        out[written++] = static_cast<int16_t>(std::min(std::max(sum, (int64_t) INT16_MIN),
+                (int64_t) INT16_MAX));
+
+        mPhase += mDown;
+        mPosition += mPhase / mUp;
+        mPhase %= mUp;
+    }
+
+    // Drop input that no later window reaches.
+    size_t consumed = std::min(mPosition, available);
+    mInput.erase(mInput.begin(), mInput.begin() + consumed);
+    mPosition -= consumed;
+    return written;
+}
+
+void PolyphaseResampler::reset() {
+    mInput.clear();
+    mPosition = 0;
+    mPhase = 0;
+}
+
+double PolyphaseResampler::getDelay() const {
+    // The first window ends at input sample mTaps - 1, at phase 0; the prototype delays by
+    // half its length at the upsampled rate.
+    return (mTaps - 1) - (mUp * mTaps - 1) / (2.0 * mUp);
+}
+
+}  // namespace android
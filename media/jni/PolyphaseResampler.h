@@ -0,0 +1,97 @@
+/*
+ * Copyright 2017, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _ANDROID_MEDIA_POLYPHASE_RESAMPLER_H_
+#define _ANDROID_MEDIA_POLYPHASE_RESAMPLER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <vector>
+
+namespace android {
+
+/**
+ * Streaming sample rate converter for mono 16 bit PCM, at any ratio of integer rates.
+ *
+ * With the ratio reduced to L/M, the input is conceptually upsampled by L, low-pass
+ * filtered, and decimated by M. Only the filter taps that meet real input samples are
+ * evaluated: the windowed-sinc filter is split into L phases of equal length, computed
+ * once per ratio, and each output sample is one fixed-point inner product of a phase with
+ * the most recent input.
+ *
+ * Input that has not yet produced all of its output is kept across calls, so a stream can
+ * be fed in chunks of any size.
+ */
+class PolyphaseResampler {
+public:
+    // Largest upsampling factor, L, supported; higher ones need too many phases.
+    static const uint32_t kMaxPhases = 1024;
+    // Largest decimation factor, M, supported; the filter grows in proportion to it.
+    static const uint32_t kMaxDecimation = 1024;
+
+    /**
+     * Returns a resampler from inRate to outRate, or nullptr if the reduced ratio needs
+     * more than kMaxPhases phases or decimates by more than kMaxDecimation.
+     */
+    static std::unique_ptr<PolyphaseResampler> create(uint32_t inRate, uint32_t outRate);
+
+    /**
+     * Appends inCount samples to the input, and writes up to outCapacity output samples
+     * to out. Returns the number written; input that does not fit stays queued, and is
+     * resampled by later calls.
+     */
+    size_t resample(const int16_t* in, size_t inCount, int16_t* out, size_t outCapacity);
+
+    /**
+     * Discards queued input, and starts again as if newly created.
+     */
+    void reset();
+
+    /**
+     * Returns the input time, in input samples from the start of the stream, that the
+     * first output sample corresponds to. Output sample t corresponds to input time
+     * getDelay() + t * M / L.
+     */
+    double getDelay() const;
+
+    uint32_t getUpFactor() const { return mUp; }
+    uint32_t getDownFactor() const { return mDown; }
+    uint32_t getTapsPerPhase() const { return mTaps; }
+
+private:
+    PolyphaseResampler(uint32_t up, uint32_t down);
+
+    // Number of fractional bits in the fixed-point filter coefficients.
+    static const int kCoefShift = 14;
+
+    const uint32_t mUp;
+    const uint32_t mDown;
+    const uint32_t mTaps;
+    // mUp phases of mTaps coefficients, each reversed so that it lines up with the input in
+    // ascending order.
+    std::vector<int16_t> mBank;
+
+    // Queued input; the next output's window starts at mPosition.
+    std::vector<int16_t> mInput;
+    size_t mPosition;
+    uint32_t mPhase;
+};
+
+}  // namespace android
+
+#endif  // _ANDROID_MEDIA_POLYPHASE_RESAMPLER_H_
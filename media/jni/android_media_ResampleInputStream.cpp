@@ -26,10 +26,14 @@
 #include <fcntl.h>
 #include <utils/threads.h>
 
+#include <vector>
+
 #include "jni.h"
 #include <nativehelper/JNIHelp.h>
 #include "android_runtime/AndroidRuntime.h"
 
+#include "PolyphaseResampler.h"
+
 
 // ----------------------------------------------------------------------------
 
@@ -107,8 +111,72 @@ static void android_media_ResampleInputStream_fir21(JNIEnv *env, jclass /* clazz
 
 // ----------------------------------------------------------------------------
 
+// A resampler for any other ratio, with buffers to stage samples through, since the
+// Java arrays hold bytes at arbitrary offsets.
+struct ResamplerContext {
+    std::unique_ptr<PolyphaseResampler> resampler;
+    std::vector<int16_t> in;
+    std::vector<int16_t> out;
+};
+
+static jlong android_media_ResampleInputStream_nativeCreate(JNIEnv *env, jclass /* clazz */,
+        jint rateIn, jint rateOut) {
+    if (rateIn <= 0 || rateOut <= 0) {
+        jniThrowExceptionFmt(env, "java/lang/IllegalArgumentException",
+                "invalid sample rates %d -> %d", rateIn, rateOut);
+        return 0;
+    }
+    std::unique_ptr<PolyphaseResampler> resampler = PolyphaseResampler::create(rateIn, rateOut);
+    if (resampler == nullptr) {
+        jniThrowExceptionFmt(env, "java/lang/IllegalArgumentException",
+                "unsupported sample rate ratio %d -> %d", rateIn, rateOut);
+        return 0;
+    }
+    ResamplerContext* context = new ResamplerContext;
+    context->resampler = std::move(resampler);
+    return reinterpret_cast<jlong>(context);
+}
+
+static void android_media_ResampleInputStream_nativeDestroy(JNIEnv* /* env */,
+        jclass /* clazz */, jlong handle) {
+    delete reinterpret_cast<ResamplerContext*>(handle);
+}
+
+// Queues jInLength bytes of input, and writes up to jOutLength bytes of output. Returns the
+// number of bytes written.
+static jint android_media_ResampleInputStream_nativeResample(JNIEnv *env, jclass /* clazz */,
+        jlong handle,
+        jbyteArray jIn, jint jInOffset, jint jInLength,
+        jbyteArray jOut, jint jOutOffset, jint jOutLength) {
+    ResamplerContext* context = reinterpret_cast<ResamplerContext*>(handle);
+
+    size_t inCount = jInLength / 2;
+    if (inCount > 0) {
+        context->in.resize(inCount);
+        env->GetByteArrayRegion(jIn, jInOffset, inCount * 2, (jbyte*)context->in.data());
+        if (env->ExceptionCheck()) {
+            return 0;
+        }
+    }
+
+    size_t outCapacity = jOutLength / 2;
+    if (context->out.size() < outCapacity) {
+        context->out.resize(outCapacity);
+    }
+    size_t outCount = context->resampler->resample(context->in.data(), inCount,
+            context->out.data(), outCapacity);
+
+    env->SetByteArrayRegion(jOut, jOutOffset, outCount * 2, (jbyte*)context->out.data());
+    return outCount * 2;
+}
+
+// ----------------------------------------------------------------------------
+
 static const JNINativeMethod gMethods[] = {
     {"fir21", "([BI[BII)V", (void*)android_media_ResampleInputStream_fir21},
+    {"nativeCreate", "(II)J", (void*)android_media_ResampleInputStream_nativeCreate},
+    {"nativeDestroy", "(J)V", (void*)android_media_ResampleInputStream_nativeDestroy},
+    {"nativeResample", "(J[BII[BII)I", (void*)android_media_ResampleInputStream_nativeResample},
 };
 
 
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "SampleCache"
+#include "utils/Log.h"
+
+#include <sys/stat.h>
+
+#include "SampleCache.h"
+
+namespace android {
+
+bool SampleCacheKey::init(int fd, int64_t offset, int64_t length) {
+    struct stat st;
+    // only a regular file's identity and mtime pin down its bytes; a pipe or socket may
+    // deliver different bytes for the same inode
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        return false;
+    }
+    mDevice = st.st_dev;
+    mInode = st.st_ino;
+    mModifiedTimeNs = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+    mOffset = offset;
+    mLength = length;
+    return true;
+}
+
+hash_t SampleCacheKey::hash() const {
+    uint32_t hash = JenkinsHashMix(0, android::hash_type(static_cast<uint64_t>(mDevice)));
+    hash = JenkinsHashMix(hash, android::hash_type(static_cast<uint64_t>(mInode)));
+    hash = JenkinsHashMix(hash, android::hash_type(mModifiedTimeNs));
+    hash = JenkinsHashMix(hash, android::hash_type(mOffset));
+    hash = JenkinsHashMix(hash, android::hash_type(mLength));
+    return JenkinsHashWhiten(hash);
+}
+
+SampleCache& SampleCache::getInstance() {
+    static SampleCache* sInstance = new SampleCache();
+    return *sInstance;
+}
+
+SampleCache::SampleCache() :
+    mCache(LruCache<SampleCacheKey, sp<DecodedSample> >::kUnlimitedCapacity),
+    mBytes(0)
+{
+    mCache.setOnEntryRemovedListener(this);
+}
+
+sp<DecodedSample> SampleCache::get(const SampleCacheKey& key) {
+    Mutex::Autolock lock(&mLock);
+    return mCache.get(key);
+}
+
+void SampleCache::put(const SampleCacheKey& key, const sp<DecodedSample>& sample) {
+    size_t size = sizeOf(sample);
+    if (size > kMaxBytes) {
+        return;
+    }
+
+    Mutex::Autolock lock(&mLock);
+    // a concurrent load of the same bytes may have got here first
+    if (!mCache.put(key, sample)) {
+        return;
+    }
+    mBytes += size;
+    while (mBytes > kMaxBytes || mCache.size() > kMaxEntries) {
+        mCache.removeOldest();
+    }
+    ALOGV("put: %zu bytes, %zu entries, %zu bytes total", size, mCache.size(), mBytes);
+}
+
+// the whole heap stays mapped for as long as the entry does, whatever the PCM's size
+size_t SampleCache::sizeOf(const sp<DecodedSample>& sample) {
+    return sample->mHeap->getSize();
+}
+
+void SampleCache::operator()(SampleCacheKey& key __unused, sp<DecodedSample>& sample) {
+    mBytes -= sizeOf(sample);
+}
+
+} // end namespace android
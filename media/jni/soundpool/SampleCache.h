@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SAMPLECACHE_H_
+#define SAMPLECACHE_H_
+
+#include <sys/types.h>
+
+#include <utils/JenkinsHash.h>
+#include <utils/LruCache.h>
+#include <utils/threads.h>
+#include <binder/MemoryHeapBase.h>
+#include <system/audio.h>
+
+namespace android {
+
+// identifies the bytes a sample was decoded from
+struct SampleCacheKey {
+    dev_t       mDevice;
+    ino_t       mInode;
+    int64_t     mModifiedTimeNs;
+    int64_t     mOffset;
+    int64_t     mLength;
+
+    // returns false if fd cannot be identified, e.g. because fstat() fails or it is not a
+    // regular file
+    bool init(int fd, int64_t offset, int64_t length);
+
+    hash_t hash() const;
+
+    bool operator==(const SampleCacheKey& other) const {
+        return mDevice == other.mDevice && mInode == other.mInode
+                && mModifiedTimeNs == other.mModifiedTimeNs
+                && mOffset == other.mOffset && mLength == other.mLength;
+    }
+};
+
+inline hash_t hash_type(const SampleCacheKey& key) {
+    return key.hash();
+}
+
+// decoded PCM, shared read-only by every Sample loaded from the same bytes
+class DecodedSample : public RefBase {
+public:
+    DecodedSample(const sp<MemoryHeapBase>& heap, size_t size, uint32_t sampleRate,
+            int numChannels, audio_format_t format) :
+        mHeap(heap), mSize(size), mSampleRate(sampleRate), mNumChannels(numChannels),
+        mFormat(format) {}
+
+    const sp<MemoryHeapBase>    mHeap;
+    const size_t                mSize;
+    const uint32_t              mSampleRate;
+    const int                   mNumChannels;
+    const audio_format_t        mFormat;
+};
+
+/*
+ * Process-wide cache of decoded samples, so that a sample loaded by several SoundPools, or
+ * reloaded after unload(), is decoded once. Bounded by the size of the heaps it keeps
+ * mapped, and by their number, since each heap also holds a file descriptor; least
+ * recently used entries are dropped first.
+ */
+class SampleCache : private OnEntryRemoved<SampleCacheKey, sp<DecodedSample> > {
+public:
+    static SampleCache& getInstance();
+
+    sp<DecodedSample> get(const SampleCacheKey& key);
+    void put(const SampleCacheKey& key, const sp<DecodedSample>& sample);
+
+private:
+    static const size_t kMaxBytes = 8 * 1024 * 1024;
+    static const size_t kMaxEntries = 64;
+
+    SampleCache();
+
+    static size_t sizeOf(const sp<DecodedSample>& sample);
+
+    // OnEntryRemoved
+    virtual void operator()(SampleCacheKey& key, sp<DecodedSample>& sample);
+
+    Mutex                                               mLock;
+    LruCache<SampleCacheKey, sp<DecodedSample> >        mCache;
+    size_t                                              mBytes;
+};
+
+} // end namespace android
+
+#endif /*SAMPLECACHE_H_*/
@@ -19,6 +19,8 @@
 
 #include <inttypes.h>
 
+#include <algorithm>
+
 #include <utils/Log.h>
 
 #define USE_SHARED_MEM_BUFFER
@@ -29,6 +31,7 @@
 #include <media/stagefright/MediaExtractor.h>
 #include "SoundPool.h"
 #include "SoundPoolThread.h"
+#include "SampleCache.h"
 #include <media/AudioPolicyHelper.h>
 #include <media/NdkMediaCodec.h>
 #include <media/NdkMediaExtractor.h>
@@ -62,6 +65,11 @@ SoundPool::SoundPool(int maxChannels, const audio_attributes_t* pAttributes)
     mQuit = false;
     mMuted = false;
     mDecodeThread = 0;
+    mLoadCount = 0;
+    mLoadCacheHits = 0;
+    mLoadFailures = 0;
+    mLoadTotalTime = 0;
+    mLoadMaxTime = 0;
     memcpy(&mAttributes, pAttributes, sizeof(audio_attributes_t));
     mAllocated = 0;
     mNextSampleID = 0;
@@ -475,8 +483,28 @@ void SoundPool::notify(SoundPoolEvent event)
     }
 }
 
+void SoundPool::sampleLoaded(const sp<Sample>& sample, status_t status)
+{
+    nsecs_t latency = systemTime() - sample->loadStartTime();
+    ALOGV("sampleLoaded: sampleID=%d, status=%d, %" PRId64 " us%s", sample->sampleID(), status,
+            ns2us(latency), sample->loadedFromCache() ? " (cached)" : "");
+    Mutex::Autolock lock(&mLock);
+    mLoadCount++;
+    if (status != NO_ERROR) {
+        mLoadFailures++;
+    } else if (sample->loadedFromCache()) {
+        mLoadCacheHits++;
+    }
+    mLoadTotalTime += latency;
+    mLoadMaxTime = std::max(mLoadMaxTime, latency);
+}
+
+// call with sound pool lock held
 void SoundPool::dump()
 {
+    ALOGV("loads: %u completed, %u from cache, %u failed, latency mean %" PRId64
+            " us, max %" PRId64 " us", mLoadCount, mLoadCacheHits, mLoadFailures,
+            mLoadCount ? ns2us(mLoadTotalTime / mLoadCount) : 0, ns2us(mLoadMaxTime));
     for (int i = 0; i < mMaxChannels; ++i) {
         mChannelPool[i].dump();
     }
@@ -503,6 +531,8 @@ void Sample::init()
     mFd = -1;
     mOffset = 0;
     mLength = 0;
+    mLoadStartTime = 0;
+    mLoadedFromCache = false;
 }
 
 Sample::~Sample()
@@ -669,6 +699,26 @@ status_t Sample::doLoad()
     int numChannels;
     audio_format_t format;
     status_t status;
+    SampleCacheKey key;
+    bool cacheable = key.init(mFd, mOffset, mLength);
+    sp<DecodedSample> decoded;
+
+    if (cacheable && (decoded = SampleCache::getInstance().get(key)) != NULL) {
+        ALOGV("close(%d)", mFd);
+        ::close(mFd);
+        mFd = -1;
+        ALOGV("Using cached decode");
+        mHeap = decoded->mHeap;
+        mSize = decoded->mSize;
+        mData = new MemoryBase(mHeap, 0, mSize);
+        mSampleRate = decoded->mSampleRate;
+        mNumChannels = decoded->mNumChannels;
+        mFormat = decoded->mFormat;
+        mLoadedFromCache = true;
+        mState = READY;
+        return NO_ERROR;
+    }
+
     mHeap = new MemoryHeapBase(kDefaultHeapSize);
 
     ALOGV("Start decode");
@@ -696,6 +746,18 @@ status_t Sample::doLoad()
         goto error;
     }
 
+    if (cacheable && mSize > 0) {
+        // The decode heap is sized for the longest sample. Cache, and play from, a copy that
+        // fits this one, so that the decode heap is freed here.
+        sp<MemoryHeapBase> heap = new MemoryHeapBase(mSize);
+        if (heap->getHeapID() >= 0) {
+            memcpy(heap->getBase(), mHeap->getBase(), mSize);
+            mHeap = heap;
+            SampleCache::getInstance().put(key,
+                    new DecodedSample(mHeap, mSize, sampleRate, numChannels, format));
+        }
+    }
+
     mData = new MemoryBase(mHeap, 0, mSize);
     mSampleRate = sampleRate;
     mNumChannels = numChannels;
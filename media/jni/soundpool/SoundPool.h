@@ -62,8 +62,10 @@ public:
     int state() { return mState; }
     uint8_t* data() { return static_cast<uint8_t*>(mData->pointer()); }
     status_t doLoad();
-    void startLoad() { mState = LOADING; }
+    void startLoad() { mState = LOADING; mLoadStartTime = systemTime(); }
     sp<IMemory> getIMemory() { return mData; }
+    nsecs_t loadStartTime() { return mLoadStartTime; }
+    bool loadedFromCache() { return mLoadedFromCache; }
 
 private:
     void init();
@@ -80,6 +82,8 @@ private:
     int64_t             mLength;
     sp<IMemory>         mData;
     sp<MemoryHeapBase>  mHeap;
+    nsecs_t             mLoadStartTime;
+    bool                mLoadedFromCache;
 };
 
 // stores pending events for stolen channels
@@ -182,7 +186,7 @@ public:
     const audio_attributes_t* attributes() { return &mAttributes; }
 
     // called from SoundPoolThread
-    void sampleLoaded(int sampleID);
+    void sampleLoaded(const sp<Sample>& sample, status_t status);
     sp<Sample> findSample(int sampleID);
 
     // called from AudioTrack thread
@@ -227,6 +231,13 @@ private:
     bool                    mQuit;
     bool                    mMuted;
 
+    // load completion, from load() to the end of decoding; reported by dump()
+    uint32_t                mLoadCount;
+    uint32_t                mLoadCacheHits;
+    uint32_t                mLoadFailures;
+    nsecs_t                 mLoadTotalTime;
+    nsecs_t                 mLoadMaxTime;
+
     // callback
     Mutex                   mCallbackLock;
     SoundPoolCallback*      mCallback;
@@ -18,6 +18,12 @@
 #define LOG_TAG "SoundPoolThread"
 #include "utils/Log.h"
 
+#include <unistd.h>
+
+#include <algorithm>
+
+#include <cutils/properties.h>
+
 #include "SoundPoolThread.h"
 
 namespace android {
@@ -31,7 +37,7 @@ void SoundPoolThread::write(SoundPoolMsg msg) {
     // if thread is quitting, don't add to queue
     if (mRunning) {
         mMsgQueue.push(msg);
-        mCondition.signal();
+        mCondition.broadcast();
     }
 }
 
@@ -42,7 +48,7 @@ const SoundPoolMsg SoundPoolThread::read() {
     }
     SoundPoolMsg msg = mMsgQueue[0];
     mMsgQueue.removeAt(0);
-    mCondition.signal();
+    mCondition.broadcast();
     return msg;
 }
 
@@ -51,20 +57,43 @@ void SoundPoolThread::quit() {
     if (mRunning) {
         mRunning = false;
         mMsgQueue.clear();
-        mMsgQueue.push(SoundPoolMsg(SoundPoolMsg::KILL, 0));
-        mCondition.signal();
-        mCondition.wait(mLock);
+        for (int i = 0; i < mThreadCount; i++) {
+            mMsgQueue.push(SoundPoolMsg(SoundPoolMsg::KILL, 0));
+        }
+        mCondition.broadcast();
+        while (mThreadCount > 0) {
+            mCondition.wait(mLock);
+        }
     }
     ALOGV("return from quit");
 }
 
+int SoundPoolThread::defaultThreadCount() {
+    int numThreads = property_get_int32("media.soundpool.decode_threads", 0);
+    if (numThreads <= 0) {
+        numThreads = std::min(static_cast<int>(sysconf(_SC_NPROCESSORS_ONLN)),
+                kMaxDefaultThreads);
+    }
+    return std::max(numThreads, 1);
+}
+
 SoundPoolThread::SoundPoolThread(SoundPool* soundPool) :
-    mSoundPool(soundPool)
+    SoundPoolThread(soundPool, defaultThreadCount())
+{
+}
+
+SoundPoolThread::SoundPoolThread(SoundPool* soundPool, int numThreads) :
+    mSoundPool(soundPool), mRunning(false), mThreadCount(0)
 {
+    ALOGV("starting %d decode threads", numThreads);
     mMsgQueue.setCapacity(maxMessages);
-    if (createThreadEtc(beginThread, this, "SoundPoolThread")) {
-        mRunning = true;
+    Mutex::Autolock lock(&mLock);
+    for (int i = 0; i < numThreads; i++) {
+        if (createThreadEtc(beginThread, this, "SoundPoolThread")) {
+            mThreadCount++;
+        }
     }
+    mRunning = mThreadCount > 0;
 }
 
 SoundPoolThread::~SoundPoolThread()
@@ -84,9 +113,13 @@ int SoundPoolThread::run() {
         SoundPoolMsg msg = read();
         ALOGV("Got message m=%d, mData=%d", msg.mMessageType, msg.mData);
         switch (msg.mMessageType) {
-        case SoundPoolMsg::KILL:
+        case SoundPoolMsg::KILL: {
             ALOGV("goodbye");
+            Mutex::Autolock lock(&mLock);
+            mThreadCount--;
+            mCondition.broadcast();
             return NO_ERROR;
+        }
         case SoundPoolMsg::LOAD_SAMPLE:
             doLoadSample(msg.mData);
             break;
@@ -107,6 +140,7 @@ void SoundPoolThread::doLoadSample(int sampleID) {
     status_t status = -1;
     if (sample != 0) {
         status = sample->doLoad();
+        mSoundPool->sampleLoaded(sample, status);
     }
     mSoundPool->notify(SoundPoolEvent(SoundPoolEvent::SAMPLE_LOADED, sampleID, status));
 }
@@ -36,11 +36,14 @@ public:
 };
 
 /*
- * This class handles background requests from the SoundPool
+ * This class handles background requests from the SoundPool on a pool of worker threads,
+ * so that samples decode in parallel. The number of workers defaults to the number of CPUs,
+ * up to kMaxDefaultThreads, and can be set with the media.soundpool.decode_threads property.
  */
 class SoundPoolThread {
 public:
     explicit SoundPoolThread(SoundPool* SoundPool);
+    SoundPoolThread(SoundPool* SoundPool, int numThreads);
     ~SoundPoolThread();
     void loadSample(int sampleID);
     void quit();
@@ -48,7 +51,9 @@ public:
 
 private:
     static const size_t maxMessages = 128;
+    static const int kMaxDefaultThreads = 4;
 
+    static int defaultThreadCount();
     static int beginThread(void* arg);
     int run();
     void doLoadSample(int sampleID);
@@ -59,6 +64,7 @@ private:
     Vector<SoundPoolMsg>    mMsgQueue;
     SoundPool*              mSoundPool;
     bool                    mRunning;
+    int                     mThreadCount;   // workers that have not exited yet
 };
 
 } // end namespace android
@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include "PolyphaseResampler.h"
+
+#include <cmath>
+#include <vector>
+
+using namespace android;
+
+static const double kAmplitude = 16384;
+
+static std::vector<int16_t> makeSine(uint32_t rate, double frequency, size_t count) {
+    std::vector<int16_t> samples(count);
+    for (size_t i = 0; i < count; i++) {
+        samples[i] = static_cast<int16_t>(
+                std::lround(kAmplitude * std::sin(2 * M_PI * frequency * i / rate)));
+    }
+    return samples;
+}
+
+// One second of a tone, resampled in one call and compared against the exact tone at the
+// input times the output samples correspond to. The first and last tenth are skipped,
+// since the filter has no input before the start or after the end.
+static double measureSnr(uint32_t inRate, uint32_t outRate, double frequency) {
+    std::unique_ptr<PolyphaseResampler> resampler = PolyphaseResampler::create(inRate, outRate);
+    EXPECT_NE(nullptr, resampler);
+    if (resampler == nullptr) {
+        return 0;
+    }
+    std::vector<int16_t> in = makeSine(inRate, frequency, inRate);
+    std::vector<int16_t> out(outRate + 1);
+    size_t count = resampler->resample(in.data(), in.size(), out.data(), out.size());
+    EXPECT_GT(count, outRate * 9 / 10);
+
+    const double step = (double) resampler->getDownFactor() / resampler->getUpFactor();
+    double signal = 0;
+    double noise = 0;
+    for (size_t t = count / 10; t < count * 9 / 10; t++) {
+        double time = resampler->getDelay() + t * step;
+        double expected = kAmplitude * std::sin(2 * M_PI * frequency * time / inRate);
+        signal += expected * expected;
+        noise += (out[t] - expected) * (out[t] - expected);
+    }
+    return 10 * std::log10(signal / noise);
+}
+
+TEST(PolyphaseResampler, create) {
+    std::unique_ptr<PolyphaseResampler> resampler = PolyphaseResampler::create(44100, 48000);
+    ASSERT_NE(nullptr, resampler);
+    EXPECT_EQ(160u, resampler->getUpFactor());
+    EXPECT_EQ(147u, resampler->getDownFactor());
+    EXPECT_EQ(0u, resampler->getTapsPerPhase() % 8);
+
+    EXPECT_EQ(nullptr, PolyphaseResampler::create(0, 48000));
+    EXPECT_EQ(nullptr, PolyphaseResampler::create(48000, 0));
+    // 48001 shares no factor with 44100, so the ratio does not reduce below 48001 phases.
+    EXPECT_EQ(nullptr, PolyphaseResampler::create(44100, 48001));
+
+    // Decimating by 48000 would need a filter millions of taps long.
+    EXPECT_EQ(nullptr, PolyphaseResampler::create(48000, 1));
+    const uint32_t maxDecimation = PolyphaseResampler::kMaxDecimation;
+    std::unique_ptr<PolyphaseResampler> decimator =
+            PolyphaseResampler::create(maxDecimation * 8, 8);
+    ASSERT_NE(nullptr, decimator);
+    EXPECT_EQ(maxDecimation, decimator->getDownFactor());
+    EXPECT_EQ(nullptr, PolyphaseResampler::create((maxDecimation + 1) * 8, 8));
+}
+
+TEST(PolyphaseResampler, snr) {
+    EXPECT_GT(measureSnr(44100, 48000, 1000), 70);
+    EXPECT_GT(measureSnr(44100, 48000, 15000), 70);
+    EXPECT_GT(measureSnr(48000, 16000, 1000), 70);
+    EXPECT_GT(measureSnr(48000, 16000, 5000), 70);
+    EXPECT_GT(measureSnr(44100, 16000, 3000), 70);
+    EXPECT_GT(measureSnr(16000, 48000, 3000), 70);
+    EXPECT_GT(measureSnr(8000, 44100, 3000), 70);
+}
+
+// A tone above the output Nyquist rate must be filtered out, not aliased into the band.
+TEST(PolyphaseResampler, stopband) {
+    std::unique_ptr<PolyphaseResampler> resampler = PolyphaseResampler::create(48000, 16000);
+    ASSERT_NE(nullptr, resampler);
+    std::vector<int16_t> in = makeSine(48000, 12000, 48000);
+    std::vector<int16_t> out(16001);
+    size_t count = resampler->resample(in.data(), in.size(), out.data(), out.size());
+    double power = 0;
+    for (size_t t = count / 10; t < count * 9 / 10; t++) {
+        power += (double) out[t] * out[t];
+    }
+    power /= count * 8 / 10;
+    double attenuation = 10 * std::log10(kAmplitude * kAmplitude / 2 / power);
+    EXPECT_GT(attenuation, 70);
+}
+
+// Feeding the input in uneven chunks, with a small output buffer, must give exactly the
+// output of a single call.
+TEST(PolyphaseResampler, streaming) {
+    std::vector<int16_t> in = makeSine(44100, 1000, 44100);
+
+    std::unique_ptr<PolyphaseResampler> whole = PolyphaseResampler::create(44100, 16000);
+    ASSERT_NE(nullptr, whole);
+    std::vector<int16_t> expected(16001);
+    expected.resize(whole->resample(in.data(), in.size(), expected.data(), expected.size()));
+
+    std::unique_ptr<PolyphaseResampler> chunked = PolyphaseResampler::create(44100, 16000);
+    ASSERT_NE(nullptr, chunked);
+    std::vector<int16_t> actual;
+    int16_t buffer[37];
+    size_t position = 0;
+    for (size_t chunk = 1; position < in.size(); chunk = chunk * 7 % 509 + 1) {
+        size_t count = std::min(chunk, in.size() - position);
+        size_t written = chunked->resample(&in[position], count, buffer, 37);
+        actual.insert(actual.end(), buffer, buffer + written);
+        while ((written = chunked->resample(nullptr, 0, buffer, 37)) > 0) {
+            actual.insert(actual.end(), buffer, buffer + written);
+        }
+        position += count;
+    }
+    EXPECT_EQ(expected, actual);
+
+    // After reset() the stream starts over.
+    chunked->reset();
+    std::vector<int16_t> again(16001);
+    again.resize(chunked->resample(in.data(), in.size(), again.data(), again.size()));
+    EXPECT_EQ(expected, again);
+}
+
+// Full scale input must saturate rather than wrap around.
+TEST(PolyphaseResampler, saturation) {
+    std::unique_ptr<PolyphaseResampler> resampler = PolyphaseResampler::create(44100, 48000);
+    ASSERT_NE(nullptr, resampler);
+    std::vector<int16_t> in(4096);
+    for (size_t i = 0; i < in.size(); i++) {
+        in[i] = (i / 3) % 2 ? INT16_MAX : INT16_MIN;
+    }
+    std::vector<int16_t> out(4500);
+    size_t count = resampler->resample(in.data(), in.size(), out.data(), out.size());
+    for (size_t t = 0; t < count; t++) {
+        int16_t previous = t > 0 ? out[t - 1] : 0;
+        // a wrapped sample jumps across almost the whole range
+        ASSERT_LT(std::abs(out[t] - previous), 60000) << "at " << t;
+    }
+}
@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include "soundpool/SampleCache.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <android-base/file.h>
+#include <android-base/test_utils.h>
+
+using namespace android;
+
+static const size_t kMegabyte = 1024 * 1024;
+
+// The cache is process-wide, so every test uses keys of its own device.
+static SampleCacheKey makeKey(dev_t device, int64_t offset) {
+    SampleCacheKey key;
+    key.mDevice = device;
+    key.mInode = 1;
+    key.mModifiedTimeNs = 0;
+    key.mOffset = offset;
+    key.mLength = 100;
+    return key;
+}
+
+static sp<DecodedSample> makeSample(size_t heapSize, size_t pcmSize) {
+    return new DecodedSample(new MemoryHeapBase(heapSize), pcmSize, 44100, 2,
+            AUDIO_FORMAT_PCM_16_BIT);
+}
+
+static sp<DecodedSample> makeSample(size_t size) {
+    return makeSample(size, size);
+}
+
+TEST(SampleCacheKey, IdentifiesRegularFile) {
+    TemporaryFile file;
+    ASSERT_TRUE(base::WriteStringToFd("not really audio", file.fd));
+
+    SampleCacheKey key;
+    ASSERT_TRUE(key.init(file.fd, 4, 8));
+    EXPECT_EQ(4, key.mOffset);
+    EXPECT_EQ(8, key.mLength);
+
+    // Another descriptor for the same file yields the same key.
+    int fd = open(file.path, O_RDONLY);
+    ASSERT_GE(fd, 0);
+    SampleCacheKey other;
+    ASSERT_TRUE(other.init(fd, 4, 8));
+    close(fd);
+    EXPECT_TRUE(key == other);
+    EXPECT_EQ(key.hash(), other.hash());
+
+    ASSERT_TRUE(other.init(file.fd, 5, 8));
+    EXPECT_FALSE(key == other);
+    ASSERT_TRUE(other.init(file.fd, 4, 9));
+    EXPECT_FALSE(key == other);
+}
+
+TEST(SampleCacheKey, ChangesWhenFileIsModified) {
+    TemporaryFile file;
+    SampleCacheKey key;
+    ASSERT_TRUE(key.init(file.fd, 0, 0));
+
+    struct timespec times[2] = { { 1000, 0 }, { 1000, 0 } };
+    ASSERT_EQ(0, futimens(file.fd, times));
+    SampleCacheKey other;
+    ASSERT_TRUE(other.init(file.fd, 0, 0));
+    EXPECT_FALSE(key == other);
+}
+
+TEST(SampleCacheKey, RejectsPipe) {
+    int fds[2];
+    ASSERT_EQ(0, pipe(fds));
+    SampleCacheKey key;
+    EXPECT_FALSE(key.init(fds[0], 0, 0));
+    EXPECT_FALSE(key.init(fds[1], 0, 0));
+    close(fds[0]);
+    close(fds[1]);
+}
+
+TEST(SampleCacheKey, RejectsDirectoryAndBadFd) {
+    TemporaryDir dir;
+    int fd = open(dir.path, O_RDONLY | O_DIRECTORY);
+    ASSERT_GE(fd, 0);
+    SampleCacheKey key;
+    EXPECT_FALSE(key.init(fd, 0, 0));
+    close(fd);
+
+    EXPECT_FALSE(key.init(-1, 0, 0));
+}
+
+TEST(SampleCache, GetReturnsPutSample) {
+    SampleCache& cache = SampleCache::getInstance();
+    const SampleCacheKey key = makeKey(1, 0);
+    EXPECT_EQ(nullptr, cache.get(key).get());
+
+    sp<DecodedSample> sample = makeSample(1000);
+    cache.put(key, sample);
+    EXPECT_EQ(sample.get(), cache.get(key).get());
+    EXPECT_EQ(nullptr, cache.get(makeKey(1, 1)).get());
+
+    // A second decode of the same bytes does not replace the first.
+    cache.put(key, makeSample(1000));
+    EXPECT_EQ(sample.get(), cache.get(key).get());
+}
+
+TEST(SampleCache, SkipsSampleLargerThanCache) {
+    SampleCache& cache = SampleCache::getInstance();
+    const SampleCacheKey key = makeKey(2, 0);
+    cache.put(key, makeSample(9 * kMegabyte));
+    EXPECT_EQ(nullptr, cache.get(key).get());
+}
+
+TEST(SampleCache, EvictsLeastRecentlyUsed) {
+    SampleCache& cache = SampleCache::getInstance();
+    const SampleCacheKey first = makeKey(3, 0);
+    const SampleCacheKey second = makeKey(3, 1);
+    const SampleCacheKey third = makeKey(3, 2);
+    const SampleCacheKey fourth = makeKey(3, 3);
+
+    cache.put(first, makeSample(3 * kMegabyte));
+    cache.put(second, makeSample(3 * kMegabyte));
+    ASSERT_NE(nullptr, cache.get(first).get());
+
+    // Over the limit, the least recently used sample goes first; that is second, since
+    // first was just looked up.
+    cache.put(third, makeSample(3 * kMegabyte));
+    EXPECT_NE(nullptr, cache.get(first).get());
+    EXPECT_EQ(nullptr, cache.get(second).get());
+    EXPECT_NE(nullptr, cache.get(third).get());
+
+    cache.put(fourth, makeSample(3 * kMegabyte));
+    EXPECT_EQ(nullptr, cache.get(first).get());
+    EXPECT_NE(nullptr, cache.get(third).get());
+    EXPECT_NE(nullptr, cache.get(fourth).get());
+}
+
+TEST(SampleCache, ChargesWholeHeap) {
+    SampleCache& cache = SampleCache::getInstance();
+    const SampleCacheKey first = makeKey(4, 0);
+    const SampleCacheKey second = makeKey(4, 1);
+    const SampleCacheKey third = makeKey(4, 2);
+
+    // A short sample in a large heap keeps all of the heap mapped.
+    cache.put(first, makeSample(3 * kMegabyte, 1000));
+    cache.put(second, makeSample(3 * kMegabyte, 1000));
+    cache.put(third, makeSample(3 * kMegabyte, 1000));
+    EXPECT_EQ(nullptr, cache.get(first).get());
+    EXPECT_NE(nullptr, cache.get(second).get());
+    EXPECT_NE(nullptr, cache.get(third).get());
+}
+
+TEST(SampleCache, LimitsEntryCount) {
+    SampleCache& cache = SampleCache::getInstance();
+    // Each entry holds an fd, so the count is bounded even for samples that fit many times.
+    const int kEntries = 65;
+    for (int i = 0; i < kEntries; i++) {
+        cache.put(makeKey(5, i), makeSample(getpagesize()));
+    }
+    EXPECT_EQ(nullptr, cache.get(makeKey(5, 0)).get());
+    for (int i = 1; i < kEntries; i++) {
+        EXPECT_NE(nullptr, cache.get(makeKey(5, i)).get()) << i;
+    }
+}
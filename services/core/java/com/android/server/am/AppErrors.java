@@ -926,6 +926,7 @@ class AppErrors {
         }
 
         info.append(processCpuTracker.printCurrentState(anrTime));
+        processCpuTracker.close();
 
         Slog.e(TAG, info.toString());
         if (tracesFile == null) {
@@ -21,6 +21,7 @@ import static android.net.NetworkStats.ROAMING_NO;
 import static android.net.NetworkStats.SET_ALL;
 import static android.net.NetworkStats.SET_DEFAULT;
 import static android.net.NetworkStats.SET_FOREGROUND;
+import static android.net.NetworkStats.TAG_ALL;
 import static android.net.NetworkStats.TAG_NONE;
 import static android.net.NetworkStats.UID_ALL;
 import static com.android.server.NetworkManagementSocketTagger.kernelToTag;
@@ -200,6 +201,25 @@ public class NetworkStatsFactoryTest {
         NetworkStatsFactory.noteStackedIface("v4-wlan0", null);
     }
 
+    @Test
+    public void testNetworkStatsDetailChanges() throws Exception {
+        stageFile(R.raw.xt_qtaguid_typical, file("net/xt_qtaguid/stats"));
+        NetworkStats stats = mFactory.readNetworkStatsDetailChanges(UID_ALL, null, TAG_ALL, null);
+        assertEquals(70, stats.size());
+        assertStatsEntry(stats, "wlan0", 0, SET_DEFAULT, 0x0, 18621L, 2898L);
+
+        // Nothing changed.
+        stats = mFactory.readNetworkStatsDetailChanges(UID_ALL, null, TAG_ALL, stats);
+        assertEquals(0, stats.size());
+
+        stageFile(R.raw.xt_qtaguid_with_clat_100mb_download_before, file("net/xt_qtaguid/stats"));
+        mFactory.readNetworkStatsDetailChanges(UID_ALL, null, TAG_ALL, null);
+        stageFile(R.raw.xt_qtaguid_with_clat_100mb_download_after, file("net/xt_qtaguid/stats"));
+        stats = mFactory.readNetworkStatsDetailChanges(UID_ALL, null, TAG_ALL, null);
+        assertEquals(14, stats.size());
+        assertStatsEntry(stats, "v4-wlan0", 10106, SET_FOREGROUND, 0x0, 432952718L, 5442288L);
+    }
+
     /**
      * Copy a {@link Resources#openRawResource(int)} into {@link File} for
      * testing purposes.
@@ -17,6 +17,8 @@
 #include "DominatorTree.h"
 
 #include <algorithm>
+#include <cstring>
+#include <unordered_map>
 
 #include "android-base/logging.h"
 
@@ -24,12 +26,57 @@
 
 namespace aapt {
 
+// Returns a key that is equal for two configurations exactly when
+// ResTable_config::diff() would not report CONFIG_LOCALE between them.
+static std::string LocaleKey(const ConfigDescription& config) {
+  char key[sizeof(config.locale) + sizeof(config.localeScript) +
+           sizeof(config.localeVariant)] = {};
+  char* p = key;
+  memcpy(p, &config.locale, sizeof(config.locale));
+  p += sizeof(config.locale);
+  if (!config.localeScriptWasComputed) {
+    memcpy(p, config.localeScript, sizeof(config.localeScript));
+  }
+  p += sizeof(config.localeScript);
+  memcpy(p, config.localeVariant, sizeof(config.localeVariant));
+  return std::string(key, sizeof(key));
+}
+
 DominatorTree::DominatorTree(
     const std::vector<std::unique_ptr<ResourceConfigValue>>& configs) {
-  for (const auto& config : configs) {
-    product_roots_[config->product].TryAddChild(
+  // ConfigDescription::Dominates() never relates configurations with different
+  // locales, so each (product, locale) pair can be built on its own root.
+  std::map<std::string, std::unordered_map<std::string, Node>> locale_roots;
+  std::unordered_map<const ResourceConfigValue*, size_t> insertion_order;
+  insertion_order.reserve(configs.size());
+  for (size_t i = 0; i < configs.size(); i++) {
+    const auto& config = configs[i];
+    insertion_order[config.get()] = i;
+    locale_roots[config->product][LocaleKey(config->config)].TryAddChild(
         util::make_unique<Node>(config.get(), nullptr));
   }
+
+  // A node only ever joins the top level by being appended to it, so each
+  // forest's top-level nodes are in insertion order. Interleave the forests
+  // back into that order, which is what a single tree would have produced.
+  for (auto& product_entry : locale_roots) {
+    std::vector<std::unique_ptr<Node>> top_level;
+    for (auto& locale_entry : product_entry.second) {
+      for (auto& child : locale_entry.second.children_) {
+        top_level.push_back(std::move(child));
+      }
+    }
+    std::sort(top_level.begin(), top_level.end(),
+              [&](const std::unique_ptr<Node>& a, const std::unique_ptr<Node>& b) {
+                return insertion_order[a->value_] < insertion_order[b->value_];
+              });
+
+    Node& root = product_roots_[product_entry.first];
+    for (auto& child : top_level) {
+      child->parent_ = &root;
+    }
+    root.children_ = std::move(top_level);
+  }
 }
 
 void DominatorTree::Accept(Visitor* visitor) {
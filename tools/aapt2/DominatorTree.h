@@ -41,6 +41,12 @@ namespace aapt {
  * For example, v21 is more specific than v11, and w1200dp is more specific than
  * w800dp.
  *
+ * Configurations for different locales never dominate one another, so the tree
+ * is built as one independent forest per locale and the forests' top-level
+ * nodes are then merged in the order the configurations were given. The result
+ * is the same as inserting every configuration into a single tree, but entries
+ * with many locale variants are no longer quadratic to build.
+ *
  * The dominator tree relies on the underlying configurations passed to it. If
  * the configurations passed to the dominator tree go out of scope, the tree
  * will exhibit undefined behavior.
@@ -68,6 +74,8 @@ class DominatorTree {
     bool TryAddChild(std::unique_ptr<Node> new_child);
 
    private:
+    friend class DominatorTree;
+
     bool AddChild(std::unique_ptr<Node> new_child);
     bool Dominates(const Node* other) const;
 
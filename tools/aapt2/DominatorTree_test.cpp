@@ -171,4 +171,36 @@ TEST(DominatorTreeTest, LocalesAreNeverDominated) {
   EXPECT_EQ(expected, printer.ToString(&tree));
 }
 
+TEST(DominatorTreeTest, InterleavedLocalesKeepInsertionOrder) {
+  const ConfigDescription land_config = test::ParseConfigOrDie("land");
+  const ConfigDescription v21_config = test::ParseConfigOrDie("v21");
+  const ConfigDescription fr_config = test::ParseConfigOrDie("fr");
+  const ConfigDescription fr_land_config = test::ParseConfigOrDie("fr-land");
+  const ConfigDescription de_config = test::ParseConfigOrDie("de");
+
+  std::vector<std::unique_ptr<ResourceConfigValue>> configs;
+  configs.push_back(util::make_unique<ResourceConfigValue>(fr_land_config, ""));
+  configs.push_back(util::make_unique<ResourceConfigValue>(ConfigDescription::DefaultConfig(), ""));
+  configs.push_back(util::make_unique<ResourceConfigValue>(de_config, ""));
+  configs.push_back(util::make_unique<ResourceConfigValue>(land_config, ""));
+  configs.push_back(util::make_unique<ResourceConfigValue>(fr_config, ""));
+  configs.push_back(util::make_unique<ResourceConfigValue>(v21_config, ""));
+
+  DominatorTree tree(configs);
+  PrettyPrinter printer;
+
+  std::string expected =
+      "<default>\n"
+      "  land\n"
+      "  v21\n"
+      "de\n"
+      "fr\n"
+      "  fr-land\n";
+  EXPECT_EQ(expected, printer.ToString(&tree));
+
+  for (const auto& top_level : tree.product_roots().at("").children()) {
+    EXPECT_TRUE(top_level->parent()->is_root_node());
+  }
+}
+
 }  // namespace aapt
@@ -20,7 +20,6 @@
 #include "ValueVisitor.h"
 #include "flatten/Archive.h"
 #include "flatten/TableFlattener.h"
-#include "io/BigBufferInputStream.h"
 #include "io/Util.h"
 
 namespace aapt {
@@ -91,17 +90,10 @@ bool LoadedApk::WriteToArchive(IAaptContext* context, const TableFlattenerOption
 
     // The resource table needs to be re-serialized since it might have changed.
     if (path == "resources.arsc") {
-      BigBuffer buffer(4096);
       // TODO(adamlesinski): How to determine if there were sparse entries (and if to encode
       // with sparse entries) b/35389232.
-      TableFlattener flattener(options, &buffer);
-      if (!flattener.Consume(context, table_.get())) {
-        return false;
-      }
-
-      io::BigBufferInputStream input_stream(&buffer);
-      if (!io::CopyInputStreamToArchive(context, &input_stream, path, ArchiveEntry::kAlign,
-                                        writer)) {
+      if (!FlattenTableToArchive(context, options, table_.get(), path, ArchiveEntry::kAlign,
+                                 writer)) {
         return false;
       }
 
@@ -170,15 +170,21 @@ StringPool::Ref StringPool::MakeRefImpl(const StringPiece& str,
       return Ref(iter->second);
     }
   }
+  return Ref(NewEntry(str, context));
+}
 
-  Entry* entry = new Entry();
+StringPool::Entry* StringPool::NewEntry(const StringPiece& str, const Context& context) {
+  Entry* entry = entry_arena_.Alloc();
   entry->value = str.to_string();
   entry->context = context;
   entry->index = strings_.size();
   entry->ref_ = 0;
-  strings_.emplace_back(entry);
-  indexed_strings_.insert(std::make_pair(StringPiece(entry->value), entry));
-  return Ref(entry);
+  strings_.push_back(entry);
+
+  // Only the first record for a value is indexed; later ones (styles, merged pools)
+  // are deliberately kept distinct.
+  indexed_strings_.emplace(StringPiece(entry->value), entry);
+  return entry;
 }
 
 StringPool::StyleRef StringPool::MakeRef(const StyleString& str) {
@@ -187,59 +193,54 @@ StringPool::StyleRef StringPool::MakeRef(const StyleString& str) {
 
 StringPool::StyleRef StringPool::MakeRef(const StyleString& str,
                                          const Context& context) {
-  Entry* entry = new Entry();
-  entry->value = str.str;
-  entry->context = context;
-  entry->index = strings_.size();
-  entry->ref_ = 0;
-  strings_.emplace_back(entry);
-  indexed_strings_.insert(std::make_pair(StringPiece(entry->value), entry));
+  Entry* entry = NewEntry(str.str, context);
 
-  StyleEntry* style_entry = new StyleEntry();
+  StyleEntry* style_entry = style_arena_.Alloc();
   style_entry->str = Ref(entry);
+  style_entry->spans.reserve(str.spans.size());
   for (const aapt::Span& span : str.spans) {
     style_entry->spans.emplace_back(
         Span{MakeRef(span.name), span.first_char, span.last_char});
   }
   style_entry->ref_ = 0;
-  styles_.emplace_back(style_entry);
+  styles_.push_back(style_entry);
   return StyleRef(style_entry);
 }
 
 StringPool::StyleRef StringPool::MakeRef(const StyleRef& ref) {
-  Entry* entry = new Entry();
-  entry->value = *ref.entry_->str;
-  entry->context = ref.entry_->str.entry_->context;
-  entry->index = strings_.size();
-  entry->ref_ = 0;
-  strings_.emplace_back(entry);
-  indexed_strings_.insert(std::make_pair(StringPiece(entry->value), entry));
+  Entry* entry = NewEntry(*ref.entry_->str, ref.entry_->str.entry_->context);
 
-  StyleEntry* style_entry = new StyleEntry();
+  StyleEntry* style_entry = style_arena_.Alloc();
   style_entry->str = Ref(entry);
+  style_entry->spans.reserve(ref.entry_->spans.size());
   for (const Span& span : ref.entry_->spans) {
     style_entry->spans.emplace_back(
         Span{MakeRef(*span.name), span.first_char, span.last_char});
   }
   style_entry->ref_ = 0;
-  styles_.emplace_back(style_entry);
+  styles_.push_back(style_entry);
   return StyleRef(style_entry);
 }
 
 void StringPool::Merge(StringPool&& pool) {
+  // Existing values keep their index entry, the merged ones are only reachable
+  // through the references already held on them.
   indexed_strings_.insert(pool.indexed_strings_.begin(),
                           pool.indexed_strings_.end());
   pool.indexed_strings_.clear();
-  std::move(pool.strings_.begin(), pool.strings_.end(),
-            std::back_inserter(strings_));
+
+  entry_arena_.Adopt(std::move(pool.entry_arena_));
+  style_arena_.Adopt(std::move(pool.style_arena_));
+
+  const size_t offset = strings_.size();
+  strings_.insert(strings_.end(), pool.strings_.begin(), pool.strings_.end());
   pool.strings_.clear();
-  std::move(pool.styles_.begin(), pool.styles_.end(),
-            std::back_inserter(styles_));
+  styles_.insert(styles_.end(), pool.styles_.begin(), pool.styles_.end());
   pool.styles_.clear();
 
-  // Assign the indices.
+  // Only the adopted entries need new indices.
   const size_t len = strings_.size();
-  for (size_t index = 0; index < len; index++) {
+  for (size_t index = offset; index < len; index++) {
     strings_[index]->index = index;
   }
 }
@@ -247,35 +248,43 @@ void StringPool::Merge(StringPool&& pool) {
 void StringPool::HintWillAdd(size_t stringCount, size_t styleCount) {
   strings_.reserve(strings_.size() + stringCount);
   styles_.reserve(styles_.size() + styleCount);
+  indexed_strings_.reserve(indexed_strings_.size() + stringCount);
 }
 
-void StringPool::Prune() {
-  const auto iter_end = indexed_strings_.end();
-  auto index_iter = indexed_strings_.begin();
-  while (index_iter != iter_end) {
-    if (index_iter->second->ref_ <= 0) {
-      index_iter = indexed_strings_.erase(index_iter);
-    } else {
-      ++index_iter;
-    }
+void StringPool::ReindexStrings() {
+  indexed_strings_.clear();
+  indexed_strings_.reserve(strings_.size());
+  for (Entry* entry : strings_) {
+    indexed_strings_.emplace(StringPiece(entry->value), entry);
   }
+}
 
-  auto end_iter2 =
-      std::remove_if(strings_.begin(), strings_.end(),
-                     [](const std::unique_ptr<Entry>& entry) -> bool {
-                       return entry->ref_ <= 0;
-                     });
+void StringPool::Prune() {
+  // Styles go first so that the references they hold on their strings are
+  // released before the strings are examined.
+  auto styles_end = std::stable_partition(
+      styles_.begin(), styles_.end(),
+      [](const StyleEntry* entry) -> bool { return entry->ref_ > 0; });
+  for (auto iter = styles_end; iter != styles_.end(); ++iter) {
+    (*iter)->str = Ref();
+    std::vector<Span>().swap((*iter)->spans);
+  }
+  styles_.erase(styles_end, styles_.end());
 
-  auto end_iter3 =
-      std::remove_if(styles_.begin(), styles_.end(),
-                     [](const std::unique_ptr<StyleEntry>& entry) -> bool {
-                       return entry->ref_ <= 0;
-                     });
+  auto strings_end = std::stable_partition(
+      strings_.begin(), strings_.end(),
+      [](const Entry* entry) -> bool { return entry->ref_ > 0; });
+  if (strings_end == strings_.end()) {
+    return;
+  }
 
-  // Remove the entries at the end or else we'll be accessing
-  // a deleted string from the StyleEntry.
-  strings_.erase(end_iter2, strings_.end());
-  styles_.erase(end_iter3, styles_.end());
+  // Release the string data of the dead records. Their slots stay in the arena,
+  // but nothing can reach them once the index is rebuilt from the survivors.
+  for (auto iter = strings_end; iter != strings_.end(); ++iter) {
+    std::string().swap((*iter)->value);
+  }
+  strings_.erase(strings_end, strings_.end());
+  ReindexStrings();
 
   // Reassign the indices.
   const size_t len = strings_.size();
@@ -286,10 +295,8 @@ void StringPool::Prune() {
 
 void StringPool::Sort(
     const std::function<bool(const Entry&, const Entry&)>& cmp) {
-  std::sort(
-      strings_.begin(), strings_.end(),
-      [&cmp](const std::unique_ptr<Entry>& a,
-             const std::unique_ptr<Entry>& b) -> bool { return cmp(*a, *b); });
+  std::sort(strings_.begin(), strings_.end(),
+            [&cmp](const Entry* a, const Entry* b) -> bool { return cmp(*a, *b); });
 
   // Assign the indices.
   const size_t len = strings_.size();
@@ -297,12 +304,18 @@ void StringPool::Sort(
     strings_[index]->index = index;
   }
 
-  // Reorder the styles.
-  std::sort(styles_.begin(), styles_.end(),
-            [](const std::unique_ptr<StyleEntry>& lhs,
-               const std::unique_ptr<StyleEntry>& rhs) -> bool {
-              return lhs->str.index() < rhs->str.index();
-            });
+  // Reorder the styles. Each style owns a distinct string, so they can be
+  // placed directly by string index instead of being sorted.
+  std::vector<StyleEntry*> by_index(len, nullptr);
+  for (StyleEntry* style : styles_) {
+    by_index[style->str.index()] = style;
+  }
+  auto out_iter = styles_.begin();
+  for (StyleEntry* style : by_index) {
+    if (style != nullptr) {
+      *out_iter++ = style;
+    }
+  }
 }
 
 template <typename T>
@@ -17,7 +17,9 @@
 #ifndef AAPT_STRING_POOL_H
 #define AAPT_STRING_POOL_H
 
+#include <algorithm>
 #include <functional>
+#include <iterator>
 #include <memory>
 #include <string>
 #include <unordered_map>
@@ -143,7 +145,7 @@ class StringPool {
     int ref_;
   };
 
-  using const_iterator = std::vector<std::unique_ptr<Entry>>::const_iterator;
+  using const_iterator = std::vector<Entry*>::const_iterator;
 
   static bool FlattenUtf8(BigBuffer* out, const StringPool& pool);
   static bool FlattenUtf16(BigBuffer* out, const StringPool& pool);
@@ -184,8 +186,9 @@ class StringPool {
   StyleRef MakeRef(const StyleRef& ref);
 
   /**
-   * Moves pool into this one without coalescing strings. When this
-   * function returns, pool will be empty.
+   * Moves pool into this one without coalescing strings. The entries and their
+   * backing storage are adopted rather than copied, so references into pool remain
+   * valid. When this function returns, pool will be empty.
    */
   void Merge(StringPool&& pool);
 
@@ -212,6 +215,38 @@ class StringPool {
  private:
   DISALLOW_COPY_AND_ASSIGN(StringPool);
 
+  /**
+   * Bump allocator for pool records. Entries are handed out of slabs that grow
+   * geometrically, so a pool holding millions of strings makes a few hundred
+   * allocations instead of one per string. Records are never freed individually;
+   * pruned records are reset and their memory is returned when the pool dies.
+   */
+  template <typename T>
+  class Arena {
+   public:
+    Arena() = default;
+    Arena(Arena&&) = default;
+    Arena& operator=(Arena&&) = default;
+
+    T* Alloc();
+
+    /**
+     * Takes ownership of all the slabs in other. Slots left unused in other's
+     * last slab are abandoned.
+     */
+    void Adopt(Arena&& other);
+
+   private:
+    DISALLOW_COPY_AND_ASSIGN(Arena);
+
+    static constexpr size_t kMinSlabSize = 16u;
+    static constexpr size_t kMaxSlabSize = 1024u;
+
+    std::vector<std::unique_ptr<T[]>> slabs_;
+    size_t slab_size_ = 0u;
+    size_t slab_used_ = 0u;
+  };
+
   friend const_iterator begin(const StringPool& pool);
   friend const_iterator end(const StringPool& pool);
 
@@ -219,9 +254,22 @@ class StringPool {
 
   Ref MakeRefImpl(const android::StringPiece& str, const Context& context, bool unique);
 
-  std::vector<std::unique_ptr<Entry>> strings_;
-  std::vector<std::unique_ptr<StyleEntry>> styles_;
-  std::unordered_multimap<android::StringPiece, Entry*> indexed_strings_;
+  Entry* NewEntry(const android::StringPiece& str, const Context& context);
+
+  // Rebuilds indexed_strings_ so that each value maps to its first live entry.
+  void ReindexStrings();
+
+  // Backing storage for every Entry and StyleEntry owned by this pool.
+  Arena<Entry> entry_arena_;
+  Arena<StyleEntry> style_arena_;
+
+  // The live entries, in index order. Sort and Prune permute and compact these
+  // arrays; the records themselves never move.
+  std::vector<Entry*> strings_;
+  std::vector<StyleEntry*> styles_;
+
+  // One record per distinct string value, used to hash-cons MakeRef() calls.
+  std::unordered_map<android::StringPiece, Entry*> indexed_strings_;
 };
 
 //
@@ -230,6 +278,35 @@ class StringPool {
 
 inline size_t StringPool::size() const { return strings_.size(); }
 
+template <typename T>
+T* StringPool::Arena<T>::Alloc() {
+  if (slab_used_ == slab_size_) {
+    slab_size_ = slab_size_ == 0u ? kMinSlabSize : std::min(slab_size_ * 2u, kMaxSlabSize);
+    slabs_.emplace_back(new T[slab_size_]);
+    slab_used_ = 0u;
+  }
+  return &slabs_.back()[slab_used_++];
+}
+
+template <typename T>
+void StringPool::Arena<T>::Adopt(Arena&& other) {
+  if (other.slabs_.empty()) {
+    return;
+  }
+
+  // Keep our own partially filled slab last so that allocation continues in it.
+  auto insert_iter = slabs_.empty() ? slabs_.end() : std::prev(slabs_.end());
+  slabs_.insert(insert_iter, std::make_move_iterator(other.slabs_.begin()),
+                std::make_move_iterator(other.slabs_.end()));
+  if (slab_size_ == 0u) {
+    slab_size_ = other.slab_size_;
+    slab_used_ = other.slab_used_;
+  }
+  other.slabs_.clear();
+  other.slab_size_ = 0u;
+  other.slab_used_ = 0u;
+}
+
 inline StringPool::const_iterator begin(const StringPool& pool) {
   return pool.strings_.begin();
 }
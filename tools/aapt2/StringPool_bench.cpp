@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "StringPool.h"
+
+#include <string>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+
+namespace aapt {
+
+// Fills each pool with `strings_per_library` strings, where half of every library's
+// strings are shared with all the other libraries. This mimics a set of static
+// libraries depending on the same support libraries.
+static void FillLibraryPools(size_t strings_per_library, std::vector<StringPool>* pools,
+                             std::vector<StringPool::Ref>* out_refs) {
+  for (size_t lib = 0; lib < pools->size(); lib++) {
+    for (size_t i = 0; i < strings_per_library; i++) {
+      std::string value = (i % 2 == 0) ? "res/layout/shared_layout_" + std::to_string(i)
+                                       : "lib" + std::to_string(lib) + "_string_" + std::to_string(i);
+      out_refs->push_back((*pools)[lib].MakeRef(value));
+    }
+  }
+}
+
+static bool CompareEntries(const StringPool::Entry& a, const StringPool::Entry& b) {
+  int diff = a.context.priority - b.context.priority;
+  if (diff == 0) {
+    return a.value < b.value;
+  }
+  return diff < 0;
+}
+
+// Copies every library's strings into one pool, as TableMerger does when it clones
+// values into the final table, then sorts and prunes it like TableFlattener.
+static void BM_StringPoolMergeLibraries(benchmark::State& state) {
+  std::vector<StringPool> libraries(state.range(0));
+  std::vector<StringPool::Ref> library_refs;
+  FillLibraryPools(state.range(1), &libraries, &library_refs);
+
+  while (state.KeepRunning()) {
+    StringPool pool;
+    std::vector<StringPool::Ref> refs;
+    refs.reserve(library_refs.size());
+    for (const StringPool::Ref& ref : library_refs) {
+      refs.push_back(pool.MakeRef(*ref, ref.GetContext()));
+    }
+    refs.resize(refs.size() / 2);
+    pool.Sort(CompareEntries);
+    pool.Prune();
+    benchmark::DoNotOptimize(pool.size());
+  }
+  state.SetItemsProcessed(state.iterations() * library_refs.size());
+}
+BENCHMARK(BM_StringPoolMergeLibraries)->Args({10, 1000})->Args({100, 1000})->Args({100, 10000});
+
+// Moves whole pools into one without coalescing, as XmlFlattener does per package.
+static void BM_StringPoolMergePools(benchmark::State& state) {
+  while (state.KeepRunning()) {
+    state.PauseTiming();
+    StringPool pool;
+    std::vector<StringPool> libraries(state.range(0));
+    std::vector<StringPool::Ref> refs;
+    FillLibraryPools(state.range(1), &libraries, &refs);
+    state.ResumeTiming();
+
+    for (StringPool& library : libraries) {
+      pool.Merge(std::move(library));
+    }
+    pool.Sort(CompareEntries);
+    benchmark::DoNotOptimize(pool.size());
+
+    state.PauseTiming();
+    refs.clear();
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0) * state.range(1));
+}
+BENCHMARK(BM_StringPoolMergePools)->Args({10, 1000})->Args({100, 1000});
+
+}  // namespace aapt
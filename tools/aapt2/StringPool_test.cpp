@@ -168,6 +168,50 @@ TEST(StringPoolTest, DoNotDedupeStyleWithSameStringAsNonStyle) {
   EXPECT_NE(ref.index(), styleRef.index());
 }
 
+TEST(StringPoolTest, MergeKeepsReferencesAndDedupe) {
+  StringPool pool;
+  StringPool::Ref ref = pool.MakeRef("foo");
+
+  StringPool other;
+  StringPool::Ref ref2 = other.MakeRef("bar");
+  StringPool::Ref ref3 = other.MakeRef("foo");
+  StringPool::StyleRef ref4 = other.MakeRef(StyleString{{"baz"}, {Span{{"b"}, 0, 1}}});
+
+  pool.Merge(std::move(other));
+  EXPECT_EQ(0u, other.size());
+  EXPECT_EQ(5u, pool.size());
+
+  EXPECT_EQ(*ref2, "bar");
+  EXPECT_EQ(1u, ref2.index());
+  EXPECT_EQ(*ref3, "foo");
+  EXPECT_EQ(2u, ref3.index());
+  EXPECT_EQ(*(ref4->str), "baz");
+  EXPECT_EQ(*(ref4->spans.front().name), "b");
+
+  // The value already in the pool keeps servicing lookups.
+  EXPECT_EQ(ref.index(), pool.MakeRef("foo").index());
+  EXPECT_EQ(ref2.index(), pool.MakeRef("bar").index());
+}
+
+TEST(StringPoolTest, PruneRemovesStylesAndTheirStrings) {
+  StringPool pool;
+
+  StringPool::Ref ref = pool.MakeRef("foo");
+  {
+    StringPool::StyleRef style_ref = pool.MakeRef(StyleString{{"bar"}, {Span{{"b"}, 0, 1}}});
+    EXPECT_EQ(3u, pool.size());
+  }
+
+  pool.Prune();
+  ASSERT_EQ(1u, pool.size());
+  EXPECT_EQ(0u, ref.index());
+
+  // Pruned values must no longer be found in the index.
+  StringPool::Ref ref2 = pool.MakeRef("bar");
+  EXPECT_EQ(1u, ref2.index());
+  EXPECT_EQ(2u, pool.size());
+}
+
 TEST(StringPoolTest, FlattenEmptyStringPoolUtf8) {
   using namespace android;  // For NO_ERROR on Windows.
 
@@ -42,6 +42,7 @@
 #include "proto/ProtoSerialize.h"
 #include "util/Files.h"
 #include "util/Maybe.h"
+#include "util/Trace.h"
 #include "util/Util.h"
 #include "xml/XmlDom.h"
 #include "xml/XmlPullParser.h"
@@ -117,6 +118,7 @@ struct CompileOptions {
   bool no_png_crunch = false;
   bool legacy_mode = false;
   bool verbose = false;
+  Maybe<std::string> trace_output_path;
 };
 
 static std::string BuildIntermediateFilename(const ResourcePathData& data) {
@@ -193,6 +195,7 @@ static bool LoadInputFilesFromDir(IAaptContext* context, const CompileOptions& o
 static bool CompileTable(IAaptContext* context, const CompileOptions& options,
                          const ResourcePathData& path_data, IArchiveWriter* writer,
                          const std::string& output_path) {
+  trace::ScopedEvent trace_event("compile_table", path_data.source.path);
   ResourceTable table;
   {
     std::ifstream fin(path_data.source.path, std::ifstream::binary);
@@ -387,6 +390,7 @@ static bool IsValidFile(IAaptContext* context, const StringPiece& input_path) {
 static bool CompileXml(IAaptContext* context, const CompileOptions& options,
                        const ResourcePathData& path_data, IArchiveWriter* writer,
                        const std::string& output_path) {
+  trace::ScopedEvent trace_event("compile_xml", path_data.source.path);
   if (context->IsVerbose()) {
     context->GetDiagnostics()->Note(DiagMessage(path_data.source) << "compiling XML");
   }
@@ -468,6 +472,7 @@ static bool CompileXml(IAaptContext* context, const CompileOptions& options,
 static bool CompilePng(IAaptContext* context, const CompileOptions& options,
                        const ResourcePathData& path_data, IArchiveWriter* writer,
                        const std::string& output_path) {
+  trace::ScopedEvent trace_event("compile_png", path_data.source.path);
   if (context->IsVerbose()) {
     context->GetDiagnostics()->Note(DiagMessage(path_data.source) << "compiling PNG");
   }
@@ -494,7 +499,11 @@ static bool CompilePng(IAaptContext* context, const CompileOptions& options,
     // Ensure that we only keep the chunks we care about if we end up
     // using the original PNG instead of the crunched one.
     PngChunkFilter png_chunk_filter(content);
-    std::unique_ptr<Image> image = ReadPng(context, path_data.source, &png_chunk_filter);
+    std::unique_ptr<Image> image;
+    {
+      trace::ScopedEvent read_event("read_png");
+      image = ReadPng(context, path_data.source, &png_chunk_filter);
+    }
     if (!image) {
       return false;
     }
@@ -527,8 +536,11 @@ static bool CompilePng(IAaptContext* context, const CompileOptions& options,
     }
 
     // Write the crunched PNG.
-    if (!WritePng(context, image.get(), nine_patch.get(), &crunched_png_buffer_out, {})) {
-      return false;
+    {
+      trace::ScopedEvent write_event("write_png");
+      if (!WritePng(context, image.get(), nine_patch.get(), &crunched_png_buffer_out, {})) {
+        return false;
+      }
     }
 
     if (nine_patch != nullptr ||
@@ -578,6 +590,7 @@ static bool CompilePng(IAaptContext* context, const CompileOptions& options,
 static bool CompileFile(IAaptContext* context, const CompileOptions& options,
                         const ResourcePathData& path_data, IArchiveWriter* writer,
                         const std::string& output_path) {
+  trace::ScopedEvent trace_event("compile_file", path_data.source.path);
   if (context->IsVerbose()) {
     context->GetDiagnostics()->Note(DiagMessage(path_data.source) << "compiling file");
   }
@@ -654,64 +667,43 @@ class CompileContext : public IAaptContext {
 };
 
 /**
- * Entry point for compilation phase. Parses arguments and dispatches to the
- * correct steps.
+ * Compiles every input named on the command line or found under --dir into the output archive.
  */
-int Compile(const std::vector<StringPiece>& args, IDiagnostics* diagnostics) {
-  CompileContext context(diagnostics);
-  CompileOptions options;
-
-  bool verbose = false;
-  Flags flags =
-      Flags()
-          .RequiredFlag("-o", "Output path", &options.output_path)
-          .OptionalFlag("--dir", "Directory to scan for resources", &options.res_dir)
-          .OptionalSwitch("--pseudo-localize",
-                          "Generate resources for pseudo-locales "
-                          "(en-XA and ar-XB)",
-                          &options.pseudolocalize)
-          .OptionalSwitch("--no-crunch", "Disables PNG processing", &options.no_png_crunch)
-          .OptionalSwitch("--legacy", "Treat errors that used to be valid in AAPT as warnings",
-                          &options.legacy_mode)
-          .OptionalSwitch("-v", "Enables verbose logging", &verbose);
-  if (!flags.Parse("aapt2 compile", args, &std::cerr)) {
-    return 1;
-  }
-
-  context.SetVerbose(verbose);
+static int CompileInputs(CompileContext* context, const CompileOptions& options, Flags* flags) {
+  trace::ScopedEvent trace_event("compile");
 
   std::unique_ptr<IArchiveWriter> archive_writer;
 
   std::vector<ResourcePathData> input_data;
   if (options.res_dir) {
-    if (!flags.GetArgs().empty()) {
+    if (!flags->GetArgs().empty()) {
       // Can't have both files and a resource directory.
-      context.GetDiagnostics()->Error(DiagMessage() << "files given but --dir specified");
-      flags.Usage("aapt2 compile", &std::cerr);
+      context->GetDiagnostics()->Error(DiagMessage() << "files given but --dir specified");
+      flags->Usage("aapt2 compile", &std::cerr);
       return 1;
     }
 
-    if (!LoadInputFilesFromDir(&context, options, &input_data)) {
+    if (!LoadInputFilesFromDir(context, options, &input_data)) {
       return 1;
     }
 
-    archive_writer = CreateZipFileArchiveWriter(context.GetDiagnostics(), options.output_path);
+    archive_writer = CreateZipFileArchiveWriter(context->GetDiagnostics(), options.output_path);
 
   } else {
-    input_data.reserve(flags.GetArgs().size());
+    input_data.reserve(flags->GetArgs().size());
 
     // Collect data from the path for each input file.
-    for (const std::string& arg : flags.GetArgs()) {
+    for (const std::string& arg : flags->GetArgs()) {
       std::string error_str;
       if (Maybe<ResourcePathData> path_data = ExtractResourcePathData(arg, &error_str)) {
         input_data.push_back(std::move(path_data.value()));
       } else {
-        context.GetDiagnostics()->Error(DiagMessage() << error_str << " (" << arg << ")");
+        context->GetDiagnostics()->Error(DiagMessage() << error_str << " (" << arg << ")");
         return 1;
       }
     }
 
-    archive_writer = CreateDirectoryArchiveWriter(context.GetDiagnostics(), options.output_path);
+    archive_writer = CreateDirectoryArchiveWriter(context->GetDiagnostics(), options.output_path);
   }
 
   if (!archive_writer) {
@@ -721,20 +713,21 @@ int Compile(const std::vector<StringPiece>& args, IDiagnostics* diagnostics) {
   bool error = false;
   for (ResourcePathData& path_data : input_data) {
     if (options.verbose) {
-      context.GetDiagnostics()->Note(DiagMessage(path_data.source) << "processing");
+      context->GetDiagnostics()->Note(DiagMessage(path_data.source) << "processing");
     }
 
-    if (!IsValidFile(&context, path_data.source.path)) {
+    if (!IsValidFile(context, path_data.source.path)) {
       error = true;
       continue;
     }
+    trace::IncrementCounter("files_processed", 1);
 
     if (path_data.resource_dir == "values") {
       // Overwrite the extension.
       path_data.extension = "arsc";
 
       const std::string output_filename = BuildIntermediateFilename(path_data);
-      if (!CompileTable(&context, options, path_data, archive_writer.get(), output_filename)) {
+      if (!CompileTable(context, options, path_data, archive_writer.get(), output_filename)) {
         error = true;
       }
 
@@ -743,36 +736,75 @@ int Compile(const std::vector<StringPiece>& args, IDiagnostics* diagnostics) {
       if (const ResourceType* type = ParseResourceType(path_data.resource_dir)) {
         if (*type != ResourceType::kRaw) {
           if (path_data.extension == "xml") {
-            if (!CompileXml(&context, options, path_data, archive_writer.get(), output_filename)) {
+            if (!CompileXml(context, options, path_data, archive_writer.get(), output_filename)) {
               error = true;
             }
           } else if (!options.no_png_crunch &&
                      (path_data.extension == "png" || path_data.extension == "9.png")) {
-            if (!CompilePng(&context, options, path_data, archive_writer.get(), output_filename)) {
+            if (!CompilePng(context, options, path_data, archive_writer.get(), output_filename)) {
               error = true;
             }
           } else {
-            if (!CompileFile(&context, options, path_data, archive_writer.get(), output_filename)) {
+            if (!CompileFile(context, options, path_data, archive_writer.get(), output_filename)) {
               error = true;
             }
           }
         } else {
-          if (!CompileFile(&context, options, path_data, archive_writer.get(), output_filename)) {
+          if (!CompileFile(context, options, path_data, archive_writer.get(), output_filename)) {
             error = true;
           }
         }
       } else {
-        context.GetDiagnostics()->Error(DiagMessage() << "invalid file path '" << path_data.source
-                                                      << "'");
+        context->GetDiagnostics()->Error(DiagMessage() << "invalid file path '"
+                                                       << path_data.source << "'");
         error = true;
       }
     }
   }
 
-  if (error) {
+  return error ? 1 : 0;
+}
+
+/**
+ * Entry point for compilation phase. Parses arguments and dispatches to the
+ * correct steps.
+ */
+int Compile(const std::vector<StringPiece>& args, IDiagnostics* diagnostics) {
+  CompileContext context(diagnostics);
+  CompileOptions options;
+
+  bool verbose = false;
+  Flags flags =
+      Flags()
+          .RequiredFlag("-o", "Output path", &options.output_path)
+          .OptionalFlag("--dir", "Directory to scan for resources", &options.res_dir)
+          .OptionalSwitch("--pseudo-localize",
+                          "Generate resources for pseudo-locales "
+                          "(en-XA and ar-XB)",
+                          &options.pseudolocalize)
+          .OptionalSwitch("--no-crunch", "Disables PNG processing", &options.no_png_crunch)
+          .OptionalSwitch("--legacy", "Treat errors that used to be valid in AAPT as warnings",
+                          &options.legacy_mode)
+          .OptionalFlag("--trace-output",
+                        "Writes a Chrome trace-event JSON profile of the compilation to this file",
+                        &options.trace_output_path)
+          .OptionalSwitch("-v", "Enables verbose logging", &verbose);
+  if (!flags.Parse("aapt2 compile", args, &std::cerr)) {
+    return 1;
+  }
+
+  context.SetVerbose(verbose);
+
+  if (options.trace_output_path) {
+    trace::Start();
+  }
+
+  const int result = CompileInputs(&context, options, &flags);
+  if (options.trace_output_path &&
+      !trace::WriteJsonToFile(options.trace_output_path.value(), context.GetDiagnostics())) {
     return 1;
   }
-  return 0;
+  return result;
 }
 
 }  // namespace aapt
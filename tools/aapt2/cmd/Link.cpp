@@ -59,6 +59,7 @@
 #include "split/TableSplitter.h"
 #include "unflatten/BinaryResourceParser.h"
 #include "util/Files.h"
+#include "util/Trace.h"
 #include "xml/XmlDom.h"
 
 using android::StringPiece;
@@ -570,6 +571,8 @@ bool ResourceFileFlattener::Flatten(ResourceTable* table, IArchiveWriter* archiv
       for (auto& map_entry : config_sorted_files) {
         const ConfigDescription& config = map_entry.first.first;
         FileOperation& file_op = map_entry.second;
+        trace::ScopedEvent trace_event("flatten_file", file_op.dst_path);
+        trace::IncrementCounter("files_processed", 1);
 
         if (file_op.xml_to_flatten) {
           std::vector<std::unique_ptr<xml::XmlResource>> versioned_docs =
@@ -692,6 +695,7 @@ class LinkCommand {
    * the results for faster lookup.
    */
   bool LoadSymbolsFromIncludePaths() {
+    trace::ScopedEvent trace_event("load_includes");
     std::unique_ptr<AssetManagerSymbolSource> asset_source =
         util::make_unique<AssetManagerSymbolSource>();
     for (const std::string& path : options_.include_paths) {
@@ -896,19 +900,13 @@ class LinkCommand {
   }
 
   bool FlattenTable(ResourceTable* table, IArchiveWriter* writer) {
-    BigBuffer buffer(1024);
-    TableFlattener flattener(options_.table_flattener_options, &buffer);
-    if (!flattener.Consume(context_, table)) {
-      context_->GetDiagnostics()->Error(DiagMessage() << "failed to flatten resource table");
-      return false;
-    }
-
-    io::BigBufferInputStream input_stream(&buffer);
-    return io::CopyInputStreamToArchive(context_, &input_stream, "resources.arsc",
-                                        ArchiveEntry::kAlign, writer);
+    trace::ScopedEvent trace_event("flatten_table");
+    return FlattenTableToArchive(context_, options_.table_flattener_options, table,
+                                 "resources.arsc", ArchiveEntry::kAlign, writer);
   }
 
   bool FlattenTableToPb(ResourceTable* table, IArchiveWriter* writer) {
+    trace::ScopedEvent trace_event("flatten_table_pb");
     std::unique_ptr<pb::ResourceTable> pb_table = SerializeTableToPb(table);
     return io::CopyProtoToArchive(context_, pb_table.get(), "resources.arsc.flat", 0, writer);
   }
@@ -920,6 +918,8 @@ class LinkCommand {
       return true;
     }
 
+    trace::ScopedEvent trace_event("generate_java", out_package);
+
     std::string out_path = options_.generate_java_class_path.value();
     file::AppendPath(&out_path, file::PackageToPath(out_package));
     if (!file::mkdirs(out_path)) {
@@ -1024,6 +1024,8 @@ class LinkCommand {
       return true;
     }
 
+    trace::ScopedEvent trace_event("write_proguard");
+
     const std::string& out_path = out.value();
     std::ofstream fout(out_path, std::ofstream::binary);
     if (!fout) {
@@ -1065,6 +1067,7 @@ class LinkCommand {
   }
 
   bool MergeStaticLibrary(const std::string& input, bool override) {
+    trace::ScopedEvent trace_event("merge_static_library", input);
     if (context_->IsVerbose()) {
       context_->GetDiagnostics()->Note(DiagMessage() << "merging static library " << input);
     }
@@ -1124,6 +1127,8 @@ class LinkCommand {
   }
 
   bool MergeResourceTable(io::IFile* file, bool override) {
+    trace::ScopedEvent trace_event("merge_table", file->GetSource().path);
+    trace::IncrementCounter("files_processed", 1);
     if (context_->IsVerbose()) {
       context_->GetDiagnostics()->Note(DiagMessage() << "merging resource table "
                                                      << file->GetSource());
@@ -1151,6 +1156,8 @@ class LinkCommand {
   }
 
   bool MergeCompiledFile(io::IFile* file, ResourceFile* file_desc, bool override) {
+    trace::ScopedEvent trace_event("merge_file", file->GetSource().path);
+    trace::IncrementCounter("files_processed", 1);
     if (context_->IsVerbose()) {
       context_->GetDiagnostics()->Note(DiagMessage() << "merging '" << file_desc->name
                                                      << "' from compiled file "
@@ -1204,6 +1211,7 @@ class LinkCommand {
    * io::IFileCollections that are open.
    */
   bool MergeArchive(const std::string& input, bool override) {
+    trace::ScopedEvent trace_event("merge_archive", input);
     if (context_->IsVerbose()) {
       context_->GetDiagnostics()->Note(DiagMessage() << "merging archive " << input);
     }
@@ -1331,6 +1339,7 @@ class LinkCommand {
   }
 
   bool CopyAssetsDirsToApk(IArchiveWriter* writer) {
+    trace::ScopedEvent trace_event("copy_assets");
     std::map<std::string, std::unique_ptr<io::RegularFile>> merged_assets;
     for (const std::string& assets_dir : options_.assets_dirs) {
       Maybe<std::vector<std::string>> files =
@@ -1376,6 +1385,7 @@ class LinkCommand {
    */
   bool WriteApk(IArchiveWriter* writer, proguard::KeepSet* keep_set, xml::XmlResource* manifest,
                 ResourceTable* table) {
+    trace::ScopedEvent trace_event("write_apk");
     const bool keep_raw_values = context_->GetPackageType() == PackageType::kStaticLib;
     bool result = FlattenXml(context_, manifest, "AndroidManifest.xml", keep_raw_values, writer);
     if (!result) {
@@ -1395,9 +1405,12 @@ class LinkCommand {
 
     ResourceFileFlattener file_flattener(file_flattener_options, context_, keep_set);
 
-    if (!file_flattener.Flatten(table, writer)) {
-      context_->GetDiagnostics()->Error(DiagMessage() << "failed linking file resources");
-      return false;
+    {
+      trace::ScopedEvent flatten_event("flatten_files");
+      if (!file_flattener.Flatten(table, writer)) {
+        context_->GetDiagnostics()->Error(DiagMessage() << "failed linking file resources");
+        return false;
+      }
     }
 
     if (context_->GetPackageType() == PackageType::kStaticLib) {
@@ -1414,6 +1427,8 @@ class LinkCommand {
   }
 
   int Run(const std::vector<std::string>& input_files) {
+    trace::ScopedEvent trace_event("link");
+
     // Load the AndroidManifest.xml
     std::unique_ptr<xml::XmlResource> manifest_xml =
         LoadXml(options_.manifest_path, context_->GetDiagnostics());
@@ -1471,17 +1486,20 @@ class LinkCommand {
                                                        context_->GetPackageId()));
     }
 
-    for (const std::string& input : input_files) {
-      if (!MergePath(input, false)) {
-        context_->GetDiagnostics()->Error(DiagMessage() << "failed parsing input");
-        return 1;
+    {
+      trace::ScopedEvent merge_event("merge_inputs");
+      for (const std::string& input : input_files) {
+        if (!MergePath(input, false)) {
+          context_->GetDiagnostics()->Error(DiagMessage() << "failed parsing input");
+          return 1;
+        }
       }
-    }
 
-    for (const std::string& input : options_.overlay_files) {
-      if (!MergePath(input, true)) {
-        context_->GetDiagnostics()->Error(DiagMessage() << "failed parsing overlays");
-        return 1;
+      for (const std::string& input : options_.overlay_files) {
+        if (!MergePath(input, true)) {
+          context_->GetDiagnostics()->Error(DiagMessage() << "failed parsing overlays");
+          return 1;
+        }
       }
     }
 
@@ -1497,6 +1515,7 @@ class LinkCommand {
       }
 
       // Assign IDs if we are building a regular app.
+      trace::ScopedEvent id_event("assign_ids");
       IdAssigner id_assigner(&options_.stable_id_map);
       if (!id_assigner.Consume(context_, &final_table_)) {
         context_->GetDiagnostics()->Error(DiagMessage() << "failed assigning IDs");
@@ -1551,10 +1570,13 @@ class LinkCommand {
           util::make_unique<FeatureSplitSymbolTableDelegate>(context_));
     }
 
-    ReferenceLinker linker;
-    if (!linker.Consume(context_, &final_table_)) {
-      context_->GetDiagnostics()->Error(DiagMessage() << "failed linking references");
-      return 1;
+    {
+      trace::ScopedEvent link_event("link_references");
+      ReferenceLinker linker;
+      if (!linker.Consume(context_, &final_table_)) {
+        context_->GetDiagnostics()->Error(DiagMessage() << "failed linking references");
+        return 1;
+      }
     }
 
     if (context_->GetPackageType() == PackageType::kStaticLib) {
@@ -1571,6 +1593,7 @@ class LinkCommand {
     }
 
     if (!options_.no_auto_version) {
+      trace::ScopedEvent version_event("auto_version");
       AutoVersioner versioner;
       if (!versioner.Consume(context_, &final_table_)) {
         context_->GetDiagnostics()->Error(DiagMessage() << "failed versioning styles");
@@ -1585,6 +1608,7 @@ class LinkCommand {
                                          << context_->GetMinSdkVersion());
       }
 
+      trace::ScopedEvent collapse_event("collapse_versions");
       VersionCollapser collapser;
       if (!collapser.Consume(context_, &final_table_)) {
         return 1;
@@ -1592,6 +1616,7 @@ class LinkCommand {
     }
 
     if (!options_.no_resource_deduping) {
+      trace::ScopedEvent dedupe_event("dedupe");
       ResourceDeduper deduper;
       if (!deduper.Consume(context_, &final_table_)) {
         context_->GetDiagnostics()->Error(DiagMessage() << "failed deduping resources");
@@ -1618,7 +1643,11 @@ class LinkCommand {
       if (!table_splitter.VerifySplitConstraints(context_)) {
         return 1;
       }
-      table_splitter.SplitTable(&final_table_);
+
+      {
+        trace::ScopedEvent split_event("split_table");
+        table_splitter.SplitTable(&final_table_);
+      }
 
       // Now we need to write out the Split APKs.
       auto path_iter = options_.split_paths.begin();
@@ -1840,6 +1869,7 @@ int Link(const std::vector<StringPiece>& args, IDiagnostics* diagnostics) {
   bool static_lib = false;
   Maybe<std::string> stable_id_file_path;
   std::vector<std::string> split_args;
+  Maybe<std::string> trace_output_path;
   Flags flags =
       Flags()
           .RequiredFlag("-o", "Output path.", &options.output_path)
@@ -1965,6 +1995,9 @@ int Link(const std::vector<StringPiece>& args, IDiagnostics* diagnostics) {
                             "Syntax: path/to/output.apk:<config>[,<config>[...]].\n"
                             "On Windows, use a semicolon ';' separator instead.",
                             &split_args)
+          .OptionalFlag("--trace-output",
+                        "Writes a Chrome trace-event JSON profile of the link to this file.",
+                        &trace_output_path)
           .OptionalSwitch("-v", "Enables verbose logging.", &verbose);
 
   if (!flags.Parse("aapt2 link", args, &std::cerr)) {
@@ -2110,8 +2143,16 @@ int Link(const std::vector<StringPiece>& args, IDiagnostics* diagnostics) {
     options.no_version_transitions = true;
   }
 
+  if (trace_output_path) {
+    trace::Start();
+  }
+
   LinkCommand cmd(&context, options);
-  return cmd.Run(arg_list);
+  const int result = cmd.Run(arg_list);
+  if (trace_output_path && !trace::WriteJsonToFile(trace_output_path.value(), diagnostics)) {
+    return 1;
+  }
+  return result;
 }
 
 }  // namespace aapt
@@ -236,18 +236,8 @@ class OptimizeCommand {
       }
     }
 
-    BigBuffer table_buffer(4096);
-    TableFlattener table_flattener(options_.table_flattener_options, &table_buffer);
-    if (!table_flattener.Consume(context_, table)) {
-      return false;
-    }
-
-    io::BigBufferInputStream table_buffer_in(&table_buffer);
-    if (!io::CopyInputStreamToArchive(context_, &table_buffer_in, "resources.arsc",
-                                      ArchiveEntry::kAlign, writer)) {
-      return false;
-    }
-    return true;
+    return FlattenTableToArchive(context_, options_.table_flattener_options, table,
+                                 "resources.arsc", ArchiveEntry::kAlign, writer);
   }
 
   OptimizeOptions options_;
@@ -20,13 +20,19 @@
 #include <zlib.h>
 
 #include <algorithm>
+#include <iterator>
+#include <limits>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 #include "android-base/errors.h"
 #include "android-base/logging.h"
 #include "android-base/macros.h"
 
+#include "util/Parallel.h"
+#include "util/Util.h"
+
 namespace aapt {
 
 // Custom deleter that destroys libpng read and info structs.
@@ -477,6 +483,489 @@ static void WriteNinePatch(png_structp write_ptr, png_infop write_info_ptr,
   png_set_unknown_chunks(write_ptr, write_info_ptr, unknown_chunks, index);
 }
 
+// Images with at least this many pixels are analyzed and encoded in parallel row strips.
+// Anything smaller is handed to libpng row by row, exactly as before.
+constexpr static const int64_t kParallelMinPixels = 512 * 512;
+
+// Target number of uncompressed bytes in each row strip. The strip height is derived from the
+// image dimensions alone, so the encoded output does not depend on the number of threads.
+constexpr static const size_t kStripBytes = 256u * 1024u;
+
+// The number of rows from the end of the previous strip used as the preset deflate dictionary.
+constexpr static const size_t kDictionaryRows = 4u;
+
+// The maximum size of a single IDAT chunk emitted by the strip encoder.
+constexpr static const size_t kIdatChunkSize = 64u * 1024u;
+
+// Packs an RGBA pixel into the 0xRRGGBBAA form used by the color palettes.
+static inline uint32_t PackColor(uint32_t r, uint32_t g, uint32_t b, uint32_t a) {
+  return r << 24 | g << 16 | b << 8 | a;
+}
+
+// A fixed-capacity, open-addressed table of distinct RGBA colors that remembers the order in
+// which colors were first seen. Once more than 256 colors have been inserted the image can no
+// longer be palettized, so the table marks itself as overflowed and stops tracking.
+class ColorTable {
+ public:
+  ColorTable() {
+    std::fill(std::begin(values_), std::end(values_), kEmpty);
+  }
+
+  // Records `color`. Returns false once the table has overflowed.
+  bool Insert(uint32_t color) {
+    if (overflowed_) {
+      return false;
+    }
+
+    if (!colors_.empty() && colors_.back() == color) {
+      // Runs of identical pixels are by far the most common case.
+      return true;
+    }
+
+    size_t slot = FindSlot(color);
+    if (values_[slot] == kEmpty) {
+      if (colors_.size() == kMaxColors) {
+        overflowed_ = true;
+        return false;
+      }
+      keys_[slot] = color;
+      values_[slot] = -1;
+      colors_.push_back(color);
+    }
+    return true;
+  }
+
+  // Returns the palette index assigned to `color` with SetIndex(), or -1.
+  int GetIndex(uint32_t color) const {
+    const size_t slot = FindSlot(color);
+    return values_[slot] == kEmpty ? -1 : values_[slot];
+  }
+
+  void SetIndex(uint32_t color, int index) {
+    const size_t slot = FindSlot(color);
+    CHECK(values_[slot] != kEmpty);
+    values_[slot] = static_cast<int16_t>(index);
+  }
+
+  // Appends the colors of `other` that are not yet in this table, preserving first-seen order.
+  void Merge(const ColorTable& other) {
+    if (other.overflowed_) {
+      overflowed_ = true;
+      return;
+    }
+    for (uint32_t color : other.colors_) {
+      if (!Insert(color)) {
+        return;
+      }
+    }
+  }
+
+  bool overflowed() const {
+    return overflowed_;
+  }
+
+  // The distinct colors in the order they were first inserted.
+  const std::vector<uint32_t>& colors() const {
+    return colors_;
+  }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(ColorTable);
+
+  static constexpr const size_t kMaxColors = 256u;
+  static constexpr const size_t kSlotBits = 10u;
+  static constexpr const size_t kSlotCount = 1u << kSlotBits;
+  static constexpr const int16_t kEmpty = -2;
+
+  size_t FindSlot(uint32_t color) const {
+    size_t slot = (color * 0x9e3779b1u) >> (32u - kSlotBits);
+    while (values_[slot] != kEmpty && keys_[slot] != color) {
+      slot = (slot + 1) & (kSlotCount - 1);
+    }
+    return slot;
+  }
+
+  uint32_t keys_[kSlotCount];
+  int16_t values_[kSlotCount];
+  std::vector<uint32_t> colors_;
+  bool overflowed_ = false;
+};
+
+// The properties of an image that decide how it gets encoded.
+struct ImageStats {
+  // The distinct colors of the image, with the RGB channels of fully transparent pixels zeroed.
+  ColorTable color_palette;
+
+  // Whether any pixel has alpha != 0xff.
+  bool has_alpha = false;
+
+  // Whether any fully transparent pixel has non-zero RGB channels.
+  bool needs_to_zero_rgb_channels_of_transparent_pixels = false;
+
+  // The largest difference between two color channels of any pixel. Zero means grayscale.
+  int max_gray_deviation = 0;
+};
+
+// Scans rows [row_start, row_end) of `image` into `stats`.
+//
+// The per-pixel channel checks are written without branches or early exits so that the compiler
+// can vectorize them. Palette tracking is a separate pass that stops as soon as the image has
+// more than 256 colors.
+static void AnalyzeRows(const Image* image, int32_t row_start, int32_t row_end,
+                        ImageStats* stats) {
+  const int32_t width = image->width;
+  int max_gray_deviation = stats->max_gray_deviation;
+  uint8_t alpha_and = 0xff;
+  uint8_t transparent_rgb_or = 0;
+
+  for (int32_t y = row_start; y < row_end; y++) {
+    const uint8_t* row = image->rows[y];
+    int row_deviation = 0;
+    for (int32_t x = 0; x < width; x++) {
+      const uint8_t alpha = row[x * 4 + 3];
+
+      // Fully transparent pixels are treated as having all channels set to 0x00.
+      const uint8_t keep = alpha != 0 ? 0xff : 0x00;
+      const uint8_t rgb_or = row[x * 4] | row[x * 4 + 1] | row[x * 4 + 2];
+      transparent_rgb_or |= rgb_or & ~keep;
+      alpha_and &= alpha;
+
+      const int red = row[x * 4] & keep;
+      const int green = row[x * 4 + 1] & keep;
+      const int blue = row[x * 4 + 2] & keep;
+      const int deviation = std::max(std::max(std::abs(red - green), std::abs(green - blue)),
+                                     std::abs(blue - red));
+      row_deviation = std::max(row_deviation, deviation);
+    }
+    max_gray_deviation = std::max(max_gray_deviation, row_deviation);
+  }
+
+  stats->max_gray_deviation = max_gray_deviation;
+  stats->has_alpha = stats->has_alpha || alpha_and != 0xff;
+  stats->needs_to_zero_rgb_channels_of_transparent_pixels =
+      stats->needs_to_zero_rgb_channels_of_transparent_pixels || transparent_rgb_or != 0;
+
+  for (int32_t y = row_start; y < row_end && !stats->color_palette.overflowed(); y++) {
+    const uint8_t* row = image->rows[y];
+    for (int32_t x = 0; x < width; x++) {
+      const uint8_t alpha = row[x * 4 + 3];
+      const uint32_t color =
+          alpha == 0 ? 0u : PackColor(row[x * 4], row[x * 4 + 1], row[x * 4 + 2], alpha);
+      if (!stats->color_palette.Insert(color)) {
+        break;
+      }
+    }
+  }
+}
+
+// Scans the entire image, splitting large images into row strips that are analyzed in parallel.
+// Strip results are merged in row order, so the outcome is the same as a single sequential scan.
+static void AnalyzeImage(const Image* image, ImageStats* stats) {
+  const int64_t pixel_count = static_cast<int64_t>(image->width) * image->height;
+  if (pixel_count < kParallelMinPixels) {
+    AnalyzeRows(image, 0, image->height, stats);
+    return;
+  }
+
+  const int32_t strip_rows =
+      std::max<int32_t>(1, kStripBytes / (static_cast<size_t>(image->width) * 4u));
+  const size_t strip_count = (image->height + strip_rows - 1) / strip_rows;
+  std::vector<std::unique_ptr<ImageStats>> strips(strip_count);
+  util::ParallelFor(strip_count, [&](size_t i) {
+    const int32_t row_start = static_cast<int32_t>(i) * strip_rows;
+    strips[i] = util::make_unique<ImageStats>();
+    AnalyzeRows(image, row_start, std::min(row_start + strip_rows, image->height),
+                strips[i].get());
+  });
+
+  for (const std::unique_ptr<ImageStats>& strip : strips) {
+    stats->color_palette.Merge(strip->color_palette);
+    stats->has_alpha = stats->has_alpha || strip->has_alpha;
+    stats->needs_to_zero_rgb_channels_of_transparent_pixels =
+        stats->needs_to_zero_rgb_channels_of_transparent_pixels ||
+        strip->needs_to_zero_rgb_channels_of_transparent_pixels;
+    stats->max_gray_deviation = std::max(stats->max_gray_deviation, strip->max_gray_deviation);
+  }
+}
+
+// Returns the number of bytes per pixel of an 8-bit image of the given color type.
+static size_t BytesPerPixel(int color_type) {
+  switch (color_type) {
+    case PNG_COLOR_TYPE_GRAY:
+    case PNG_COLOR_TYPE_PALETTE:
+      return 1;
+    case PNG_COLOR_TYPE_GRAY_ALPHA:
+      return 2;
+    case PNG_COLOR_TYPE_RGB:
+      return 3;
+    default:
+      return 4;
+  }
+}
+
+// Converts the RGBA row `in_row` into `out_row` using the encoding of `color_type`.
+// The color channels of fully transparent pixels are zeroed.
+static void PackRow(const uint8_t* in_row, int32_t width, int color_type, bool grayscale,
+                    const ColorTable& color_palette, png_bytep out_row) {
+  switch (color_type) {
+    case PNG_COLOR_TYPE_PALETTE:
+      for (int32_t x = 0; x < width; x++) {
+        const uint8_t aa = in_row[x * 4 + 3];
+        const uint32_t color =
+            aa == 0 ? 0u : PackColor(in_row[x * 4], in_row[x * 4 + 1], in_row[x * 4 + 2], aa);
+        const int idx = color_palette.GetIndex(color);
+        CHECK(idx >= 0);
+        out_row[x] = static_cast<png_byte>(idx);
+      }
+      break;
+
+    case PNG_COLOR_TYPE_GRAY:
+    case PNG_COLOR_TYPE_GRAY_ALPHA: {
+      const size_t bpp = color_type == PNG_COLOR_TYPE_GRAY ? 1 : 2;
+      for (int32_t x = 0; x < width; x++) {
+        int rr = in_row[x * 4];
+        int gg = in_row[x * 4 + 1];
+        int bb = in_row[x * 4 + 2];
+        int aa = in_row[x * 4 + 3];
+        if (aa == 0) {
+          // Zero out the gray channel when transparent.
+          rr = gg = bb = 0;
+        }
+
+        if (grayscale) {
+          // The image was already grayscale, red == green == blue.
+          out_row[x * bpp] = in_row[x * 4];
+        } else {
+          // The image is convertible to grayscale, use linear-luminance of
+          // sRGB colorspace:
+          // https://en.wikipedia.org/wiki/Grayscale#Colorimetric_.28luminance-preserving.29_conversion_to_grayscale
+          out_row[x * bpp] = (png_byte)(rr * 0.2126f + gg * 0.7152f + bb * 0.0722f);
+        }
+
+        if (bpp == 2) {
+          // Write out alpha if we have it.
+          out_row[x * bpp + 1] = aa;
+        }
+      }
+      break;
+    }
+
+    case PNG_COLOR_TYPE_RGB:
+    case PNG_COLOR_TYPE_RGB_ALPHA: {
+      const size_t bpp = color_type == PNG_COLOR_TYPE_RGB ? 3 : 4;
+      for (int32_t x = 0; x < width; x++) {
+        const uint8_t aa = in_row[x * 4 + 3];
+        // Zero out the RGB channels when transparent.
+        const uint8_t keep = aa != 0 ? 0xff : 0x00;
+        out_row[x * bpp] = in_row[x * 4] & keep;
+        out_row[x * bpp + 1] = in_row[x * 4 + 1] & keep;
+        out_row[x * bpp + 2] = in_row[x * 4 + 2] & keep;
+        if (bpp == 4) {
+          out_row[x * bpp + 3] = aa;
+        }
+      }
+      break;
+    }
+
+    default:
+      LOG(FATAL) << "unreachable";
+      break;
+  }
+}
+
+// The PNG filter types, as written in the first byte of each filtered row.
+enum FilterType : uint8_t {
+  kFilterNone = 0,
+  kFilterSub = 1,
+  kFilterUp = 2,
+  kFilterAverage = 3,
+  kFilterPaeth = 4,
+  kFilterCount = 5,
+};
+
+static inline uint8_t PaethPredictor(int a, int b, int c) {
+  const int p = a + b - c;
+  const int pa = std::abs(p - a);
+  const int pb = std::abs(p - b);
+  const int pc = std::abs(p - c);
+  if (pa <= pb && pa <= pc) {
+    return static_cast<uint8_t>(a);
+  }
+  return static_cast<uint8_t>(pb <= pc ? b : c);
+}
+
+// Applies `filter` to `row` (with `prev_row` above it, or nullptr for the first row of the image)
+// and writes the filter type byte followed by the filtered bytes to `out`. Returns the sum of the
+// filtered bytes interpreted as signed values, which libpng also uses to rank the filters.
+static uint64_t FilterRow(FilterType filter, const uint8_t* row, const uint8_t* prev_row,
+                          size_t row_bytes, size_t bpp, uint8_t* out) {
+  out[0] = filter;
+  uint8_t* dst = out + 1;
+  for (size_t i = 0; i < row_bytes; i++) {
+    const int a = i >= bpp ? row[i - bpp] : 0;
+    const int b = prev_row != nullptr ? prev_row[i] : 0;
+    const int c = i >= bpp && prev_row != nullptr ? prev_row[i - bpp] : 0;
+    uint8_t predictor = 0;
+    switch (filter) {
+      case kFilterSub:
+        predictor = a;
+        break;
+      case kFilterUp:
+        predictor = b;
+        break;
+      case kFilterAverage:
+        predictor = static_cast<uint8_t>((a + b) / 2);
+        break;
+      case kFilterPaeth:
+        predictor = PaethPredictor(a, b, c);
+        break;
+      default:
+        break;
+    }
+    dst[i] = row[i] - predictor;
+  }
+
+  uint64_t sum = 0;
+  for (size_t i = 0; i < row_bytes; i++) {
+    sum += dst[i] < 128 ? dst[i] : 256 - dst[i];
+  }
+  return sum;
+}
+
+// One horizontal strip of the image, filtered and compressed as a piece of the zlib stream.
+struct EncodedStrip {
+  std::vector<uint8_t> filtered;
+  std::vector<uint8_t> deflated;
+  uLong adler = 0;
+  bool error = false;
+};
+
+// Packs and filters rows [row_start, row_end) of `image` into `out_strip->filtered`, choosing the
+// filter of each row the same way libpng does.
+static void FilterStrip(const Image* image, int32_t row_start, int32_t row_end, int color_type,
+                        bool grayscale, const ColorTable& color_palette,
+                        EncodedStrip* out_strip) {
+  const size_t bpp = BytesPerPixel(color_type);
+  const size_t row_bytes = static_cast<size_t>(image->width) * bpp;
+
+  // Palette images are not filtered, which matches what libpng is told for the sequential path.
+  const bool use_filters = color_type != PNG_COLOR_TYPE_PALETTE;
+
+  std::vector<uint8_t> prev_row;
+  std::vector<uint8_t> cur_row(row_bytes);
+  if (row_start > 0 && use_filters) {
+    prev_row.resize(row_bytes);
+    PackRow(image->rows[row_start - 1], image->width, color_type, grayscale, color_palette,
+            prev_row.data());
+  }
+
+  std::vector<uint8_t>& filtered = out_strip->filtered;
+  filtered.reserve((row_bytes + 1) * (row_end - row_start));
+  std::vector<uint8_t> candidate(row_bytes + 1);
+  std::vector<uint8_t> best(row_bytes + 1);
+  for (int32_t y = row_start; y < row_end; y++) {
+    PackRow(image->rows[y], image->width, color_type, grayscale, color_palette, cur_row.data());
+    const uint8_t* above = prev_row.empty() ? nullptr : prev_row.data();
+    uint64_t best_sum = FilterRow(kFilterNone, cur_row.data(), above, row_bytes, bpp, best.data());
+    if (use_filters) {
+      for (uint8_t f = kFilterSub; f < kFilterCount; f++) {
+        const uint64_t sum = FilterRow(static_cast<FilterType>(f), cur_row.data(), above,
+                                       row_bytes, bpp, candidate.data());
+        if (sum < best_sum) {
+          best_sum = sum;
+          std::swap(best, candidate);
+        }
+      }
+      std::swap(prev_row, cur_row);
+      cur_row.resize(row_bytes);
+    }
+    filtered.insert(filtered.end(), best.begin(), best.end());
+  }
+  out_strip->adler = adler32(adler32(0L, Z_NULL, 0), filtered.data(), filtered.size());
+}
+
+// Deflates the filtered bytes of `strip` as a piece of a raw deflate stream. The last few rows of
+// the previous strip prime the sliding window so that matches can reach across the strip
+// boundary, which recovers most of the ratio lost by splitting the stream without paying to hash
+// a full 32K window. Every strip except the last one ends on a byte-aligned sync flush so that
+// the strips can simply be concatenated.
+static void DeflateStrip(const EncodedStrip* prev_strip, size_t filtered_row_bytes, bool is_last,
+                         bool use_filters, EncodedStrip* strip) {
+  z_stream stream = {};
+  if (deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8,
+                   use_filters ? Z_FILTERED : Z_DEFAULT_STRATEGY) != Z_OK) {
+    strip->error = true;
+    return;
+  }
+
+  if (prev_strip != nullptr) {
+    const size_t window = std::min<size_t>(
+        {prev_strip->filtered.size(), kDictionaryRows * filtered_row_bytes, 1u << MAX_WBITS});
+    deflateSetDictionary(&stream,
+                         prev_strip->filtered.data() + prev_strip->filtered.size() - window,
+                         window);
+  }
+
+  // Leave room for the sync flush marker on top of the worst-case expansion.
+  strip->deflated.resize(deflateBound(&stream, strip->filtered.size()) + 16u);
+  stream.next_in = strip->filtered.data();
+  stream.avail_in = strip->filtered.size();
+  stream.next_out = strip->deflated.data();
+  stream.avail_out = strip->deflated.size();
+  const int result = deflate(&stream, is_last ? Z_FINISH : Z_SYNC_FLUSH);
+  if ((is_last && result != Z_STREAM_END) || (!is_last && result != Z_OK) ||
+      stream.avail_in != 0) {
+    strip->error = true;
+  }
+  strip->deflated.resize(stream.total_out);
+  deflateEnd(&stream);
+}
+
+// Writes the image data as IDAT chunks followed by IEND, compressing horizontal strips of the
+// image in parallel. This replaces png_write_row()/png_write_end() for large images. The strip
+// layout only depends on the image dimensions, so the output is deterministic.
+static bool WriteImageDataInStrips(png_structp write_ptr, const Image* image, int color_type,
+                                   bool grayscale, const ColorTable& color_palette) {
+  const size_t row_bytes = static_cast<size_t>(image->width) * BytesPerPixel(color_type);
+  const int32_t strip_rows = std::max<int32_t>(1, kStripBytes / (row_bytes + 1));
+  const size_t strip_count = (image->height + strip_rows - 1) / strip_rows;
+
+  // All strips are filtered before any are compressed, since each strip's dictionary comes from
+  // the filtered bytes of the strip before it.
+  std::vector<EncodedStrip> strips(strip_count);
+  util::ParallelFor(strip_count, [&](size_t i) {
+    const int32_t row_start = static_cast<int32_t>(i) * strip_rows;
+    FilterStrip(image, row_start, std::min(row_start + strip_rows, image->height), color_type,
+                grayscale, color_palette, &strips[i]);
+  });
+  util::ParallelFor(strip_count, [&](size_t i) {
+    DeflateStrip(i > 0 ? &strips[i - 1] : nullptr, row_bytes + 1, i + 1 == strip_count,
+                 color_type != PNG_COLOR_TYPE_PALETTE, &strips[i]);
+  });
+
+  // zlib header for a 32K window at maximum compression.
+  std::vector<uint8_t> zdata = {0x78, 0xda};
+  uLong adler = adler32(0L, Z_NULL, 0);
+  for (const EncodedStrip& strip : strips) {
+    if (strip.error) {
+      return false;
+    }
+    zdata.insert(zdata.end(), strip.deflated.begin(), strip.deflated.end());
+    adler = adler32_combine(adler, strip.adler, strip.filtered.size());
+  }
+  zdata.push_back(static_cast<uint8_t>(adler >> 24));
+  zdata.push_back(static_cast<uint8_t>(adler >> 16));
+  zdata.push_back(static_cast<uint8_t>(adler >> 8));
+  zdata.push_back(static_cast<uint8_t>(adler));
+
+  for (size_t offset = 0; offset < zdata.size(); offset += kIdatChunkSize) {
+    png_write_chunk(write_ptr, (png_const_bytep)"IDAT", zdata.data() + offset,
+                    std::min(kIdatChunkSize, zdata.size() - offset));
+  }
+  png_write_chunk(write_ptr, (png_const_bytep)"IEND", nullptr, 0);
+  return true;
+}
+
 bool WritePng(IAaptContext* context, const Image* image,
               const NinePatch* nine_patch, io::OutputStream* out,
               const PngOptions& options) {
@@ -521,59 +1010,40 @@ bool WritePng(IAaptContext* context, const Image* image,
   // 1. Every pixel has R == G == B (grayscale)
   // 2. Every pixel has A == 255 (opaque)
   // 3. There are no more than 256 distinct RGBA colors (palette).
+  ImageStats stats;
+  AnalyzeImage(image, &stats);
+
+  // Rebuild the palettes in the order the colors were first seen, which keeps the palette
+  // indices assigned by WritePalette() the same as when every pixel was inserted directly.
   std::unordered_map<uint32_t, int> color_palette;
   std::unordered_set<uint32_t> alpha_palette;
-  bool needs_to_zero_rgb_channels_of_transparent_pixels = false;
-  bool grayscale = true;
-  int max_gray_deviation = 0;
-
-  for (int32_t y = 0; y < image->height; y++) {
-    const uint8_t* row = image->rows[y];
-    for (int32_t x = 0; x < image->width; x++) {
-      int red = *row++;
-      int green = *row++;
-      int blue = *row++;
-      int alpha = *row++;
-
-      if (alpha == 0) {
-        // The color is completely transparent.
-        // For purposes of palettes and grayscale optimization,
-        // treat all channels as 0x00.
-        needs_to_zero_rgb_channels_of_transparent_pixels =
-            needs_to_zero_rgb_channels_of_transparent_pixels ||
-            (red != 0 || green != 0 || blue != 0);
-        red = green = blue = 0;
-      }
-
-      // Insert the color into the color palette.
-      const uint32_t color = red << 24 | green << 16 | blue << 8 | alpha;
+  if (!stats.color_palette.overflowed()) {
+    for (uint32_t color : stats.color_palette.colors()) {
       color_palette[color] = -1;
-
-      // If the pixel has non-opaque alpha, insert it into the
-      // alpha palette.
-      if (alpha != 0xff) {
+      if ((color & 0x000000ff) != 0xff) {
         alpha_palette.insert(color);
       }
-
-      // Check if the image is indeed grayscale.
-      if (grayscale) {
-        if (red != green || red != blue) {
-          grayscale = false;
-        }
-      }
-
-      // Calculate the gray scale deviation so that it can be compared
-      // with the threshold.
-      max_gray_deviation = std::max(std::abs(red - green), max_gray_deviation);
-      max_gray_deviation = std::max(std::abs(green - blue), max_gray_deviation);
-      max_gray_deviation = std::max(std::abs(blue - red), max_gray_deviation);
     }
   }
 
+  // Past 256 colors only the number of distinct colors matters, and any image that large
+  // can't be palettized.
+  const size_t color_palette_size =
+      stats.color_palette.overflowed() ? std::numeric_limits<size_t>::max() : color_palette.size();
+  const size_t alpha_palette_size =
+      stats.color_palette.overflowed() ? (stats.has_alpha ? 1u : 0u) : alpha_palette.size();
+  const bool grayscale = stats.max_gray_deviation == 0;
+  const int max_gray_deviation = stats.max_gray_deviation;
+
   if (context->IsVerbose()) {
     DiagMessage msg;
-    msg << " paletteSize=" << color_palette.size()
-        << " alphaPaletteSize=" << alpha_palette.size()
+    msg << " paletteSize=";
+    if (stats.color_palette.overflowed()) {
+      msg << ">256";
+    } else {
+      msg << color_palette.size();
+    }
+    msg << " alphaPaletteSize=" << alpha_palette.size()
         << " maxGrayDeviation=" << max_gray_deviation
         << " grayScale=" << (grayscale ? "true" : "false");
     context->GetDiagnostics()->Note(msg);
@@ -583,7 +1053,7 @@ bool WritePng(IAaptContext* context, const Image* image,
 
   const int new_color_type = PickColorType(
       image->width, image->height, grayscale, convertible_to_grayscale,
-      nine_patch != nullptr, color_palette.size(), alpha_palette.size());
+      nine_patch != nullptr, color_palette_size, alpha_palette_size);
 
   if (context->IsVerbose()) {
     DiagMessage msg;
@@ -634,105 +1104,41 @@ bool WritePng(IAaptContext* context, const Image* image,
   // Flush our updates to the header.
   png_write_info(write_ptr, write_info_ptr);
 
-  // Write out each row of image data according to its encoding.
-  if (new_color_type == PNG_COLOR_TYPE_PALETTE) {
-    // 1 byte/pixel.
-    auto out_row = std::unique_ptr<png_byte[]>(new png_byte[image->width]);
-
-    for (int32_t y = 0; y < image->height; y++) {
-      png_const_bytep in_row = image->rows[y];
-      for (int32_t x = 0; x < image->width; x++) {
-        int rr = *in_row++;
-        int gg = *in_row++;
-        int bb = *in_row++;
-        int aa = *in_row++;
-        if (aa == 0) {
-          // Zero out color channels when transparent.
-          rr = gg = bb = 0;
-        }
+  if (new_color_type & PNG_COLOR_MASK_PALETTE) {
+    // Mirror the indices chosen by WritePalette() for fast per-pixel lookups.
+    for (const auto& entry : color_palette) {
+      stats.color_palette.SetIndex(entry.first, entry.second);
+    }
+  }
 
-        const uint32_t color = rr << 24 | gg << 16 | bb << 8 | aa;
-        const int idx = color_palette[color];
-        CHECK(idx != -1);
-        out_row[x] = static_cast<png_byte>(idx);
-      }
-      png_write_row(write_ptr, out_row.get());
+  if (static_cast<int64_t>(image->width) * image->height >= kParallelMinPixels) {
+    if (!WriteImageDataInStrips(write_ptr, image, new_color_type, grayscale,
+                                stats.color_palette)) {
+      context->GetDiagnostics()->Error(DiagMessage() << "failed to compress image data");
+      return false;
     }
-  } else if (new_color_type == PNG_COLOR_TYPE_GRAY ||
-             new_color_type == PNG_COLOR_TYPE_GRAY_ALPHA) {
-    const size_t bpp = new_color_type == PNG_COLOR_TYPE_GRAY ? 1 : 2;
-    auto out_row =
-        std::unique_ptr<png_byte[]>(new png_byte[image->width * bpp]);
+    return true;
+  }
 
+  // Write out each row of image data according to its encoding.
+  if ((new_color_type == PNG_COLOR_TYPE_RGB || new_color_type == PNG_COLOR_TYPE_RGBA) &&
+      !stats.needs_to_zero_rgb_channels_of_transparent_pixels) {
+    // The source image can be used as-is, just tell libpng whether or not to
+    // ignore the alpha channel.
+    if (new_color_type == PNG_COLOR_TYPE_RGB) {
+      // Delete the extraneous alpha values that we appended to our buffer
+      // when reading the original values.
+      png_set_filler(write_ptr, 0, PNG_FILLER_AFTER);
+    }
+    png_write_image(write_ptr, image->rows.get());
+  } else {
+    auto out_row = std::unique_ptr<png_byte[]>(
+        new png_byte[image->width * BytesPerPixel(new_color_type)]);
     for (int32_t y = 0; y < image->height; y++) {
-      png_const_bytep in_row = image->rows[y];
-      for (int32_t x = 0; x < image->width; x++) {
-        int rr = in_row[x * 4];
-        int gg = in_row[x * 4 + 1];
-        int bb = in_row[x * 4 + 2];
-        int aa = in_row[x * 4 + 3];
-        if (aa == 0) {
-          // Zero out the gray channel when transparent.
-          rr = gg = bb = 0;
-        }
-
-        if (grayscale) {
-          // The image was already grayscale, red == green == blue.
-          out_row[x * bpp] = in_row[x * 4];
-        } else {
-          // The image is convertible to grayscale, use linear-luminance of
-          // sRGB colorspace:
-          // https://en.wikipedia.org/wiki/Grayscale#Colorimetric_.28luminance-preserving.29_conversion_to_grayscale
-          out_row[x * bpp] =
-              (png_byte)(rr * 0.2126f + gg * 0.7152f + bb * 0.0722f);
-        }
-
-        if (bpp == 2) {
-          // Write out alpha if we have it.
-          out_row[x * bpp + 1] = aa;
-        }
-      }
+      PackRow(image->rows[y], image->width, new_color_type, grayscale, stats.color_palette,
+              out_row.get());
       png_write_row(write_ptr, out_row.get());
     }
-  } else if (new_color_type == PNG_COLOR_TYPE_RGB || new_color_type == PNG_COLOR_TYPE_RGBA) {
-    const size_t bpp = new_color_type == PNG_COLOR_TYPE_RGB ? 3 : 4;
-    if (needs_to_zero_rgb_channels_of_transparent_pixels) {
-      // The source RGBA data can't be used as-is, because we need to zero out
-      // the RGB values of transparent pixels.
-      auto out_row = std::unique_ptr<png_byte[]>(new png_byte[image->width * bpp]);
-
-      for (int32_t y = 0; y < image->height; y++) {
-        png_const_bytep in_row = image->rows[y];
-        for (int32_t x = 0; x < image->width; x++) {
-          int rr = *in_row++;
-          int gg = *in_row++;
-          int bb = *in_row++;
-          int aa = *in_row++;
-          if (aa == 0) {
-            // Zero out the RGB channels when transparent.
-            rr = gg = bb = 0;
-          }
-          out_row[x * bpp] = rr;
-          out_row[x * bpp + 1] = gg;
-          out_row[x * bpp + 2] = bb;
-          if (bpp == 4) {
-            out_row[x * bpp + 3] = aa;
-          }
-        }
-        png_write_row(write_ptr, out_row.get());
-      }
-    } else {
-      // The source image can be used as-is, just tell libpng whether or not to
-      // ignore the alpha channel.
-      if (new_color_type == PNG_COLOR_TYPE_RGB) {
-        // Delete the extraneous alpha values that we appended to our buffer
-        // when reading the original values.
-        png_set_filler(write_ptr, 0, PNG_FILLER_AFTER);
-      }
-      png_write_image(write_ptr, image->rows.get());
-    }
-  } else {
-    LOG(FATAL) << "unreachable";
   }
 
   png_write_end(write_ptr, write_info_ptr);
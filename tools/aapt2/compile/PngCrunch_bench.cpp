@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "compile/Png.h"
+
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "android-base/file.h"
+#include "benchmark/benchmark.h"
+
+#include "io/BigBufferOutputStream.h"
+#include "test/Context.h"
+#include "util/Files.h"
+#include "util/Util.h"
+
+namespace aapt {
+
+// The shapes of drawables commonly found in apps.
+enum class DrawableKind {
+  // Anti-aliased launcher icon: colored, with soft alpha edges.
+  kIcon,
+  // Flat UI artwork with a handful of colors.
+  kFlat,
+  // Opaque photograph-like content, such as splash screens and backgrounds.
+  kPhoto,
+  // Grayscale alpha mask, such as shadows and ripples.
+  kMask,
+};
+
+static std::unique_ptr<Image> MakeDrawable(DrawableKind kind, int32_t size) {
+  std::unique_ptr<Image> image = util::make_unique<Image>();
+  image->width = size;
+  image->height = size;
+  image->data = std::unique_ptr<uint8_t[]>(new uint8_t[size * size * 4]);
+  image->rows = std::unique_ptr<uint8_t* []>(new uint8_t*[size]);
+
+  uint32_t noise = 0x12345678u;
+  for (int32_t y = 0; y < size; y++) {
+    image->rows[y] = image->data.get() + y * size * 4;
+    for (int32_t x = 0; x < size; x++) {
+      uint8_t* rgba = image->rows[y] + x * 4;
+      noise = noise * 1664525u + 1013904223u;
+      const int32_t dx = x - size / 2;
+      const int32_t dy = y - size / 2;
+      const int32_t dist = (dx * dx + dy * dy) * 255 / (size * size / 4 + 1);
+      switch (kind) {
+        case DrawableKind::kIcon:
+          rgba[0] = static_cast<uint8_t>(x * 255 / size);
+          rgba[1] = static_cast<uint8_t>(y * 255 / size);
+          rgba[2] = 0xc0;
+          rgba[3] = static_cast<uint8_t>(dist >= 255 ? 0 : dist > 230 ? (255 - dist) * 10 : 255);
+          break;
+        case DrawableKind::kFlat: {
+          const uint8_t band = static_cast<uint8_t>((x / 24 + y / 24) % 6);
+          rgba[0] = band * 40;
+          rgba[1] = 0x80;
+          rgba[2] = 0xff - band * 40;
+          rgba[3] = band == 0 ? 0x00 : 0xff;
+          break;
+        }
+        case DrawableKind::kPhoto:
+          rgba[0] = static_cast<uint8_t>(x / 2 + (noise >> 28));
+          rgba[1] = static_cast<uint8_t>(y / 2 + ((noise >> 24) & 0x0f));
+          rgba[2] = static_cast<uint8_t>((x + y) / 4 + ((noise >> 20) & 0x0f));
+          rgba[3] = 0xff;
+          break;
+        case DrawableKind::kMask:
+          rgba[0] = rgba[1] = rgba[2] = 0;
+          rgba[3] = static_cast<uint8_t>(dist > 255 ? 0 : 255 - dist);
+          break;
+      }
+    }
+  }
+  return image;
+}
+
+static void CrunchImages(benchmark::State& state,
+                         const std::vector<std::unique_ptr<Image>>& images) {
+  std::unique_ptr<IAaptContext> context = test::ContextBuilder().Build();
+  size_t pixel_bytes = 0;
+  for (const std::unique_ptr<Image>& image : images) {
+    pixel_bytes += static_cast<size_t>(image->width) * image->height * 4u;
+  }
+
+  size_t crunched_bytes = 0;
+  while (state.KeepRunning()) {
+    crunched_bytes = 0;
+    for (const std::unique_ptr<Image>& image : images) {
+      BigBuffer buffer(4096);
+      io::BigBufferOutputStream out(&buffer);
+      if (!WritePng(context.get(), image.get(), nullptr, &out, {})) {
+        state.SkipWithError("failed to crunch image");
+        return;
+      }
+      crunched_bytes += buffer.size();
+    }
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * pixel_bytes);
+  state.SetLabel("crunched " + std::to_string(crunched_bytes) + " bytes");
+}
+
+// Crunches a single synthetic drawable of kind range(0) and size range(1) x range(1).
+// Throughput is reported in uncompressed RGBA bytes.
+static void BM_CrunchDrawable(benchmark::State& state) {
+  std::vector<std::unique_ptr<Image>> images;
+  images.push_back(MakeDrawable(static_cast<DrawableKind>(state.range(0)), state.range(1)));
+  CrunchImages(state, images);
+}
+BENCHMARK(BM_CrunchDrawable)
+    ->Args({static_cast<int>(DrawableKind::kIcon), 192})
+    ->Args({static_cast<int>(DrawableKind::kFlat), 192})
+    ->Args({static_cast<int>(DrawableKind::kMask), 192})
+    ->Args({static_cast<int>(DrawableKind::kIcon), 512})
+    ->Args({static_cast<int>(DrawableKind::kFlat), 1024})
+    ->Args({static_cast<int>(DrawableKind::kPhoto), 1024})
+    ->Args({static_cast<int>(DrawableKind::kMask), 1024})
+    ->Args({static_cast<int>(DrawableKind::kPhoto), 2048});
+
+// Crunches every PNG found in the directory named by the AAPT2_PNG_CORPUS environment variable,
+// such as the res/ directory of a real app.
+static void BM_CrunchCorpus(benchmark::State& state) {
+  const char* corpus_dir = getenv("AAPT2_PNG_CORPUS");
+  if (corpus_dir == nullptr) {
+    state.SkipWithError("set AAPT2_PNG_CORPUS to a directory of PNG files");
+    return;
+  }
+
+  std::unique_ptr<IAaptContext> context = test::ContextBuilder().Build();
+  Maybe<std::vector<std::string>> files = file::FindFiles(corpus_dir, context->GetDiagnostics());
+  if (!files) {
+    state.SkipWithError("failed to list AAPT2_PNG_CORPUS");
+    return;
+  }
+
+  std::vector<std::unique_ptr<Image>> images;
+  for (const std::string& file : files.value()) {
+    if (!util::EndsWith(file, ".png") || util::EndsWith(file, ".9.png")) {
+      continue;
+    }
+
+    std::string path = corpus_dir;
+    file::AppendPath(&path, file);
+    std::string content;
+    if (!android::base::ReadFileToString(path, &content)) {
+      continue;
+    }
+
+    PngChunkFilter in(content);
+    std::unique_ptr<Image> image = ReadPng(context.get(), Source(path), &in);
+    if (image) {
+      images.push_back(std::move(image));
+    }
+  }
+
+  if (images.empty()) {
+    state.SkipWithError("no PNG files found in AAPT2_PNG_CORPUS");
+    return;
+  }
+  CrunchImages(state, images);
+}
+BENCHMARK(BM_CrunchCorpus)->Unit(benchmark::kMillisecond);
+
+}  // namespace aapt
@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "compile/Png.h"
+
+#include <cstring>
+
+#include "io/BigBufferOutputStream.h"
+#include "test/Test.h"
+
+namespace aapt {
+
+// Creates a width x height RGBA image whose pixels are produced by `pixel(x, y, rgba)`.
+template <typename Fn>
+static std::unique_ptr<Image> MakeImage(int32_t width, int32_t height, const Fn& pixel) {
+  std::unique_ptr<Image> image = util::make_unique<Image>();
+  image->width = width;
+  image->height = height;
+  image->data = std::unique_ptr<uint8_t[]>(new uint8_t[width * height * 4]);
+  image->rows = std::unique_ptr<uint8_t* []>(new uint8_t*[height]);
+  for (int32_t y = 0; y < height; y++) {
+    image->rows[y] = image->data.get() + y * width * 4;
+    for (int32_t x = 0; x < width; x++) {
+      pixel(x, y, image->rows[y] + x * 4);
+    }
+  }
+  return image;
+}
+
+static void EncodePng(IAaptContext* context, const Image* image, BigBuffer* out_buffer) {
+  io::BigBufferOutputStream out(out_buffer);
+  ASSERT_TRUE(WritePng(context, image, nullptr, &out, {}));
+  ASSERT_FALSE(out.HadError());
+}
+
+static std::unique_ptr<Image> DecodePng(IAaptContext* context, const BigBuffer& buffer) {
+  std::unique_ptr<uint8_t[]> data = util::Copy(buffer);
+  PngChunkFilter in(android::StringPiece(reinterpret_cast<const char*>(data.get()), buffer.size()));
+  return ReadPng(context, Source("test.png"), &in);
+}
+
+static void ExpectSamePixels(const Image* expected, const Image* actual) {
+  ASSERT_EQ(expected->width, actual->width);
+  ASSERT_EQ(expected->height, actual->height);
+  for (int32_t y = 0; y < expected->height; y++) {
+    ASSERT_EQ(0, memcmp(expected->rows[y], actual->rows[y], expected->width * 4)) << "row " << y;
+  }
+}
+
+TEST(PngCrunchTest, LargeRgbaImageRoundTrips) {
+  std::unique_ptr<IAaptContext> context = test::ContextBuilder().Build();
+  std::unique_ptr<Image> image = MakeImage(700, 600, [](int32_t x, int32_t y, uint8_t* rgba) {
+    rgba[0] = static_cast<uint8_t>(x * 7 + y);
+    rgba[1] = static_cast<uint8_t>(x ^ y);
+    rgba[2] = static_cast<uint8_t>(y * 3);
+    rgba[3] = static_cast<uint8_t>(128 + (x % 64));
+  });
+
+  BigBuffer buffer(4096);
+  ASSERT_NO_FATAL_FAILURE(EncodePng(context.get(), image.get(), &buffer));
+
+  std::unique_ptr<Image> decoded = DecodePng(context.get(), buffer);
+  ASSERT_NE(nullptr, decoded);
+  ExpectSamePixels(image.get(), decoded.get());
+}
+
+TEST(PngCrunchTest, LargeImageZeroesTransparentPixels) {
+  std::unique_ptr<IAaptContext> context = test::ContextBuilder().Build();
+  std::unique_ptr<Image> image = MakeImage(600, 600, [](int32_t x, int32_t y, uint8_t* rgba) {
+    rgba[0] = static_cast<uint8_t>(x);
+    rgba[1] = static_cast<uint8_t>(y);
+    rgba[2] = static_cast<uint8_t>(x + y);
+    rgba[3] = (x + y) % 3 == 0 ? 0x00 : 0xff;
+  });
+
+  BigBuffer buffer(4096);
+  ASSERT_NO_FATAL_FAILURE(EncodePng(context.get(), image.get(), &buffer));
+
+  std::unique_ptr<Image> decoded = DecodePng(context.get(), buffer);
+  ASSERT_NE(nullptr, decoded);
+
+  std::unique_ptr<Image> expected = MakeImage(600, 600, [&](int32_t x, int32_t y, uint8_t* rgba) {
+    memcpy(rgba, image->rows[y] + x * 4, 4);
+    if (rgba[3] == 0) {
+      rgba[0] = rgba[1] = rgba[2] = 0;
+    }
+  });
+  ExpectSamePixels(expected.get(), decoded.get());
+}
+
+TEST(PngCrunchTest, LargeGrayscaleAndPaletteImagesRoundTrip) {
+  std::unique_ptr<IAaptContext> context = test::ContextBuilder().Build();
+
+  std::unique_ptr<Image> gray = MakeImage(800, 400, [](int32_t x, int32_t y, uint8_t* rgba) {
+    rgba[0] = rgba[1] = rgba[2] = static_cast<uint8_t>(x + y);
+    rgba[3] = 0xff;
+  });
+  BigBuffer gray_buffer(4096);
+  ASSERT_NO_FATAL_FAILURE(EncodePng(context.get(), gray.get(), &gray_buffer));
+  std::unique_ptr<Image> decoded = DecodePng(context.get(), gray_buffer);
+  ASSERT_NE(nullptr, decoded);
+  ExpectSamePixels(gray.get(), decoded.get());
+
+  std::unique_ptr<Image> palette = MakeImage(800, 400, [](int32_t x, int32_t y, uint8_t* rgba) {
+    const uint8_t shade = static_cast<uint8_t>((x / 16 + y / 16) % 4 * 60);
+    rgba[0] = shade;
+    rgba[1] = 0x20;
+    rgba[2] = static_cast<uint8_t>(0xff - shade);
+    rgba[3] = (x / 16) % 2 == 0 ? 0xff : 0x80;
+  });
+  BigBuffer palette_buffer(4096);
+  ASSERT_NO_FATAL_FAILURE(EncodePng(context.get(), palette.get(), &palette_buffer));
+  decoded = DecodePng(context.get(), palette_buffer);
+  ASSERT_NE(nullptr, decoded);
+  ExpectSamePixels(palette.get(), decoded.get());
+}
+
+TEST(PngCrunchTest, LargeImageEncodingIsDeterministic) {
+  std::unique_ptr<IAaptContext> context = test::ContextBuilder().Build();
+  std::unique_ptr<Image> image = MakeImage(1024, 1024, [](int32_t x, int32_t y, uint8_t* rgba) {
+    rgba[0] = static_cast<uint8_t>(x * y);
+    rgba[1] = static_cast<uint8_t>(x + 3 * y);
+    rgba[2] = static_cast<uint8_t>(y);
+    rgba[3] = 0xff;
+  });
+
+  BigBuffer first(4096);
+  ASSERT_NO_FATAL_FAILURE(EncodePng(context.get(), image.get(), &first));
+  BigBuffer second(4096);
+  ASSERT_NO_FATAL_FAILURE(EncodePng(context.get(), image.get(), &second));
+
+  std::unique_ptr<uint8_t[]> first_data = util::Copy(first);
+  std::unique_ptr<uint8_t[]> second_data = util::Copy(second);
+  ASSERT_EQ(first.size(), second.size());
+  EXPECT_EQ(0, memcmp(first_data.get(), second_data.get(), first.size()));
+}
+
+}  // namespace aapt
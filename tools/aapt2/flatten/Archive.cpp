@@ -27,6 +27,7 @@
 #include "ziparchive/zip_writer.h"
 
 #include "util/Files.h"
+#include "util/Trace.h"
 
 using android::StringPiece;
 
@@ -78,6 +79,7 @@ class DirectoryWriter : public IArchiveWriter {
       file_.reset(nullptr);
       return false;
     }
+    trace::IncrementCounter("bytes_written", len);
     return true;
   }
 
@@ -158,6 +160,7 @@ class ZipFileWriter : public IArchiveWriter {
       error_ = ZipWriter::ErrorCodeString(result);
       return false;
     }
+    trace::IncrementCounter("bytes_written", len);
     return true;
   }
 
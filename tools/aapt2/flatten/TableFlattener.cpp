@@ -30,6 +30,8 @@
 #include "ValueVisitor.h"
 #include "flatten/ChunkWriter.h"
 #include "flatten/ResourceTypeExtensions.h"
+#include "io/BigBufferInputStream.h"
+#include "io/Util.h"
 #include "util/BigBuffer.h"
 
 using namespace android;
@@ -76,10 +78,14 @@ struct FlatEntry {
   uint32_t entry_key;
 };
 
+// Flattens the ResTable_map entries of a complex value. When constructed without an output
+// buffer, it only counts the entries that would be written.
 class MapFlattenVisitor : public RawValueVisitor {
  public:
   using RawValueVisitor::Visit;
 
+  MapFlattenVisitor() : out_entry_(nullptr), buffer_(nullptr) {}
+
   MapFlattenVisitor(ResTable_entry_ext* out_entry, BigBuffer* buffer)
       : out_entry_(out_entry), buffer_(buffer) {}
 
@@ -111,14 +117,16 @@ class MapFlattenVisitor : public RawValueVisitor {
   }
 
   void Visit(Style* style) override {
-    if (style->parent) {
+    if (style->parent && out_entry_ != nullptr) {
       const Reference& parent_ref = style->parent.value();
       CHECK(bool(parent_ref.id)) << "parent has no ID";
       out_entry_->parent.ident = util::HostToDevice32(parent_ref.id.value().id);
     }
 
-    // Sort the style.
-    std::sort(style->entries.begin(), style->entries.end(), cmp_style_entries);
+    // Sort the style. Counting does not depend on the order, so it is left to the flattening pass.
+    if (buffer_ != nullptr) {
+      std::sort(style->entries.begin(), style->entries.end(), cmp_style_entries);
+    }
 
     for (Style::Entry& entry : style->entries) {
       FlattenEntry(&entry.key, entry.value.get());
@@ -134,10 +142,13 @@ class MapFlattenVisitor : public RawValueVisitor {
 
   void Visit(Array* array) override {
     for (auto& item : array->items) {
+      entry_count_++;
+      if (buffer_ == nullptr) {
+        continue;
+      }
       ResTable_map* out_entry = buffer_->NextBlock<ResTable_map>();
       FlattenValue(item.get(), out_entry);
       out_entry->value.size = util::HostToDevice16(sizeof(out_entry->value));
-      entry_count_++;
     }
   }
 
@@ -190,6 +201,8 @@ class MapFlattenVisitor : public RawValueVisitor {
    */
   void Finish() { out_entry_->count = util::HostToDevice32(entry_count_); }
 
+  size_t entry_count() const { return entry_count_; }
+
  private:
   DISALLOW_COPY_AND_ASSIGN(MapFlattenVisitor);
 
@@ -203,11 +216,14 @@ class MapFlattenVisitor : public RawValueVisitor {
   }
 
   void FlattenEntry(Reference* key, Item* value) {
+    entry_count_++;
+    if (buffer_ == nullptr) {
+      return;
+    }
     ResTable_map* out_entry = buffer_->NextBlock<ResTable_map>();
     FlattenKey(key, out_entry);
     FlattenValue(value, out_entry);
     out_entry->value.size = util::HostToDevice16(sizeof(out_entry->value));
-    entry_count_++;
   }
 
   ResTable_entry_ext* out_entry_;
@@ -215,6 +231,32 @@ class MapFlattenVisitor : public RawValueVisitor {
   size_t entry_count_ = 0;
 };
 
+// Receives the flattened table one piece at a time, in file order. Pieces are either moved into
+// a BigBuffer or copied to an OutputStream and released.
+class FlattenedTableWriter {
+ public:
+  FlattenedTableWriter(BigBuffer* buffer, io::OutputStream* out) : buffer_(buffer), out_(out) {}
+
+  bool Append(BigBuffer* piece) {
+    if (buffer_ != nullptr) {
+      buffer_->AppendBuffer(std::move(*piece));
+      return true;
+    }
+
+    io::BigBufferInputStream in(piece);
+    return io::Copy(out_, &in) && !out_->HadError();
+  }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(FlattenedTableWriter);
+
+  BigBuffer* buffer_;
+  io::OutputStream* out_;
+};
+
+// Flattens a package in two passes. Prepare() assigns the type and key strings and computes the
+// size of every chunk without flattening any values. FlattenPackage() then writes the package
+// one resource type at a time.
 class PackageFlattener {
  public:
   PackageFlattener(IAaptContext* context, ResourceTablePackage* package,
@@ -225,44 +267,108 @@ class PackageFlattener {
         shared_libs_(shared_libs),
         use_sparse_entries_(use_sparse_entries) {}
 
-  bool FlattenPackage(BigBuffer* buffer) {
-    ChunkWriter pkg_writer(buffer);
-    ResTable_package* pkg_header = pkg_writer.StartChunk<ResTable_package>(RES_TABLE_PACKAGE_TYPE);
-    pkg_header->id = util::HostToDevice32(package_->id.value());
-
+  bool Prepare() {
     // AAPT truncated the package name, so do the same.
     // Shared libraries require full package names, so don't truncate theirs.
     if (context_->GetPackageType() != PackageType::kApp &&
-        package_->name.size() >= arraysize(pkg_header->name)) {
+        package_->name.size() >= arraysize(ResTable_package::name)) {
       diag_->Error(DiagMessage() << "package name '" << package_->name
                                  << "' is too long. "
                                     "Shared libraries cannot have truncated package names");
       return false;
     }
 
-    // Copy the package name in device endianness.
-    strcpy16_htod(pkg_header->name, arraysize(pkg_header->name), util::Utf8ToUtf16(package_->name));
+    // Sort the types by their IDs. They will be inserted into the StringPool in
+    // this order.
+    sorted_types_ = CollectAndSortTypes();
+
+    size_t expected_type_id = 1;
+    for (ResourceTableType* type : sorted_types_) {
+      // If there is a gap in the type IDs, fill in the StringPool
+      // with empty values until we reach the ID we expect.
+      while (type->id.value() > expected_type_id) {
+        std::stringstream type_name;
+        type_name << "?" << expected_type_id;
+        type_pool_.MakeRef(type_name.str());
+        expected_type_id++;
+      }
+      expected_type_id++;
+      type_pool_.MakeRef(ToString(type->type));
 
-    // Serialize the types. We do this now so that our type and key strings
-    // are populated. We write those first.
-    BigBuffer type_buffer(1024);
-    FlattenTypes(&type_buffer);
+      std::vector<ResourceEntry*> sorted_entries = CollectAndSortEntries(type);
+      type_sizes_.push_back(sorted_entries.empty() ? 0u : ComputeTypeSize(sorted_entries));
+    }
 
-    pkg_header->typeStrings = util::HostToDevice32(pkg_writer.size());
-    StringPool::FlattenUtf16(pkg_writer.buffer(), type_pool_);
+    // The type and key strings are complete, so their pools can be flattened now.
+    StringPool::FlattenUtf16(&type_pool_buffer_, type_pool_);
+    StringPool::FlattenUtf8(&key_pool_buffer_, key_pool_);
 
-    pkg_header->keyStrings = util::HostToDevice32(pkg_writer.size());
-    StringPool::FlattenUtf8(pkg_writer.buffer(), key_pool_);
+    size_ = sizeof(ResTable_package) + type_pool_buffer_.size() + key_pool_buffer_.size();
+    size_ = std::accumulate(type_sizes_.begin(), type_sizes_.end(), size_);
+    if (HasLibrarySpec()) {
+      size_ += sizeof(ResTable_lib_header) + LibraryEntryCount() * sizeof(ResTable_lib_entry);
+    }
+    return true;
+  }
 
-    // Append the types.
-    buffer->AppendBuffer(std::move(type_buffer));
+  // The size of the package chunk, as computed by Prepare().
+  size_t size() const { return size_; }
 
-    // If there are libraries (or if the package ID is 0x00), encode a library chunk.
-    if (package_->id.value() == 0x00 || !shared_libs_->empty()) {
-      FlattenLibrarySpec(buffer);
+  bool FlattenPackage(FlattenedTableWriter* writer) {
+    {
+      BigBuffer header_buffer(sizeof(ResTable_package));
+      ChunkWriter pkg_writer(&header_buffer);
+      ResTable_package* pkg_header =
+          pkg_writer.StartChunk<ResTable_package>(RES_TABLE_PACKAGE_TYPE);
+      pkg_header->header.size = util::HostToDevice32(size_);
+      pkg_header->id = util::HostToDevice32(package_->id.value());
+
+      // Copy the package name in device endianness.
+      strcpy16_htod(pkg_header->name, arraysize(pkg_header->name),
+                    util::Utf8ToUtf16(package_->name));
+
+      // The type and key strings come before the types.
+      pkg_header->typeStrings = util::HostToDevice32(pkg_writer.size());
+      pkg_header->keyStrings =
+          util::HostToDevice32(pkg_writer.size() + type_pool_buffer_.size());
+      header_buffer.AppendBuffer(std::move(type_pool_buffer_));
+      header_buffer.AppendBuffer(std::move(key_pool_buffer_));
+      if (!writer->Append(&header_buffer)) {
+        return false;
+      }
+    }
+
+    // Flatten and write out one type at a time.
+    for (size_t i = 0; i < sorted_types_.size(); i++) {
+      if (type_sizes_[i] == 0) {
+        continue;
+      }
+
+      BigBuffer type_buffer(1024);
+      if (!FlattenType(sorted_types_[i], &type_buffer)) {
+        return false;
+      }
+      if (type_buffer.size() != type_sizes_[i]) {
+        // The package and table headers already hold the predicted size, so the output
+        // would be corrupt.
+        diag_->Error(DiagMessage() << "size of type '" << sorted_types_[i]->type
+                                   << "' was mispredicted: expected " << type_sizes_[i]
+                                   << " bytes, flattened " << type_buffer.size());
+        return false;
+      }
+      if (!writer->Append(&type_buffer)) {
+        return false;
+      }
     }
 
-    pkg_writer.Finish();
+    // If there are libraries (or if the package ID is 0x00), encode a library chunk.
+    if (HasLibrarySpec()) {
+      BigBuffer lib_buffer(sizeof(ResTable_lib_header));
+      FlattenLibrarySpec(&lib_buffer);
+      if (!writer->Append(&lib_buffer)) {
+        return false;
+      }
+    }
     return true;
   }
 
@@ -311,6 +417,63 @@ class PackageFlattener {
     return true;
   }
 
+  bool ShouldSparseEncode(const ConfigDescription& config, size_t values_size,
+                          size_t num_entries, size_t num_total_entries) {
+    bool sparse_encode = use_sparse_entries_;
+
+    // Only sparse encode if the entries will be read on platforms O+.
+    sparse_encode =
+        sparse_encode && (context_->GetMinSdkVersion() >= SDK_O || config.sdkVersion >= SDK_O);
+
+    // Only sparse encode if the offsets are representable in 2 bytes.
+    sparse_encode = sparse_encode && (values_size / 4u) <= std::numeric_limits<uint16_t>::max();
+
+    // Only sparse encode if the ratio of populated entries to total entries is below some
+    // threshold.
+    sparse_encode =
+        sparse_encode && ((100 * num_entries) / num_total_entries) < kSparseEncodingThreshold;
+    return sparse_encode;
+  }
+
+  // Returns the number of bytes FlattenValue() writes for `value`.
+  static size_t ComputeValueSize(Value* value) {
+    if (ValueCast<Item>(value)) {
+      return sizeof(ResTable_entry) + sizeof(Res_value);
+    }
+    MapFlattenVisitor visitor;
+    value->Accept(&visitor);
+    return sizeof(ResTable_entry_ext) + visitor.entry_count() * sizeof(ResTable_map);
+  }
+
+  // Returns the number of bytes FlattenConfig() writes for `entries`.
+  size_t ComputeConfigSize(const ConfigDescription& config, size_t num_total_entries,
+                           const std::vector<FlatEntry>& entries) {
+    size_t values_size = 0;
+    for (const FlatEntry& flat_entry : entries) {
+      values_size += ComputeValueSize(flat_entry.value);
+    }
+
+    size_t size = sizeof(ResTable_type) + values_size;
+    if (ShouldSparseEncode(config, values_size, entries.size(), num_total_entries)) {
+      size += entries.size() * sizeof(ResTable_sparseTypeEntry);
+    } else {
+      size += num_total_entries * sizeof(uint32_t);
+    }
+    return size;
+  }
+
+  // Returns the number of bytes FlattenType() writes for a type with the given entries.
+  size_t ComputeTypeSize(const std::vector<ResourceEntry*>& sorted_entries) {
+    // Since the entries are sorted by ID, the last ID will be the largest.
+    const size_t num_entries = sorted_entries.back()->id.value() + 1;
+
+    size_t size = sizeof(ResTable_typeSpec) + num_entries * sizeof(uint32_t);
+    for (auto& entry : CollectConfigs(sorted_entries)) {
+      size += ComputeConfigSize(entry.first, num_entries, entry.second);
+    }
+    return size;
+  }
+
   bool FlattenConfig(const ResourceTableType* type, const ConfigDescription& config,
                      const size_t num_total_entries, std::vector<FlatEntry>* entries,
                      BigBuffer* buffer) {
@@ -340,22 +503,7 @@ class PackageFlattener {
       }
     }
 
-    bool sparse_encode = use_sparse_entries_;
-
-    // Only sparse encode if the entries will be read on platforms O+.
-    sparse_encode =
-        sparse_encode && (context_->GetMinSdkVersion() >= SDK_O || config.sdkVersion >= SDK_O);
-
-    // Only sparse encode if the offsets are representable in 2 bytes.
-    sparse_encode =
-        sparse_encode && (values_buffer.size() / 4u) <= std::numeric_limits<uint16_t>::max();
-
-    // Only sparse encode if the ratio of populated entries to total entries is below some
-    // threshold.
-    sparse_encode =
-        sparse_encode && ((100 * entries->size()) / num_total_entries) < kSparseEncodingThreshold;
-
-    if (sparse_encode) {
+    if (ShouldSparseEncode(config, values_buffer.size(), entries->size(), num_total_entries)) {
       type_header->entryCount = util::HostToDevice32(entries->size());
       type_header->flags |= ResTable_type::FLAG_SPARSE;
       ResTable_sparseTypeEntry* indices =
@@ -460,69 +608,56 @@ class PackageFlattener {
     return true;
   }
 
-  bool FlattenTypes(BigBuffer* buffer) {
-    // Sort the types by their IDs. They will be inserted into the StringPool in
-    // this order.
-    std::vector<ResourceTableType*> sorted_types = CollectAndSortTypes();
-
-    size_t expected_type_id = 1;
-    for (ResourceTableType* type : sorted_types) {
-      // If there is a gap in the type IDs, fill in the StringPool
-      // with empty values until we reach the ID we expect.
-      while (type->id.value() > expected_type_id) {
-        std::stringstream type_name;
-        type_name << "?" << expected_type_id;
-        type_pool_.MakeRef(type_name.str());
-        expected_type_id++;
-      }
-      expected_type_id++;
-      type_pool_.MakeRef(ToString(type->type));
-
-      std::vector<ResourceEntry*> sorted_entries = CollectAndSortEntries(type);
-      if (sorted_entries.empty()) {
-        continue;
+  // The binary resource table lists resource entries for each configuration.
+  // We store them inverted, where a resource entry lists the values for each
+  // configuration available. Here we reverse this to match the binary table.
+  std::map<ConfigDescription, std::vector<FlatEntry>> CollectConfigs(
+      const std::vector<ResourceEntry*>& sorted_entries) {
+    std::map<ConfigDescription, std::vector<FlatEntry>> config_to_entry_list_map;
+    for (ResourceEntry* entry : sorted_entries) {
+      const uint32_t key_index = (uint32_t)key_pool_.MakeRef(entry->name).index();
+
+      // Group values by configuration.
+      for (auto& config_value : entry->values) {
+        config_to_entry_list_map[config_value->config].push_back(
+            FlatEntry{entry, config_value->value.get(), key_index});
       }
+    }
+    return config_to_entry_list_map;
+  }
 
-      if (!FlattenTypeSpec(type, &sorted_entries, buffer)) {
-        return false;
-      }
+  bool FlattenType(ResourceTableType* type, BigBuffer* buffer) {
+    std::vector<ResourceEntry*> sorted_entries = CollectAndSortEntries(type);
+    if (!FlattenTypeSpec(type, &sorted_entries, buffer)) {
+      return false;
+    }
 
-      // Since the entries are sorted by ID, the last ID will be the largest.
-      const size_t num_entries = sorted_entries.back()->id.value() + 1;
-
-      // The binary resource table lists resource entries for each
-      // configuration.
-      // We store them inverted, where a resource entry lists the values for
-      // each
-      // configuration available. Here we reverse this to match the binary
-      // table.
-      std::map<ConfigDescription, std::vector<FlatEntry>> config_to_entry_list_map;
-      for (ResourceEntry* entry : sorted_entries) {
-        const uint32_t key_index = (uint32_t)key_pool_.MakeRef(entry->name).index();
-
-        // Group values by configuration.
-        for (auto& config_value : entry->values) {
-          config_to_entry_list_map[config_value->config].push_back(
-              FlatEntry{entry, config_value->value.get(), key_index});
-        }
-      }
+    // Since the entries are sorted by ID, the last ID will be the largest.
+    const size_t num_entries = sorted_entries.back()->id.value() + 1;
 
-      // Flatten a configuration value.
-      for (auto& entry : config_to_entry_list_map) {
-        if (!FlattenConfig(type, entry.first, num_entries, &entry.second, buffer)) {
-          return false;
-        }
+    // Flatten a configuration value.
+    for (auto& entry : CollectConfigs(sorted_entries)) {
+      if (!FlattenConfig(type, entry.first, num_entries, &entry.second, buffer)) {
+        return false;
       }
     }
     return true;
   }
 
+  bool HasLibrarySpec() const {
+    return package_->id.value() == 0x00 || !shared_libs_->empty();
+  }
+
+  size_t LibraryEntryCount() const {
+    return (package_->id.value() == 0x00 ? 1 : 0) + shared_libs_->size();
+  }
+
   void FlattenLibrarySpec(BigBuffer* buffer) {
     ChunkWriter lib_writer(buffer);
     ResTable_lib_header* lib_header =
         lib_writer.StartChunk<ResTable_lib_header>(RES_TABLE_LIBRARY_TYPE);
 
-    const size_t num_entries = (package_->id.value() == 0x00 ? 1 : 0) + shared_libs_->size();
+    const size_t num_entries = LibraryEntryCount();
     CHECK(num_entries > 0);
 
     lib_header->count = util::HostToDevice32(num_entries);
@@ -552,6 +687,55 @@ class PackageFlattener {
   bool use_sparse_entries_;
   StringPool type_pool_;
   StringPool key_pool_;
+
+  // Filled in by Prepare().
+  std::vector<ResourceTableType*> sorted_types_;
+  std::vector<size_t> type_sizes_;
+  BigBuffer type_pool_buffer_{1024};
+  BigBuffer key_pool_buffer_{1024};
+  size_t size_ = 0;
+};
+
+// An OutputStream over the entry an IArchiveWriter has open between StartEntry() and
+// FinishEntry(). Flush() must be called before the entry is finished.
+class ArchiveEntryOutputStream : public io::OutputStream {
+ public:
+  explicit ArchiveEntryOutputStream(IArchiveWriter* writer) : writer_(writer), adaptor_(writer) {}
+
+  bool Next(void** data, size_t* size) override {
+    int out_size;
+    if (!adaptor_.Next(data, &out_size)) {
+      return false;
+    }
+    *size = static_cast<size_t>(out_size);
+    return true;
+  }
+
+  void BackUp(size_t count) override {
+    adaptor_.BackUp(static_cast<int>(count));
+  }
+
+  size_t ByteCount() const override {
+    return static_cast<size_t>(adaptor_.ByteCount());
+  }
+
+  bool Flush() {
+    return adaptor_.Flush();
+  }
+
+  bool HadError() const override {
+    return writer_->HadError();
+  }
+
+  std::string GetError() const override {
+    return writer_->GetError();
+  }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(ArchiveEntryOutputStream);
+
+  IArchiveWriter* writer_;
+  ::google::protobuf::io::CopyingOutputStreamAdaptor adaptor_;
 };
 
 }  // namespace
@@ -571,11 +755,6 @@ bool TableFlattener::Consume(IAaptContext* context, ResourceTable* table) {
       });
   table->string_pool.Prune();
 
-  // Write the ResTable header.
-  ChunkWriter table_writer(buffer_);
-  ResTable_header* table_header = table_writer.StartChunk<ResTable_header>(RES_TABLE_TYPE);
-  table_header->packageCount = util::HostToDevice32(table->packages.size());
-
   // Write a self mapping entry for this package if the ID is non-standard (0x7f).
   if (context->GetPackageType() == PackageType::kApp) {
     const uint8_t package_id = context->GetPackageId();
@@ -585,22 +764,65 @@ bool TableFlattener::Consume(IAaptContext* context, ResourceTable* table) {
   }
 
   // Flatten the values string pool.
+  BigBuffer header_buffer(1024);
+  ChunkWriter table_writer(&header_buffer);
+  ResTable_header* table_header = table_writer.StartChunk<ResTable_header>(RES_TABLE_TYPE);
+  table_header->packageCount = util::HostToDevice32(table->packages.size());
   StringPool::FlattenUtf8(table_writer.buffer(), table->string_pool);
 
-  BigBuffer package_buffer(1024);
-
-  // Flatten each package.
+  // Size every package before anything is written, since the table header holds the total size.
+  std::vector<std::unique_ptr<PackageFlattener>> package_flatteners;
+  size_t table_size = header_buffer.size();
   for (auto& package : table->packages) {
-    PackageFlattener flattener(context, package.get(), &table->included_packages_,
-                               options_.use_sparse_entries);
-    if (!flattener.FlattenPackage(&package_buffer)) {
+    package_flatteners.push_back(util::make_unique<PackageFlattener>(
+        context, package.get(), &table->included_packages_, options_.use_sparse_entries));
+    if (!package_flatteners.back()->Prepare()) {
       return false;
     }
+    table_size += package_flatteners.back()->size();
+  }
+  table_writer.chunk_header()->size = util::HostToDevice32(table_size);
+
+  FlattenedTableWriter writer(buffer_, out_);
+  bool result = writer.Append(&header_buffer);
+
+  // Flatten each package.
+  for (size_t i = 0; result && i < package_flatteners.size(); i++) {
+    result = package_flatteners[i]->FlattenPackage(&writer);
+  }
+
+  if (!result && out_ != nullptr && out_->HadError()) {
+    context->GetDiagnostics()->Error(DiagMessage() << "failed writing resource table: "
+                                                   << out_->GetError());
+  }
+  return result;
+}
+
+bool FlattenTableToArchive(IAaptContext* context, const TableFlattenerOptions& options,
+                           ResourceTable* table, const std::string& out_path,
+                           uint32_t compression_flags, IArchiveWriter* writer) {
+  if (context->IsVerbose()) {
+    context->GetDiagnostics()->Note(DiagMessage() << "writing " << out_path << " to archive");
   }
 
-  // Finally merge all the packages into the main buffer.
-  table_writer.buffer()->AppendBuffer(std::move(package_buffer));
-  table_writer.Finish();
+  if (!writer->StartEntry(out_path, compression_flags)) {
+    context->GetDiagnostics()->Error(DiagMessage() << "failed to write " << out_path
+                                                   << " to archive: " << writer->GetError());
+    return false;
+  }
+
+  ArchiveEntryOutputStream out(writer);
+  TableFlattener flattener(options, &out);
+  if (!flattener.Consume(context, table)) {
+    context->GetDiagnostics()->Error(DiagMessage() << "failed to flatten resource table");
+    return false;
+  }
+
+  if (!out.Flush() || !writer->FinishEntry()) {
+    context->GetDiagnostics()->Error(DiagMessage() << "failed to write " << out_path
+                                                   << " to archive: " << writer->GetError());
+    return false;
+  }
   return true;
 }
 
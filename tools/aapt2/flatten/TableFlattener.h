@@ -20,6 +20,8 @@
 #include "android-base/macros.h"
 
 #include "ResourceTable.h"
+#include "flatten/Archive.h"
+#include "io/Io.h"
 #include "process/IResourceTableConsumer.h"
 #include "util/BigBuffer.h"
 
@@ -42,15 +44,27 @@ class TableFlattener : public IResourceTableConsumer {
   explicit TableFlattener(const TableFlattenerOptions& options, BigBuffer* buffer)
       : options_(options), buffer_(buffer) {}
 
+  // Streams the flattened table to `out`. The sizes of all chunks are computed up front, so
+  // only the string pool and one resource type are ever held in memory at a time.
+  explicit TableFlattener(const TableFlattenerOptions& options, io::OutputStream* out)
+      : options_(options), out_(out) {}
+
   bool Consume(IAaptContext* context, ResourceTable* table) override;
 
  private:
   DISALLOW_COPY_AND_ASSIGN(TableFlattener);
 
   TableFlattenerOptions options_;
-  BigBuffer* buffer_;
+  BigBuffer* buffer_ = nullptr;
+  io::OutputStream* out_ = nullptr;
 };
 
+// Flattens the table straight into the archive entry at out_path, without first buffering the
+// whole flattened table in memory.
+bool FlattenTableToArchive(IAaptContext* context, const TableFlattenerOptions& options,
+                           ResourceTable* table, const std::string& out_path,
+                           uint32_t compression_flags, IArchiveWriter* writer);
+
 }  // namespace aapt
 
 #endif /* AAPT_FLATTEN_TABLEFLATTENER_H */
@@ -20,6 +20,7 @@
 
 #include "ResourceUtils.h"
 #include "SdkConstants.h"
+#include "io/BigBufferOutputStream.h"
 #include "test/Test.h"
 #include "unflatten/BinaryResourceParser.h"
 #include "util/Util.h"
@@ -467,4 +468,45 @@ TEST_F(TableFlattenerTest, LongSharedLibraryPackageNameIsIllegal) {
   ASSERT_FALSE(Flatten(context.get(), {}, table.get(), &result));
 }
 
+TEST_F(TableFlattenerTest, StreamedTableMatchesBufferedTable) {
+  std::unique_ptr<IAaptContext> context = test::ContextBuilder()
+                                              .SetCompilationPackage("android")
+                                              .SetPackageId(0x01)
+                                              .SetMinSdkVersion(SDK_O)
+                                              .Build();
+
+  const ConfigDescription sparse_config = test::ParseConfigOrDie("en-rGB");
+  std::unique_ptr<ResourceTable> table = BuildTableWithSparseEntries(context.get(), sparse_config,
+                                                                     0.25f);
+  ASSERT_TRUE(table->AddResource(
+      test::ParseNameOrDie("android:attr/size"), ResourceId(0x01010000),
+      ConfigDescription::DefaultConfig(), "",
+      test::AttributeBuilder().SetTypeMask(ResTable_map::TYPE_DIMENSION).Build(),
+      context->GetDiagnostics()));
+  ASSERT_TRUE(table->AddResource(
+      test::ParseNameOrDie("android:styleable/View"), ResourceId(0x01030000),
+      ConfigDescription::DefaultConfig(), "",
+      test::StyleableBuilder().AddItem("android:attr/size", ResourceId(0x01010000)).Build(),
+      context->GetDiagnostics()));
+  ASSERT_TRUE(table->AddResource(test::ParseNameOrDie("android:layout/main"),
+                                 ResourceId(0x01040000), test::ParseConfigOrDie("land"), "",
+                                 util::make_unique<FileReference>(
+                                     table->string_pool.MakeRef("res/layout-land/main.xml")),
+                                 context->GetDiagnostics()));
+
+  TableFlattenerOptions options;
+  options.use_sparse_entries = true;
+
+  std::string buffered_contents;
+  ASSERT_TRUE(Flatten(context.get(), options, table.get(), &buffered_contents));
+
+  BigBuffer streamed(1024);
+  io::BigBufferOutputStream out(&streamed);
+  TableFlattener flattener(options, &out);
+  ASSERT_TRUE(flattener.Consume(context.get(), table.get()));
+  ASSERT_FALSE(out.HadError());
+
+  EXPECT_EQ(buffered_contents, streamed.to_string());
+}
+
 }  // namespace aapt
@@ -17,9 +17,12 @@
 #include "optimize/ResourceDeduper.h"
 
 #include <algorithm>
+#include <memory>
+#include <vector>
 
 #include "DominatorTree.h"
 #include "ResourceTable.h"
+#include "util/Parallel.h"
 
 namespace aapt {
 
@@ -40,8 +43,9 @@ class DominatedKeyValueRemover : public DominatorTree::BottomUpVisitor {
  public:
   using Node = DominatorTree::Node;
 
-  explicit DominatedKeyValueRemover(IAaptContext* context, ResourceEntry* entry)
-      : context_(context), entry_(entry) {}
+  DominatedKeyValueRemover(bool verbose, IDiagnostics* diag, ResourceEntry* entry,
+                           std::vector<std::unique_ptr<Value>>* removed)
+      : verbose_(verbose), diag_(diag), entry_(entry), removed_(removed) {}
 
   void VisitConfig(Node* node) {
     Node* parent = node->parent();
@@ -72,30 +76,60 @@ class DominatedKeyValueRemover : public DominatorTree::BottomUpVisitor {
         return;
       }
     }
-    if (context_->IsVerbose()) {
-      context_->GetDiagnostics()->Note(
+    if (verbose_) {
+      diag_->Note(
           DiagMessage(node_value->value->GetSource())
           << "removing dominated duplicate resource with name \""
           << entry_->name << "\"");
-      context_->GetDiagnostics()->Note(
+      diag_->Note(
           DiagMessage(parent_value->value->GetSource()) << "dominated here");
     }
-    node_value->value = {};
+    // Destroying the value releases its references into the table's shared StringPool,
+    // whose reference counts are not thread-safe, so leave that to the caller.
+    removed_->push_back(std::move(node_value->value));
   }
 
  private:
   DISALLOW_COPY_AND_ASSIGN(DominatedKeyValueRemover);
 
-  IAaptContext* context_;
+  bool verbose_;
+  IDiagnostics* diag_;
   ResourceEntry* entry_;
+  std::vector<std::unique_ptr<Value>>* removed_;
 };
 
-static void DedupeEntry(IAaptContext* context, ResourceEntry* entry) {
+// Holds on to the messages logged while deduping one type, so that types can be
+// deduped concurrently and their messages still reported in table order.
+class BufferedDiagnostics : public IDiagnostics {
+ public:
+  BufferedDiagnostics() = default;
+
+  void Log(Level level, DiagMessageActual& actual_msg) override {
+    messages_.push_back({level, std::move(actual_msg)});
+  }
+
+  void FlushTo(IDiagnostics* diag) {
+    for (auto& message : messages_) {
+      diag->Log(message.first, message.second);
+    }
+    messages_.clear();
+  }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(BufferedDiagnostics);
+
+  std::vector<std::pair<Level, DiagMessageActual>> messages_;
+};
+
+// Moves the dominated values of `entry` into `removed`, without destroying them.
+static void DedupeEntry(bool verbose, IDiagnostics* diag, ResourceEntry* entry,
+                        std::vector<std::unique_ptr<Value>>* removed) {
   DominatorTree tree(entry->values);
-  DominatedKeyValueRemover remover(context, entry);
+  DominatedKeyValueRemover remover(verbose, diag, entry, removed);
   tree.Accept(&remover);
 
-  // Erase the values that were removed.
+  // Erase the config values whose values were removed. They hold no values, so no string
+  // references are released here.
   entry->values.erase(
       std::remove_if(
           entry->values.begin(), entry->values.end(),
@@ -108,12 +142,28 @@ static void DedupeEntry(IAaptContext* context, ResourceEntry* entry) {
 }  // namespace
 
 bool ResourceDeduper::Consume(IAaptContext* context, ResourceTable* table) {
+  // Entries are independent of one another, so dedupe each type on its own thread.
+  std::vector<ResourceTableType*> types;
   for (auto& package : table->packages) {
     for (auto& type : package->types) {
-      for (auto& entry : type->entries) {
-        DedupeEntry(context, entry.get());
-      }
+      types.push_back(type.get());
+    }
+  }
+
+  const bool verbose = context->IsVerbose();
+  std::vector<BufferedDiagnostics> type_diagnostics(types.size());
+  std::vector<std::vector<std::unique_ptr<Value>>> type_removed(types.size());
+  util::ParallelFor(types.size(), [&](size_t i) {
+    for (auto& entry : types[i]->entries) {
+      DedupeEntry(verbose, &type_diagnostics[i], entry.get(), &type_removed[i]);
     }
+  });
+
+  // Destroy the removed values on this thread only.
+  type_removed.clear();
+
+  for (BufferedDiagnostics& diag : type_diagnostics) {
+    diag.FlushTo(context->GetDiagnostics());
   }
   return true;
 }
@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "optimize/ResourceDeduper.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "android-base/logging.h"
+#include "android-base/stringprintf.h"
+#include "benchmark/benchmark.h"
+
+#include "ConfigDescription.h"
+#include "ResourceTable.h"
+#include "ResourceValues.h"
+#include "test/Context.h"
+#include "util/Util.h"
+
+namespace aapt {
+
+// Builds a table with `type_count` types of 50 entries each. Every entry has a default value,
+// a translation for each of `locale_count` locales, and a v21 and an xxhdpi variant of each
+// translation. The v21 variants repeat their parent's value, so the deduper removes them.
+static std::unique_ptr<ResourceTable> BuildHighVariantTable(IDiagnostics* diag, int type_count,
+                                                            int locale_count) {
+  static const ResourceType kTypes[] = {ResourceType::kString, ResourceType::kDimen,
+                                        ResourceType::kInteger, ResourceType::kBool};
+  constexpr int kEntriesPerType = 50;
+
+  std::vector<ConfigDescription> configs;
+  configs.push_back(ConfigDescription::DefaultConfig());
+  for (int i = 0; i < locale_count; i++) {
+    const std::string language = {static_cast<char>('a' + (i / 26) % 26),
+                                  static_cast<char>('a' + i % 26)};
+    for (const char* suffix : {"", "-v21", "-xxhdpi"}) {
+      ConfigDescription config;
+      CHECK(ConfigDescription::Parse(language + suffix, &config));
+      configs.push_back(config);
+    }
+  }
+
+  std::unique_ptr<ResourceTable> table = util::make_unique<ResourceTable>();
+  for (int t = 0; t < type_count; t++) {
+    for (int e = 0; e < kEntriesPerType; e++) {
+      const ResourceName name("com.app.bench", kTypes[t % arraysize(kTypes)],
+                              android::base::StringPrintf("res_%d_%d", t, e));
+      for (size_t c = 0; c < configs.size(); c++) {
+        // Configs come in (locale, locale-v21, locale-xxhdpi) triples after the default;
+        // give the v21 variant the same value as its locale.
+        const uint32_t data = static_cast<uint32_t>(c == 0 || c % 3 != 2 ? c : c - 1);
+        CHECK(table->AddResource(
+            name, configs[c], {},
+            util::make_unique<BinaryPrimitive>(android::Res_value::TYPE_INT_DEC, data), diag));
+      }
+    }
+  }
+  return table;
+}
+
+// Dedupes a table of range(0) types whose entries each have range(1) locales.
+static void BM_DedupeHighVariantTable(benchmark::State& state) {
+  std::unique_ptr<IAaptContext> context =
+      test::ContextBuilder().SetCompilationPackage("com.app.bench").SetPackageId(0x7f).Build();
+  while (state.KeepRunning()) {
+    state.PauseTiming();
+    std::unique_ptr<ResourceTable> table = BuildHighVariantTable(
+        context->GetDiagnostics(), static_cast<int>(state.range(0)),
+        static_cast<int>(state.range(1)));
+    state.ResumeTiming();
+
+    ResourceDeduper deduper;
+    if (!deduper.Consume(context.get(), table.get())) {
+      state.SkipWithError("failed to dedupe table");
+      return;
+    }
+  }
+}
+BENCHMARK(BM_DedupeHighVariantTable)
+    ->Args({1, 10})
+    ->Args({1, 100})
+    ->Args({4, 100})
+    ->Args({4, 300})
+    ->Unit(benchmark::kMillisecond);
+
+}  // namespace aapt
@@ -0,0 +1,258 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "util/Trace.h"
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "android-base/errors.h"
+
+using android::StringPiece;
+
+namespace aapt {
+namespace trace {
+
+namespace {
+
+struct Event {
+  // 'X' for a complete duration event, 'C' for a counter sample.
+  char phase;
+  int tid;
+  int64_t ts_us;
+  int64_t dur_us;
+  std::string name;
+  std::string detail;
+  int64_t value;
+};
+
+struct Counter {
+  int64_t value = 0;
+  int64_t last_sampled = 0;
+};
+
+struct TraceState {
+  std::mutex lock;
+  std::chrono::steady_clock::time_point start_time;
+  std::vector<Event> events;
+  std::map<std::string, Counter> counters;
+  int64_t last_peak_rss_kb = 0;
+};
+
+std::atomic<bool> sEnabled{false};
+std::atomic<int> sNextThreadId{1};
+
+TraceState& GetState() {
+  static TraceState* state = new TraceState();
+  return *state;
+}
+
+// Small, stable ids read better in the trace viewer than native thread handles.
+int GetThreadId() {
+  static thread_local int tid = sNextThreadId++;
+  return tid;
+}
+
+int64_t NowUs(const TraceState& state) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now() - state.start_time)
+      .count();
+}
+
+int64_t GetPeakRssKb() {
+#ifdef _WIN32
+  return 0;
+#else
+  struct rusage usage = {};
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return 0;
+  }
+#ifdef __APPLE__
+  // Darwin reports bytes rather than kilobytes.
+  return usage.ru_maxrss / 1024;
+#else
+  return usage.ru_maxrss;
+#endif
+#endif
+}
+
+// Appends a counter sample for every counter that changed since it was last sampled.
+// Must be called with the state's lock held.
+void SampleCountersLocked(TraceState* state, int tid, int64_t ts_us) {
+  for (auto& entry : state->counters) {
+    Counter& counter = entry.second;
+    if (counter.value != counter.last_sampled) {
+      counter.last_sampled = counter.value;
+      state->events.push_back(Event{'C', tid, ts_us, 0, entry.first, {}, counter.value});
+    }
+  }
+
+  const int64_t peak_rss_kb = GetPeakRssKb();
+  if (peak_rss_kb != state->last_peak_rss_kb) {
+    state->last_peak_rss_kb = peak_rss_kb;
+    state->events.push_back(Event{'C', tid, ts_us, 0, "peak_rss_kb", {}, peak_rss_kb});
+  }
+}
+
+void WriteJsonString(const StringPiece& str, std::ostream* out) {
+  *out << '"';
+  for (char c : str) {
+    switch (c) {
+      case '"':
+        *out << "\\\"";
+        break;
+      case '\\':
+        *out << "\\\\";
+        break;
+      case '\n':
+        *out << "\\n";
+        break;
+      case '\t':
+        *out << "\\t";
+        break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          static const char kHex[] = "0123456789abcdef";
+          *out << "\\u00" << kHex[(c >> 4) & 0x0f] << kHex[c & 0x0f];
+        } else {
+          *out << c;
+        }
+        break;
+    }
+  }
+  *out << '"';
+}
+
+}  // namespace
+
+void Start() {
+  TraceState& state = GetState();
+  std::lock_guard<std::mutex> guard(state.lock);
+  state.start_time = std::chrono::steady_clock::now();
+  state.events.clear();
+  state.counters.clear();
+  state.last_peak_rss_kb = 0;
+  sEnabled = true;
+}
+
+void Stop() {
+  TraceState& state = GetState();
+  std::lock_guard<std::mutex> guard(state.lock);
+  sEnabled = false;
+  state.events.clear();
+  state.counters.clear();
+  state.last_peak_rss_kb = 0;
+}
+
+bool IsEnabled() {
+  return sEnabled;
+}
+
+ScopedEvent::ScopedEvent(const StringPiece& name) : ScopedEvent(name, {}) {
+}
+
+ScopedEvent::ScopedEvent(const StringPiece& name, const StringPiece& detail)
+    : enabled_(IsEnabled()) {
+  if (enabled_) {
+    name_ = name.to_string();
+    detail_ = detail.to_string();
+    start_us_ = NowUs(GetState());
+  }
+}
+
+ScopedEvent::~ScopedEvent() {
+  if (!enabled_) {
+    return;
+  }
+
+  TraceState& state = GetState();
+  const int tid = GetThreadId();
+  std::lock_guard<std::mutex> guard(state.lock);
+  const int64_t end_us = NowUs(state);
+  state.events.push_back(
+      Event{'X', tid, start_us_, end_us - start_us_, std::move(name_), std::move(detail_), 0});
+  SampleCountersLocked(&state, tid, end_us);
+}
+
+void IncrementCounter(const StringPiece& name, int64_t delta) {
+  if (!IsEnabled()) {
+    return;
+  }
+
+  TraceState& state = GetState();
+  std::lock_guard<std::mutex> guard(state.lock);
+  state.counters[name.to_string()].value += delta;
+}
+
+void WriteJson(std::ostream* out) {
+  TraceState& state = GetState();
+  std::lock_guard<std::mutex> guard(state.lock);
+  SampleCountersLocked(&state, GetThreadId(), NowUs(state));
+
+  *out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  bool first = true;
+  for (const Event& event : state.events) {
+    if (!first) {
+      *out << ",";
+    }
+    first = false;
+
+    *out << "\n{\"name\":";
+    WriteJsonString(event.name, out);
+    *out << ",\"cat\":\"aapt2\",\"ph\":\"" << event.phase << "\",\"pid\":1,\"tid\":" << event.tid
+         << ",\"ts\":" << event.ts_us;
+    if (event.phase == 'X') {
+      *out << ",\"dur\":" << event.dur_us;
+      if (!event.detail.empty()) {
+        *out << ",\"args\":{\"path\":";
+        WriteJsonString(event.detail, out);
+        *out << "}";
+      }
+    } else {
+      *out << ",\"args\":{\"value\":" << event.value << "}";
+    }
+    *out << "}";
+  }
+  *out << "\n]}\n";
+}
+
+bool WriteJsonToFile(const std::string& path, IDiagnostics* diag) {
+  std::ofstream fout(path, std::ofstream::binary);
+  if (!fout) {
+    diag->Error(DiagMessage(path) << "failed to open trace output: "
+                                  << android::base::SystemErrorCodeToString(errno));
+    return false;
+  }
+
+  WriteJson(&fout);
+  if (!fout) {
+    diag->Error(DiagMessage(path) << "failed writing trace output: "
+                                  << android::base::SystemErrorCodeToString(errno));
+    return false;
+  }
+  return true;
+}
+
+}  // namespace trace
+}  // namespace aapt
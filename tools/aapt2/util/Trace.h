@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AAPT_TRACE_H
+#define AAPT_TRACE_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+#include "android-base/macros.h"
+#include "androidfw/StringPiece.h"
+
+#include "Diagnostics.h"
+
+namespace aapt {
+namespace trace {
+
+/*
+ * Starts recording trace events for this process, discarding any previously
+ * recorded events. Until this is called, every other function here is a no-op.
+ */
+void Start();
+
+/*
+ * Stops recording trace events and discards those recorded so far.
+ */
+void Stop();
+
+/*
+ * Returns true if trace events are being recorded.
+ */
+bool IsEnabled();
+
+/*
+ * Records a duration event covering the lifetime of this object on the calling
+ * thread. Events on the same thread nest by their begin and end times.
+ */
+class ScopedEvent {
+ public:
+  explicit ScopedEvent(const android::StringPiece& name);
+
+  /*
+   * `detail` is attached to the event as its "path" argument, which is how
+   * per-file steps are told apart.
+   */
+  ScopedEvent(const android::StringPiece& name, const android::StringPiece& detail);
+
+  ~ScopedEvent();
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(ScopedEvent);
+
+  bool enabled_;
+  std::string name_;
+  std::string detail_;
+  int64_t start_us_ = 0;
+};
+
+/*
+ * Adds `delta` to the named process-wide counter. Counters are sampled into the
+ * trace whenever a ScopedEvent ends, so hot paths can update them cheaply.
+ */
+void IncrementCounter(const android::StringPiece& name, int64_t delta);
+
+/*
+ * Writes the recorded events as a Chrome trace-event JSON object.
+ */
+void WriteJson(std::ostream* out);
+
+/*
+ * Writes the recorded events to `path` in the format of WriteJson().
+ */
+bool WriteJsonToFile(const std::string& path, IDiagnostics* diag);
+
+}  // namespace trace
+}  // namespace aapt
+
+#endif  // AAPT_TRACE_H
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "util/Trace.h"
+
+#include <sstream>
+
+#include "test/Test.h"
+
+using ::testing::HasSubstr;
+using ::testing::Not;
+
+namespace aapt {
+namespace trace {
+
+// Tracing is process-wide, so it must not stay on for the tests that follow.
+class TraceTest : public ::testing::Test {
+ protected:
+  void TearDown() override {
+    Stop();
+  }
+};
+
+TEST_F(TraceTest, RecordsNestedEventsAndCounters) {
+  Start();
+  {
+    ScopedEvent outer("link");
+    {
+      ScopedEvent inner("flatten_xml", "res/layout/\"main\".xml");
+      IncrementCounter("bytes_written", 42);
+    }
+  }
+
+  std::stringstream json;
+  WriteJson(&json);
+  const std::string str = json.str();
+  EXPECT_THAT(str, HasSubstr("\"traceEvents\""));
+  EXPECT_THAT(str, HasSubstr("\"name\":\"link\",\"cat\":\"aapt2\",\"ph\":\"X\""));
+  EXPECT_THAT(str, HasSubstr("\"name\":\"flatten_xml\""));
+  EXPECT_THAT(str, HasSubstr("\"args\":{\"path\":\"res/layout/\\\"main\\\".xml\"}"));
+  EXPECT_THAT(str, HasSubstr("\"name\":\"bytes_written\",\"cat\":\"aapt2\",\"ph\":\"C\""));
+  EXPECT_THAT(str, HasSubstr("\"args\":{\"value\":42}"));
+}
+
+TEST_F(TraceTest, StartDiscardsPreviousEvents) {
+  Start();
+  { ScopedEvent event("first"); }
+
+  Start();
+  { ScopedEvent event("second"); }
+
+  std::stringstream json;
+  WriteJson(&json);
+  EXPECT_THAT(json.str(), Not(HasSubstr("\"first\"")));
+  EXPECT_THAT(json.str(), HasSubstr("\"second\""));
+}
+
+TEST_F(TraceTest, StopDisablesAndDiscardsEvents) {
+  Start();
+  { ScopedEvent event("before_stop"); }
+
+  Stop();
+  EXPECT_FALSE(IsEnabled());
+  { ScopedEvent event("after_stop"); }
+
+  std::stringstream json;
+  WriteJson(&json);
+  EXPECT_THAT(json.str(), Not(HasSubstr("\"before_stop\"")));
+  EXPECT_THAT(json.str(), Not(HasSubstr("\"after_stop\"")));
+}
+
+}  // namespace trace
+}  // namespace aapt